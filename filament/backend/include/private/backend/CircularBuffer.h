@@ -67,6 +67,20 @@ public:
     // call at least once every getRequiredSize() bytes allocated from the buffer
     void circularize() noexcept;
 
+    // the memory of a circular buffer, see grow()
+    struct Mapping {
+        void* data = nullptr;
+        size_t size = 0;
+        int fd = -1;
+    };
+
+    // Replaces the memory of an empty buffer (e.g. after circularize()) with a new mapping of
+    // 'size' bytes, and returns the previous one. The previous mapping must be kept until the
+    // commands written to it are executed, and then freed with release().
+    Mapping grow(size_t size) noexcept;
+
+    static void release(Mapping const& mapping) noexcept;
+
 private:
     void* alloc(size_t size) noexcept;
     void dealloc() noexcept;
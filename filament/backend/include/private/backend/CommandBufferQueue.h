@@ -23,34 +23,35 @@
 #include <utils/Condition.h>
 #include <utils/Mutex.h>
 
-#include <vector>
+#include <array>
+#include <atomic>
 
 namespace filament {
 namespace backend {
 
 /*
- * A producer-consumer command queue that uses a CircularBuffer as main storage
+ * A single-producer single-consumer command queue that uses a CircularBuffer as main storage.
+ *
+ * The producer flushes command buffers (slices of the CircularBuffer) into a lock-free ring,
+ * and the consumer executes and releases them in order. The free space of the CircularBuffer is
+ * accounted for atomically. The lock is only taken to park a side that must block, i.e. the
+ * consumer when there are no commands, or the producer when there isn't enough space, and to
+ * wake it up.
  */
 class CommandBufferQueue {
+public:
     struct Slice {
         void* begin;
         void* end;
     };
 
-    const size_t mRequiredSize;
-
-    CircularBuffer mCircularBuffer;
-
-    // space available in the circular buffer
-
-    mutable utils::Mutex mLock;
-    mutable utils::Condition mCondition;
-    mutable std::vector<Slice> mCommandBuffersToExecute;
-    size_t mFreeSpace = 0;
-    size_t mHighWatermark = 0;
-    bool mExitRequested = false;
+    struct Statistics {
+        size_t flushedSize = 0;     // bytes of commands flushed
+        size_t highWatermark = 0;   // largest number of bytes of the circular buffer in use
+        uint32_t stallCount = 0;    // number of times flush() blocked
+        uint64_t stallTime = 0;     // time flush() was blocked, in nanoseconds
+    };
 
-public:
     // requiredSize: guaranteed available space after flush()
     CommandBufferQueue(size_t requiredSize, size_t bufferSize);
     ~CommandBufferQueue();
@@ -59,12 +60,30 @@ public:
 
     size_t getHigWatermark() noexcept { return mHighWatermark; }
 
-    // wait for commands to be available and returns an array containing these commands
-    std::vector<Slice> waitForCommands() const;
+    // current size of the circular buffer, it can change with setMaxBufferSize()
+    size_t getBufferSize() const noexcept { return mCircularBuffer.size(); }
+
+    // Returns the statistics of the flush() calls since the last call, and resets them.
+    // This must be called from the producer thread.
+    Statistics resetStatistics() noexcept;
+
+    // When flush() would block because the consumer is too far behind, the circular buffer
+    // grows instead (its size doubles), up to 'size' bytes. Growth is disabled with 0.
+    // This must be called from the producer thread.
+    void setMaxBufferSize(size_t size) noexcept { mMaxBufferSize = size; }
+
+    // Waits for commands to be available and returns the number of command buffers that can be
+    // executed, which is 0 only when exit was requested and all of them were released.
+    size_t waitForCommands() const;
+
+    // The oldest command buffer that wasn't released. Valid only if waitForCommands() returned
+    // more command buffers than were released since.
+    Slice const& front() const noexcept {
+        return mSlices[mReleased.load(std::memory_order_relaxed) % MAX_SLICE_COUNT];
+    }
 
     // return the memory used by this command buffer to the circular buffer
-    // WARNING: releaseBuffer() must be called in sequence of the Slices returned by
-    // waitForCommands()
+    // WARNING: releaseBuffer() must be called with front()
     void releaseBuffer(Slice const& buffer);
 
     // all commands buffers (Slices) written to this point are returned by waitForCommand(). This
@@ -73,6 +92,53 @@ public:
 
     // returns from waitForCommands() immediately.
     void requestExit();
+
+private:
+    // maximum number of command buffers waiting to be executed, flush() blocks past that
+    static constexpr uint32_t MAX_SLICE_COUNT = 256;
+
+    // Blocks until predicate() is true. 'parked' is set while blocked, so that the other side
+    // knows it needs to call unpark().
+    template<typename P>
+    void park(std::atomic<bool>& parked, utils::Condition& condition, P predicate) const;
+
+    // wakes up the other side if it's blocked in park()
+    void unpark(std::atomic<bool> const& parked, utils::Condition& condition) const;
+
+    // park()s the producer until predicate() is true, and records the stall
+    template<typename P>
+    void stall(P predicate) noexcept;
+
+    const size_t mRequiredSize;
+
+    CircularBuffer mCircularBuffer;
+
+    // ring of the command buffers to execute, [mReleased, mFlushed) modulo MAX_SLICE_COUNT
+    std::array<Slice, MAX_SLICE_COUNT> mSlices{};
+    std::atomic<uint32_t> mFlushed = { 0 };     // only written by the producer
+    std::atomic<uint32_t> mReleased = { 0 };    // only written by the consumer
+
+    // space available in the circular buffer
+    std::atomic<size_t> mFreeSpace;
+
+    std::atomic<bool> mExitRequested = { false };
+
+    mutable utils::Mutex mLock;
+    mutable utils::Condition mCommandsAvailable;
+    mutable utils::Condition mSpaceAvailable;
+    mutable std::atomic<bool> mConsumerParked = { false };
+    mutable std::atomic<bool> mProducerParked = { false };
+
+    // the following are only accessed by the producer
+
+    // the memory the circular buffer used before it last grew, it's released when the consumer
+    // released all the command buffers up to mRetiredSliceCount
+    CircularBuffer::Mapping mRetiredMapping;
+    uint32_t mRetiredSliceCount = 0;
+    size_t mMaxBufferSize = 0;
+
+    Statistics mStatistics;
+    size_t mHighWatermark = 0;
 };
 
 } // namespace backend
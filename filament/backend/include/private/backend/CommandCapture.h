@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_COMMANDCAPTURE_H
+#define TNT_FILAMENT_DRIVER_COMMANDCAPTURE_H
+
+#include <backend/BufferDescriptor.h>
+#include <backend/DriverEnums.h>
+#include <backend/Handle.h>
+#include <backend/PipelineState.h>
+#include <backend/PixelBufferDescriptor.h>
+#include <backend/TargetBufferInfo.h>
+
+#include "private/backend/Program.h"
+#include "private/backend/SamplerGroup.h"
+
+#include <utils/compiler.h>
+
+#include <type_traits>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace filament {
+namespace backend {
+
+/*
+ * Identifies a command of the DriverAPI in a capture. The synchronous calls are not part of the
+ * command stream and aren't captured.
+ */
+enum class CommandId : uint16_t {
+#define DECL_DRIVER_API(methodName, paramsDecl, params)                     methodName,
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)     methodName,
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
+#include "private/backend/DriverAPI.inc"
+    COUNT
+};
+
+// returns the name of the DriverAPI method of a command, e.g. "draw"
+const char* getCommandName(CommandId id) noexcept;
+
+/*
+ * CommandCapture writes the commands recorded into a CommandStream, along with the content of
+ * their buffers, to a file which can be replayed with CommandReplay on any Driver.
+ *
+ * The file starts with a header:
+ *      char[8]     magic, "FCMDCAP\0"
+ *      uint32_t    VERSION
+ *      uint32_t    CommandId::COUNT
+ *      uint32_t    sizeof(size_t)
+ * followed by the commands, in the order they were recorded:
+ *      uint16_t    CommandId
+ *      uint32_t    size of the parameters in bytes
+ *      ...         the parameters
+ *
+ * The parameters are written in the order of the DriverAPI method, the handle returned by the
+ * commands creating an object first. Trivially copyable parameters are written as is, handles
+ * as their id, buffers as their size followed by their content. Pointers to native objects
+ * (e.g. the window of a swap chain) can't be captured and are replayed as nullptr.
+ */
+class CommandCapture {
+public:
+    static constexpr uint32_t VERSION = 1;
+    static constexpr char MAGIC[8] = "FCMDCAP";
+
+    // Captures the commands of the next 'frameCount' frames, i.e. up to the frameCount-th
+    // endFrame command, into the file at 'path'.
+    CommandCapture(const char* path, uint32_t frameCount) noexcept;
+    ~CommandCapture() noexcept;
+
+    CommandCapture(CommandCapture const& rhs) = delete;
+    CommandCapture& operator=(CommandCapture const& rhs) = delete;
+
+    // false if the file couldn't be created
+    bool isValid() const noexcept { return mFile != nullptr; }
+
+    // Writes a command and its parameters. Returns false when the capture is done, i.e. after
+    // its last endFrame command has been written or if writing the file failed.
+    template<typename... ARGS>
+    bool record(CommandId id, ARGS const& ... args) noexcept {
+        mPayload.clear();
+        UTILS_UNUSED int dummy[] = { (write(args), 0)... };
+        return commit(id);
+    }
+
+private:
+    template<typename T>
+    void write(T const& value) noexcept {
+        static_assert(std::is_trivially_copyable<T>::value,
+                "this parameter type needs a CommandCapture::write() overload");
+        writeBytes(&value, sizeof(T));
+    }
+
+    template<typename T>
+    void write(Handle<T> const& handle) noexcept {
+        write(handle.getId());
+    }
+
+    void write(const char* string) noexcept;
+    void write(void* pointer) noexcept;
+    void write(BufferDescriptor const& buffer) noexcept;
+    void write(PixelBufferDescriptor const& buffer) noexcept;
+    void write(FaceOffsets const& faceOffsets) noexcept;
+    void write(TargetBufferInfo const& info) noexcept;
+    void write(PipelineState const& state) noexcept;
+    void write(SamplerGroup const& samplerGroup) noexcept;
+    void write(Program const& program) noexcept;
+
+    void writeBytes(void const* data, size_t size) noexcept;
+    bool commit(CommandId id) noexcept;
+
+    FILE* mFile = nullptr;
+    uint32_t mFrameCount;
+    std::vector<uint8_t> mPayload;  // parameters of the command being recorded
+};
+
+} // namespace backend
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_COMMANDCAPTURE_H
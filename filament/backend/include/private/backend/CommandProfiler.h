@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_COMMANDPROFILER_H
+#define TNT_FILAMENT_DRIVER_COMMANDPROFILER_H
+
+#include "private/backend/CommandCapture.h"
+
+#include <utils/compiler.h>
+
+#include <array>
+#include <mutex>
+#include <string>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+namespace backend {
+
+/*
+ * CommandProfiler aggregates, per DriverAPI method, the commands executed by the driver when
+ * its dispatcher is profiled (see Driver::setCommandProfilingEnabled()).
+ *
+ * The commands are recorded on the driver thread, and published at the end of each frame,
+ * i.e. after each endFrame command. The last published frame can be read from any thread.
+ */
+class CommandProfiler {
+public:
+    struct Command {
+        uint32_t count = 0;         // number of commands executed
+        uint64_t totalTime = 0;     // total execution time in nanoseconds
+        uint64_t maxTime = 0;       // execution time of the slowest command in nanoseconds
+        uint64_t payloadSize = 0;   // size of the commands and of their buffers in bytes
+    };
+
+    struct Frame {
+        uint32_t frame = 0;         // number of frames published before this one
+        std::array<Command, size_t(CommandId::COUNT)> commands{};
+    };
+
+    // called on the driver thread, after each command
+    inline void record(CommandId id, uint64_t time, size_t payloadSize) noexcept {
+        Command& command = mCurrentFrame.commands[size_t(id)];
+        command.count++;
+        command.totalTime += time;
+        command.maxTime = time > command.maxTime ? time : command.maxTime;
+        command.payloadSize += payloadSize;
+    }
+
+    // called on the driver thread, publishes the current frame and starts the next one
+    void endFrame() noexcept;
+
+    // returns the last frame published, can be called from any thread
+    Frame getLastFrame() const noexcept;
+
+    // Returns a frame as a JSON object, the methods which weren't called are omitted:
+    // { "frame": 42, "commands": { "draw": { "count": 1, "totalTime": 1200,
+    //      "maxTime": 1200, "payloadSize": 64 }, ... } }
+    static std::string toJson(Frame const& frame) noexcept;
+
+private:
+    Frame mCurrentFrame;
+    uint32_t mFrameCount = 0;
+    mutable std::mutex mLock;
+    Frame mLastFrame;
+};
+
+} // namespace backend
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_COMMANDPROFILER_H
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_COMMANDREPLAY_H
+#define TNT_FILAMENT_DRIVER_COMMANDREPLAY_H
+
+#include "private/backend/CircularBuffer.h"
+#include "private/backend/CommandCapture.h"
+#include "private/backend/CommandStream.h"
+
+#include <tsl/robin_map.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace filament {
+namespace backend {
+
+class Driver;
+
+/*
+ * CommandReplay reads a capture written by CommandCapture and records its commands into a
+ * CommandStream bound to 'driver', which can be any Driver (e.g. the NoopDriver).
+ *
+ * The handles returned by the replayed commands are remapped to the ones in the capture. The
+ * commands using a handle created before the capture started are skipped, since the object
+ * it refers to doesn't exist in the replay.
+ *
+ * The commands are executed by execute(), on the calling thread, which becomes the driver's
+ * thread.
+ */
+class CommandReplay {
+public:
+    // size of the command buffer, the commands of a frame must fit in it
+    static constexpr size_t BUFFER_SIZE = 4 * 1024 * 1024;
+
+    CommandReplay(const char* path, Driver& driver) noexcept;
+    ~CommandReplay() noexcept;
+
+    CommandReplay(CommandReplay const& rhs) = delete;
+    CommandReplay& operator=(CommandReplay const& rhs) = delete;
+
+    // false if the file couldn't be opened or isn't a capture this version can replay
+    bool isValid() const noexcept { return mFile != nullptr; }
+
+    // Reads the next command of the capture and records it into the stream, unless it must be
+    // skipped. Returns false at the end of the capture, or if it's truncated.
+    bool next(CommandId* id = nullptr, bool* skipped = nullptr) noexcept;
+
+    // Executes the commands recorded since the last call and purges the driver. The commands are
+    // also executed when the buffer is half full, and by the destructor.
+    void execute() noexcept;
+
+    // number of commands skipped so far
+    size_t getSkippedCount() const noexcept { return mSkippedCount; }
+
+private:
+    template<typename T>
+    struct Type {};
+
+    template<typename T>
+    T read(Type<T>) noexcept;
+
+    template<typename T>
+    Handle<T> read(Type<Handle<T>>) noexcept;
+
+    const char* read(Type<const char*>) noexcept;
+    void* read(Type<void*>) noexcept;
+    BufferDescriptor read(Type<BufferDescriptor>) noexcept;
+    PixelBufferDescriptor read(Type<PixelBufferDescriptor>) noexcept;
+    FaceOffsets read(Type<FaceOffsets>) noexcept;
+    TargetBufferInfo read(Type<TargetBufferInfo>) noexcept;
+    PipelineState read(Type<PipelineState>) noexcept;
+    SamplerGroup read(Type<SamplerGroup>) noexcept;
+    Program read(Type<Program>) noexcept;
+
+    bool hasBytes(size_t size) noexcept;
+    void readBytes(void* data, size_t size) noexcept;
+    void* readData(size_t size) noexcept;
+    utils::CString readString() noexcept;
+
+    template<typename... ARGS>
+    bool replay(void (CommandStream::*method)(ARGS...)) noexcept;
+
+    template<typename R, typename... ARGS>
+    bool replayReturn(R (CommandStream::*method)(ARGS...)) noexcept;
+
+    template<typename M, M method>
+    bool replayCommand() noexcept { return replay(method); }
+
+    template<typename M, M method>
+    bool replayReturnCommand() noexcept { return replayReturn(method); }
+
+    FILE* mFile = nullptr;
+    CircularBuffer mBuffer;
+    CommandStream mStream;
+    Driver& mDriver;
+
+    std::vector<uint8_t> mPayload;  // parameters of the command being replayed
+    size_t mCursor = 0;             // read position in mPayload
+    bool mMissingHandle = false;    // a parameter of the command is a handle we don't know
+    bool mTruncated = false;        // a parameter of the command is past the end of mPayload
+    size_t mSkippedCount = 0;
+
+    // handles of the capture to the handles of the replay
+    tsl::robin_map<HandleBase::HandleId, HandleBase::HandleId> mHandles;
+};
+
+} // namespace backend
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_COMMANDREPLAY_H
@@ -20,6 +20,7 @@
 #define TNT_FILAMENT_DRIVER_COMMANDSTREAM_H
 
 #include "private/backend/CircularBuffer.h"
+#include "private/backend/CommandCapture.h"
 
 #include <backend/BufferDescriptor.h>
 #include <backend/Handle.h>
@@ -40,8 +41,10 @@
 #include <utils/compiler.h>
 
 #include <functional>
+#include <memory>
 #include <tuple>
 #include <thread>
+#include <type_traits>
 #include <utility>
 
 #include <assert.h>
@@ -71,6 +74,10 @@ class CommandBase;
 class Dispatcher {
 public:
     using Execute = void (*)(Driver& driver, CommandBase* self, intptr_t* next);
+
+    // switches the function pointers below to the ones profiling the commands, or back
+    void (*setProfilingEnabled)(Dispatcher& dispatcher, bool enable);
+
 #define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
 #define DECL_DRIVER_API(methodName, paramsDecl, params)                     Execute methodName##_;
 #define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)     Execute methodName##_;
@@ -121,6 +128,13 @@ constexpr void apply(M&& m, D&& d, T&& t) {
             std::make_index_sequence< std::tuple_size<std::remove_reference_t<T>>::value >{});
 }
 
+// size of the buffer of a command parameter, if it's a BufferDescriptor
+template<typename T,
+        typename = typename std::enable_if<!std::is_base_of<BufferDescriptor, T>::value>::type>
+constexpr size_t getBufferSize(T const&) noexcept { return 0; }
+
+inline size_t getBufferSize(BufferDescriptor const& buffer) noexcept { return buffer.size; }
+
 /*
  * CommandType<> is just a wrapper class to specialize on a pointer-to-member of Driver
  * (i.e. a method pointer to a method of Driver of a particular type -- but not the
@@ -148,6 +162,14 @@ struct CommandType<void (Driver::*)(ARGS...)> {
         void log() noexcept;
         template<std::size_t... I> void log(std::index_sequence<I...>) noexcept;
 
+        template<std::size_t... I>
+        size_t getBufferSize(std::index_sequence<I...>) const noexcept {
+            size_t size = 0;
+            UTILS_UNUSED int dummy[] = {
+                    0, (size += backend::getBufferSize(std::get<I>(mArgs)), 0)... };
+            return size;
+        }
+
     public:
         template<typename M, typename D>
         static inline void execute(M&& method, D&& driver, CommandBase* base, intptr_t* next) noexcept {
@@ -161,6 +183,11 @@ struct CommandType<void (Driver::*)(ARGS...)> {
             self->~Command();
         }
 
+        // size in bytes of the buffers passed to this command
+        size_t getBufferSize() const noexcept {
+            return getBufferSize(std::index_sequence_for<ARGS...>{});
+        }
+
         // A command can be moved
         inline Command(Command&& rhs) noexcept = default;
 
@@ -213,11 +240,18 @@ public:
     #define DEBUG_COMMAND(methodName, params...) mDriver->debugCommand(#methodName)
 #endif
 
+// writes the command to the capture in progress, if any, and ends the capture after its last frame
+#define CAPTURE_COMMAND(methodName, params...)                                                  \
+    if (UTILS_UNLIKELY(mCapture) && !mCapture->record(CommandId::methodName, params)) {         \
+        mCapture.reset();                                                                       \
+    }
+
 class CommandStream {
 public:
 #define DECL_DRIVER_API(methodName, paramsDecl, params)                                         \
     inline void methodName(paramsDecl) {                                                        \
         DEBUG_COMMAND(methodName, params);                                                      \
+        CAPTURE_COMMAND(methodName, params);                                                    \
         using Cmd = COMMAND_TYPE(methodName);                                                   \
         void* const p = allocateCommand(CommandBase::align(sizeof(Cmd)));                       \
         new(p) Cmd(mDispatcher->methodName##_, params);                                         \
@@ -233,6 +267,7 @@ public:
     inline RetType methodName(paramsDecl) {                                                     \
         DEBUG_COMMAND(methodName, params);                                                      \
         RetType result = mDriver->methodName##S();                                              \
+        CAPTURE_COMMAND(methodName, result, params);                                            \
         using Cmd = COMMAND_TYPE(methodName##R);                                                \
         void* const p = allocateCommand(CommandBase::align(sizeof(Cmd)));                       \
         new(p) Cmd(mDispatcher->methodName##_, RetType(result), params);                        \
@@ -262,6 +297,33 @@ public:
      */
     void queueCommand(std::function<void()> command);
 
+    /*
+     * splice() moves the commands recorded in 'secondary' since the last splice() to the end of
+     * this stream, in order.
+     *
+     * A secondary stream is a CommandStream with its own CircularBuffer, it can be recorded on
+     * another thread while this stream is recorded on the render thread -- but only one thread
+     * at a time must record it and splice() must be called after it's done (debugThreading()
+     * must be called by the recording thread first).
+     * Commands are moved with memcpy(), so only the commands whose parameters are trivially
+     * relocatable (handles, PipelineState, etc...) can be recorded in a secondary stream;
+     * queueCommand(), allocate() and the commands returning a handle can't be used.
+     * The secondary buffer must be large enough for everything recorded between two splice().
+     */
+    void splice(CommandStream& secondary) noexcept;
+
+    /*
+     * startCapture() writes the commands recorded from now on, up to the frameCount-th endFrame,
+     * to the file at 'path', see CommandCapture. Returns false if the file can't be created.
+     *
+     * Only the DriverAPI commands recorded directly in this stream are captured: the commands
+     * queued with queueCommand() can't be, and secondary streams shouldn't be spliced while
+     * isCapturing() is true.
+     */
+    bool startCapture(const char* path, uint32_t frameCount) noexcept;
+
+    bool isCapturing() const noexcept { return mCapture != nullptr; }
+
     /*
      * Allocates memory associated to the current CommandStreamBuffer.
      * This memory will be automatically freed after this command buffer is processed.
@@ -283,6 +345,7 @@ private:
     Dispatcher* mDispatcher = nullptr;
     Driver* mDriver = nullptr;
     CircularBuffer* UTILS_RESTRICT mCurrentBuffer = nullptr;
+    std::unique_ptr<CommandCapture> mCapture;
 
 #ifndef NDEBUG
     // just for debugging...
@@ -39,6 +39,7 @@ namespace backend {
 
 template<typename T>
 class ConcreteDispatcher;
+class CommandProfiler;
 class Dispatcher;
 
 class Driver {
@@ -55,6 +56,12 @@ public:
 
     virtual Dispatcher& getDispatcher() noexcept = 0;
 
+    // Called from the main thread, switches the dispatcher to entry points timing each command
+    // with the CommandProfiler. This affects the commands recorded after the call.
+    virtual void setCommandProfilingEnabled(bool enable) noexcept = 0;
+
+    virtual CommandProfiler& getCommandProfiler() noexcept = 0;
+
 #ifndef NDEBUG
     virtual void debugCommand(const char* methodName) {}
 #endif
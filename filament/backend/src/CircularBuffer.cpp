@@ -24,6 +24,7 @@
 #    define HAS_MMAP 0
 #endif
 
+#include <assert.h>
 #include <stdio.h>
 
 #include <utils/ashmem.h>
@@ -102,9 +103,10 @@ void* CircularBuffer::alloc(size_t size) noexcept {
         if (fd >= 0)
             close(fd);
 
-        data = mmap(nullptr, size * 2 + BLOCK_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        data = mmap(nullptr, size * 2 + BLOCK_SIZE,
+                PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 
-        ASSERT_POSTCONDITION(data,
+        ASSERT_POSTCONDITION(data != MAP_FAILED,
                 "couldn't allocate %u KiB of memory for the command buffer",
                 (size * 2 / 1024));
 
@@ -122,18 +124,33 @@ void* CircularBuffer::alloc(size_t size) noexcept {
 }
 
 void CircularBuffer::dealloc() noexcept {
+    release({ mData, mSize, mUsesAshmem });
+    mData = nullptr;
+    mUsesAshmem = -1;
+}
+
+void CircularBuffer::release(Mapping const& mapping) noexcept {
 #if HAS_MMAP
-    if (mData) {
-        munmap(mData, mSize * 2 + BLOCK_SIZE);
-        if (mUsesAshmem >= 0) {
-            close(mUsesAshmem);
-            mUsesAshmem = -1;
+    if (mapping.data) {
+        munmap(mapping.data, mapping.size * 2 + BLOCK_SIZE);
+        if (mapping.fd >= 0) {
+            close(mapping.fd);
         }
     }
 #else
-    ::free(mData);
+    ::free(mapping.data);
 #endif
-    mData = nullptr;
+}
+
+CircularBuffer::Mapping CircularBuffer::grow(size_t size) noexcept {
+    assert(empty());
+    const Mapping previous{ mData, mSize, mUsesAshmem };
+    mUsesAshmem = -1;
+    mData = alloc(size);
+    mSize = size;
+    mTail = mData;
+    mHead = mData;
+    return previous;
 }
 
 
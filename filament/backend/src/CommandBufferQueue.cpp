@@ -16,6 +16,9 @@
 
 #include "private/backend/CommandBufferQueue.h"
 
+#include <algorithm>
+#include <chrono>
+
 #include <assert.h>
 
 #include <utils/Log.h>
@@ -36,13 +39,55 @@ CommandBufferQueue::CommandBufferQueue(size_t requiredSize, size_t bufferSize)
 }
 
 CommandBufferQueue::~CommandBufferQueue() {
-    assert(mCommandBuffersToExecute.empty());
+    assert(mFlushed.load() == mReleased.load());
+    CircularBuffer::release(mRetiredMapping);
 }
 
-void CommandBufferQueue::requestExit() {
+/*
+ * A side sets its 'parked' flag before checking its predicate one last time, and the other side
+ * changes the state before checking the flag. All these accesses are sequentially consistent,
+ * so at least one side sees the other's write: either the predicate is already true, or the
+ * other side sees the flag and notifies the condition. The notification can't be missed since
+ * it's done with the lock held, which park() only releases while waiting.
+ */
+
+template<typename P>
+void CommandBufferQueue::park(std::atomic<bool>& parked, Condition& condition,
+        P predicate) const {
     std::unique_lock<utils::Mutex> lock(mLock);
-    mExitRequested = true;
-    mCondition.notify_one();
+    parked.store(true, std::memory_order_seq_cst);
+    while (!predicate()) {
+        condition.wait(lock);
+    }
+    parked.store(false, std::memory_order_relaxed);
+}
+
+void CommandBufferQueue::unpark(std::atomic<bool> const& parked, Condition& condition) const {
+    if (UTILS_UNLIKELY(parked.load(std::memory_order_seq_cst))) {
+        std::lock_guard<utils::Mutex> lock(mLock);
+        condition.notify_one();
+    }
+}
+
+template<typename P>
+void CommandBufferQueue::stall(P predicate) noexcept {
+    const auto start = std::chrono::steady_clock::now();
+    park(mProducerParked, mSpaceAvailable, predicate);
+    const auto duration = std::chrono::steady_clock::now() - start;
+    mStatistics.stallCount++;
+    mStatistics.stallTime += uint64_t(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+}
+
+CommandBufferQueue::Statistics CommandBufferQueue::resetStatistics() noexcept {
+    Statistics statistics = mStatistics;
+    mStatistics = {};
+    return statistics;
+}
+
+void CommandBufferQueue::requestExit() {
+    mExitRequested.store(true, std::memory_order_seq_cst);
+    unpark(mConsumerParked, mCommandsAvailable);
 }
 
 void CommandBufferQueue::flush() noexcept {
@@ -68,56 +113,89 @@ void CommandBufferQueue::flush() noexcept {
 
     circularBuffer.circularize();
 
-    std::unique_lock<utils::Mutex> lock(mLock);
-    mCommandBuffersToExecute.push_back({ tail, head });
+    // there is always a free slot in the ring, unless the consumer is very far behind
+    const uint32_t flushed = mFlushed.load(std::memory_order_relaxed);
+    if (UTILS_UNLIKELY(flushed - mReleased.load(std::memory_order_acquire) == MAX_SLICE_COUNT)) {
+        SYSTRACE_NAME("waiting: CommandBufferQueue::flush()");
+        stall([this, flushed]() -> bool {
+            return flushed - mReleased.load(std::memory_order_seq_cst) < MAX_SLICE_COUNT;
+        });
+    }
+    mSlices[flushed % MAX_SLICE_COUNT] = { tail, head };
+
+    const size_t freeSpace = mFreeSpace.fetch_sub(used, std::memory_order_seq_cst) - used;
 
     // circular buffer is too small, we corrupted the stream
-    assert(used <= mFreeSpace);
+    assert(freeSpace <= circularBuffer.size());
+
+    // publish the command buffer
+    mFlushed.store(flushed + 1, std::memory_order_seq_cst);
+    unpark(mConsumerParked, mCommandsAvailable);
+
+    // the memory the circular buffer used before it grew can be released once the consumer is
+    // done with it
+    if (UTILS_UNLIKELY(mRetiredMapping.data) &&
+            int32_t(mReleased.load(std::memory_order_acquire) - mRetiredSliceCount) >= 0) {
+        CircularBuffer::release(mRetiredMapping);
+        mRetiredMapping = {};
+    }
 
-    // wait until there is enough space in the buffer
-    mFreeSpace -= used;
     const size_t requiredSize = mRequiredSize;
 
-#ifndef NDEBUG
-    size_t totalUsed = circularBuffer.size() - mFreeSpace;
+    size_t totalUsed = circularBuffer.size() - freeSpace;
     mHighWatermark = std::max(mHighWatermark, totalUsed);
+    mStatistics.highWatermark = std::max(mStatistics.highWatermark, totalUsed);
+    mStatistics.flushedSize += used;
+
+#ifndef NDEBUG
     if (UTILS_UNLIKELY(totalUsed > requiredSize)) {
         slog.d << "CommandStream used too much space: " << totalUsed
             << ", out of " << requiredSize << " (will block)" << io::endl;
     }
 #endif
 
-    if (UTILS_LIKELY(mFreeSpace >= requiredSize)) {
-        // ideally (and usually) we don't have to wait, this is the common case, so special case
-        // the unlock-before-notify, optimization.
-        lock.unlock();
-        mCondition.notify_one();
-    } else {
-        // unfortunately, there is not enough space left, we'll have to wait.
-        mCondition.notify_one(); // too bad there isn't a notify-and-wait
-        SYSTRACE_NAME("waiting: CircularBuffer::flush()");
-        mCondition.wait(lock, [this, requiredSize]() -> bool {
-            return mFreeSpace >= requiredSize;
-        });
+    // ideally (and usually) we don't have to wait for the consumer to release some space
+    if (UTILS_UNLIKELY(freeSpace < requiredSize)) {
+        const size_t size = circularBuffer.size();
+        if (size * 2 <= mMaxBufferSize && !mRetiredMapping.data) {
+            // grow instead of waiting, the circular buffer is empty after circularize().
+            // The command buffers flushed so far stay in the previous memory, they'll return their
+            // space to the new memory when they're released.
+            SYSTRACE_NAME("growing: CircularBuffer::flush()");
+            mRetiredMapping = circularBuffer.grow(size * 2);
+            mRetiredSliceCount = flushed + 1;
+            mFreeSpace.fetch_add(size, std::memory_order_seq_cst);
+        } else {
+            SYSTRACE_NAME("waiting: CircularBuffer::flush()");
+            stall([this, requiredSize]() -> bool {
+                return mFreeSpace.load(std::memory_order_seq_cst) >= requiredSize;
+            });
+        }
     }
 }
 
-std::vector<CommandBufferQueue::Slice> CommandBufferQueue::waitForCommands() const {
-    if (!UTILS_HAS_THREADING) {
-        return std::move(mCommandBuffersToExecute);
+size_t CommandBufferQueue::waitForCommands() const {
+    const uint32_t released = mReleased.load(std::memory_order_relaxed);
+    if (UTILS_HAS_THREADING) {
+        if (mFlushed.load(std::memory_order_acquire) == released &&
+                !mExitRequested.load(std::memory_order_relaxed)) {
+            park(mConsumerParked, mCommandsAvailable, [this, released]() -> bool {
+                return mFlushed.load(std::memory_order_seq_cst) != released ||
+                       mExitRequested.load(std::memory_order_seq_cst);
+            });
+        }
     }
-    std::unique_lock<utils::Mutex> lock(mLock);
-    while (mCommandBuffersToExecute.empty() && !mExitRequested) {
-        mCondition.wait(lock);
-    }
-    return std::move(mCommandBuffersToExecute);
+    return mFlushed.load(std::memory_order_acquire) - released;
 }
 
 void CommandBufferQueue::releaseBuffer(CommandBufferQueue::Slice const& buffer) {
-    std::unique_lock<utils::Mutex> lock(mLock);
-    mFreeSpace += uintptr_t(buffer.end) - uintptr_t(buffer.begin);
-    lock.unlock();
-    mCondition.notify_one();
+    assert(&buffer == &front());
+    const size_t size = uintptr_t(buffer.end) - uintptr_t(buffer.begin);
+
+    // the slot of the command buffer can be reused by the producer after this
+    mReleased.store(mReleased.load(std::memory_order_relaxed) + 1, std::memory_order_seq_cst);
+    mFreeSpace.fetch_add(size, std::memory_order_seq_cst);
+    unpark(mProducerParked, mSpaceAvailable);
 }
 
 } // namespace backend
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "private/backend/CommandCapture.h"
+
+#include <utils/Log.h>
+
+#include <string.h>
+
+using namespace utils;
+
+namespace filament {
+namespace backend {
+
+constexpr uint32_t CommandCapture::VERSION;
+constexpr char CommandCapture::MAGIC[8];
+
+const char* getCommandName(CommandId id) noexcept {
+    static constexpr const char* names[] = {
+#define DECL_DRIVER_API(methodName, paramsDecl, params)                     #methodName,
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)     #methodName,
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
+#include "private/backend/DriverAPI.inc"
+    };
+    static_assert(sizeof(names) / sizeof(*names) == size_t(CommandId::COUNT),
+            "the command names don't match the CommandIds");
+    return id < CommandId::COUNT ? names[size_t(id)] : "unknown";
+}
+
+CommandCapture::CommandCapture(const char* path, uint32_t frameCount) noexcept
+        : mFrameCount(frameCount) {
+    mFile = fopen(path, "wb");
+    if (!mFile) {
+        slog.e << "couldn't create the command capture " << path << io::endl;
+        return;
+    }
+    const uint32_t header[] = { VERSION, uint32_t(CommandId::COUNT), uint32_t(sizeof(size_t)) };
+    fwrite(MAGIC, sizeof(MAGIC), 1, mFile);
+    fwrite(header, sizeof(header), 1, mFile);
+}
+
+CommandCapture::~CommandCapture() noexcept {
+    if (mFile) {
+        fclose(mFile);
+    }
+}
+
+void CommandCapture::writeBytes(void const* data, size_t size) noexcept {
+    uint8_t const* const p = static_cast<uint8_t const*>(data);
+    mPayload.insert(mPayload.end(), p, p + size);
+}
+
+bool CommandCapture::commit(CommandId id) noexcept {
+    if (!mFile) {
+        return false;
+    }
+    const uint16_t command = uint16_t(id);
+    const uint32_t size = uint32_t(mPayload.size());
+    bool success = fwrite(&command, sizeof(command), 1, mFile) == 1;
+    success = success && fwrite(&size, sizeof(size), 1, mFile) == 1;
+    success = success && (!size || fwrite(mPayload.data(), size, 1, mFile) == 1);
+    if (UTILS_UNLIKELY(!success)) {
+        slog.e << "couldn't write the command capture" << io::endl;
+        return false;
+    }
+    return id != CommandId::endFrame || --mFrameCount > 0;
+}
+
+void CommandCapture::write(const char* string) noexcept {
+    // null strings are written with a size of ~0
+    const uint32_t size = string ? uint32_t(strlen(string)) : ~0u;
+    write(size);
+    if (string) {
+        writeBytes(string, size);
+    }
+}
+
+void CommandCapture::write(void*) noexcept {
+    // native objects can't be captured
+}
+
+void CommandCapture::write(BufferDescriptor const& buffer) noexcept {
+    write(buffer.size);
+    writeBytes(buffer.buffer, buffer.size);
+}
+
+void CommandCapture::write(PixelBufferDescriptor const& buffer) noexcept {
+    write(static_cast<BufferDescriptor const&>(buffer));
+    const PixelDataType type = buffer.type;
+    const uint8_t alignment = buffer.alignment;
+    write(type);
+    write(alignment);
+    write(buffer.left);
+    write(buffer.top);
+    if (type == PixelDataType::COMPRESSED) {
+        write(buffer.imageSize);
+        write(buffer.compressedFormat);
+    } else {
+        write(buffer.stride);
+        write(buffer.format);
+    }
+}
+
+void CommandCapture::write(FaceOffsets const& faceOffsets) noexcept {
+    writeBytes(faceOffsets.offsets, sizeof(faceOffsets.offsets));
+}
+
+void CommandCapture::write(TargetBufferInfo const& info) noexcept {
+    write(info.handle);
+    write(info.level);
+    write(info.layer);
+}
+
+void CommandCapture::write(PipelineState const& state) noexcept {
+    write(state.program);
+    write(state.rasterState);
+    write(state.polygonOffset);
+}
+
+void CommandCapture::write(SamplerGroup const& samplerGroup) noexcept {
+    const uint8_t count = uint8_t(samplerGroup.getSize());
+    write(count);
+    SamplerGroup::Sampler const* const samplers = samplerGroup.getSamplers();
+    for (size_t i = 0; i < count; i++) {
+        write(samplers[i].t);
+        write(samplers[i].s);
+    }
+}
+
+void CommandCapture::write(Program const& program) noexcept {
+    write(program.getName().c_str_safe());
+    write(program.getVariant());
+    for (auto const& source : program.getShadersSource()) {
+        write(source.size());
+        writeBytes(source.data(), source.size());
+    }
+    for (auto const& name : program.getUniformBlockInfo()) {
+        write(name.c_str_safe());
+    }
+    write(program.hasSamplers());
+    for (auto const& samplers : program.getSamplerGroupInfo()) {
+        write(samplers.size());
+        for (auto const& sampler : samplers) {
+            write(sampler.name.c_str_safe());
+            write(sampler.binding);
+        }
+    }
+}
+
+} // namespace backend
+} // namespace filament
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "private/backend/CommandProfiler.h"
+
+namespace filament {
+namespace backend {
+
+void CommandProfiler::endFrame() noexcept {
+    mCurrentFrame.frame = mFrameCount++;
+    std::unique_lock<std::mutex> lock(mLock);
+    mLastFrame = mCurrentFrame;
+    lock.unlock();
+    mCurrentFrame = {};
+}
+
+CommandProfiler::Frame CommandProfiler::getLastFrame() const noexcept {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mLastFrame;
+}
+
+std::string CommandProfiler::toJson(Frame const& frame) noexcept {
+    std::string json;
+    json += "{ \"frame\": " + std::to_string(frame.frame) + ", \"commands\": {";
+    const char* separator = " ";
+    for (size_t i = 0; i < frame.commands.size(); i++) {
+        Command const& command = frame.commands[i];
+        if (!command.count) {
+            continue;
+        }
+        json += separator;
+        json += "\"";
+        json += getCommandName(CommandId(i));
+        json += "\": { \"count\": " + std::to_string(command.count);
+        json += ", \"totalTime\": " + std::to_string(command.totalTime);
+        json += ", \"maxTime\": " + std::to_string(command.maxTime);
+        json += ", \"payloadSize\": " + std::to_string(command.payloadSize) + " }";
+        separator = ", ";
+    }
+    json += " } }";
+    return json;
+}
+
+} // namespace backend
+} // namespace filament
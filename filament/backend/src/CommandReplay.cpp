@@ -0,0 +1,337 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "private/backend/CommandReplay.h"
+
+#include "private/backend/Driver.h"
+
+#include <utils/Log.h>
+
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace utils;
+
+namespace filament {
+namespace backend {
+
+static void freeBuffer(void* buffer, size_t, void*) {
+    ::free(buffer);
+}
+
+template<typename M, typename T, std::size_t... I>
+static auto invoke(CommandStream& stream, M method, T& args, std::index_sequence<I...>) {
+    return (stream.*method)(std::move(std::get<I>(args))...);
+}
+
+CommandReplay::CommandReplay(const char* path, Driver& driver) noexcept
+        : mBuffer(BUFFER_SIZE), mStream(driver, mBuffer), mDriver(driver) {
+    mFile = fopen(path, "rb");
+    if (!mFile) {
+        slog.e << "couldn't open the command capture " << path << io::endl;
+        return;
+    }
+    char magic[sizeof(CommandCapture::MAGIC)];
+    uint32_t header[3];
+    if (fread(magic, sizeof(magic), 1, mFile) != 1 || fread(header, sizeof(header), 1, mFile) != 1
+            || memcmp(magic, CommandCapture::MAGIC, sizeof(magic)) != 0) {
+        slog.e << path << " isn't a command capture" << io::endl;
+    } else if (header[0] != CommandCapture::VERSION || header[1] != uint32_t(CommandId::COUNT)
+            || header[2] != sizeof(size_t)) {
+        slog.e << path << " was captured by an incompatible version" << io::endl;
+    } else {
+        return;
+    }
+    fclose(mFile);
+    mFile = nullptr;
+}
+
+CommandReplay::~CommandReplay() noexcept {
+    // the commands recorded but not executed still own their buffers
+    execute();
+    if (mFile) {
+        fclose(mFile);
+    }
+}
+
+bool CommandReplay::next(CommandId* id, bool* skipped) noexcept {
+    using Replay = bool (CommandReplay::*)() noexcept;
+    static constexpr Replay replays[] = {
+#define DECL_DRIVER_API(methodName, paramsDecl, params)                                         \
+        &CommandReplay::replayCommand<decltype(&CommandStream::methodName),                     \
+                &CommandStream::methodName>,
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)                         \
+        &CommandReplay::replayReturnCommand<decltype(&CommandStream::methodName),               \
+                &CommandStream::methodName>,
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
+#include "private/backend/DriverAPI.inc"
+    };
+
+    if (!mFile) {
+        return false;
+    }
+
+    uint16_t command;
+    uint32_t size;
+    if (fread(&command, sizeof(command), 1, mFile) != 1) {
+        return false; // end of the capture
+    }
+    mPayload.resize(0);
+    if (fread(&size, sizeof(size), 1, mFile) != 1 || command >= uint16_t(CommandId::COUNT)) {
+        mTruncated = true;
+    } else {
+        mPayload.resize(size);
+        mTruncated = size && fread(mPayload.data(), size, 1, mFile) != 1;
+    }
+
+    // make sure there is room for the command and its strings, we only need a flush here when
+    // a frame doesn't fit in the buffer.
+    if (size_t(uintptr_t(mBuffer.getHead()) - uintptr_t(mBuffer.getTail())) > BUFFER_SIZE / 2) {
+        execute();
+    }
+
+    bool recorded = false;
+    if (!mTruncated) {
+        mCursor = 0;
+        mMissingHandle = false;
+        recorded = (this->*replays[command])();
+    }
+    if (UTILS_UNLIKELY(mTruncated)) {
+        slog.e << "the command capture is corrupted" << io::endl;
+        return false;
+    }
+
+    mSkippedCount += recorded ? 0 : 1;
+    if (id) {
+        *id = CommandId(command);
+    }
+    if (skipped) {
+        *skipped = !recorded;
+    }
+    return true;
+}
+
+void CommandReplay::execute() noexcept {
+    // terminates the commands like CommandBufferQueue::flush() does
+    new(mBuffer.allocate(sizeof(NoopCommand))) NoopCommand(nullptr);
+    void* const begin = mBuffer.getTail();
+    mBuffer.circularize();
+    mStream.execute(begin);
+    mDriver.purge();
+}
+
+template<typename... ARGS>
+bool CommandReplay::replay(void (CommandStream::*method)(ARGS...)) noexcept {
+    // the parameters are read in order, which only braced initialization guarantees
+    std::tuple<typename std::decay<ARGS>::type...> args{
+            read(Type<typename std::decay<ARGS>::type>{})... };
+    if (UTILS_UNLIKELY(mMissingHandle || mTruncated)) {
+        return false;
+    }
+    invoke(mStream, method, args, std::index_sequence_for<ARGS...>{});
+    return true;
+}
+
+template<typename R, typename... ARGS>
+bool CommandReplay::replayReturn(R (CommandStream::*method)(ARGS...)) noexcept {
+    const HandleBase::HandleId captured = read(Type<HandleBase::HandleId>{});
+    std::tuple<typename std::decay<ARGS>::type...> args{
+            read(Type<typename std::decay<ARGS>::type>{})... };
+    if (UTILS_UNLIKELY(mMissingHandle || mTruncated)) {
+        return false;
+    }
+    R const result = invoke(mStream, method, args, std::index_sequence_for<ARGS...>{});
+    mHandles[captured] = result.getId();
+    return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+bool CommandReplay::hasBytes(size_t size) noexcept {
+    if (UTILS_UNLIKELY(size > mPayload.size() - mCursor)) {
+        mTruncated = true;
+        mCursor = mPayload.size();
+        return false;
+    }
+    return true;
+}
+
+void CommandReplay::readBytes(void* data, size_t size) noexcept {
+    if (hasBytes(size)) {
+        memcpy(data, mPayload.data() + mCursor, size);
+        mCursor += size;
+    } else {
+        memset(data, 0, size);
+    }
+}
+
+void* CommandReplay::readData(size_t size) noexcept {
+    if (!hasBytes(size)) {
+        return nullptr;
+    }
+    void* const data = ::malloc(size);
+    readBytes(data, size);
+    return data;
+}
+
+CString CommandReplay::readString() noexcept {
+    const uint32_t size = read(Type<uint32_t>{});
+    if (size == ~0u || !hasBytes(size)) {
+        return {};
+    }
+    std::string string((const char*)mPayload.data() + mCursor, size);
+    mCursor += size;
+    return CString(string.c_str(), size);
+}
+
+template<typename T>
+T CommandReplay::read(Type<T>) noexcept {
+    T value;
+    readBytes(&value, sizeof(T));
+    return value;
+}
+
+template<typename T>
+Handle<T> CommandReplay::read(Type<Handle<T>>) noexcept {
+    const HandleBase::HandleId id = read(Type<HandleBase::HandleId>{});
+    if (id == HandleBase::nullid) {
+        return {};
+    }
+    auto pos = mHandles.find(id);
+    if (UTILS_UNLIKELY(pos == mHandles.end())) {
+        // created before the capture started
+        mMissingHandle = true;
+        return {};
+    }
+    return Handle<T>(pos->second);
+}
+
+const char* CommandReplay::read(Type<const char*>) noexcept {
+    const uint32_t size = read(Type<uint32_t>{});
+    if (size == ~0u || !hasBytes(size)) {
+        return nullptr;
+    }
+    // the string must live until the command is executed
+    char* const string = mStream.allocatePod<char>(size + 1);
+    readBytes(string, size);
+    string[size] = 0;
+    return string;
+}
+
+void* CommandReplay::read(Type<void*>) noexcept {
+    return nullptr;
+}
+
+BufferDescriptor CommandReplay::read(Type<BufferDescriptor>) noexcept {
+    const size_t size = read(Type<size_t>{});
+    void* const data = readData(size);
+    return { data, data ? size : 0, freeBuffer };
+}
+
+PixelBufferDescriptor CommandReplay::read(Type<PixelBufferDescriptor>) noexcept {
+    const size_t size = read(Type<size_t>{});
+    void* const data = readData(size);
+    const PixelDataType type = read(Type<PixelDataType>{});
+    const uint8_t alignment = read(Type<uint8_t>{});
+    const uint32_t left = read(Type<uint32_t>{});
+    const uint32_t top = read(Type<uint32_t>{});
+    if (type == PixelDataType::COMPRESSED) {
+        const uint32_t imageSize = read(Type<uint32_t>{});
+        const auto format = read(Type<CompressedPixelDataType>{});
+        PixelBufferDescriptor buffer(data, data ? size : 0, format, imageSize, freeBuffer);
+        buffer.left = left;
+        buffer.top = top;
+        return buffer;
+    }
+    const uint32_t stride = read(Type<uint32_t>{});
+    const PixelDataFormat format = read(Type<PixelDataFormat>{});
+    return { data, data ? size : 0, format, type, alignment, left, top, stride, freeBuffer };
+}
+
+FaceOffsets CommandReplay::read(Type<FaceOffsets>) noexcept {
+    FaceOffsets faceOffsets;
+    readBytes(faceOffsets.offsets, sizeof(faceOffsets.offsets));
+    return faceOffsets;
+}
+
+TargetBufferInfo CommandReplay::read(Type<TargetBufferInfo>) noexcept {
+    TargetBufferInfo info;
+    info.handle = read(Type<Handle<HwTexture>>{});
+    info.level = read(Type<uint8_t>{});
+    info.layer = read(Type<uint16_t>{});
+    return info;
+}
+
+PipelineState CommandReplay::read(Type<PipelineState>) noexcept {
+    PipelineState state;
+    state.program = read(Type<Handle<HwProgram>>{});
+    state.rasterState = read(Type<RasterState>{});
+    state.polygonOffset = read(Type<PolygonOffset>{});
+    return state;
+}
+
+SamplerGroup CommandReplay::read(Type<SamplerGroup>) noexcept {
+    const uint8_t count = read(Type<uint8_t>{});
+    if (UTILS_UNLIKELY(count > MAX_SAMPLER_COUNT)) {
+        mTruncated = true;
+        return {};
+    }
+    SamplerGroup samplerGroup(count);
+    for (size_t i = 0; i < count; i++) {
+        const Handle<HwTexture> texture = read(Type<Handle<HwTexture>>{});
+        const SamplerParams params = read(Type<SamplerParams>{});
+        samplerGroup.setSampler(i, texture, params);
+    }
+    return samplerGroup;
+}
+
+Program CommandReplay::read(Type<Program>) noexcept {
+    Program program;
+    CString name = readString();
+    const uint8_t variant = read(Type<uint8_t>{});
+    program.diagnostics(std::move(name), variant);
+    for (size_t i = 0; i < Program::SHADER_TYPE_COUNT; i++) {
+        const size_t size = read(Type<size_t>{});
+        if (hasBytes(size)) {
+            program.shader(Program::Shader(i), mPayload.data() + mCursor, size);
+            mCursor += size;
+        }
+    }
+    for (size_t i = 0; i < Program::UNIFORM_BINDING_COUNT; i++) {
+        program.setUniformBlock(i, readString());
+    }
+    const bool hasSamplers = read(Type<bool>{});
+    for (size_t i = 0; i < Program::SAMPLER_BINDING_COUNT; i++) {
+        const size_t count = read(Type<size_t>{});
+        std::vector<Program::Sampler> samplers;
+        for (size_t j = 0; j < count && !mTruncated; j++) {
+            CString samplerName = readString();
+            const size_t binding = read(Type<size_t>{});
+            samplers.push_back({ std::move(samplerName), binding });
+        }
+        if (hasSamplers) {
+            program.setSamplerGroup(i, samplers.data(), samplers.size());
+        }
+    }
+    return program;
+}
+
+} // namespace backend
+} // namespace filament
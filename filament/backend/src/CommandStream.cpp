@@ -23,6 +23,8 @@
 
 #include <functional>
 
+#include <string.h>
+
 using namespace utils;
 
 namespace filament {
@@ -94,6 +96,25 @@ void CommandStream::execute(void* buffer) {
     }
 }
 
+void CommandStream::splice(CommandStream& secondary) noexcept {
+    CircularBuffer& buffer = *secondary.mCurrentBuffer;
+    const size_t size = uintptr_t(buffer.getHead()) - uintptr_t(buffer.getTail());
+    if (size) {
+        memcpy(allocateCommand(size), buffer.getTail(), size);
+    }
+    buffer.circularize();
+}
+
+bool CommandStream::startCapture(const char* path, uint32_t frameCount) noexcept {
+    assert(frameCount > 0);
+    mCapture.reset(new CommandCapture(path, frameCount));
+    if (!mCapture->isValid()) {
+        mCapture.reset();
+        return false;
+    }
+    return true;
+}
+
 void CommandStream::queueCommand(std::function<void()> command) {
     new(allocateCommand(CustomCommand::align(sizeof(CustomCommand)))) CustomCommand(std::move(command));
 }
@@ -235,6 +256,7 @@ io::ostream& operator<<(io::ostream& out, SamplerType type) {
         CASE(SamplerType, SAMPLER_2D)
         CASE(SamplerType, SAMPLER_CUBEMAP)
         CASE(SamplerType, SAMPLER_EXTERNAL)
+        CASE(SamplerType, SAMPLER_2D_ARRAY)
     }
     return out;
 }
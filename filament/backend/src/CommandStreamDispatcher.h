@@ -18,11 +18,13 @@
 #define TNT_FILAMENT_DRIVER_COMMANDSTREAM_DISPATCHER_H
 
 #include "private/backend/Driver.h"
+#include "private/backend/CommandProfiler.h"
 #include "private/backend/CommandStream.h"
 
 #include <utils/compiler.h>
 #include <utils/Systrace.h>
 
+#include <chrono>
 #include <cstddef>
 #include <utility>
 
@@ -51,12 +53,37 @@ class ConcreteDispatcher final : public Dispatcher {
 public:
     // initialize the dispatch table
     explicit ConcreteDispatcher() noexcept : Dispatcher() {
+        Dispatcher::setProfilingEnabled = &ConcreteDispatcher::setProfiling;
+        setProfiling(*this, false);
+    }
+private:
+    static void setProfiling(Dispatcher& dispatcher, bool enable) noexcept {
 #define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
-#define DECL_DRIVER_API(methodName, paramsDecl, params)                 methodName##_ = &ConcreteDispatcher::methodName;
-#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params) methodName##_ = &ConcreteDispatcher::methodName;
+#define DECL_DRIVER_API(methodName, paramsDecl, params)                                         \
+        dispatcher.methodName##_ = enable ? &ConcreteDispatcher::methodName##Profiled           \
+                                          : &ConcreteDispatcher::methodName;
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)                         \
+        dispatcher.methodName##_ = enable ? &ConcreteDispatcher::methodName##Profiled           \
+                                          : &ConcreteDispatcher::methodName;
 #include "private/backend/DriverAPI.inc"
     }
-private:
+
+    // executes a command, and records its execution time and size with the driver's profiler
+    template<typename Cmd, typename M>
+    static inline void profile(CommandId id, M&& method,
+            Driver& driver, CommandBase* base, intptr_t* next) noexcept {
+        ConcreteDriver& concreteDriver = static_cast<ConcreteDriver&>(driver);
+        const size_t bufferSize = static_cast<Cmd*>(base)->getBufferSize();
+        const auto start = std::chrono::steady_clock::now();
+        Cmd::execute(std::forward<M>(method), concreteDriver, base, next);
+        const std::chrono::nanoseconds time = std::chrono::steady_clock::now() - start;
+        CommandProfiler& profiler = concreteDriver.getCommandProfiler();
+        profiler.record(id, uint64_t(time.count()), size_t(*next) + bufferSize);
+        if (id == CommandId::endFrame) {
+            profiler.endFrame();
+        }
+    }
+
 #define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
 #define DECL_DRIVER_API(methodName, paramsDecl, params)                                         \
     static void methodName(Driver& driver, CommandBase* base, intptr_t* next) {                 \
@@ -64,6 +91,11 @@ private:
         using Cmd = COMMAND_TYPE(methodName);                                                   \
         ConcreteDriver& concreteDriver = static_cast<ConcreteDriver&>(driver);                  \
         Cmd::execute(&ConcreteDriver::methodName, concreteDriver, base, next);                  \
+     }                                                                                          \
+    static void methodName##Profiled(Driver& driver, CommandBase* base, intptr_t* next) {       \
+        SYSTRACE()                                                                              \
+        using Cmd = COMMAND_TYPE(methodName);                                                   \
+        profile<Cmd>(CommandId::methodName, &ConcreteDriver::methodName, driver, base, next);   \
      }
 #define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)                         \
     static void methodName(Driver& driver, CommandBase* base, intptr_t* next) {                 \
@@ -71,6 +103,11 @@ private:
         using Cmd = COMMAND_TYPE(methodName##R);                                                \
         ConcreteDriver& concreteDriver = static_cast<ConcreteDriver&>(driver);                  \
         Cmd::execute(&ConcreteDriver::methodName##R, concreteDriver, base, next);               \
+     }                                                                                          \
+    static void methodName##Profiled(Driver& driver, CommandBase* base, intptr_t* next) {       \
+        SYSTRACE()                                                                              \
+        using Cmd = COMMAND_TYPE(methodName##R);                                                \
+        profile<Cmd>(CommandId::methodName, &ConcreteDriver::methodName##R, driver, base, next);\
      }
 #include "private/backend/DriverAPI.inc"
 };
@@ -48,6 +48,10 @@ void DriverBase::purge() noexcept {
     lock.unlock(); // don't remove this, it ensures mBufferToPurge is destroyed without lock held
 }
 
+void DriverBase::setCommandProfilingEnabled(bool enable) noexcept {
+    mDispatcher->setProfilingEnabled(*mDispatcher, enable);
+}
+
 void DriverBase::scheduleDestroySlow(BufferDescriptor&& buffer) noexcept {
     std::lock_guard<std::mutex> lock(mPurgeLock);
     mBufferToPurge.push_back(std::move(buffer));
@@ -24,6 +24,7 @@
 
 #include <backend/DriverEnums.h>
 
+#include "private/backend/CommandProfiler.h"
 #include "private/backend/Driver.h"
 #include "private/backend/SamplerGroup.h"
 
@@ -153,6 +154,10 @@ public:
 
     Dispatcher& getDispatcher() noexcept final { return *mDispatcher; }
 
+    void setCommandProfilingEnabled(bool enable) noexcept final;
+
+    CommandProfiler& getCommandProfiler() noexcept final { return mCommandProfiler; }
+
     // --------------------------------------------------------------------------------------------
     // Privates
     // --------------------------------------------------------------------------------------------
@@ -171,6 +176,7 @@ protected:
 private:
     std::mutex mPurgeLock;
     std::vector<BufferDescriptor> mBufferToPurge;
+    CommandProfiler mCommandProfiler;
 };
 
 
@@ -300,6 +300,18 @@ MetalTexture::MetalTexture(MetalContext& context, backend::SamplerType target, u
         descriptor.usage = getMetalTextureUsage(usage);
         descriptor.storageMode = getMetalStorageMode(usage);
         texture = [context.device newTextureWithDescriptor:descriptor];
+    } else if (target == backend::SamplerType::SAMPLER_2D_ARRAY) {
+        ASSERT_POSTCONDITION(!multisampled, "Multisampled texture arrays not supported.");
+        descriptor = [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:pixelFormat
+                                                                        width:width
+                                                                       height:height
+                                                                    mipmapped:mipmapped];
+        descriptor.mipmapLevelCount = levels;
+        descriptor.textureType = MTLTextureType2DArray;
+        descriptor.arrayLength = depth;
+        descriptor.usage = getMetalTextureUsage(usage);
+        descriptor.storageMode = getMetalStorageMode(usage);
+        texture = [context.device newTextureWithDescriptor:descriptor];
     } else if (target == backend::SamplerType::SAMPLER_CUBEMAP) {
         ASSERT_POSTCONDITION(!multisampled, "Multisampled cubemap faces not supported.");
         ASSERT_POSTCONDITION(width == height, "Cubemap faces must be square.");
@@ -17,6 +17,9 @@
 #include "noop/NoopDriver.h"
 #include "CommandStreamDispatcher.h"
 
+#include <utils/Log.h>
+#include <utils/Systrace.h>
+
 namespace filament {
 
 using namespace backend;
@@ -25,7 +28,7 @@ Driver* NoopDriver::create() {
     return new NoopDriver();
 }
 
-NoopDriver::NoopDriver() noexcept : DriverBase(new ConcreteDispatcher<NoopDriver>()) {
+NoopDriver::NoopDriver() noexcept : NoopDriverBase(new ConcreteDispatcher<NoopDriver>()) {
 }
 
 NoopDriver::~NoopDriver() noexcept = default;
@@ -38,6 +41,29 @@ backend::ShaderModel NoopDriver::getShaderModel() const noexcept {
 #endif
 }
 
+void NoopDriver::terminate() {
+    utils::slog.i << "NoopDriver: " << mTotalStats.drawCount << " draw calls, "
+                  << mTotalStats.instanceCount << " instances" << utils::io::endl;
+}
+
+void NoopDriver::beginFrame(int64_t monotonic_clock_ns, uint32_t frameId) {
+    mCurrentStats = {};
+}
+
+void NoopDriver::endFrame(uint32_t frameId) {
+    SYSTRACE_CONTEXT();
+    mFrameStats = mCurrentStats;
+    SYSTRACE_VALUE32("drawCount", mFrameStats.drawCount);
+    SYSTRACE_VALUE32("instanceCount", mFrameStats.instanceCount);
+}
+
+void NoopDriver::draw(PipelineState state, RenderPrimitiveHandle rph, uint32_t instanceCount) {
+    mCurrentStats.drawCount++;
+    mCurrentStats.instanceCount += instanceCount;
+    mTotalStats.drawCount++;
+    mTotalStats.instanceCount += instanceCount;
+}
+
 // explicit instantiation of the Dispatcher
 template class backend::ConcreteDispatcher<NoopDriver>;
 
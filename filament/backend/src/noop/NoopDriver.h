@@ -24,19 +24,14 @@
 
 namespace filament {
 
-class NoopDriver final : public backend::DriverBase {
-    NoopDriver() noexcept;
-    ~NoopDriver() noexcept override;
-
-public:
-    static backend::Driver* create();
-
-private:
-    backend::ShaderModel getShaderModel() const noexcept final;
-
-    /*
-     * Driver interface
-     */
+/*
+ * Implements all the driver APIs as no-ops. NoopDriver below hides the few it keeps statistics
+ * for.
+ */
+class NoopDriverBase : public backend::DriverBase {
+protected:
+    explicit NoopDriverBase(backend::Dispatcher* dispatcher) noexcept
+            : backend::DriverBase(dispatcher) { }
 
     template<typename T>
     friend class backend::ConcreteDispatcher;
@@ -58,6 +53,47 @@ private:
 #include "private/backend/DriverAPI.inc"
 };
 
+class NoopDriver final : public NoopDriverBase {
+    NoopDriver() noexcept;
+    ~NoopDriver() noexcept override;
+
+public:
+    static backend::Driver* create();
+
+    // Draw calls received by the driver, they let us measure the effect of batching (e.g.
+    // instancing) without a GPU.
+    struct Stats {
+        uint32_t drawCount = 0;     // number of draw() calls
+        uint32_t instanceCount = 0; // number of instances drawn by these calls
+    };
+
+    // statistics of the last completed frame
+    Stats const& getFrameStats() const noexcept { return mFrameStats; }
+
+    // statistics since the driver was created
+    Stats const& getTotalStats() const noexcept { return mTotalStats; }
+
+private:
+    backend::ShaderModel getShaderModel() const noexcept final;
+
+    /*
+     * Driver interface
+     */
+
+    template<typename T>
+    friend class backend::ConcreteDispatcher;
+
+    void terminate() override;
+    void beginFrame(int64_t monotonic_clock_ns, uint32_t frameId);
+    void endFrame(uint32_t frameId);
+    void draw(backend::PipelineState state, backend::RenderPrimitiveHandle rph,
+            uint32_t instanceCount);
+
+    Stats mCurrentStats;
+    Stats mFrameStats;
+    Stats mTotalStats;
+};
+
 } // namespace filament
 
 #endif // TNT_FILAMENT_DRIVER_NOOPDRIVER_H
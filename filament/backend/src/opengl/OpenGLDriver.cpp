@@ -1051,6 +1051,11 @@ void OpenGLDriver::createTextureR(Handle<HwTexture> th, SamplerType target, uint
                                 getIndexForTextureTarget(t->gl.target = GL_TEXTURE_2D_ARRAY);
                     }
                     break;
+                case SamplerType::SAMPLER_2D_ARRAY:
+                    // always an array, even with a single layer, so it matches sampler2DArray
+                    t->gl.targetIndex = (uint8_t)
+                            getIndexForTextureTarget(t->gl.target = GL_TEXTURE_2D_ARRAY);
+                    break;
                 case SamplerType::SAMPLER_CUBEMAP:
                     t->gl.targetIndex = (uint8_t)
                             getIndexForTextureTarget(t->gl.target = GL_TEXTURE_CUBE_MAP);
@@ -1096,6 +1101,7 @@ void OpenGLDriver::framebufferTexture(backend::TargetBufferInfo const& binfo,
     GLenum target = GL_TEXTURE_2D;
     switch (t->target) {
         case SamplerType::SAMPLER_2D:
+        case SamplerType::SAMPLER_2D_ARRAY:
             target = t->gl.target;  // this could be GL_TEXTURE_2D_MULTISAMPLE or GL_TEXTURE_2D_ARRAY
             // note: multi-sampled textures can't have mipmaps
             break;
@@ -1957,6 +1963,7 @@ void OpenGLDriver::setTextureData(GLTexture* t,
             // but it's not supported, so instead, we behave like a texture2d.
             // fallthrough...
         case SamplerType::SAMPLER_2D:
+        case SamplerType::SAMPLER_2D_ARRAY:
             // NOTE: GL_TEXTURE_2D_MULTISAMPLE is not allowed
             bindTexture(MAX_TEXTURE_UNIT_COUNT - 1, t);
             activeTexture(MAX_TEXTURE_UNIT_COUNT - 1);
@@ -2038,6 +2045,7 @@ void OpenGLDriver::setCompressedTextureData(GLTexture* t,
             // but it's not supported, so instead, we behave like a texture2d.
             // fallthrough...
         case SamplerType::SAMPLER_2D:
+        case SamplerType::SAMPLER_2D_ARRAY:
             // NOTE: GL_TEXTURE_2D_MULTISAMPLE is not allowed
             bindTexture(MAX_TEXTURE_UNIT_COUNT - 1, t);
             activeTexture(MAX_TEXTURE_UNIT_COUNT - 1);
@@ -2975,7 +2983,8 @@ void OpenGLDriver::updateTextureLodRange(GLTexture* texture, int8_t targetLevel)
     }
 }
 
-void OpenGLDriver::draw(PipelineState state, Handle<HwRenderPrimitive> rph) {
+void OpenGLDriver::draw(PipelineState state, Handle<HwRenderPrimitive> rph,
+        uint32_t instanceCount) {
     DEBUG_MARKER()
 
     OpenGLProgram* p = handle_cast<OpenGLProgram*>(state.program);
@@ -2990,8 +2999,13 @@ void OpenGLDriver::draw(PipelineState state, Handle<HwRenderPrimitive> rph) {
 
     enable(GL_SCISSOR_TEST);
 
-    glDrawRangeElements(GLenum(rp->type), rp->minIndex, rp->maxIndex, rp->count,
-            rp->gl.indicesType, reinterpret_cast<const void*>(rp->offset));
+    if (instanceCount > 1) {
+        glDrawElementsInstanced(GLenum(rp->type), rp->count, rp->gl.indicesType,
+                reinterpret_cast<const void*>(rp->offset), GLsizei(instanceCount));
+    } else {
+        glDrawRangeElements(GLenum(rp->type), rp->minIndex, rp->maxIndex, rp->count,
+                rp->gl.indicesType, reinterpret_cast<const void*>(rp->offset));
+    }
 
     CHECK_GL_ERROR(utils::slog.e)
 }
@@ -271,6 +271,10 @@ VulkanTexture::VulkanTexture(VulkanContext& context, SamplerType target, uint8_t
         imageInfo.arrayLayers = 6;
         imageInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
     }
+    if (target == SamplerType::SAMPLER_2D_ARRAY) {
+        imageInfo.extent.depth = 1;
+        imageInfo.arrayLayers = depth;
+    }
     if (usage & TextureUsage::SAMPLEABLE) {
         imageInfo.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
     }
@@ -325,6 +329,9 @@ VulkanTexture::VulkanTexture(VulkanContext& context, SamplerType target, uint8_t
     if (target == SamplerType::SAMPLER_CUBEMAP) {
         viewInfo.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
         viewInfo.subresourceRange.layerCount = 6;
+    } else if (target == SamplerType::SAMPLER_2D_ARRAY) {
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+        viewInfo.subresourceRange.layerCount = depth;
     } else {
         viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
         viewInfo.subresourceRange.layerCount = 1;
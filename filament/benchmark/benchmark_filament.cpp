@@ -20,13 +20,37 @@
 
 
 #include <filament/Box.h>
+#include <filament/Engine.h>
 #include <filament/Frustum.h>
+#include <filament/LightManager.h>
+#include <filament/RenderableManager.h>
+#include <filament/Scene.h>
+#include <filament/TransformManager.h>
+#include "components/TransformManager.h"
+#include "details/BoundingVolumeHierarchy.h"
 #include "details/Culler.h"
+#include "details/Engine.h"
+#include "details/Froxelizer.h"
+#include "details/OcclusionCuller.h"
+#include "details/Scene.h"
+#include "RenderPass.h"
+
+#include "private/backend/CircularBuffer.h"
+#include "private/backend/CommandBufferQueue.h"
 
 #include <utils/Allocator.h>
+#include <utils/EntityManager.h>
+#include <utils/JobSystem.h>
 
-#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <random>
+#include <thread>
+#include <vector>
+
+#include <math.h>
 
 using namespace filament;
 using namespace filament::details;
@@ -81,11 +105,20 @@ public:
     }
 };
 
-BENCHMARK_F(FilamentFixture, boxCulling)(benchmark::State& state) {
+static const char* const ISA_NAMES[] = { "scalar", "sse2", "avx2", "avx512", "neon" };
+
+BENCHMARK_DEFINE_F(FilamentFixture, boxCulling)(benchmark::State& state) {
+    const auto isa = Culler::Isa(state.range(0));
+    if (!Culler::isSupported(isa)) {
+        state.SkipWithError("instruction set not supported");
+        return;
+    }
+    state.SetLabel(ISA_NAMES[state.range(0)]);
     {
         PerformanceCounters pc(state);
         for (auto _ : state) {
-            Culler::Test::intersects(visibles, frustum, boxesCenter.data(), boxesExtent.data(), BATCH_SIZE);
+            Culler::Test::intersects(visibles, frustum, boxesCenter.data(), boxesExtent.data(),
+                    BATCH_SIZE, isa);
         }
         benchmark::ClobberMemory();
         pc.stop();
@@ -93,14 +126,794 @@ BENCHMARK_F(FilamentFixture, boxCulling)(benchmark::State& state) {
     }
 }
 
-BENCHMARK_F(FilamentFixture, sphereCulling)(benchmark::State& state) {
+BENCHMARK_DEFINE_F(FilamentFixture, sphereCulling)(benchmark::State& state) {
+    const auto isa = Culler::Isa(state.range(0));
+    if (!Culler::isSupported(isa)) {
+        state.SkipWithError("instruction set not supported");
+        return;
+    }
+    state.SetLabel(ISA_NAMES[state.range(0)]);
     {
         PerformanceCounters pc(state);
         for (auto _ : state) {
-            Culler::Test::intersects(visibles, frustum, spheres.data(), BATCH_SIZE);
+            Culler::Test::intersects(visibles, frustum, spheres.data(), BATCH_SIZE, isa);
         }
         benchmark::ClobberMemory();
         pc.stop();
         state.SetItemsProcessed(state.iterations() * BATCH_SIZE);
     }
 }
+
+// one run per Culler::Isa
+BENCHMARK_REGISTER_F(FilamentFixture, boxCulling)->DenseRange(0, 4)->ArgName("isa");
+BENCHMARK_REGISTER_F(FilamentFixture, sphereCulling)->DenseRange(0, 4)->ArgName("isa");
+
+// A large, mostly flat "city" of boxes, of which the camera only sees a small fraction.
+class CityFixture : public benchmark::Fixture {
+protected:
+    Frustum frustum{};
+    std::vector<float3> boxesCenter;
+    std::vector<float3> boxesExtent;
+    std::vector<Culler::result_type> visibles;
+    BoundingVolumeHierarchy bvh;
+
+public:
+    void SetUp(benchmark::State& state) override {
+        const size_t count = size_t(state.range(0));
+        const float size = 2.0f * std::sqrt(float(count));
+
+        std::default_random_engine gen; // NOLINT
+        std::uniform_real_distribution<float> position(-size, size);
+        std::uniform_real_distribution<float> height(0.0f, 20.0f);
+        std::uniform_real_distribution<float> extent(0.5f, 2.0f);
+
+        boxesCenter.resize(Culler::round(count));
+        boxesExtent.resize(Culler::round(count));
+        visibles.resize(Culler::round(count));
+        for (size_t i = 0; i < count; i++) {
+            boxesCenter[i] = { position(gen), height(gen), position(gen) };
+            boxesExtent[i] = { extent(gen), extent(gen), extent(gen) };
+        }
+
+        frustum = Frustum{ mat4f::perspective(45.0f, 1.0f, 0.1f, 100.0f) *
+                inverse(mat4f::lookAt(float3{ 0, 10, 0 }, float3{ 1, 10, 1 }, float3{ 0, 1, 0 })) };
+
+        bvh.build(boxesCenter.data(), boxesExtent.data(), count);
+    }
+
+    void TearDown(benchmark::State& state) override {
+        boxesCenter.clear();
+        boxesExtent.clear();
+        visibles.clear();
+    }
+};
+
+BENCHMARK_DEFINE_F(CityFixture, flatCulling)(benchmark::State& state) {
+    const size_t count = size_t(state.range(0));
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            Culler::Test::intersects(visibles.data(), frustum,
+                    boxesCenter.data(), boxesExtent.data(), count);
+        }
+        benchmark::ClobberMemory();
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * count);
+    }
+}
+
+BENCHMARK_DEFINE_F(CityFixture, hierarchicalCulling)(benchmark::State& state) {
+    const size_t count = size_t(state.range(0));
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            std::fill(visibles.begin(), visibles.end(), 0);
+            bvh.cull(visibles.data(), frustum, 0);
+        }
+        benchmark::ClobberMemory();
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * count);
+    }
+}
+
+BENCHMARK_REGISTER_F(CityFixture, flatCulling)->Arg(10000)->Arg(100000)->Arg(1000000);
+BENCHMARK_REGISTER_F(CityFixture, hierarchicalCulling)->Arg(10000)->Arg(100000)->Arg(1000000);
+
+// A scene with many static renderables, used to measure how FScene::prepare() scales with the
+// number of threads of the JobSystem.
+class ScenePrepareFixture : public benchmark::Fixture {
+protected:
+    static constexpr size_t ENTITY_COUNT = 65536;
+
+    Engine* engine = nullptr;
+    Scene* scene = nullptr;
+    std::vector<Entity> entities;
+
+    template<typename F>
+    void runWithThreads(size_t threadCount, F run) {
+        // FScene::prepare() must be called from a thread adopted by the JobSystem it uses
+        JobSystem& engineJobSystem = upcast(engine)->getJobSystem();
+        engineJobSystem.emancipate();
+        {
+            JobSystem js(threadCount);
+            js.adopt();
+            run(js);
+            js.emancipate();
+        }
+        engineJobSystem.adopt();
+    }
+
+public:
+    void SetUp(benchmark::State& state) override {
+        engine = Engine::create(Engine::Backend::NOOP);
+        scene = engine->createScene();
+
+        std::default_random_engine gen; // NOLINT
+        std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+
+        TransformManager& tcm = engine->getTransformManager();
+        entities.resize(ENTITY_COUNT);
+        EntityManager::get().create(entities.size(), entities.data());
+        for (Entity e : entities) {
+            RenderableManager::Builder(0)
+                    .boundingBox({{ 0, 0, 0 }, { 1, 1, 1 }})
+                    .build(*engine, e);
+            tcm.create(e, {}, mat4f::translation(
+                    float3{ position(gen), position(gen), position(gen) }));
+            scene->addEntity(e);
+        }
+    }
+
+    void TearDown(benchmark::State& state) override {
+        RenderableManager& rcm = engine->getRenderableManager();
+        TransformManager& tcm = engine->getTransformManager();
+        for (Entity e : entities) {
+            rcm.destroy(e);
+            tcm.destroy(e);
+        }
+        EntityManager::get().destroy(entities.size(), entities.data());
+        entities.clear();
+        engine->destroy(scene);
+        Engine::destroy(&engine);
+    }
+};
+
+// everything is gathered from scratch, e.g. after an entity was added to the scene
+BENCHMARK_DEFINE_F(ScenePrepareFixture, gather)(benchmark::State& state) {
+    FScene* const s = upcast(scene);
+    runWithThreads(size_t(state.range(0)), [&](JobSystem& js) {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            s->addEntity(entities[0]);
+            s->prepare(js, mat4f{});
+        }
+        benchmark::ClobberMemory();
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * ENTITY_COUNT);
+    });
+}
+
+// all transforms are updated in place, e.g. when the camera moves
+BENCHMARK_DEFINE_F(ScenePrepareFixture, update)(benchmark::State& state) {
+    FScene* const s = upcast(scene);
+    runWithThreads(size_t(state.range(0)), [&](JobSystem& js) {
+        s->prepare(js, mat4f{});
+        PerformanceCounters pc(state);
+        float x = 0;
+        for (auto _ : state) {
+            s->prepare(js, mat4f::translation(float3{ x++, 0, 0 }));
+        }
+        benchmark::ClobberMemory();
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * ENTITY_COUNT);
+    });
+}
+
+BENCHMARK_REGISTER_F(ScenePrepareFixture, gather)
+        ->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16)->UseRealTime();
+BENCHMARK_REGISTER_F(ScenePrepareFixture, update)
+        ->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16)->UseRealTime();
+
+// Animated characters: many small hierarchies whose local transforms all change every frame,
+// committed in a local transform transaction.
+class TransformHierarchyFixture : public benchmark::Fixture {
+protected:
+    static constexpr size_t ROOT_COUNT = 512;
+    static constexpr size_t DEPTH = 8;
+    static constexpr size_t CHILD_COUNT = 8;    // per root, on each level below the root
+
+    std::vector<Entity> entities;
+
+public:
+    void SetUp(benchmark::State& state) override {
+        entities.resize(ROOT_COUNT * (1 + (DEPTH - 1) * CHILD_COUNT));
+        EntityManager::get().create(entities.size(), entities.data());
+    }
+
+    void TearDown(benchmark::State& state) override {
+        EntityManager::get().destroy(entities.size(), entities.data());
+        entities.clear();
+    }
+
+    // each root has CHILD_COUNT chains of DEPTH - 1 nodes
+    void createHierarchy(FTransformManager& tcm) {
+        size_t e = 0;
+        for (size_t r = 0; r < ROOT_COUNT; r++) {
+            tcm.create(entities[e]);
+            const auto root = tcm.getInstance(entities[e++]);
+            for (size_t c = 0; c < CHILD_COUNT; c++) {
+                auto parent = root;
+                for (size_t d = 1; d < DEPTH; d++) {
+                    tcm.create(entities[e], parent, mat4f::translation(float3{ 0, 1, 0 }));
+                    parent = tcm.getInstance(entities[e++]);
+                }
+            }
+        }
+    }
+};
+
+BENCHMARK_DEFINE_F(TransformHierarchyFixture, commit)(benchmark::State& state) {
+    JobSystem js(size_t(state.range(0)));
+    js.adopt();
+    {
+        FTransformManager tcm(js);
+        createHierarchy(tcm);
+        // the first transaction sorts the nodes
+        tcm.openLocalTransformTransaction();
+        tcm.commitLocalTransformTransaction();
+
+        PerformanceCounters pc(state);
+        float angle = 0;
+        for (auto _ : state) {
+            tcm.openLocalTransformTransaction();
+            const mat4f local = mat4f::rotation(angle += 0.01f, float3{ 0, 0, 1 });
+            for (Entity e : entities) {
+                tcm.setTransform(tcm.getInstance(e), local);
+            }
+            tcm.commitLocalTransformTransaction();
+        }
+        benchmark::ClobberMemory();
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * entities.size());
+
+        for (Entity e : entities) {
+            tcm.destroy(e);
+        }
+    }
+    js.emancipate();
+}
+
+BENCHMARK_REGISTER_F(TransformHierarchyFixture, commit)
+        ->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
+
+// The per-renderable uniforms of a large scene, whose transforms are all of the same type:
+// 0 rigid, 1 uniformly scaled or 2 general (non-uniformly scaled).
+class PerRenderableUboFixture : public benchmark::Fixture {
+protected:
+    static constexpr size_t ENTITY_COUNT = 50000;
+
+    Engine* engine = nullptr;
+    Scene* scene = nullptr;
+    std::vector<Entity> entities;
+    std::vector<uint8_t> buffer;
+
+public:
+    void SetUp(benchmark::State& state) override {
+        engine = Engine::create(Engine::Backend::NOOP);
+        scene = engine->createScene();
+
+        std::default_random_engine gen; // NOLINT
+        std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+        std::uniform_real_distribution<float> angle(-3.0f, 3.0f);
+        std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+
+        TransformManager& tcm = engine->getTransformManager();
+        entities.resize(ENTITY_COUNT);
+        EntityManager::get().create(entities.size(), entities.data());
+        for (Entity e : entities) {
+            RenderableManager::Builder(0)
+                    .boundingBox({{ 0, 0, 0 }, { 1, 1, 1 }})
+                    .build(*engine, e);
+            mat4f transform = mat4f::translation(
+                    float3{ position(gen), position(gen), position(gen) }) *
+                    mat4f::eulerZYX(angle(gen), angle(gen), angle(gen));
+            if (state.range(0) == 1) {
+                transform *= mat4f::scaling(scale(gen));
+            } else if (state.range(0) == 2) {
+                transform *= mat4f::scaling(float3{ scale(gen), scale(gen), scale(gen) });
+            }
+            tcm.create(e, {}, transform);
+            scene->addEntity(e);
+        }
+        upcast(scene)->prepare(upcast(engine)->getJobSystem(), mat4f{});
+        buffer.resize(FScene::getPerRenderableUboSize(ENTITY_COUNT));
+    }
+
+    void TearDown(benchmark::State& state) override {
+        RenderableManager& rcm = engine->getRenderableManager();
+        TransformManager& tcm = engine->getTransformManager();
+        for (Entity e : entities) {
+            rcm.destroy(e);
+            tcm.destroy(e);
+        }
+        EntityManager::get().destroy(entities.size(), entities.data());
+        entities.clear();
+        buffer.clear();
+        engine->destroy(scene);
+        Engine::destroy(&engine);
+    }
+};
+
+// what FScene::updateUBOs() does every frame, minus the command stream
+BENCHMARK_DEFINE_F(PerRenderableUboFixture, updateUBOs)(benchmark::State& state) {
+    FScene const* const s = upcast(scene);
+    PerformanceCounters pc(state);
+    for (auto _ : state) {
+        s->writeUBOs(buffer.data(), { 0, uint32_t(ENTITY_COUNT) });
+        benchmark::DoNotOptimize(buffer.data());
+    }
+    benchmark::ClobberMemory();
+    pc.stop();
+    state.SetItemsProcessed(state.iterations() * ENTITY_COUNT);
+}
+
+// the normal matrices are recomputed when the transforms change, e.g. when the world origin moves
+BENCHMARK_DEFINE_F(PerRenderableUboFixture, updateNormals)(benchmark::State& state) {
+    FScene* const s = upcast(scene);
+    JobSystem& js = upcast(engine)->getJobSystem();
+    PerformanceCounters pc(state);
+    float x = 0;
+    for (auto _ : state) {
+        s->prepare(js, mat4f::translation(float3{ x++, 0, 0 }));
+    }
+    benchmark::ClobberMemory();
+    pc.stop();
+    state.SetItemsProcessed(state.iterations() * ENTITY_COUNT);
+}
+
+BENCHMARK_REGISTER_F(PerRenderableUboFixture, updateUBOs)
+        ->Arg(0)->Arg(1)->Arg(2)->ArgName("type");
+BENCHMARK_REGISTER_F(PerRenderableUboFixture, updateNormals)
+        ->Arg(0)->Arg(1)->Arg(2)->ArgName("type")->UseRealTime();
+
+// A crowd of skinned characters, whose bones are all updated every frame. The argument is the
+// RenderableManager::BoneFormat: 0 quaternion and scales, 1 dual quaternion.
+class SkinningFixture : public benchmark::Fixture {
+protected:
+    static constexpr size_t CHARACTER_COUNT = 1000;
+    static constexpr size_t BONE_COUNT = 64;
+
+    Engine* engine = nullptr;
+    std::vector<Entity> entities;
+    std::vector<mat4f> bones;
+
+public:
+    void SetUp(benchmark::State& state) override {
+        engine = Engine::create(Engine::Backend::NOOP);
+
+        std::default_random_engine gen; // NOLINT
+        std::uniform_real_distribution<float> position(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> angle(-3.0f, 3.0f);
+        bones.resize(BONE_COUNT);
+        for (mat4f& bone : bones) {
+            bone = mat4f::translation(float3{ position(gen), position(gen), position(gen) }) *
+                    mat4f::eulerZYX(angle(gen), angle(gen), angle(gen));
+        }
+
+        entities.resize(CHARACTER_COUNT);
+        EntityManager::get().create(entities.size(), entities.data());
+        for (Entity e : entities) {
+            RenderableManager::Builder(0)
+                    .boundingBox({{ 0, 0, 0 }, { 1, 1, 1 }})
+                    .skinning(BONE_COUNT)
+                    .boneFormat(RenderableManager::BoneFormat(state.range(0)))
+                    .build(*engine, e);
+        }
+    }
+
+    void TearDown(benchmark::State& state) override {
+        RenderableManager& rcm = engine->getRenderableManager();
+        for (Entity e : entities) {
+            rcm.destroy(e);
+        }
+        EntityManager::get().destroy(entities.size(), entities.data());
+        entities.clear();
+        Engine::destroy(&engine);
+    }
+};
+
+// what gltfio's Animator does every frame, the bones are then uploaded at once
+BENCHMARK_DEFINE_F(SkinningFixture, setBones)(benchmark::State& state) {
+    RenderableManager& rcm = engine->getRenderableManager();
+    PerformanceCounters pc(state);
+    for (auto _ : state) {
+        for (Entity e : entities) {
+            rcm.setBones(rcm.getInstance(e), bones.data(), BONE_COUNT);
+        }
+    }
+    benchmark::ClobberMemory();
+    pc.stop();
+    state.SetItemsProcessed(state.iterations() * CHARACTER_COUNT * BONE_COUNT);
+}
+
+BENCHMARK_REGISTER_F(SkinningFixture, setBones)->Arg(0)->Arg(1)->ArgName("format");
+
+// Color pass commands (without depth pre-pass) of a large scene: a few priorities, bucketed Z
+// and many materials.
+class CommandSortFixture : public benchmark::Fixture {
+protected:
+    using Command = RenderPass::Command;
+    std::vector<Command> commands;
+    std::vector<Command> sorted;
+    std::vector<Command> scratch;
+
+public:
+    void SetUp(benchmark::State& state) override {
+        std::default_random_engine gen; // NOLINT
+        std::uniform_int_distribution<uint32_t> priority(0, 7);
+        std::uniform_int_distribution<uint32_t> zbucket(0, 1023);
+        std::uniform_int_distribution<uint32_t> material(0, 2047);
+        std::uniform_int_distribution<uint32_t> instance(0, 63);
+
+        commands.resize(size_t(state.range(0)));
+        for (Command& command : commands) {
+            command.key = (uint64_t(RenderPass::Pass::COLOR)) |
+                          (uint64_t(priority(gen)) << RenderPass::PRIORITY_SHIFT) |
+                          (uint64_t(zbucket(gen)) << RenderPass::Z_BUCKET_SHIFT) |
+                          RenderPass::makeMaterialSortingKey(material(gen), instance(gen));
+        }
+        sorted.resize(commands.size());
+        scratch.resize(commands.size());
+    }
+
+    void TearDown(benchmark::State& state) override {
+        commands.clear();
+        sorted.clear();
+        scratch.clear();
+    }
+};
+
+BENCHMARK_DEFINE_F(CommandSortFixture, stdSort)(benchmark::State& state) {
+    PerformanceCounters pc(state);
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::copy(commands.begin(), commands.end(), sorted.begin());
+        state.ResumeTiming();
+        std::sort(sorted.begin(), sorted.end());
+    }
+    benchmark::ClobberMemory();
+    pc.stop();
+    state.SetItemsProcessed(state.iterations() * commands.size());
+}
+
+BENCHMARK_DEFINE_F(CommandSortFixture, radixSort)(benchmark::State& state) {
+    JobSystem js;
+    js.adopt();
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            state.PauseTiming();
+            std::copy(commands.begin(), commands.end(), sorted.begin());
+            state.ResumeTiming();
+            RenderPass::sortCommands(js,
+                    sorted.data(), sorted.data() + sorted.size(), scratch.data());
+        }
+        benchmark::ClobberMemory();
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * commands.size());
+    }
+    js.emancipate();
+}
+
+BENCHMARK_REGISTER_F(CommandSortFixture, stdSort)
+        ->Arg(10000)->Arg(50000)->Arg(100000)->Arg(500000)->UseRealTime();
+BENCHMARK_REGISTER_F(CommandSortFixture, radixSort)
+        ->Arg(10000)->Arg(50000)->Arg(100000)->Arg(500000)->UseRealTime();
+
+// A street seen from the ground: rows of buildings (boxes) occluding what's behind them.
+class OcclusionFixture : public benchmark::Fixture {
+protected:
+    static constexpr size_t BUILDING_COUNT = 64;
+
+    OcclusionCuller culler;
+    std::vector<float3> vertices;
+    std::vector<uint16_t> indices;
+    std::vector<mat3x4f> buildings;
+    std::vector<float3> centers;
+    std::vector<float3> extents;
+    std::vector<Culler::result_type> results;
+    mat4f viewProjection;
+
+public:
+    void SetUp(benchmark::State& state) override {
+        // unit cube, 12 triangles
+        vertices.assign({
+                { -1, -1, -1 }, { 1, -1, -1 }, { 1, 1, -1 }, { -1, 1, -1 },
+                { -1, -1,  1 }, { 1, -1,  1 }, { 1, 1,  1 }, { -1, 1,  1 }});
+        indices.assign({
+                0, 1, 2, 0, 2, 3,  4, 6, 5, 4, 7, 6,  0, 4, 5, 0, 5, 1,
+                3, 2, 6, 3, 6, 7,  0, 3, 7, 0, 7, 4,  1, 5, 6, 1, 6, 2 });
+
+        std::default_random_engine gen; // NOLINT
+        std::uniform_real_distribution<float> x(-200.0f, 200.0f);
+        std::uniform_real_distribution<float> z(-40.0f, -20.0f);
+        std::uniform_real_distribution<float> height(5.0f, 30.0f);
+        buildings.resize(BUILDING_COUNT);
+        for (mat3x4f& building : buildings) {
+            float h = height(gen);
+            building = mat3x4f(mat4f::translation(float3{ x(gen), h - 2.0f, z(gen) }) *
+                               mat4f::scaling(float3{ 5.0f, h, 5.0f }));
+        }
+
+        std::uniform_real_distribution<float> ox(-300.0f, 300.0f);
+        std::uniform_real_distribution<float> oz(-500.0f, -5.0f);
+        const size_t count = size_t(state.range(0));
+        centers.resize(count);
+        extents.resize(count);
+        results.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            centers[i] = { ox(gen), 0.0f, oz(gen) };
+            extents[i] = { 1.0f, 1.0f, 1.0f };
+        }
+
+        viewProjection = mat4f::perspective(60.0f,
+                float(OcclusionCuller::WIDTH) / OcclusionCuller::HEIGHT,
+                0.1f, 1000.0f);
+    }
+
+    void TearDown(benchmark::State& state) override {
+        buildings.clear();
+        centers.clear();
+        extents.clear();
+        results.clear();
+    }
+
+    void addOccluders() {
+        culler.begin(viewProjection);
+        for (mat3x4f const& building : buildings) {
+            culler.addOccluder(building,
+                    vertices.data(), vertices.size(), indices.data(), indices.size());
+        }
+    }
+};
+
+BENCHMARK_DEFINE_F(OcclusionFixture, rasterize)(benchmark::State& state) {
+    JobSystem js;
+    js.adopt();
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            addOccluders();
+            culler.rasterize(js);
+        }
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * culler.getTriangleCount());
+    }
+    js.emancipate();
+}
+
+BENCHMARK_DEFINE_F(OcclusionFixture, cull)(benchmark::State& state) {
+    JobSystem js;
+    js.adopt();
+    addOccluders();
+    culler.rasterize(js);
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            state.PauseTiming();
+            std::fill(results.begin(), results.end(), Culler::result_type(1));
+            state.ResumeTiming();
+            culler.cull(js, results.data(), centers.data(), extents.data(), results.size(), 0);
+        }
+        benchmark::ClobberMemory();
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * results.size());
+    }
+    js.emancipate();
+}
+
+BENCHMARK_REGISTER_F(OcclusionFixture, rasterize)->Arg(0)->UseRealTime();
+BENCHMARK_REGISTER_F(OcclusionFixture, cull)->Arg(10000)->Arg(100000)->UseRealTime();
+
+// A night-city like scene: many small point and spot lights in front of the camera.
+// Up to CONFIG_MAX_LIGHT_COUNT lights are froxelized with bitsets, beyond that with the
+// clustered light lists.
+class FroxelizerFixture : public benchmark::Fixture {
+protected:
+    FEngine* engine = nullptr;
+    Froxelizer* froxelizer = nullptr;
+    LinearAllocatorArena* arena = nullptr;
+    utils::ArenaScope<LinearAllocatorArena>* scope = nullptr;
+    Entity pointLight;
+    Entity spotLight;
+    FScene::LightSoa lights;
+    CameraInfo camera{};
+
+public:
+    void SetUp(benchmark::State& state) override {
+        engine = upcast(Engine::create(Engine::Backend::NOOP));
+        arena = new LinearAllocatorArena("froxelizer benchmark",
+                FEngine::CONFIG_PER_RENDER_PASS_ARENA_SIZE);
+        scope = new utils::ArenaScope<LinearAllocatorArena>(*arena);
+
+        pointLight = EntityManager::get().create();
+        spotLight = EntityManager::get().create();
+        LightManager::Builder(LightManager::Type::POINT)
+                .falloff(4.0f)
+                .build(*engine, pointLight);
+        LightManager::Builder(LightManager::Type::SPOT)
+                .falloff(4.0f)
+                .spotLightCone(0.5f, 0.7f)
+                .build(*engine, spotLight);
+        FLightManager& lcm = engine->getLightManager();
+
+        std::default_random_engine gen; // NOLINT
+        std::uniform_real_distribution<float> xy(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> z(-100.0f, -2.0f);
+        std::uniform_real_distribution<float> radius(1.0f, 4.0f);
+        const size_t count = size_t(state.range(0));
+        lights.push_back({}, {}, {}, {}, {}, {});   // the directional light is always skipped
+        for (size_t i = 0; i < count; i++) {
+            const float d = z(gen);
+            const float4 sphere{ xy(gen) * d, xy(gen) * d * 0.5f, d, radius(gen) };
+            const bool isSpot = i & 1;
+            lights.push_back(sphere, float3{ 0, -1, 0 },
+                    lcm.getInstance(isSpot ? spotLight : pointLight), 1, {}, {});
+        }
+
+        camera.projection = mat4f::perspective(90, 2.0f, 0.1, 100, mat4f::Fov::HORIZONTAL);
+        camera.zn = 0.1f;
+        camera.zf = 100.0f;
+
+        // the froxelizer's buffers stay valid for the whole benchmark. The first prepare() finds
+        // that all the lights changed, so each froxelizeLights() froxelizes all of them again.
+        froxelizer = new Froxelizer(*engine);
+        froxelizer->setOptions(5, 100);
+        froxelizer->prepare(*engine, engine->getDriverApi(), *scope, { 0, 0, 1920, 960 },
+                camera.projection, camera.zn, camera.zf, camera, lights);
+    }
+
+    void TearDown(benchmark::State& state) override {
+        froxelizer->terminate(engine->getDriverApi());
+        delete froxelizer;
+        delete scope;
+        delete arena;
+        lights.clear();
+        engine->getLightManager().destroy(pointLight);
+        engine->getLightManager().destroy(spotLight);
+        EntityManager::get().destroy(pointLight);
+        EntityManager::get().destroy(spotLight);
+        Engine* e = engine;
+        Engine::destroy(&e);
+    }
+};
+
+BENCHMARK_DEFINE_F(FroxelizerFixture, froxelizeLights)(benchmark::State& state) {
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            froxelizer->froxelizeLights(*engine, camera, lights);
+        }
+        benchmark::ClobberMemory();
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * (lights.size() - 1));
+    }
+}
+
+BENCHMARK_REGISTER_F(FroxelizerFixture, froxelizeLights)
+        ->Arg(64)->Arg(256)->Arg(1024)->Arg(4096)->UseRealTime();
+
+// same as above without the SIMD kernels, only the bitset path (<= 256 lights) uses them
+BENCHMARK_DEFINE_F(FroxelizerFixture, froxelizeLightsScalar)(benchmark::State& state) {
+    froxelizer->setSimdEnabled(false);
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            froxelizer->froxelizeLights(*engine, camera, lights);
+        }
+        benchmark::ClobberMemory();
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * (lights.size() - 1));
+    }
+}
+
+BENCHMARK_REGISTER_F(FroxelizerFixture, froxelizeLightsScalar)
+        ->Arg(64)->Arg(256)->UseRealTime();
+
+// a mostly static scene: one light in sixteen moves every frame
+BENCHMARK_DEFINE_F(FroxelizerFixture, froxelizeLightsIncremental)(benchmark::State& state) {
+    froxelizer->froxelizeLights(*engine, camera, lights);
+    auto* spheres = lights.data<FScene::POSITION_RADIUS>();
+    const size_t count = lights.size() - FScene::DIRECTIONAL_LIGHTS_COUNT;
+    float offset = 0.1f;
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            for (size_t i = 0; i < count; i += 16) {
+                spheres[i + FScene::DIRECTIONAL_LIGHTS_COUNT].y += offset;
+            }
+            offset = -offset;
+            utils::ArenaScope<LinearAllocatorArena> frame(*arena);
+            froxelizer->prepare(*engine, engine->getDriverApi(), frame, { 0, 0, 1920, 960 },
+                    camera.projection, camera.zn, camera.zf, camera, lights);
+            froxelizer->froxelizeLights(*engine, camera, lights);
+            // releases the froxel and record buffers prepare() allocated in the command stream
+            engine->flush();
+        }
+        benchmark::ClobberMemory();
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * count);
+    }
+}
+
+BENCHMARK_REGISTER_F(FroxelizerFixture, froxelizeLightsIncremental)
+        ->Arg(64)->Arg(256)->UseRealTime();
+
+// ------------------------------------------------------------------------------------------------
+
+// Command buffers flushed by this thread and executed by another one, as the engine and driver
+// threads do. The argument is the size of each command buffer, i.e. the smaller it is, the more
+// often command buffers are flushed. Reports the average latency between flush() and the
+// consumer receiving the command buffer, in nanoseconds.
+class CommandBufferQueueFixture : public benchmark::Fixture {
+protected:
+    using Clock = std::chrono::steady_clock;
+
+    std::unique_ptr<backend::CommandBufferQueue> queue;
+    std::thread consumer;
+    std::atomic<int64_t> totalLatency = { 0 };
+    std::atomic<size_t> received = { 0 };
+
+public:
+    void SetUp(benchmark::State& state) override {
+        queue.reset(new backend::CommandBufferQueue(
+                CONFIG_MIN_COMMAND_BUFFERS_SIZE, CONFIG_COMMAND_BUFFERS_SIZE));
+        totalLatency = 0;
+        received = 0;
+        consumer = std::thread([this]() {
+            backend::CommandBufferQueue& q = *queue;
+            while (size_t count = q.waitForCommands()) {
+                while (count--) {
+                    // each command buffer starts with the time it was flushed at
+                    backend::CommandBufferQueue::Slice const& slice = q.front();
+                    const int64_t flushed = *static_cast<int64_t const*>(slice.begin);
+                    const int64_t now = Clock::now().time_since_epoch().count();
+                    q.releaseBuffer(slice);
+                    totalLatency.fetch_add(now - flushed, std::memory_order_relaxed);
+                    received.fetch_add(1, std::memory_order_release);
+                }
+            }
+        });
+    }
+
+    void TearDown(benchmark::State& state) override {
+        queue->requestExit();
+        consumer.join();
+        queue.reset();
+    }
+};
+
+BENCHMARK_DEFINE_F(CommandBufferQueueFixture, flush)(benchmark::State& state) {
+    const size_t size = size_t(state.range(0));
+    backend::CircularBuffer& buffer = queue->getCircularBuffer();
+    for (auto _ : state) {
+        // the commands themselves aren't written, only the time stamp
+        int64_t* const stamp = static_cast<int64_t*>(buffer.allocate(size));
+        *stamp = Clock::now().time_since_epoch().count();
+        queue->flush();
+    }
+
+    // wait for the consumer to receive everything, so that the latency covers all command buffers
+    const size_t count = size_t(state.iterations());
+    while (received.load(std::memory_order_acquire) < count) {
+        std::this_thread::yield();
+    }
+    state.counters["latency"] = double(totalLatency.load()) / double(count) *
+            (double(Clock::period::num) * 1e9 / double(Clock::period::den));
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * size);
+}
+
+BENCHMARK_REGISTER_F(CommandBufferQueueFixture, flush)
+        ->Arg(64)->Arg(4 * 1024)->Arg(64 * 1024)->Arg(256 * 1024)->ArgName("size")
+        ->UseRealTime();
@@ -23,6 +23,7 @@
 
 #include <limits>
 
+#include <math/mat3x4.h>
 #include <math/mat4.h>
 #include <math/vec3.h>
 
@@ -112,6 +113,15 @@ public:
      */
     friend Box rigidTransform(Box const& box, const math::mat4f& m) noexcept;
 
+    /**
+     * Computes the bounding box of a box transformed by a rigid transform
+     * @param box the box to transfrom
+     * @param m a 3x4 affine matrix that must be a rigid transform
+     * @return the bounding box of the transformed box.
+     *         Result is undefined if \p m is not a rigid transform
+     */
+    friend Box rigidTransform(Box const& box, const math::mat3x4f& m) noexcept;
+
     /**
      * Computes the bounding box of a box transformed by a rigid transform
      * @param box the box to transfrom
@@ -24,8 +24,12 @@
 #include <backend/Platform.h>
 
 #include <utils/compiler.h>
+#include <utils/CString.h>
 #include <utils/EntityManager.h>
 
+#include <stddef.h>
+#include <stdint.h>
+
 namespace filament {
 
 class Camera;
@@ -341,6 +345,129 @@ public:
      */
     void* streamAlloc(size_t size, size_t alignment = alignof(double)) noexcept;
 
+    /**
+     * Enables or disables automatic instancing of renderables.
+     *
+     * When enabled, consecutive draws of the same geometry (i.e. same VertexBuffer, IndexBuffer
+     * and range) with the same MaterialInstance are merged into a single instanced draw call,
+     * which greatly reduces the CPU overhead of scenes containing many copies of an object.
+     * Skinned renderables are never instanced.
+     *
+     * Automatic instancing is disabled by default.
+     *
+     * @param enable true to enable automatic instancing, false to disable it.
+     */
+    void setAutomaticInstancingEnabled(bool enable) noexcept;
+
+    /**
+     * @return true if automatic instancing is enabled, false otherwise.
+     */
+    bool isAutomaticInstancingEnabled() const noexcept;
+
+    /**
+     * Statistics about the command buffer, for the last frame.
+     * @see getCommandBufferStatistics()
+     */
+    struct CommandBufferStatistics {
+        //! Size in bytes of the commands recorded during the frame.
+        size_t frameSize = 0;
+        //! Largest number of bytes of the command buffer in use during the frame.
+        size_t highWatermark = 0;
+        //! Size in bytes of the command buffer.
+        size_t capacity = 0;
+        //! Number of times the calling thread waited for space in the command buffer.
+        uint32_t stallCount = 0;
+        //! Total time in nanoseconds the calling thread waited for space in the command buffer.
+        uint64_t stallTime = 0;
+    };
+
+    /**
+     * Returns statistics about the command buffer for the last frame, i.e. the commands flushed
+     * since the previous call to Renderer::endFrame() and up to the last one.
+     *
+     * The calling thread stalls when the render thread is too far behind and the command buffer
+     * is full. A high watermark close to the capacity, or stalls, mean the command buffer is too
+     * small for the frames, see setCommandBufferGrowthEnabled().
+     *
+     * @return The command buffer statistics of the last frame.
+     */
+    CommandBufferStatistics getCommandBufferStatistics() const noexcept;
+
+    /**
+     * Enables or disables the growth of the command buffer.
+     *
+     * When enabled, instead of waiting for the render thread to free some space in the command
+     * buffer, the command buffer's size is doubled, up to a fixed limit. The memory of the
+     * previous command buffer is freed once the render thread is done with it.
+     *
+     * Growth is disabled by default.
+     *
+     * @param enable true to enable the growth of the command buffer, false to disable it.
+     */
+    void setCommandBufferGrowthEnabled(bool enable) noexcept;
+
+    /**
+     * @return true if the command buffer can grow, false otherwise.
+     */
+    bool isCommandBufferGrowthEnabled() const noexcept;
+
+    /**
+     * Captures the backend commands of the next frames into a file, for offline analysis.
+     *
+     * The capture starts with the next command and ends after the frameCount-th
+     * Renderer::endFrame(). It contains every backend command along with the content of the
+     * buffers it uploads, and can be replayed on any backend, including Backend::NOOP, with the
+     * cmdreplay tool.
+     *
+     * The commands using an object created before the capture started can't be replayed and are
+     * skipped, so the capture should start before the scene's resources are created (e.g. right
+     * after Engine::create()) for a complete replay.
+     *
+     * @param path          Path of the capture file, which is overwritten.
+     * @param frameCount    Number of frames to capture, must be at least 1.
+     *
+     * @return false if the capture file couldn't be created.
+     */
+    bool startCommandCapture(const char* path, uint32_t frameCount = 1) noexcept;
+
+    /**
+     * Enables or disables the profiling of the backend commands.
+     *
+     * When enabled, the backend measures the CPU time spent executing each command, and
+     * aggregates the call count, total and maximum time and payload size of each backend
+     * method over a frame, see getCommandProfileAsJson(). Profiling is disabled by default,
+     * and costs nothing when disabled. The setting applies to the commands issued after the call.
+     *
+     * @param enable true to enable the profiling, false to disable it.
+     */
+    void setCommandProfilingEnabled(bool enable) noexcept;
+
+    /**
+     * @return true if the backend commands are profiled, false otherwise.
+     */
+    bool isCommandProfilingEnabled() const noexcept;
+
+    /**
+     * Returns the profile of the last frame fully executed by the backend as a JSON object,
+     * for instance:
+     *
+     * ~~~~~~~~~~~{.json}
+     * { "frame": 42, "commands": {
+     *     "draw": { "count": 120, "totalTime": 843000, "maxTime": 31000, "payloadSize": 7680 },
+     *     ... } }
+     * ~~~~~~~~~~~
+     *
+     * Times are in nanoseconds and sizes in bytes. The payload size of a command includes the
+     * buffers it uploads. The methods which weren't called during the frame are omitted.
+     *
+     * Because the backend runs asynchronously, this frame is usually a few frames behind the
+     * last Renderer::endFrame().
+     *
+     * @return A JSON object, without commands if no frame was profiled yet.
+     * @see setCommandProfilingEnabled()
+     */
+    utils::CString getCommandProfileAsJson() const;
+
 
     /**
      * helper for creating an Entity and Camera component in one call
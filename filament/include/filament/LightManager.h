@@ -232,6 +232,104 @@ public:
          * Setting this value correctly is essential for LISPSM shadow-maps.
          */
         float polygonOffsetSlope = 2.0f;
+
+        /**
+         * Number of shadow cascades to use for this light. Must be between 1 and 4 (inclusive).
+         * A value greater than 1 turns on cascaded shadow maps. Only applicable to SUN or
+         * DIRECTIONAL lights. Each cascade is a layer of the shadow map and renders the shadow
+         * casters of a slice of the view frustum, which improves the resolution of the shadows
+         * close to the camera.
+         *
+         * When using shadow cascades, cascadeSplitPositions must also be set.
+         *
+         * @see ShadowOptions::cascadeSplitPositions
+         */
+        uint8_t shadowCascades = 1;
+
+        /**
+         * The split positions for shadow cascades.
+         *
+         * Cascaded shadow mapping (CSM) partitions the camera frustum into cascades. These values
+         * determine the planes along the camera's Z axis to split the frustum. The camera near
+         * plane is represented by 0.0f and the far plane (or shadowFar when set) by 1.0f.
+         *
+         * For example, if using 4 cascades, these values would set a uniform split scheme:
+         * { 0.25f, 0.50f, 0.75f }
+         *
+         * For N cascades, N - 1 split positions will be read from this array, they must be in
+         * increasing order.
+         *
+         * Filament provides utility methods inside LightManager::ShadowCascades to help set
+         * these values. For example, to use a uniform split scheme:
+         *
+         * ~~~~~~~~~~~{.cpp}
+         *   LightManager::ShadowCascades::computeUniformSplits(options.cascadeSplitPositions, 4);
+         * ~~~~~~~~~~~
+         *
+         * @see ShadowCascades::computeUniformSplits
+         * @see ShadowCascades::computeLogSplits
+         * @see ShadowCascades::computePracticalSplits
+         */
+        float cascadeSplitPositions[3] = { 0.25f, 0.50f, 0.75f };
+
+        /**
+         * Whether the static shadow casters are rendered once in a persistent shadow map. Only
+         * applicable to SUN or DIRECTIONAL lights.
+         *
+         * The Renderables built with RenderableManager::Builder::staticShadowCaster() are only
+         * rendered again when the light's projection changes (e.g. the light's direction, or the
+         * camera moved the shadow map) or when one of them changed (e.g. its transform). Every
+         * frame, the persistent map is copied in the shadow map and only the other shadow casters
+         * are rendered on top of it.
+         *
+         * This is most effective with stable shadows and a camera that doesn't move much. It is
+         * ignored on backends that can't copy depth buffers.
+         *
+         * @see ShadowOptions::stable
+         */
+        bool cacheStaticCasters = false;
+    };
+
+    /**
+     * Helpers to compute LightManager::ShadowOptions::cascadeSplitPositions.
+     *
+     * Each method writes cascades - 1 split positions, normalized between the camera near
+     * plane (0.0f) and far plane (1.0f). 'near' and 'far' are the distances, in world units,
+     * covered by the cascades.
+     */
+    struct ShadowCascades {
+        /**
+         * Splits the frustum in cascades of equal depth.
+         *
+         * @param splitPositions    an array of at least cascades - 1 floats
+         * @param cascades          the number of shadow cascades, at most 4
+         */
+        static void computeUniformSplits(float* splitPositions, uint8_t cascades) noexcept;
+
+        /**
+         * Splits the frustum logarithmically, which keeps the ratio between the shadow map
+         * resolution and the on-screen resolution constant, but makes the first cascades small.
+         *
+         * @param splitPositions    an array of at least cascades - 1 floats
+         * @param cascades          the number of shadow cascades, at most 4
+         * @param near              the camera near plane
+         * @param far               the distance covered by the cascades (e.g. shadowFar)
+         */
+        static void computeLogSplits(float* splitPositions, uint8_t cascades,
+                float near, float far) noexcept;
+
+        /**
+         * Blends the logarithmic and uniform splits, this is the "practical split scheme" of
+         * Zhang et al., 2006, "Parallel-Split Shadow Maps for Large-scale Virtual Environments".
+         *
+         * @param splitPositions    an array of at least cascades - 1 floats
+         * @param cascades          the number of shadow cascades, at most 4
+         * @param near              the camera near plane
+         * @param far               the distance covered by the cascades (e.g. shadowFar)
+         * @param lambda            0.0f for the uniform splits, 1.0f for the logarithmic splits
+         */
+        static void computePracticalSplits(float* splitPositions, uint8_t cascades,
+                float near, float far, float lambda) noexcept;
     };
 
     //! Use Builder to construct a Light object instance
@@ -257,8 +355,11 @@ public:
          *
          * @return This Builder, for chaining calls.
          *
-         * @warning
-         * - Only a Type.DIRECTIONAL or Type.SUN light can cast shadows
+         * Point and spot lights share a shadow atlas, where the lights that appear the largest on
+         * screen get the most resolution, up to ShadowOptions::mapSize. A point light, or a spot
+         * light whose outer cone angle exceeds 60 degrees, uses six times as much space as a
+         * narrower spot light.
+         * When the atlas is full, the lights that appear the smallest don't cast shadows.
          */
         Builder& castShadows(bool enable) noexcept;
 
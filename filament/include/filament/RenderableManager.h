@@ -49,6 +49,9 @@ public:
     using Instance = utils::EntityInstance<RenderableManager>;
     using PrimitiveType = backend::PrimitiveType;
 
+    // maximum number of levels of detail of a Renderable, see Builder::level()
+    static constexpr size_t MAX_LEVEL_COUNT = 4;
+
     bool hasComponent(utils::Entity e) const noexcept;
 
     Instance getInstance(utils::Entity e) const noexcept;
@@ -59,6 +62,20 @@ public:
         float reserved = 0;
     };
 
+    /**
+     * How the bones of a skinned Renderable are stored on the GPU, see Builder::boneFormat().
+     */
+    enum class BoneFormat : uint8_t {
+        //! A rotation, a translation and non-uniform scales, 64 bytes per bone.
+        QUATERNION_SCALE,
+        /**
+         * A unit dual quaternion, 32 bytes per bone. The scales of the bones are dropped, and
+         * the vertices are skinned with dual quaternion blending, which preserves the volume
+         * around the joints.
+         */
+        DUAL_QUATERNION
+    };
+
     class Builder : public BuilderBase<BuilderDetails> {
         friend struct BuilderDetails;
     public:
@@ -83,13 +100,45 @@ public:
         Builder& culling(bool enable) noexcept; // true by default
         Builder& castShadows(bool enable) noexcept; // false by default
         Builder& receiveShadows(bool enable) noexcept; // true by default
+        // A static shadow caster rarely moves, see LightManager::ShadowOptions::cacheStaticCasters
+        Builder& staticShadowCaster(bool enable) noexcept; // false by default
         Builder& skinning(size_t boneCount) noexcept; // 0 by default, 255 max
         Builder& skinning(size_t boneCount, Bone const* bones) noexcept;
         Builder& skinning(size_t boneCount, math::mat4f const* transforms) noexcept;
+        // Halves the memory and bandwidth of rigid skeletons, see BoneFormat.
+        Builder& boneFormat(BoneFormat format) noexcept; // QUATERNION_SCALE by default
+
+        /**
+         * Sets a simplified mesh of this Renderable, used to hide other Renderables behind it
+         * when View::setOcclusionCullingEnabled() is set.
+         *
+         * The mesh is an indexed triangle list in the Renderable's local space. It is rasterized
+         * on the CPU, so it should have few triangles, and it must be fully contained in the
+         * Renderable's actual geometry. The arrays are copied during build().
+         */
+        Builder& occluder(math::float3 const* vertices, size_t vertexCount,
+                uint16_t const* indices, size_t indexCount) noexcept;
 
         // Sets an ordering index for blended primitives that all live at the same Z value.
         Builder& blendOrder(size_t index, uint16_t order) noexcept; // 0 by default
 
+        /**
+         * Assigns the primitive at 'index' to a level of detail, 0 (the most detailed) by default.
+         *
+         * Only the primitives of one level are drawn at a time, chosen by the View from the
+         * projected size of the Renderable (see levelScreenSize()). Each level must be a range of
+         * consecutive primitives, levels must be in increasing order starting at 0, and there are
+         * at most MAX_LEVEL_COUNT levels. Primitive indices used by RenderableManager span all
+         * levels, in the order they're given here.
+         */
+        Builder& level(size_t index, uint8_t level) noexcept;
+
+        /**
+         * Sets the size in pixels, on the screen, of the Renderable's bounding box under which
+         * 'level' is replaced by the next level of detail. By default a level is never replaced.
+         */
+        Builder& levelScreenSize(uint8_t level, float pixels) noexcept;
+
         /**
          * Adds the Renderable component to an entity.
          *
@@ -124,6 +173,7 @@ public:
             MaterialInstance const* materialInstance = nullptr;
             PrimitiveType type = PrimitiveType::TRIANGLES;
             uint16_t blendOrder = 0;
+            uint8_t level = 0;
         };
     };
 
@@ -138,11 +188,14 @@ public:
     void setPriority(Instance instance, uint8_t priority) noexcept;
     void setCastShadows(Instance instance, bool enable) noexcept;
     void setReceiveShadows(Instance instance, bool enable) noexcept;
+    void setStaticShadowCaster(Instance instance, bool enable) noexcept;
     bool isShadowCaster(Instance instance) const noexcept;
     bool isShadowReceiver(Instance instance) const noexcept;
+    bool isStaticShadowCaster(Instance instance) const noexcept;
 
     // Updates the bone transforms in the range [offset, offset + boneCount).
-    // The bones must be pre-allocated using Builder::skinning().
+    // The bones must be pre-allocated using Builder::skinning(). The bones of all the
+    // Renderables are uploaded together, once per frame.
     void setBones(Instance instance, Bone const* transforms, size_t boneCount = 1, size_t offset = 0) noexcept;
     void setBones(Instance instance, math::mat4f const* transforms, size_t boneCount = 1, size_t offset = 0) noexcept;
 
@@ -150,7 +203,7 @@ public:
     // getters...
     const Box& getAxisAlignedBoundingBox(Instance instance) const noexcept;
 
-    // number of render primitives in this renderable
+    // number of render primitives in this renderable, of all levels of detail
     size_t getPrimitiveCount(Instance instance) const noexcept;
 
     // set/change the material of a given render primitive
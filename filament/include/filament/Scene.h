@@ -129,6 +129,27 @@ public:
      * @return Whether the given entity is in the Scene.
      */
     bool hasEntity(utils::Entity entity) const noexcept;
+
+    /**
+     * Enables or disables hierarchical culling.
+     *
+     * When enabled, a bounding volume hierarchy is built over the world-space bounding boxes
+     * of the Scene's renderables, and used to reject whole groups of renderables during frustum
+     * culling. The hierarchy is refit when renderables move and is rebuilt when renderables
+     * are added or removed, which makes this mostly useful for large, mostly static, scenes.
+     *
+     * Hierarchical culling is disabled by default.
+     *
+     * @param enabled true to enable hierarchical culling, false to disable it.
+     */
+    void setHierarchicalCullingEnabled(bool enabled) noexcept;
+
+    /**
+     * Returns whether hierarchical culling is enabled.
+     *
+     * @return true if hierarchical culling is enabled, false otherwise.
+     */
+    bool isHierarchicalCullingEnabled() const noexcept;
 };
 
 } // namespace filament
@@ -139,7 +139,9 @@ public:
     /**
      * Sets a local transform of a transform component.
      * @param ci              The instance of the transform component to set the local transform to.
-     * @param localTransform  The local transform (i.e. relative to the parent).
+     * @param localTransform  The local transform (i.e. relative to the parent). It must be
+     *                        affine, i.e. its last row must be (0, 0, 0, 1), only its first
+     *                        three rows are kept.
      * @see getTransform()
      * @attention This operation can be slow if the hierarchy of transform is too deep, and this
      *            will be particularly bad when updating a lot of transforms. In that case,
@@ -154,7 +156,7 @@ public:
      *         returns the value set by setTransform().
      * @see setTransform()
      */
-    const math::mat4f& getTransform(Instance ci) const noexcept;
+    math::mat4f getTransform(Instance ci) const noexcept;
 
     /**
      * Return the world transform of a transform component.
@@ -164,7 +166,7 @@ public:
      *         transform.
      * @see setTransform()
      */
-    const math::mat4f& getWorldTransform(Instance ci) const noexcept;
+    math::mat4f getWorldTransform(Instance ci) const noexcept;
 
     /**
      * Opens a local transform transaction. During a transaction, getWorldTransform() can
@@ -184,6 +186,15 @@ public:
      * Commits the currently open local transform transaction. When this returns, calls
      * to getWorldTransform() will return the proper value.
      *
+     * Only the world transforms of the components whose local transform was set during the
+     * transaction, and of their descendants, are computed. They're computed one level of the
+     * hierarchy at a time, using several threads for the levels that have many components.
+     * This must be called from the thread that created the Engine.
+     *
+     * @attention If the hierarchy changed since the last transaction (e.g. components were
+     *            created, destroyed or re-parented), the components are sorted by depth, which
+     *            invalidates all the Instances of this manager.
+     *
      * @attention failing to call this method when done updating the local transform will cause
      *            a lot of rendering problems. The system never closes the transaction
      *            automatically.
@@ -238,6 +238,28 @@ public:
      */
     void setDepthPrepass(DepthPrepass prepass) noexcept;
 
+    /**
+     * Enables or disables caching of the rendering commands across frames.
+     *
+     * When enabled, the sorted rendering commands of a frame are kept and reused by the next
+     * one if the camera and the visible renderables didn't change. If only a few renderables
+     * changed, only their commands are regenerated. This is useful for mostly static content,
+     * e.g. a product viewer, but it adds a copy of all the commands to each frame, which is
+     * wasted when the camera moves continuously.
+     *
+     * Command caching is disabled by default.
+     *
+     * @param enabled true to enable command caching, false to disable it.
+     */
+    void setCommandCachingEnabled(bool enabled) noexcept;
+
+    /**
+     * Returns whether command caching is enabled.
+     *
+     * @return true if command caching is enabled, false otherwise.
+     */
+    bool isCommandCachingEnabled() const noexcept;
+
     /**
      * Sets the View's name. Only useful for debugging.
      * @param name Pointer to the View's name. The string is copied.
@@ -581,6 +603,48 @@ public:
      */
     bool isFrontFaceWindingInverted() const noexcept;
 
+    /**
+     * Enables or disables occlusion culling.
+     *
+     * When enabled, the occluder meshes of the visible renderables (see
+     * RenderableManager::Builder::occluder()) are rasterized on the CPU into a low resolution
+     * depth buffer, and renderables hidden behind them are not drawn. Shadow casters are not
+     * affected.
+     *
+     * Occlusion culling is disabled by default.
+     *
+     * @param enabled true to enable occlusion culling, false to disable it.
+     */
+    void setOcclusionCullingEnabled(bool enabled) noexcept;
+
+    /**
+     * Returns whether occlusion culling is enabled.
+     *
+     * @return true if occlusion culling is enabled, false otherwise.
+     */
+    bool isOcclusionCullingEnabled() const noexcept;
+
+    /**
+     * Sets the size in pixels, on the screen, under which renderables are not drawn.
+     *
+     * The size of a renderable is the projected diameter of its bounding box. The same size
+     * selects the level of detail of renderables that have several (see
+     * RenderableManager::Builder::level()). Renderables with culling disabled are never culled,
+     * and shadow casters still cast shadows.
+     *
+     * The default is 0, i.e. renderables are never culled because of their size.
+     *
+     * @param pixels minimum size of a visible renderable, in pixels.
+     */
+    void setScreenSizeCullingThreshold(float pixels) noexcept;
+
+    /**
+     * Returns the size in pixels under which renderables are not drawn.
+     *
+     * @return the minimum size of a visible renderable, in pixels.
+     */
+    float getScreenSizeCullingThreshold() const noexcept;
+
     // for debugging...
 
     //! debugging: allows to entirely disable frustum culling. (culling enabled by default).
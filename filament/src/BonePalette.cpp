@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/BonePalette.h"
+
+#include "private/backend/DriverApi.h"
+
+#include <utils/compiler.h>
+
+#include <algorithm>
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace filament::backend;
+
+namespace filament {
+namespace details {
+
+BonePalette::BonePalette() noexcept = default;
+
+BonePalette::~BonePalette() noexcept {
+    assert(!mHandle);
+}
+
+void BonePalette::terminate(DriverApi& driver) noexcept {
+    if (mHandle) {
+        driver.destroyUniformBuffer(mHandle);
+        mHandle.clear();
+    }
+}
+
+uint32_t BonePalette::allocate(uint32_t size) noexcept {
+    size = align(size);
+    auto pos = std::find_if(mFreeRanges.begin(), mFreeRanges.end(),
+            [size](Range const& range) { return range.size >= size; });
+    if (pos != mFreeRanges.end()) {
+        const uint32_t offset = pos->offset;
+        pos->offset += size;
+        pos->size -= size;
+        if (!pos->size) {
+            mFreeRanges.erase(pos);
+        }
+        return offset;
+    }
+    const uint32_t offset = uint32_t(mData.size());
+    mData.resize(offset + size);
+    return offset;
+}
+
+void BonePalette::free(uint32_t offset, uint32_t size) noexcept {
+    size = align(size);
+    assert(offset + size <= mData.size());
+
+    auto pos = std::lower_bound(mFreeRanges.begin(), mFreeRanges.end(), offset,
+            [](Range const& range, uint32_t offset) { return range.offset < offset; });
+
+    // merge with the next free range
+    if (pos != mFreeRanges.end() && offset + size == pos->offset) {
+        pos->offset = offset;
+        pos->size += size;
+    } else {
+        pos = mFreeRanges.insert(pos, { offset, size });
+    }
+
+    // merge with the previous free range
+    if (pos != mFreeRanges.begin()) {
+        auto prev = pos - 1;
+        if (prev->offset + prev->size == pos->offset) {
+            prev->size += pos->size;
+            pos = mFreeRanges.erase(pos) - 1;
+        }
+    }
+
+    // a free range at the end of the palette just shrinks it
+    if (pos->offset + pos->size == mData.size()) {
+        mData.resize(pos->offset);
+        mFreeRanges.erase(pos);
+    }
+}
+
+void* BonePalette::invalidate(uint32_t offset, uint32_t size) noexcept {
+    assert(offset + size <= mData.size());
+    mDirty = true;
+    return mData.data() + offset;
+}
+
+void BonePalette::commit(DriverApi& driver) noexcept {
+    if (!mDirty) {
+        return;
+    }
+    mDirty = false;
+
+    const uint32_t size = uint32_t(mData.size());
+    if (UTILS_UNLIKELY(size > mCapacity)) {
+        // the draws recorded before this are still using the old buffer, which is destroyed
+        // after them
+        if (mHandle) {
+            driver.destroyUniformBuffer(mHandle);
+        }
+        mCapacity = std::max(size, mCapacity * 2);
+        mHandle = driver.createUniformBuffer(mCapacity + BINDING_SIZE, BufferUsage::DYNAMIC);
+    }
+
+    if (size) {
+        // The palette can be larger than the command stream, so it's uploaded from a copy
+        // that the driver frees once done with it.
+        void* const buffer = ::malloc(size);
+        memcpy(buffer, mData.data(), size);
+        driver.loadUniformBuffer(mHandle, { buffer, size,
+                [](void* buffer, size_t, void*) { ::free(buffer); }});
+    }
+}
+
+} // namespace details
+} // namespace filament
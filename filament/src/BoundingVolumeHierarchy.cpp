@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/BoundingVolumeHierarchy.h"
+
+#include <utils/Systrace.h>
+
+#include <algorithm>
+#include <limits>
+
+using namespace filament::math;
+
+namespace filament {
+namespace details {
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy() noexcept = default;
+
+BoundingVolumeHierarchy::~BoundingVolumeHierarchy() noexcept = default;
+
+float BoundingVolumeHierarchy::area(float3 extent) noexcept {
+    // we only need a quantity proportional to the surface area
+    return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+void BoundingVolumeHierarchy::build(float3 const* center, float3 const* extent, size_t count) {
+    SYSTRACE_CALL();
+
+    mNodes.clear();
+    mLeafFirst.clear();
+    mLeafNodes.clear();
+    mBuildCost = 0.0f;
+
+    mIndices.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        mIndices[i] = i;
+    }
+
+    if (count) {
+        // a binary tree with N/LEAF_SIZE leaves has a bit less than twice as many nodes
+        mNodes.reserve(2 * ((count + LEAF_SIZE - 1) / LEAF_SIZE));
+        buildRecursive(center, extent, 0, uint32_t(count));
+    }
+
+    // store the boxes in tree order, so that each leaf covers a contiguous range that we can
+    // feed directly to Culler::intersects(), which may read up to MODULO entries past the end.
+    mCenters.resize(count + Culler::MODULO);
+    mExtents.resize(count + Culler::MODULO);
+    mSlots.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        const uint32_t index = mIndices[i];
+        mCenters[i] = center[index];
+        mExtents[i] = extent[index];
+        mSlots[index] = i;
+    }
+    std::fill(mCenters.begin() + count, mCenters.end(), float3{});
+    std::fill(mExtents.begin() + count, mExtents.end(), float3{});
+
+    mDirty.assign(mNodes.size(), 0);
+    mCost = mBuildCost;
+}
+
+uint32_t BoundingVolumeHierarchy::buildRecursive(float3 const* center, float3 const* extent,
+        uint32_t first, uint32_t count) {
+    uint32_t* const indices = mIndices.data();
+
+    // bounds of the boxes and bounds of their centers
+    float3 lo(std::numeric_limits<float>::max());
+    float3 hi(std::numeric_limits<float>::lowest());
+    float3 clo(std::numeric_limits<float>::max());
+    float3 chi(std::numeric_limits<float>::lowest());
+    for (uint32_t i = first, e = first + count; i < e; i++) {
+        const float3 c = center[indices[i]];
+        const float3 h = extent[indices[i]];
+        lo = min(lo, c - h);
+        hi = max(hi, c + h);
+        clo = min(clo, c);
+        chi = max(chi, c);
+    }
+
+    const uint32_t index = uint32_t(mNodes.size());
+    mNodes.push_back({});
+    Node node;
+    node.center = (hi + lo) * 0.5f;
+    node.extent = (hi - lo) * 0.5f;
+    node.first = first;
+    node.count = count;
+    mBuildCost += area(node.extent);
+
+    if (count <= LEAF_SIZE) {
+        node.next = index + 1;
+        mNodes[index] = node;
+        mLeafFirst.push_back(first);
+        mLeafNodes.push_back(index);
+        return index;
+    }
+
+    // split at the median of the longest axis of the centers' bounds. This is not as good as
+    // a SAH split, but it's fast, always balanced and works well for culling.
+    const float3 d = chi - clo;
+    const size_t axis = (d.x >= d.y && d.x >= d.z) ? 0 : (d.y >= d.z ? 1 : 2);
+
+    // keep the left side a multiple of LEAF_SIZE, so leaves are as full as possible
+    uint32_t half = count / 2;
+    half = std::max(uint32_t(LEAF_SIZE), uint32_t(half / LEAF_SIZE) * uint32_t(LEAF_SIZE));
+    std::nth_element(indices + first, indices + first + half, indices + first + count,
+            [center, axis](uint32_t lhs, uint32_t rhs) {
+                return center[lhs][axis] < center[rhs][axis];
+            });
+
+    buildRecursive(center, extent, first, half);
+    buildRecursive(center, extent, first + half, count - half);
+
+    node.next = uint32_t(mNodes.size());
+    mNodes[index] = node;
+    return index;
+}
+
+void BoundingVolumeHierarchy::computeLeafBounds(Node& node) const noexcept {
+    float3 lo(std::numeric_limits<float>::max());
+    float3 hi(std::numeric_limits<float>::lowest());
+    float3 const* const UTILS_RESTRICT centers = mCenters.data();
+    float3 const* const UTILS_RESTRICT extents = mExtents.data();
+    for (uint32_t i = node.first, e = node.first + node.count; i < e; i++) {
+        lo = min(lo, centers[i] - extents[i]);
+        hi = max(hi, centers[i] + extents[i]);
+    }
+    node.center = (hi + lo) * 0.5f;
+    node.extent = (hi - lo) * 0.5f;
+}
+
+size_t BoundingVolumeHierarchy::refit(
+        float3 const* center, float3 const* extent, size_t count) noexcept {
+    SYSTRACE_CALL();
+
+    assert(count == mIndices.size());
+
+    // update the boxes and flag the leaves that contain them
+    size_t changed = 0;
+    uint8_t* const UTILS_RESTRICT dirty = mDirty.data();
+    for (uint32_t i = 0; i < count; i++) {
+        const uint32_t slot = mSlots[i];
+        if (any(notEqual(mCenters[slot], center[i])) || any(notEqual(mExtents[slot], extent[i]))) {
+            mCenters[slot] = center[i];
+            mExtents[slot] = extent[i];
+            // leaves are stored in tree order, so we can find ours with a binary search
+            auto pos = std::upper_bound(mLeafFirst.begin(), mLeafFirst.end(), slot);
+            dirty[mLeafNodes[pos - mLeafFirst.begin() - 1]] = 1;
+            changed++;
+        }
+    }
+
+    if (!changed) {
+        return 0;
+    }
+
+    // Propagate the changes bottom-up. Children are always stored after their parent, so
+    // walking the nodes backward guarantees that children are processed first.
+    Node* const nodes = mNodes.data();
+    for (uint32_t i = uint32_t(mNodes.size()); i-- > 0;) {
+        Node& node = nodes[i];
+        if (node.isLeaf(i)) {
+            if (dirty[i]) {
+                mCost -= area(node.extent);
+                computeLeafBounds(node);
+                mCost += area(node.extent);
+            }
+        } else {
+            // the left child immediately follows its parent, the right child follows the
+            // left subtree.
+            const uint32_t l = i + 1;
+            const uint32_t r = nodes[l].next;
+            if (dirty[l] | dirty[r]) {
+                const float3 lo = min(nodes[l].center - nodes[l].extent,
+                                      nodes[r].center - nodes[r].extent);
+                const float3 hi = max(nodes[l].center + nodes[l].extent,
+                                      nodes[r].center + nodes[r].extent);
+                mCost -= area(node.extent);
+                node.center = (hi + lo) * 0.5f;
+                node.extent = (hi - lo) * 0.5f;
+                mCost += area(node.extent);
+                dirty[i] = 1;
+            }
+            dirty[l] = 0;
+            dirty[r] = 0;
+        }
+    }
+    dirty[0] = 0;
+
+    return changed;
+}
+
+void BoundingVolumeHierarchy::remap(uint32_t const* map) noexcept {
+    // mIndices is only used by cull() once the tree is built
+    uint32_t* const UTILS_RESTRICT indices = mIndices.data();
+    uint32_t const* const UTILS_RESTRICT slots = mSlots.data();
+    for (size_t i = 0, c = mSlots.size(); i < c; i++) {
+        indices[slots[i]] = map[i];
+    }
+}
+
+void BoundingVolumeHierarchy::cull(Culler::result_type* UTILS_RESTRICT results,
+        Frustum const& frustum, size_t bit) const noexcept {
+    SYSTRACE_CALL();
+
+    float4 const* const UTILS_RESTRICT planes = frustum.getNormalizedPlanes();
+    Node const* const UTILS_RESTRICT nodes = mNodes.data();
+    uint32_t const* const UTILS_RESTRICT indices = mIndices.data();
+    const Culler::result_type visible = Culler::result_type(1u << bit);
+
+    Culler::result_type leafResults[LEAF_SIZE];
+
+    for (uint32_t i = 0, c = uint32_t(mNodes.size()); i < c;) {
+        Node const& node = nodes[i];
+
+        // classify the node's box w.r.t. each plane: 'outside' if it's entirely on the
+        // outer side of any plane, 'inside' if it's on the inner side of all of them.
+        bool outside = false;
+        bool inside = true;
+        #pragma clang loop unroll(full)
+        for (size_t j = 0; j < 6; j++) {
+            const float d = dot(planes[j].xyz, node.center) + planes[j].w;
+            const float r = dot(abs(planes[j].xyz), node.extent);
+            outside |= (d - r) >= 0.0f;
+            inside &= (d + r) < 0.0f;
+        }
+
+        if (outside) {
+            // skip this whole subtree
+            i = node.next;
+            continue;
+        }
+
+        if (inside) {
+            // this whole subtree is visible
+            for (uint32_t k = node.first, e = node.first + node.count; k < e; k++) {
+                results[indices[k]] |= visible;
+            }
+            i = node.next;
+            continue;
+        }
+
+        if (node.isLeaf(i)) {
+            // partially visible leaf, test each box
+            std::fill_n(leafResults, Culler::round(node.count), 0);
+            Culler::intersects(leafResults, frustum,
+                    mCenters.data() + node.first, mExtents.data() + node.first, node.count, bit);
+            for (uint32_t k = 0; k < node.count; k++) {
+                results[indices[node.first + k]] |= leafResults[k];
+            }
+        }
+
+        // go to the next node, for inner nodes this is the left child
+        i++;
+    }
+}
+
+} // namespace details
+} // namespace filament
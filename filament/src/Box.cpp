@@ -25,6 +25,11 @@ Box rigidTransform(Box const& UTILS_RESTRICT box, const mat4f& UTILS_RESTRICT m)
     return { u * box.center + m[3].xyz, abs(u) * box.halfExtent };
 }
 
+Box rigidTransform(Box const& UTILS_RESTRICT box, const mat3x4f& UTILS_RESTRICT m) noexcept {
+    const mat3f u(m.upperLeft());
+    return { u * box.center + m[3], abs(u) * box.halfExtent };
+}
+
 Box rigidTransform(Box const& UTILS_RESTRICT box, const mat3f& UTILS_RESTRICT u) noexcept {
     return { u * box.center, abs(u) * box.halfExtent };
 }
@@ -171,7 +171,7 @@ void FCamera::lookAt(const float3& eye, const float3& center, const float3& up)
     setModelMatrix(mat4f::lookAt(eye, center, up));
 }
 
-mat4f const& FCamera::getModelMatrix() const noexcept {
+mat4f FCamera::getModelMatrix() const noexcept {
     FTransformManager const& transformManager = mEngine.getTransformManager();
     return transformManager.getWorldTransform(transformManager.getInstance(mEntity));
 }
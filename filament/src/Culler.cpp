@@ -18,23 +18,59 @@
 
 #include <math/fast.h>
 
+#include <algorithm>
+
+#include <assert.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#   define FILAMENT_CULLER_HAS_SSE2 1
+#   include <emmintrin.h>
+#   if (defined(__i386__) || defined(__x86_64__)) && !defined(_MSC_VER)
+        // AVX2 and AVX-512 kernels are compiled with target attributes and selected at runtime
+#       define FILAMENT_CULLER_HAS_AVX 1
+#       include <immintrin.h>
+#   endif
+#endif
+
+#if defined(__ARM_NEON)
+#   define FILAMENT_CULLER_HAS_NEON 1
+#   include <arm_neon.h>
+#endif
+
 using namespace filament::math;
 
 namespace filament {
 namespace details {
 
-void Culler::intersects(
+namespace {
+
+using result_type = Culler::result_type;
+
+// 'count' is always a multiple of Culler::MODULO
+using BoxKernel = void(*)(result_type* results, float4 const* planes,
+        float3 const* center, float3 const* extent, size_t count, size_t bit);
+
+using SphereKernel = void(*)(result_type* results, float4 const* planes,
+        float4 const* b, size_t count);
+
+struct Kernels {
+    BoxKernel boxes;
+    SphereKernel spheres;
+};
+
+// ------------------------------------------------------------------------------------------------
+// Scalar
+// ------------------------------------------------------------------------------------------------
+
+void spheresScalar(
         result_type* UTILS_RESTRICT results,
-        Frustum const& UTILS_RESTRICT frustum,
+        float4 const* UTILS_RESTRICT planes,
         float4 const* UTILS_RESTRICT b,
         size_t count) noexcept {
 
-    float4 const * const UTILS_RESTRICT planes = frustum.mPlanes;
-
     // we use a vectorize width of 8 because, on ARMv8 it allow the compiler to write 8
     // 8-bits results in one go. Without this it has to do 4 separate byte writes, which
     // ends-up being slower.
-    count = round(count); // capacity guaranteed to be multiple of 8
     #pragma clang loop vectorize_width(8)
     for (size_t i = 0; i < count; i++) {
         int visible = ~0;
@@ -54,19 +90,16 @@ void Culler::intersects(
     }
 }
 
-void Culler::intersects(
+void boxesScalar(
         result_type* UTILS_RESTRICT results,
-        Frustum const& UTILS_RESTRICT frustum,
+        float4 const* UTILS_RESTRICT planes,
         float3 const* UTILS_RESTRICT center,
         float3 const* UTILS_RESTRICT extent,
         size_t count, size_t bit) noexcept {
 
-    float4 const * UTILS_RESTRICT const planes = frustum.mPlanes;
-
     // we use a vectorize width of 8 because, on ARMv8 it allows the compiler to write eight
     // 8-bits results in one go. Without this it has to do 4 separate byte writes, which
     // ends-up being slower.
-    count = round(count); // capacity guaranteed to be multiple of 8
     #pragma clang loop vectorize_width(8)
     for (size_t i = 0; i < count; i++) {
         int visible = ~0;
@@ -88,6 +121,496 @@ void Culler::intersects(
     }
 }
 
+// The SIMD kernels below compute exactly the same expressions, in the same order, as the
+// scalar ones (in particular they don't use FMAs), so all kernels return identical results.
+// The visibility of an element is the sign bit of the AND of its six plane distances.
+
+// ------------------------------------------------------------------------------------------------
+// SSE2
+// ------------------------------------------------------------------------------------------------
+
+#if defined(FILAMENT_CULLER_HAS_SSE2)
+
+// loads 4 consecutive float3 and transposes them to x, y and z vectors
+inline void load4(float3 const* p, __m128& x, __m128& y, __m128& z) noexcept {
+    float const* f = &p->x;
+    const __m128 a = _mm_loadu_ps(f);       // x0 y0 z0 x1
+    const __m128 b = _mm_loadu_ps(f + 4);   // y1 z1 x2 y2
+    const __m128 c = _mm_loadu_ps(f + 8);   // z2 x3 y3 z3
+    const __m128 bc = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 3, 2));
+    const __m128 ab = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1));
+    const __m128 bb = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3));
+    const __m128 az = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2));
+    const __m128 cz = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0));
+    x = _mm_shuffle_ps(a, bc, _MM_SHUFFLE(3, 0, 3, 0));
+    y = _mm_shuffle_ps(ab, bb, _MM_SHUFFLE(2, 0, 2, 0));
+    z = _mm_shuffle_ps(az, cz, _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+// returns 'value' in each lane whose sign bit is set, 0 otherwise
+inline __m128i select(__m128 visible, __m128i value) noexcept {
+    return _mm_and_si128(_mm_srai_epi32(_mm_castps_si128(visible), 31), value);
+}
+
+// narrows two vectors of 4 results to 8 bytes, in the low half of the returned vector
+inline __m128i pack8(__m128i lo, __m128i hi) noexcept {
+    const __m128i r = _mm_packs_epi32(lo, hi);
+    return _mm_packus_epi16(r, r);
+}
+
+__m128 boxVisibility(float4 const* planes,
+        __m128 cx, __m128 cy, __m128 cz, __m128 ex, __m128 ey, __m128 ez) noexcept {
+    __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (size_t j = 0; j < 6; j++) {
+        __m128 d = _mm_sub_ps(
+                _mm_mul_ps(_mm_set1_ps(planes[j].x), cx),
+                _mm_mul_ps(_mm_set1_ps(std::abs(planes[j].x)), ex));
+        d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(planes[j].y), cy));
+        d = _mm_sub_ps(d, _mm_mul_ps(_mm_set1_ps(std::abs(planes[j].y)), ey));
+        d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(planes[j].z), cz));
+        d = _mm_sub_ps(d, _mm_mul_ps(_mm_set1_ps(std::abs(planes[j].z)), ez));
+        d = _mm_add_ps(d, _mm_set1_ps(planes[j].w));
+        visible = _mm_and_ps(visible, d);
+    }
+    return visible;
+}
+
+__m128 sphereVisibility(float4 const* planes, float4 const* b) noexcept {
+    __m128 x = _mm_loadu_ps(&b[0].x);
+    __m128 y = _mm_loadu_ps(&b[1].x);
+    __m128 z = _mm_loadu_ps(&b[2].x);
+    __m128 r = _mm_loadu_ps(&b[3].x);
+    _MM_TRANSPOSE4_PS(x, y, z, r);
+    __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (size_t j = 0; j < 6; j++) {
+        __m128 d = _mm_add_ps(
+                _mm_mul_ps(_mm_set1_ps(planes[j].x), x),
+                _mm_mul_ps(_mm_set1_ps(planes[j].y), y));
+        d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(planes[j].z), z));
+        d = _mm_add_ps(d, _mm_set1_ps(planes[j].w));
+        d = _mm_sub_ps(d, r);
+        visible = _mm_and_ps(visible, d);
+    }
+    return visible;
+}
+
+void boxesSSE2(
+        result_type* UTILS_RESTRICT results,
+        float4 const* UTILS_RESTRICT planes,
+        float3 const* UTILS_RESTRICT center,
+        float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+    const __m128i value = _mm_set1_epi32(1 << bit);
+    for (size_t i = 0; i < count; i += 8) {
+        __m128i r[2];
+        for (size_t h = 0; h < 2; h++) {
+            __m128 cx, cy, cz, ex, ey, ez;
+            load4(center + i + h * 4, cx, cy, cz);
+            load4(extent + i + h * 4, ex, ey, ez);
+            r[h] = select(boxVisibility(planes, cx, cy, cz, ex, ey, ez), value);
+        }
+        __m128i* const p = reinterpret_cast<__m128i*>(results + i);
+        _mm_storel_epi64(p, _mm_or_si128(_mm_loadl_epi64(p), pack8(r[0], r[1])));
+    }
+}
+
+void spheresSSE2(
+        result_type* UTILS_RESTRICT results,
+        float4 const* UTILS_RESTRICT planes,
+        float4 const* UTILS_RESTRICT b,
+        size_t count) noexcept {
+    const __m128i value = _mm_set1_epi32(1);
+    for (size_t i = 0; i < count; i += 8) {
+        const __m128i lo = select(sphereVisibility(planes, b + i), value);
+        const __m128i hi = select(sphereVisibility(planes, b + i + 4), value);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(results + i), pack8(lo, hi));
+    }
+}
+
+#endif // FILAMENT_CULLER_HAS_SSE2
+
+// ------------------------------------------------------------------------------------------------
+// AVX2 & AVX-512
+// ------------------------------------------------------------------------------------------------
+
+#if defined(FILAMENT_CULLER_HAS_AVX)
+
+#define FILAMENT_TARGET_AVX2    __attribute__((target("avx2")))
+#define FILAMENT_TARGET_AVX512  __attribute__((target("avx512f")))
+
+FILAMENT_TARGET_AVX2
+inline __m256 combine(__m128 lo, __m128 hi) noexcept {
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+
+FILAMENT_TARGET_AVX2
+inline __m128i pack8(__m256i v) noexcept {
+    return pack8(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+}
+
+FILAMENT_TARGET_AVX2
+void boxesAVX2(
+        result_type* UTILS_RESTRICT results,
+        float4 const* UTILS_RESTRICT planes,
+        float3 const* UTILS_RESTRICT center,
+        float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+    const __m256i value = _mm256_set1_epi32(1 << bit);
+    for (size_t i = 0; i < count; i += 8) {
+        __m128 x0, y0, z0, x1, y1, z1;
+        load4(center + i,     x0, y0, z0);
+        load4(center + i + 4, x1, y1, z1);
+        const __m256 cx = combine(x0, x1), cy = combine(y0, y1), cz = combine(z0, z1);
+        load4(extent + i,     x0, y0, z0);
+        load4(extent + i + 4, x1, y1, z1);
+        const __m256 ex = combine(x0, x1), ey = combine(y0, y1), ez = combine(z0, z1);
+
+        __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (size_t j = 0; j < 6; j++) {
+            __m256 d = _mm256_sub_ps(
+                    _mm256_mul_ps(_mm256_set1_ps(planes[j].x), cx),
+                    _mm256_mul_ps(_mm256_set1_ps(std::abs(planes[j].x)), ex));
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(planes[j].y), cy));
+            d = _mm256_sub_ps(d, _mm256_mul_ps(_mm256_set1_ps(std::abs(planes[j].y)), ey));
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(planes[j].z), cz));
+            d = _mm256_sub_ps(d, _mm256_mul_ps(_mm256_set1_ps(std::abs(planes[j].z)), ez));
+            d = _mm256_add_ps(d, _mm256_set1_ps(planes[j].w));
+            visible = _mm256_and_ps(visible, d);
+        }
+        const __m256i r = _mm256_and_si256(
+                _mm256_srai_epi32(_mm256_castps_si256(visible), 31), value);
+
+        __m128i* const p = reinterpret_cast<__m128i*>(results + i);
+        _mm_storel_epi64(p, _mm_or_si128(_mm_loadl_epi64(p), pack8(r)));
+    }
+}
+
+FILAMENT_TARGET_AVX2
+void spheresAVX2(
+        result_type* UTILS_RESTRICT results,
+        float4 const* UTILS_RESTRICT planes,
+        float4 const* UTILS_RESTRICT b,
+        size_t count) noexcept {
+    const __m256i value = _mm256_set1_epi32(1);
+    for (size_t i = 0; i < count; i += 8) {
+        // two transposes of 4 spheres, one in each 128-bits lane
+        __m256 x = combine(_mm_loadu_ps(&b[i + 0].x), _mm_loadu_ps(&b[i + 4].x));
+        __m256 y = combine(_mm_loadu_ps(&b[i + 1].x), _mm_loadu_ps(&b[i + 5].x));
+        __m256 z = combine(_mm_loadu_ps(&b[i + 2].x), _mm_loadu_ps(&b[i + 6].x));
+        __m256 w = combine(_mm_loadu_ps(&b[i + 3].x), _mm_loadu_ps(&b[i + 7].x));
+        const __m256 t0 = _mm256_unpacklo_ps(x, y);
+        const __m256 t1 = _mm256_unpackhi_ps(x, y);
+        const __m256 t2 = _mm256_unpacklo_ps(z, w);
+        const __m256 t3 = _mm256_unpackhi_ps(z, w);
+        x = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+        y = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        z = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        w = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+
+        __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (size_t j = 0; j < 6; j++) {
+            __m256 d = _mm256_add_ps(
+                    _mm256_mul_ps(_mm256_set1_ps(planes[j].x), x),
+                    _mm256_mul_ps(_mm256_set1_ps(planes[j].y), y));
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(planes[j].z), z));
+            d = _mm256_add_ps(d, _mm256_set1_ps(planes[j].w));
+            d = _mm256_sub_ps(d, w);
+            visible = _mm256_and_ps(visible, d);
+        }
+        const __m256i r = _mm256_and_si256(
+                _mm256_srai_epi32(_mm256_castps_si256(visible), 31), value);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(results + i), pack8(r));
+    }
+}
+
+// Indices to transpose 16 float3 with two _mm512_permutex2var_ps: the first one gathers the
+// elements found in the first 32 floats, the second one the remaining ones.
+alignas(64) constexpr int32_t AOS3_FIRST[3][16] = {
+        { 0, 3, 6,  9, 12, 15, 18, 21, 24, 27, 30,  0,  0,  0,  0,  0 },
+        { 1, 4, 7, 10, 13, 16, 19, 22, 25, 28, 31,  0,  0,  0,  0,  0 },
+        { 2, 5, 8, 11, 14, 17, 20, 23, 26, 29,  0,  0,  0,  0,  0,  0 }};
+alignas(64) constexpr int32_t AOS3_SECOND[3][16] = {
+        { 0, 1, 2,  3,  4,  5,  6,  7,  8,  9, 10, 17, 20, 23, 26, 29 },
+        { 0, 1, 2,  3,  4,  5,  6,  7,  8,  9, 10, 18, 21, 24, 27, 30 },
+        { 0, 1, 2,  3,  4,  5,  6,  7,  8,  9, 16, 19, 22, 25, 28, 31 }};
+
+FILAMENT_TARGET_AVX512
+inline __m512 load16(float const* f, size_t component) noexcept {
+    const __m512 a = _mm512_loadu_ps(f);
+    const __m512 b = _mm512_loadu_ps(f + 16);
+    const __m512 c = _mm512_loadu_ps(f + 32);
+    const __m512 ab = _mm512_permutex2var_ps(a,
+            _mm512_load_si512(AOS3_FIRST[component]), b);
+    return _mm512_permutex2var_ps(ab, _mm512_load_si512(AOS3_SECOND[component]), c);
+}
+
+FILAMENT_TARGET_AVX512
+void boxesAVX512(
+        result_type* UTILS_RESTRICT results,
+        float4 const* UTILS_RESTRICT planes,
+        float3 const* UTILS_RESTRICT center,
+        float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+    const __m512i value = _mm512_set1_epi32(1 << bit);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m512 cx = load16(&center[i].x, 0);
+        const __m512 cy = load16(&center[i].x, 1);
+        const __m512 cz = load16(&center[i].x, 2);
+        const __m512 ex = load16(&extent[i].x, 0);
+        const __m512 ey = load16(&extent[i].x, 1);
+        const __m512 ez = load16(&extent[i].x, 2);
+
+        __m512i visible = _mm512_set1_epi32(-1);
+        for (size_t j = 0; j < 6; j++) {
+            __m512 d = _mm512_sub_ps(
+                    _mm512_mul_ps(_mm512_set1_ps(planes[j].x), cx),
+                    _mm512_mul_ps(_mm512_set1_ps(std::abs(planes[j].x)), ex));
+            d = _mm512_add_ps(d, _mm512_mul_ps(_mm512_set1_ps(planes[j].y), cy));
+            d = _mm512_sub_ps(d, _mm512_mul_ps(_mm512_set1_ps(std::abs(planes[j].y)), ey));
+            d = _mm512_add_ps(d, _mm512_mul_ps(_mm512_set1_ps(planes[j].z), cz));
+            d = _mm512_sub_ps(d, _mm512_mul_ps(_mm512_set1_ps(std::abs(planes[j].z)), ez));
+            d = _mm512_add_ps(d, _mm512_set1_ps(planes[j].w));
+            visible = _mm512_and_si512(visible, _mm512_castps_si512(d));
+        }
+        const __m128i r = _mm512_cvtepi32_epi8(
+                _mm512_and_si512(_mm512_srai_epi32(visible, 31), value));
+
+        __m128i* const p = reinterpret_cast<__m128i*>(results + i);
+        _mm_storeu_si128(p, _mm_or_si128(_mm_loadu_si128(p), r));
+    }
+    if (i < count) {
+        // count is a multiple of 8, AVX-512 implies AVX2
+        boxesAVX2(results + i, planes, center + i, extent + i, count - i, bit);
+    }
+}
+
+FILAMENT_TARGET_AVX512
+void spheresAVX512(
+        result_type* UTILS_RESTRICT results,
+        float4 const* UTILS_RESTRICT planes,
+        float4 const* UTILS_RESTRICT b,
+        size_t count) noexcept {
+    const __m512i value = _mm512_set1_epi32(1);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        // transposes 16 spheres with 4x4 transposes within each 128-bits lane, then gathers
+        // the lanes in order.
+        __m512 x = _mm512_loadu_ps(&b[i + 0].x);
+        __m512 y = _mm512_loadu_ps(&b[i + 4].x);
+        __m512 z = _mm512_loadu_ps(&b[i + 8].x);
+        __m512 w = _mm512_loadu_ps(&b[i + 12].x);
+        const __m512 t0 = _mm512_unpacklo_ps(x, y);
+        const __m512 t1 = _mm512_unpackhi_ps(x, y);
+        const __m512 t2 = _mm512_unpacklo_ps(z, w);
+        const __m512 t3 = _mm512_unpackhi_ps(z, w);
+        x = _mm512_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+        y = _mm512_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        z = _mm512_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        w = _mm512_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+
+        __m512i visible = _mm512_set1_epi32(-1);
+        for (size_t j = 0; j < 6; j++) {
+            __m512 d = _mm512_add_ps(
+                    _mm512_mul_ps(_mm512_set1_ps(planes[j].x), x),
+                    _mm512_mul_ps(_mm512_set1_ps(planes[j].y), y));
+            d = _mm512_add_ps(d, _mm512_mul_ps(_mm512_set1_ps(planes[j].z), z));
+            d = _mm512_add_ps(d, _mm512_set1_ps(planes[j].w));
+            d = _mm512_sub_ps(d, w);
+            visible = _mm512_and_si512(visible, _mm512_castps_si512(d));
+        }
+        const __m512i r = _mm512_and_si512(_mm512_srai_epi32(visible, 31), value);
+
+        // lane l of the results holds the spheres i + l + 4 * k, for k in [0, 4)
+        const __m512i order = _mm512_setr_epi32(
+                0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(results + i),
+                _mm512_cvtepi32_epi8(_mm512_permutexvar_epi32(order, r)));
+    }
+    if (i < count) {
+        spheresAVX2(results + i, planes, b + i, count - i);
+    }
+}
+
+#endif // FILAMENT_CULLER_HAS_AVX
+
+// ------------------------------------------------------------------------------------------------
+// NEON
+// ------------------------------------------------------------------------------------------------
+
+#if defined(FILAMENT_CULLER_HAS_NEON)
+
+inline uint32x4_t select(uint32x4_t visible, uint32x4_t value) noexcept {
+    return vandq_u32(vreinterpretq_u32_s32(vshrq_n_s32(vreinterpretq_s32_u32(visible), 31)),
+            value);
+}
+
+inline uint8x8_t pack8(uint32x4_t lo, uint32x4_t hi) noexcept {
+    return vmovn_u16(vcombine_u16(vmovn_u32(lo), vmovn_u32(hi)));
+}
+
+void boxesNEON(
+        result_type* UTILS_RESTRICT results,
+        float4 const* UTILS_RESTRICT planes,
+        float3 const* UTILS_RESTRICT center,
+        float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+    const uint32x4_t value = vdupq_n_u32(1u << bit);
+    for (size_t i = 0; i < count; i += 8) {
+        uint32x4_t r[2];
+        for (size_t h = 0; h < 2; h++) {
+            // vld3q transposes the float3 for us
+            const float32x4x3_t c = vld3q_f32(&center[i + h * 4].x);
+            const float32x4x3_t e = vld3q_f32(&extent[i + h * 4].x);
+            uint32x4_t visible = vdupq_n_u32(~0u);
+            for (size_t j = 0; j < 6; j++) {
+                float32x4_t d = vsubq_f32(
+                        vmulq_n_f32(c.val[0], planes[j].x),
+                        vmulq_n_f32(e.val[0], std::abs(planes[j].x)));
+                d = vaddq_f32(d, vmulq_n_f32(c.val[1], planes[j].y));
+                d = vsubq_f32(d, vmulq_n_f32(e.val[1], std::abs(planes[j].y)));
+                d = vaddq_f32(d, vmulq_n_f32(c.val[2], planes[j].z));
+                d = vsubq_f32(d, vmulq_n_f32(e.val[2], std::abs(planes[j].z)));
+                d = vaddq_f32(d, vdupq_n_f32(planes[j].w));
+                visible = vandq_u32(visible, vreinterpretq_u32_f32(d));
+            }
+            r[h] = select(visible, value);
+        }
+        vst1_u8(results + i, vorr_u8(vld1_u8(results + i), pack8(r[0], r[1])));
+    }
+}
+
+void spheresNEON(
+        result_type* UTILS_RESTRICT results,
+        float4 const* UTILS_RESTRICT planes,
+        float4 const* UTILS_RESTRICT b,
+        size_t count) noexcept {
+    const uint32x4_t value = vdupq_n_u32(1u);
+    for (size_t i = 0; i < count; i += 8) {
+        uint32x4_t r[2];
+        for (size_t h = 0; h < 2; h++) {
+            const float32x4x4_t s = vld4q_f32(&b[i + h * 4].x);
+            uint32x4_t visible = vdupq_n_u32(~0u);
+            for (size_t j = 0; j < 6; j++) {
+                float32x4_t d = vaddq_f32(
+                        vmulq_n_f32(s.val[0], planes[j].x),
+                        vmulq_n_f32(s.val[1], planes[j].y));
+                d = vaddq_f32(d, vmulq_n_f32(s.val[2], planes[j].z));
+                d = vaddq_f32(d, vdupq_n_f32(planes[j].w));
+                d = vsubq_f32(d, s.val[3]);
+                visible = vandq_u32(visible, vreinterpretq_u32_f32(d));
+            }
+            r[h] = select(visible, value);
+        }
+        vst1_u8(results + i, pack8(r[0], r[1]));
+    }
+}
+
+#endif // FILAMENT_CULLER_HAS_NEON
+
+// ------------------------------------------------------------------------------------------------
+// Dispatch
+// ------------------------------------------------------------------------------------------------
+
+Culler::Isa detectIsa() noexcept {
+#if defined(FILAMENT_CULLER_HAS_NEON)
+    return Culler::Isa::NEON;
+#elif defined(FILAMENT_CULLER_HAS_AVX)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return Culler::Isa::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return Culler::Isa::AVX2;
+    }
+    return Culler::Isa::SSE2;
+#elif defined(FILAMENT_CULLER_HAS_SSE2)
+    return Culler::Isa::SSE2;
+#else
+    return Culler::Isa::SCALAR;
+#endif
+}
+
+Kernels getKernels(Culler::Isa isa) noexcept {
+    switch (isa) {
+#if defined(FILAMENT_CULLER_HAS_SSE2)
+        case Culler::Isa::SSE2:     return { boxesSSE2, spheresSSE2 };
+#endif
+#if defined(FILAMENT_CULLER_HAS_AVX)
+        case Culler::Isa::AVX2:     return { boxesAVX2, spheresAVX2 };
+        case Culler::Isa::AVX512:   return { boxesAVX512, spheresAVX512 };
+#endif
+#if defined(FILAMENT_CULLER_HAS_NEON)
+        case Culler::Isa::NEON:     return { boxesNEON, spheresNEON };
+#endif
+        default:                    return { boxesScalar, spheresScalar };
+    }
+}
+
+Kernels const& kernels() noexcept {
+    static const Kernels sKernels = getKernels(Culler::getIsa());
+    return sKernels;
+}
+
+} // anonymous namespace
+
+Culler::Isa Culler::getIsa() noexcept {
+    static const Isa sIsa = detectIsa();
+    return sIsa;
+}
+
+bool Culler::isSupported(Isa isa) noexcept {
+    const Isa best = getIsa();
+    switch (isa) {
+        case Isa::SCALAR:   return true;
+        case Isa::SSE2:     return best == Isa::SSE2 || best == Isa::AVX2 || best == Isa::AVX512;
+        case Isa::AVX2:     return best == Isa::AVX2 || best == Isa::AVX512;
+        case Isa::AVX512:   return best == Isa::AVX512;
+        case Isa::NEON:     return best == Isa::NEON;
+    }
+    return false;
+}
+
+void Culler::intersects(
+        result_type* UTILS_RESTRICT results,
+        Frustum const& UTILS_RESTRICT frustum,
+        float4 const* UTILS_RESTRICT b,
+        size_t count) noexcept {
+    count = round(count); // capacity guaranteed to be multiple of 8
+    kernels().spheres(results, frustum.mPlanes, b, count);
+}
+
+void Culler::intersects(
+        result_type* UTILS_RESTRICT results,
+        Frustum const& UTILS_RESTRICT frustum,
+        float3 const* UTILS_RESTRICT center,
+        float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+    count = round(count); // capacity guaranteed to be multiple of 8
+    kernels().boxes(results, frustum.mPlanes, center, extent, count, bit);
+}
+
+void Culler::intersects(
+        result_type* UTILS_RESTRICT results,
+        Frustum const* UTILS_RESTRICT frustums, size_t frustumCount,
+        float3 const* UTILS_RESTRICT center,
+        float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+    assert(bit + frustumCount <= sizeof(result_type) * 8);
+
+    // the boxes are processed in blocks small enough to stay in the L1 cache while they're
+    // tested against all the frustums (2 * 24 bytes per box, i.e. 12 KiB per block)
+    constexpr size_t BLOCK_SIZE = MODULO * 32;
+    BoxKernel const boxes = kernels().boxes;
+    count = round(count); // capacity guaranteed to be multiple of 8
+    for (size_t i = 0; i < count; i += BLOCK_SIZE) {
+        const size_t n = std::min(BLOCK_SIZE, count - i);
+        for (size_t j = 0; j < frustumCount; j++) {
+            boxes(results + i, frustums[j].mPlanes, center + i, extent + i, n, bit + j);
+        }
+    }
+}
+
 /*
  * returns whether a box intersects with the frustum
  */
@@ -117,6 +640,20 @@ bool Culler::intersects(Frustum const& frustum, float4 const& sphere) noexcept {
     return bool(results[0]);
 }
 
+/*
+ * transforms the frustum's planes by a rigid transform
+ */
+Frustum Culler::transform(Frustum const& frustum, mat4f const& m) noexcept {
+    // a point p in the source space is inside the plane P if dot(P, m * p) < 0, which is
+    // the same as dot(transpose(m) * P, p) < 0. Since m is rigid, the planes stay normalized.
+    Frustum result;
+    const mat4f t(transpose(m));
+    for (size_t i = 0; i < 6; i++) {
+        result.mPlanes[i] = t * frustum.mPlanes[i];
+    }
+    return result;
+}
+
 // For testing...
 
 void Culler::Test::intersects(
@@ -135,5 +672,21 @@ void Culler::Test::intersects(
     Culler::intersects(results, frustum, b, count);
 }
 
+void Culler::Test::intersects(
+        result_type* UTILS_RESTRICT results,
+        Frustum const& UTILS_RESTRICT frustum,
+        float3 const* UTILS_RESTRICT c,
+        float3 const* UTILS_RESTRICT e,
+        size_t count, Isa isa) noexcept {
+    getKernels(isa).boxes(results, frustum.mPlanes, c, e, round(count), 0);
+}
+
+void Culler::Test::intersects(
+        result_type* UTILS_RESTRICT results,
+        Frustum const& UTILS_RESTRICT frustum,
+        float4 const* UTILS_RESTRICT b, size_t count, Isa isa) noexcept {
+    getKernels(isa).spheres(results, frustum.mPlanes, b, round(count));
+}
+
 } // namespace details
 } // namespace filament
@@ -133,7 +133,7 @@ FEngine::FEngine(Backend backend, Platform* platform, void* sharedGLContext) :
         mPostProcessManager(*this),
         mEntityManager(EntityManager::get()),
         mRenderableManager(*this),
-        mTransformManager(),
+        mTransformManager(mJobSystem),
         mLightManager(*this),
         mCameraManager(*this),
         mCommandBufferQueue(CONFIG_MIN_COMMAND_BUFFERS_SIZE, CONFIG_COMMAND_BUFFERS_SIZE),
@@ -156,6 +156,11 @@ FEngine::FEngine(Backend backend, Platform* platform, void* sharedGLContext) :
 void FEngine::init() {
     // this must be first.
     mCommandStream = CommandStream(*mDriver, mCommandBufferQueue.getCircularBuffer());
+    for (size_t i = 0; i < CONFIG_SECONDARY_COMMAND_STREAM_COUNT; i++) {
+        mSecondaryCommandBuffers[i] =
+                std::make_unique<CircularBuffer>(CONFIG_SECONDARY_COMMAND_BUFFERS_SIZE);
+        mSecondaryCommandStreams[i] = CommandStream(*mDriver, *mSecondaryCommandBuffers[i]);
+    }
     DriverApi& driverApi = getDriverApi();
 
     // Parse all post process shaders now, but create them lazily
@@ -239,7 +244,7 @@ void FEngine::shutdown() {
 #ifndef NDEBUG
     // print out some statistics about this run
     size_t wm = mCommandBufferQueue.getHigWatermark();
-    size_t wmpct = wm / (CONFIG_COMMAND_BUFFERS_SIZE / 100);
+    size_t wmpct = wm / (mCommandBufferQueue.getBufferSize() / 100);
     slog.d << "CircularBuffer: High watermark "
            << wm / 1024 << " KiB (" << wmpct << "%)" << io::endl;
 #endif
@@ -292,6 +297,8 @@ void FEngine::shutdown() {
     }
     cleanupResourceList(mFences);
 
+    mRenderPrimitiveFactory.terminate(driver);
+
     for (const auto& mPostProcessProgram : mPostProcessPrograms) {
         driver.destroyProgram(mPostProcessProgram);
     }
@@ -352,6 +359,17 @@ void FEngine::gc() {
     js.runAndWait(parent);
 }
 
+void FEngine::updateCommandBufferStatistics() noexcept {
+    const CommandBufferQueue::Statistics statistics = mCommandBufferQueue.resetStatistics();
+    mCommandBufferStatistics = {
+            .frameSize = statistics.flushedSize,
+            .highWatermark = statistics.highWatermark,
+            .capacity = mCommandBufferQueue.getBufferSize(),
+            .stallCount = statistics.stallCount,
+            .stallTime = statistics.stallTime
+    };
+}
+
 void FEngine::flush() {
     // flush the command buffer
     flushCommandBuffer(mCommandBufferQueue);
@@ -771,17 +789,16 @@ void* FEngine::streamAlloc(size_t size, size_t alignment) noexcept {
 bool FEngine::execute() {
 
     // wait until we get command buffers to be executed (or thread exit requested)
-    auto buffers = mCommandBufferQueue.waitForCommands();
-    if (UTILS_UNLIKELY(buffers.empty())) {
+    size_t count = mCommandBufferQueue.waitForCommands();
+    if (UTILS_UNLIKELY(!count)) {
         return false;
     }
 
-    // execute all command buffers
-    for (auto& item : buffers) {
-        if (UTILS_LIKELY(item.begin)) {
-            mCommandStream.execute(item.begin);
-            mCommandBufferQueue.releaseBuffer(item);
-        }
+    // execute all command buffers, in order
+    while (count--) {
+        CommandBufferQueue::Slice const& item = mCommandBufferQueue.front();
+        mCommandStream.execute(item.begin);
+        mCommandBufferQueue.releaseBuffer(item);
     }
 
     return true;
@@ -949,6 +966,43 @@ void* Engine::streamAlloc(size_t size, size_t alignment) noexcept {
     return upcast(this)->streamAlloc(size, alignment);
 }
 
+void Engine::setAutomaticInstancingEnabled(bool enable) noexcept {
+    upcast(this)->setAutomaticInstancingEnabled(enable);
+}
+
+bool Engine::isAutomaticInstancingEnabled() const noexcept {
+    return upcast(this)->isAutomaticInstancingEnabled();
+}
+
+Engine::CommandBufferStatistics Engine::getCommandBufferStatistics() const noexcept {
+    return upcast(this)->getCommandBufferStatistics();
+}
+
+void Engine::setCommandBufferGrowthEnabled(bool enable) noexcept {
+    upcast(this)->setCommandBufferGrowthEnabled(enable);
+}
+
+bool Engine::isCommandBufferGrowthEnabled() const noexcept {
+    return upcast(this)->isCommandBufferGrowthEnabled();
+}
+
+bool Engine::startCommandCapture(const char* path, uint32_t frameCount) noexcept {
+    ASSERT_PRECONDITION(frameCount > 0, "at least one frame must be captured");
+    return upcast(this)->startCommandCapture(path, frameCount);
+}
+
+void Engine::setCommandProfilingEnabled(bool enable) noexcept {
+    upcast(this)->setCommandProfilingEnabled(enable);
+}
+
+bool Engine::isCommandProfilingEnabled() const noexcept {
+    return upcast(this)->isCommandProfilingEnabled();
+}
+
+CString Engine::getCommandProfileAsJson() const {
+    return upcast(this)->getCommandProfileAsJson();
+}
+
 // The external-facing execute does a flush, and is meant only for single-threaded environments.
 // It also discards the boolean return value, which would otherwise indicate a thread exit.
 void Engine::execute() {
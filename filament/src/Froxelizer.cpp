@@ -23,8 +23,10 @@
 
 #include <filament/Viewport.h>
 
+#include <utils/algorithm.h>
 #include <utils/Allocator.h>
 #include <utils/BinaryTreeArray.h>
+#include <utils/JobSystem.h>
 #include <utils/Systrace.h>
 
 #include <math/mat4.h>
@@ -32,9 +34,18 @@
 #include <math/scalar.h>
 
 #include <algorithm>
+#include <atomic>
 
 #include <stddef.h>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#   define FILAMENT_FROXELIZER_HAS_SSE2 1
+#   include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#   define FILAMENT_FROXELIZER_HAS_NEON 1
+#   include <arm_neon.h>
+#endif
+
 using namespace filament::math;
 using namespace utils;
 
@@ -75,11 +86,25 @@ constexpr size_t RECORD_BUFFER_WIDTH        = 1u << RECORD_BUFFER_WIDTH_SHIFT;
 constexpr size_t RECORD_BUFFER_HEIGHT       = 2048;
 constexpr size_t RECORD_BUFFER_ENTRY_COUNT  = RECORD_BUFFER_WIDTH * RECORD_BUFFER_HEIGHT; // 64K
 
-// Buffer needed for Froxelizer internal data structures (~256 KiB)
+// Each light uses 4 RGBA32F texels in the light buffer (clustered mode only)
+constexpr size_t LIGHT_BUFFER_WIDTH_SHIFT   = 6u;
+constexpr size_t LIGHT_BUFFER_WIDTH         = 1u << LIGHT_BUFFER_WIDTH_SHIFT;
+constexpr size_t LIGHT_BUFFER_HEIGHT        = CONFIG_MAX_CLUSTERED_LIGHT_COUNT * 4 / LIGHT_BUFFER_WIDTH;
+
+// Maximum number of light indices stored in the screen-space tiles (clustered mode only).
+// When there are more, the farthest lights are dropped.
+constexpr size_t TILE_RECORD_ENTRY_COUNT    = 128 * 1024;   // 256 KiB
+
+// number of screen-space tiles, i.e. columns of froxels
+constexpr size_t TILE_COUNT_MAX = FROXEL_BUFFER_ENTRY_COUNT_MAX / FEngine::CONFIG_FROXEL_SLICE_COUNT;
+
+// Buffer needed for Froxelizer internal data structures (~320 KiB)
 constexpr size_t PER_FROXELDATA_ARENA_SIZE = sizeof(float4) *
                                                  (FROXEL_BUFFER_ENTRY_COUNT_MAX +
                                                   FROXEL_BUFFER_ENTRY_COUNT_MAX + 3 +
-                                                  FEngine::CONFIG_FROXEL_SLICE_COUNT / 4 + 1);
+                                                  FEngine::CONFIG_FROXEL_SLICE_COUNT / 4 + 1) +
+                                             sizeof(float) * 2 *
+                                                 (FROXEL_BUFFER_ENTRY_COUNT_MAX + 1);
 
 
 // number of lights processed by one group (e.g. 32)
@@ -89,23 +114,49 @@ static constexpr size_t LIGHT_PER_GROUP = sizeof(Froxelizer::LightGroupType) * 8
 static constexpr size_t GROUP_COUNT =
         (CONFIG_MAX_LIGHT_COUNT + LIGHT_PER_GROUP - 1) / LIGHT_PER_GROUP;
 
+// Froxelization state kept between frames for incremental updates (~265 KiB), i.e.
+// GROUP_COUNT x FroxelThreadData, CONFIG_MAX_LIGHT_COUNT x LightParams and the changed lights
+static constexpr size_t PER_FROXELIZER_CACHE_SIZE =
+        GROUP_COUNT * sizeof(Froxelizer::LightGroupType) * (FROXEL_BUFFER_ENTRY_COUNT_MAX + 2) +
+        CONFIG_MAX_LIGHT_COUNT * sizeof(float4) * 3 + CACHELINE_SIZE;
+
 
 // record buffer cannot be larger than 65K entries because we're using uint16_t to store indices
 // so its maximum size is 128 KiB
 static_assert(RECORD_BUFFER_ENTRY_COUNT <= 65536,
         "RecordBuffer cannot be larger than 65536 entries");
 
+static_assert(sizeof(LightsUib) == 4 * sizeof(float4),
+        "LightsUib must be 4 texels of the light buffer");
+
+static_assert(LIGHT_BUFFER_HEIGHT <= 2048,
+        "LightBuffer cannot be higher than the minimum texture size");
+
 Froxelizer::Froxelizer(FEngine& engine)
-        : mArena("froxel", PER_FROXELDATA_ARENA_SIZE) {
+        : mArena("froxel", PER_FROXELDATA_ARENA_SIZE + PER_FROXELIZER_CACHE_SIZE) {
 
     DriverApi& driverApi = engine.getDriverApi();
 
+    // these are allocated first, so they're not affected when update() rewinds the arena
+    static_assert(sizeof(LightParams) <= sizeof(float4) * 3,
+            "PER_FROXELIZER_CACHE_SIZE is too small");
+    mFroxelShardedData = {
+            mArena.alloc<FroxelThreadData>(GROUP_COUNT, CACHELINE_SIZE), uint32_t(GROUP_COUNT) };
+    mCachedLights = mArena.alloc<LightParams>(CONFIG_MAX_LIGHT_COUNT);
+    mChangedLights = mArena.alloc<LightGroupType>(GROUP_COUNT);
+    assert(mFroxelShardedData.begin());
+    assert(mCachedLights);
+    assert(mChangedLights);
+
     // RecordBuffer cannot be larger than 65536 entries, because indices are uint16_t
     GPUBuffer::ElementType type = std::is_same<RecordBufferType, uint8_t>::value
                                   ? GPUBuffer::ElementType::UINT8 : GPUBuffer::ElementType::UINT16;
     mRecordsBuffer = GPUBuffer(driverApi, { type, 1 }, RECORD_BUFFER_WIDTH, RECORD_BUFFER_HEIGHT);
+    // mClusteredRecordsBuffer is only created if the clustered mode is used, see prepare()
     mFroxelBuffer  = GPUBuffer(driverApi, { GPUBuffer::ElementType::UINT16, 2 },
             FROXEL_BUFFER_WIDTH, FROXEL_BUFFER_HEIGHT);
+    mLightBuffer   = GPUBuffer(driverApi, { GPUBuffer::ElementType::FLOAT, 4 },
+            LIGHT_BUFFER_WIDTH, LIGHT_BUFFER_HEIGHT);
 }
 
 Froxelizer::~Froxelizer() {
@@ -116,13 +167,22 @@ void Froxelizer::terminate(DriverApi& driverApi) noexcept {
     // call reset() on our LinearAllocator arenas
     mArena.reset();
 
+    mFroxelShardedData.clear();
+    mCachedLights = nullptr;
+    mChangedLights = nullptr;
+    mPlanesXz = nullptr;
+    mPlanesXx = nullptr;
     mBoundingSpheres = nullptr;
     mPlanesY = nullptr;
     mPlanesX = nullptr;
     mDistancesZ = nullptr;
 
     mRecordsBuffer.terminate(driverApi);
+    if (mClusteredRecordsBuffer.isValid()) {
+        mClusteredRecordsBuffer.terminate(driverApi);
+    }
     mFroxelBuffer.terminate(driverApi);
+    mLightBuffer.terminate(driverApi);
 }
 
 void Froxelizer::setOptions(float zLightNear, float zLightFar) noexcept {
@@ -149,9 +209,10 @@ void Froxelizer::setProjection(const mat4f& projection, float near, float far) n
     }
 }
 
-bool Froxelizer::prepare(
+bool Froxelizer::prepare(FEngine& engine,
         FEngine::DriverApi& driverApi, ArenaScope& arena, filament::Viewport const& viewport,
-        const mat4f& projection, float projectionNear, float projectionFar) noexcept {
+        const mat4f& projection, float projectionNear, float projectionFar,
+        CameraInfo const& camera, const FScene::LightSoa& lightData) noexcept {
     setViewport(viewport);
     setProjection(projection, projectionNear, projectionFar);
 
@@ -160,6 +221,35 @@ bool Froxelizer::prepare(
         uniformsNeedUpdating = update();
     }
 
+    // The buffers below are only needed if froxelizeLights() will have something to commit,
+    // which we know once we've found the lights that changed.
+    size_t lightCount = lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT;
+    mClustered = isClustered(lightCount);
+    if (UTILS_UNLIKELY(mClustered)) {
+        if (UTILS_UNLIKELY(!mClusteredRecordsBuffer.isValid())) {
+            // the clustered records are 16 bits, this buffer is twice the size of mRecordsBuffer
+            mClusteredRecordsBuffer = GPUBuffer(driverApi, { GPUBuffer::ElementType::UINT16, 1 },
+                    RECORD_BUFFER_WIDTH, RECORD_BUFFER_HEIGHT);
+        }
+        // the clustered mode doesn't use (nor update) the cached froxels
+        mCacheValid = false;
+        mCommitNeeded = true;
+    } else {
+        mCommitNeeded = findChangedLights(engine, camera, lightData);
+    }
+
+    if (!mCommitNeeded) {
+        mFroxelBufferUser.clear();
+        mRecordBufferUser.clear();
+        mClusteredRecordBufferUser.clear();
+        mLightRecords.clear();
+        mClusteredLights.clear();
+        mClusteredBounds.clear();
+        mTileOffsets.clear();
+        mTileRecords.clear();
+        return uniformsNeedUpdating;
+    }
+
     /*
      * Allocations that need to persists until the driver consumes them are done from
      * the command stream.
@@ -170,35 +260,71 @@ bool Froxelizer::prepare(
             driverApi.allocatePod<FroxelEntry>(FROXEL_BUFFER_ENTRY_COUNT_MAX),
             FROXEL_BUFFER_ENTRY_COUNT_MAX };
 
-    // record buffer (~64 KiB)
-    mRecordBufferUser = {
-            driverApi.allocatePod<RecordBufferType>(RECORD_BUFFER_ENTRY_COUNT),
-            RECORD_BUFFER_ENTRY_COUNT };
+    if (UTILS_UNLIKELY(mClustered)) {
+        // record buffer (~128 KiB)
+        mClusteredRecordBufferUser = {
+                driverApi.allocatePod<ClusteredRecordBufferType>(RECORD_BUFFER_ENTRY_COUNT),
+                RECORD_BUFFER_ENTRY_COUNT };
+        mRecordBufferUser.clear();
+        assert(mClusteredRecordBufferUser.begin());
+    } else {
+        // record buffer (~64 KiB)
+        mRecordBufferUser = {
+                driverApi.allocatePod<RecordBufferType>(RECORD_BUFFER_ENTRY_COUNT),
+                RECORD_BUFFER_ENTRY_COUNT };
+        mClusteredRecordBufferUser.clear();
+        assert(mRecordBufferUser.begin());
+    }
 
     /*
      * Temporary allocations for processing all froxel data
      */
 
-    // light records per froxel (~256 KiB)
-    mLightRecords = {
-            arena.allocate<LightRecord>(FROXEL_BUFFER_ENTRY_COUNT_MAX, CACHELINE_SIZE),
-            FROXEL_BUFFER_ENTRY_COUNT_MAX };
+    if (UTILS_UNLIKELY(mClustered)) {
+        lightCount = std::min(lightCount, CONFIG_MAX_CLUSTERED_LIGHT_COUNT);
 
-    // froxel thread data (~256 KiB)
-    mFroxelShardedData = {
-            arena.allocate<FroxelThreadData>(GROUP_COUNT, CACHELINE_SIZE),
-            uint32_t(GROUP_COUNT)
-    };
+        // lights parameters and bounds (~192 KiB w/ 4096 lights)
+        mClusteredLights = {
+                arena.allocate<LightParams>(lightCount, CACHELINE_SIZE), uint32_t(lightCount) };
+        mClusteredBounds = {
+                arena.allocate<LightBounds>(lightCount, CACHELINE_SIZE), uint32_t(lightCount) };
+
+        // lights per screen-space tile (~256 KiB)
+        mTileOffsets = {
+                arena.allocate<uint32_t>(TILE_COUNT_MAX + 1, CACHELINE_SIZE), TILE_COUNT_MAX + 1 };
+        mTileRecords = {
+                arena.allocate<ClusteredRecordBufferType>(TILE_RECORD_ENTRY_COUNT, CACHELINE_SIZE),
+                TILE_RECORD_ENTRY_COUNT };
+
+        mLightRecords.clear();
+
+        assert(mClusteredLights.begin());
+        assert(mClusteredBounds.begin());
+        assert(mTileOffsets.begin());
+        assert(mTileRecords.begin());
+    } else {
+        // light records per froxel (~256 KiB)
+        mLightRecords = {
+                arena.allocate<LightRecord>(FROXEL_BUFFER_ENTRY_COUNT_MAX, CACHELINE_SIZE),
+                FROXEL_BUFFER_ENTRY_COUNT_MAX };
+
+        mClusteredLights.clear();
+        mClusteredBounds.clear();
+        mTileOffsets.clear();
+        mTileRecords.clear();
+
+        assert(mLightRecords.begin());
+    }
 
     assert(mFroxelBufferUser.begin());
-    assert(mRecordBufferUser.begin());
-    assert(mLightRecords.begin());
-    assert(mFroxelShardedData.begin());
 
 #ifndef NDEBUG
     memset(mFroxelBufferUser.data(),    0x55, mFroxelBufferUser.sizeInBytes());
-    memset(mRecordBufferUser.data(),    0xEB, mRecordBufferUser.sizeInBytes());
-    memset(mFroxelShardedData.data(),   0xFD, mFroxelShardedData.sizeInBytes());
+    if (mClustered) {
+        memset(mClusteredRecordBufferUser.data(), 0xEB, mClusteredRecordBufferUser.sizeInBytes());
+    } else {
+        memset(mRecordBufferUser.data(), 0xEB, mRecordBufferUser.sizeInBytes());
+    }
 #endif
 
     return uniformsNeedUpdating;
@@ -248,6 +374,9 @@ void Froxelizer::computeFroxelLayout(
 
 UTILS_NOINLINE
 bool Froxelizer::update() noexcept {
+    // the froxels changed, all lights need to be froxelized again
+    mCacheValid = false;
+
     bool uniformsNeedUpdating = false;
     if (UTILS_UNLIKELY(mDirtyFlags & VIEWPORT_CHANGED)) {
         filament::Viewport const& viewport = mViewport;
@@ -284,6 +413,8 @@ bool Froxelizer::update() noexcept {
             // this is a LinearAllocator arena, use rewind() instead of free (which is a no op).
             mArena.rewind(mDistancesZ);
 
+            mPlanesXz = nullptr;
+            mPlanesXx = nullptr;
             mBoundingSpheres = nullptr;
             mPlanesY = nullptr;
             mPlanesX = nullptr;
@@ -294,11 +425,15 @@ bool Froxelizer::update() noexcept {
         mPlanesX         = mArena.alloc<float4>(froxelCountX + 1);
         mPlanesY         = mArena.alloc<float4>(froxelCountY + 1);
         mBoundingSpheres = mArena.alloc<float4>(froxelCount);
+        mPlanesXx        = mArena.alloc<float>(froxelCountX + 1);
+        mPlanesXz        = mArena.alloc<float>(froxelCountX + 1);
 
         assert(mDistancesZ);
         assert(mPlanesX);
         assert(mPlanesY);
         assert(mBoundingSpheres);
+        assert(mPlanesXx);
+        assert(mPlanesXz);
 
         mDistancesZ[0] = 0.0f;
         const float zLightNear = mZLightNear;
@@ -351,6 +486,8 @@ bool Froxelizer::update() noexcept {
             p0 = mat4f::project(invProjection, p0);
             p1 = mat4f::project(invProjection, p1);
             mPlanesX[i] = float4(normalize(cross(p1.xyz, p0.xyz)), 0);
+            mPlanesXx[i] = mPlanesX[i].x;
+            mPlanesXz[i] = mPlanesX[i].z;
         }
 
         for (size_t i = 0, n = mFroxelCountY; i <= n; ++i) {
@@ -523,13 +660,21 @@ std::pair<size_t, size_t> Froxelizer::clipToIndices(float2 const& clip) const no
 
 
 void Froxelizer::commit(backend::DriverApi& driverApi) {
+    if (!mCommitNeeded) {
+        // no light moved, the GPU already has the right froxels and records
+        return;
+    }
     // send data to GPU
     mFroxelBuffer.commit(driverApi, mFroxelBufferUser);
-    mRecordsBuffer.commit(driverApi, mRecordBufferUser);
+    if (UTILS_UNLIKELY(mClustered)) {
+        mClusteredRecordsBuffer.commit(driverApi, mClusteredRecordBufferUser);
+    } else {
+        mRecordsBuffer.commit(driverApi, mRecordBufferUser);
+    }
 #ifndef NDEBUG
     mFroxelBufferUser.clear();
     mRecordBufferUser.clear();
-    mFroxelShardedData.clear();
+    mClusteredRecordBufferUser.clear();
 #endif
 }
 
@@ -537,13 +682,22 @@ void Froxelizer::froxelizeLights(FEngine& engine,
         CameraInfo const& UTILS_RESTRICT camera,
         const FScene::LightSoa& UTILS_RESTRICT lightData) noexcept {
     // note: this is called asynchronously
-    froxelizeLoop(engine, camera, lightData);
-    froxelizeAssignRecordsCompress();
+    if (!mCommitNeeded) {
+        // prepare() found that no light changed
+        return;
+    }
+
+    if (UTILS_UNLIKELY(mClustered)) {
+        froxelizeClustered(engine, camera, lightData);
+    } else {
+        froxelizeLoop(engine, lightData);
+        froxelizeAssignRecordsCompress();
+        mCacheValid = true;
+    }
 
 #ifndef NDEBUG
-    if (lightData.size()) {
+    if (lightData.size() && mCommitNeeded) {
         // go through every froxel
-        auto const& recordBufferUser(mRecordBufferUser);
         auto gpuFroxelEntries(mFroxelBufferUser);
         gpuFroxelEntries.set(gpuFroxelEntries.begin(),
                 mFroxelCountX * mFroxelCountY * mFroxelCountZ);
@@ -553,8 +707,11 @@ void Froxelizer::froxelizeLights(FEngine& engine,
                 // get the light index
                 assert(entry.offset + i < RECORD_BUFFER_ENTRY_COUNT);
 
-                size_t lightIndex = recordBufferUser[entry.offset + i];
-                assert(lightIndex <= CONFIG_MAX_LIGHT_INDEX);
+                size_t lightIndex = mClustered ?
+                        mClusteredRecordBufferUser[entry.offset + i] :
+                        mRecordBufferUser[entry.offset + i];
+                assert(lightIndex <= (mClustered ?
+                        CONFIG_MAX_CLUSTERED_LIGHT_INDEX : CONFIG_MAX_LIGHT_INDEX));
 
                 // make sure it corresponds to an existing light
                 assert(lightIndex < lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT);
@@ -564,27 +721,36 @@ void Froxelizer::froxelizeLights(FEngine& engine,
 #endif
 }
 
-void Froxelizer::froxelizeLoop(FEngine& engine,
+bool Froxelizer::findChangedLights(FEngine& engine,
         const CameraInfo& UTILS_RESTRICT camera,
         const FScene::LightSoa& UTILS_RESTRICT lightData) noexcept {
     SYSTRACE_CALL();
 
-    Slice<FroxelThreadData> froxelThreadData = mFroxelShardedData;
-    memset(froxelThreadData.data(), 0, froxelThreadData.sizeInBytes());
+    LightParams* const UTILS_RESTRICT cachedLights = mCachedLights;
+
+    const bool rebuild = !mCacheValid;
+    if (rebuild) {
+        mCachedLightCount = 0;
+    }
 
     auto& lcm = engine.getLightManager();
     auto const* UTILS_RESTRICT spheres      = lightData.data<FScene::POSITION_RADIUS>();
     auto const* UTILS_RESTRICT directions   = lightData.data<FScene::DIRECTION>();
     auto const* UTILS_RESTRICT instances    = lightData.data<FScene::LIGHT_INSTANCE>();
 
-    auto process = [ this, &froxelThreadData,
-                     spheres, directions, instances, &camera, &lcm ]
-            (size_t count, size_t offset, size_t stride) {
-
-        const mat4f& projection = mProjection;
-        const mat3f& vn = camera.view.upperLeft();
-
-        for (size_t i = offset; i < count; i += stride) {
+    // Find the lights that changed since the last froxelization, only these need to be
+    // removed from the froxels they were in and froxelized again. Lights are identified by
+    // their index, so a light that just moves to another index counts as a change too.
+    // Note that lights are in view-space, so moving the camera changes them all.
+    const size_t lightCount = lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT;
+    const size_t cachedLightCount = mCachedLightCount;
+    const mat3f& vn = camera.view.upperLeft();
+    LightGroupType* const UTILS_RESTRICT changed = mChangedLights;
+    std::fill_n(changed, GROUP_COUNT, LightGroupType(0));
+    bool anyChanged = rebuild;
+    for (size_t i = 0, c = std::max(lightCount, cachedLightCount); i < c; i++) {
+        bool lightChanged = rebuild || i >= cachedLightCount || i >= lightCount;
+        if (i < lightCount) {
             const size_t j = i + FScene::DIRECTIONAL_LIGHTS_COUNT;
             FLightManager::Instance li = instances[j];
             LightParams light = {
@@ -594,33 +760,83 @@ void Froxelizer::froxelizeLoop(FEngine& engine,
                     .invSin = lcm.getSinInverse(li),        // spot only
                     .radius = spheres[j].w,
             };
+            if (lightChanged || light != cachedLights[i]) {
+                cachedLights[i] = light;
+                lightChanged = true;
+            }
+        }
+        changed[i % GROUP_COUNT] |= LightGroupType(lightChanged) << (i / GROUP_COUNT);
+        anyChanged |= lightChanged;
+    }
+    mCachedLightCount = uint16_t(lightCount);
+
+    // the froxels don't match mCachedLights until froxelizeLoop() runs
+    mRebuildNeeded = rebuild;
+    mCacheValid = mCacheValid && !anyChanged;
+    return anyChanged;
+}
+
+void Froxelizer::froxelizeLoop(FEngine& engine,
+        const FScene::LightSoa& UTILS_RESTRICT lightData) noexcept {
+    SYSTRACE_CALL();
+
+    Slice<FroxelThreadData> froxelThreadData = mFroxelShardedData;
+    LightParams const* const UTILS_RESTRICT cachedLights = mCachedLights;
+    LightGroupType const* const UTILS_RESTRICT changed = mChangedLights;
+    const size_t lightCount = lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT;
 
-            const size_t group = i % GROUP_COUNT;
-            const size_t bit   = i / GROUP_COUNT;
-            assert(bit < LIGHT_PER_GROUP);
+    const bool rebuild = mRebuildNeeded;
+    if (rebuild) {
+        memset(froxelThreadData.data(), 0, froxelThreadData.sizeInBytes());
+    }
+
+    auto process = [ this, &froxelThreadData, changed, cachedLights, lightCount, rebuild ]
+            (size_t group) {
+
+        const mat4f& projection = mProjection;
+        FroxelThreadData& threadData = froxelThreadData[group];
 
-            FroxelThreadData& threadData = froxelThreadData[group];
+        const LightGroupType mask = changed[group];
+        if (!mask) {
+            return;
+        }
+
+        if (!rebuild) {
+            // remove the lights that changed from all froxels (including the light type)
+            // this loops gets vectorized w/ clang
+            for (LightGroupType& bits : threadData) {
+                bits &= ~mask;
+            }
+        }
+
+        for (size_t bit = 0; bit < LIGHT_PER_GROUP; bit++) {
+            const size_t i = bit * GROUP_COUNT + group;
+            if (!(mask & (LightGroupType(1) << bit)) || i >= lightCount) {
+                continue;
+            }
+            LightParams const& light = cachedLights[i];
             const bool isSpot = light.invSin != std::numeric_limits<float>::infinity();
-            threadData[0] |= isSpot << bit;
+            threadData[0] |= LightGroupType(isSpot) << bit;
             froxelizePointAndSpotLight(threadData, bit, projection, light);
         }
     };
 
-    // we do 64 lights per job
+    // one job per group of lights
     JobSystem& js = engine.getJobSystem();
 
     constexpr bool SINGLE_THREADED = false;
     if (!SINGLE_THREADED) {
         auto parent = js.createJob();
         for (size_t i = 0; i < GROUP_COUNT; i++) {
-            js.run(jobs::createJob(js, parent, std::cref(process),
-                    lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT, i, GROUP_COUNT));
+            if (changed[i]) {
+                js.run(jobs::createJob(js, parent, std::cref(process), i));
+            }
         }
         js.runAndWait(parent);
     } else {
-        js.runAndWait(jobs::createJob(js, nullptr, std::cref(process),
-                lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT, 0, 1)
-        );
+        for (size_t i = 0; i < GROUP_COUNT; i++) {
+            process(i);
+        }
     }
 }
 
@@ -751,6 +967,211 @@ out_of_memory:
     ;
 }
 
+void Froxelizer::froxelizeClustered(FEngine& engine,
+        const CameraInfo& UTILS_RESTRICT camera,
+        const FScene::LightSoa& UTILS_RESTRICT lightData) noexcept {
+    SYSTRACE_CALL();
+
+    // lights in excess were dropped by FScene::prepareDynamicLights()
+    const size_t lightCount = lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT;
+    assert(lightCount <= mClusteredLights.size());
+
+    JobSystem& js = engine.getJobSystem();
+    auto& lcm = engine.getLightManager();
+    auto const* UTILS_RESTRICT spheres      = lightData.data<FScene::POSITION_RADIUS>();
+    auto const* UTILS_RESTRICT directions   = lightData.data<FScene::DIRECTION>();
+    auto const* UTILS_RESTRICT instances    = lightData.data<FScene::LIGHT_INSTANCE>();
+
+    LightParams* const UTILS_RESTRICT lights = mClusteredLights.data();
+    LightBounds* const UTILS_RESTRICT bounds = mClusteredBounds.data();
+
+    /*
+     * Compute the view-space parameters and the froxel-space bounds of each light
+     */
+
+    auto prepareLights = [this, lights, bounds, spheres, directions, instances, &camera, &lcm]
+            (uint32_t first, uint32_t count) {
+        const mat3f& vn = camera.view.upperLeft();
+        for (size_t i = first, last = first + count; i < last; i++) {
+            const size_t j = i + FScene::DIRECTIONAL_LIGHTS_COUNT;
+            FLightManager::Instance li = instances[j];
+            lights[i] = {
+                    .position = (camera.view * float4{ spheres[j].xyz, 1 }).xyz, // to view-space
+                    .cosSqr = lcm.getCosOuterSquared(li),   // spot only
+                    .axis = vn * directions[j],             // spot only
+                    .invSin = lcm.getSinInverse(li),        // spot only
+                    .radius = spheres[j].w,
+            };
+            bounds[i] = computeLightBounds(mProjection, lights[i]);
+        }
+    };
+    js.runAndWait(jobs::parallel_for(js, nullptr, 0, uint32_t(lightCount),
+            std::cref(prepareLights), jobs::CountSplitter<64, 8>()));
+
+    /*
+     * First level: bin the lights into screen-space tiles (i.e. columns of froxels).
+     * Lights are sorted by distance to the camera, so if we run out of tile records, the
+     * farthest lights are dropped.
+     */
+
+    const size_t froxelCountX = mFroxelCountX;
+    const size_t tileCount = froxelCountX * mFroxelCountY;
+    assert(tileCount <= TILE_COUNT_MAX);
+
+    uint32_t* const UTILS_RESTRICT tileOffsets = mTileOffsets.data();
+    ClusteredRecordBufferType* const UTILS_RESTRICT tileRecords = mTileRecords.data();
+    std::fill_n(tileOffsets, tileCount + 1, 0);
+
+    // count the lights of each tile
+    size_t binnedLightCount = 0;
+    for (size_t total = 0; binnedLightCount < lightCount; binnedLightCount++) {
+        LightBounds const& b = bounds[binnedLightCount];
+        const size_t area = (b.x1 - b.x0) * (b.y1 - b.y0 + 1u);
+        if (UTILS_UNLIKELY(total + area > TILE_RECORD_ENTRY_COUNT)) {
+#ifndef NDEBUG
+            slog.d << "out of tile records: " << lightCount - binnedLightCount
+                   << " lights dropped" << io::endl;
+#endif
+            break;
+        }
+        total += area;
+        for (size_t iy = b.y0; iy <= b.y1; iy++) {
+            for (size_t ix = b.x0; ix < b.x1; ix++) {
+                tileOffsets[iy * froxelCountX + ix]++;
+            }
+        }
+    }
+
+    // convert the counts to offsets
+    for (size_t t = 0, offset = 0; t <= tileCount; t++) {
+        const size_t count = tileOffsets[t];
+        tileOffsets[t] = uint32_t(offset);
+        offset += count;
+    }
+
+    // fill the tiles, this leaves each offset pointing to the next tile...
+    for (size_t l = 0; l < binnedLightCount; l++) {
+        LightBounds const& b = bounds[l];
+        for (size_t iy = b.y0; iy <= b.y1; iy++) {
+            for (size_t ix = b.x0; ix < b.x1; ix++) {
+                tileRecords[tileOffsets[iy * froxelCountX + ix]++] = ClusteredRecordBufferType(l);
+            }
+        }
+    }
+
+    // ...so shift them back
+    std::copy_backward(tileOffsets, tileOffsets + tileCount, tileOffsets + tileCount + 1);
+    tileOffsets[0] = 0;
+
+    /*
+     * Second level: test the lights of each tile against its froxels, slice by slice, and
+     * write the resulting lists into the record buffer.
+     */
+
+    auto remap = [stride = size_t(froxelCountX * mFroxelCountY)](size_t i) -> size_t {
+        if (SUPPORTS_REMAPPED_FROXELS) {
+            i = (i % stride) * FEngine::CONFIG_FROXEL_SLICE_COUNT + (i / stride);
+        }
+        return i;
+    };
+
+    std::atomic<uint32_t> recordCount{ 0 };
+    FroxelEntry* const UTILS_RESTRICT froxels = mFroxelBufferUser.data();
+    ClusteredRecordBufferType* const UTILS_RESTRICT froxelRecords =
+            mClusteredRecordBufferUser.data();
+    float4 const* const UTILS_RESTRICT boundingSpheres = mBoundingSpheres;
+
+    auto assignTiles = [this, &recordCount, &remap, froxels, froxelRecords, boundingSpheres,
+                        lights, bounds, tileOffsets, tileRecords, froxelCountX]
+            (uint32_t first, uint32_t count) {
+        // We have a limitation of 255 spot + 255 point lights per froxel.
+        ClusteredRecordBufferType list[255 * 2];
+        ClusteredRecordBufferType spotList[255];
+
+        for (size_t t = first, last = first + count; t < last; t++) {
+            const size_t ix = t % froxelCountX;
+            const size_t iy = t / froxelCountX;
+            ClusteredRecordBufferType const* const tileBegin = tileRecords + tileOffsets[t];
+            ClusteredRecordBufferType const* const tileEnd   = tileRecords + tileOffsets[t + 1];
+
+            // entry of this tile's previous froxel, reused when the lists are identical
+            FroxelEntry previous;
+
+            for (size_t iz = 0, nz = mFroxelCountZ; iz < nz; iz++) {
+                const size_t fi = getFroxelIndex(ix, iy, iz);
+                const float4 froxel = boundingSpheres[fi];
+
+                size_t pointCount = 0;
+                size_t spotCount = 0;
+                for (ClusteredRecordBufferType const* curr = tileBegin; curr != tileEnd; ++curr) {
+                    const size_t l = *curr;
+                    LightBounds const& b = bounds[l];
+                    if (iz < b.z0 || iz > b.z1) {
+                        continue;
+                    }
+                    LightParams const& light = lights[l];
+                    const float3 d = light.position - froxel.xyz;
+                    const float r = light.radius + froxel.w;
+                    if (dot(d, d) > r * r) {
+                        continue;
+                    }
+                    if (light.invSin != std::numeric_limits<float>::infinity()) {
+                        if (spotCount < 255 && sphereConeIntersectionFast(froxel,
+                                light.position, light.axis, light.invSin, light.cosSqr)) {
+                            spotList[spotCount++] = ClusteredRecordBufferType(l);
+                        }
+                    } else if (pointCount < 255) {
+                        list[pointCount++] = ClusteredRecordBufferType(l);
+                    }
+                }
+
+                const size_t froxelLightCount = pointCount + spotCount;
+                if (!froxelLightCount) {
+                    froxels[remap(fi)].u32 = 0;
+                    previous.u32 = 0;
+                    continue;
+                }
+                std::copy_n(spotList, spotCount, list + pointCount);
+
+                FroxelEntry entry = {
+                        .offset = 0,
+                        .pointLightCount = uint8_t(pointCount),
+                        .spotLightCount  = uint8_t(spotCount)
+                };
+                if (entry.pointLightCount == previous.pointLightCount &&
+                        entry.spotLightCount == previous.spotLightCount &&
+                        std::equal(list, list + froxelLightCount, froxelRecords + previous.offset)) {
+                    // same lights as in the previous slice
+                    froxels[remap(fi)].u32 = previous.u32;
+                    continue;
+                }
+
+                const uint32_t offset = recordCount.fetch_add(
+                        uint32_t(froxelLightCount), std::memory_order_relaxed);
+                if (UTILS_UNLIKELY(offset + froxelLightCount > RECORD_BUFFER_ENTRY_COUNT)) {
+                    // out of space, this froxel won't be lit
+                    froxels[remap(fi)].u32 = 0;
+                    previous.u32 = 0;
+                    continue;
+                }
+                std::copy_n(list, froxelLightCount, froxelRecords + offset);
+                entry.offset = uint16_t(offset);
+                froxels[remap(fi)].u32 = entry.u32;
+                previous = entry;
+            }
+        }
+    };
+    js.runAndWait(jobs::parallel_for(js, nullptr, 0, uint32_t(tileCount),
+            std::cref(assignTiles), jobs::CountSplitter<16, 8>()));
+
+#ifndef NDEBUG
+    if (recordCount > RECORD_BUFFER_ENTRY_COUNT) {
+        slog.d << "out of space: " << recordCount - RECORD_BUFFER_ENTRY_COUNT
+               << " records dropped" << io::endl;
+    }
+#endif
+}
+
 static inline float2 project(mat4f const& p, float3 const& v) noexcept {
     const float vx = v[0];
     const float vy = v[1];
@@ -773,8 +1194,177 @@ static inline float2 project(mat4f const& p, float3 const& v) noexcept {
     return float2{ x, y } * (1 / w);
 }
 
-void Froxelizer::froxelizePointAndSpotLight(
-        FroxelThreadData& froxelThread, size_t bit,
+#if FILAMENT_FROXELIZER_HAS_NEON
+// equivalent of _mm_movemask_ps(), one bit per lane
+static inline uint32_t movemask(uint32x4_t m) noexcept {
+    const uint32x4_t bits = { 1, 2, 4, 8 };
+    const uint32x4_t b = vandq_u32(m, bits);
+    uint32x2_t r = vorr_u32(vget_low_u32(b), vget_high_u32(b));
+    r = vpadd_u32(r, r);
+    return vget_lane_u32(r, 0);
+}
+#endif
+
+/*
+ * The kernels below test a light against 4 froxels at a time. They don't use FMAs so that
+ * they give the exact same results as the scalar code (which handles the remaining froxels).
+ */
+
+// Returns the index of the first x-plane in [begin, end) intersecting the sphere s (radius
+// squared), or max(begin, end) if there are none.
+static size_t findFirstIntersection(float4 const& s,
+        float const* UTILS_RESTRICT px, float const* UTILS_RESTRICT pz,
+        size_t begin, size_t end) noexcept {
+    size_t i = begin;
+#if FILAMENT_FROXELIZER_HAS_SSE2
+    const __m128 sx = _mm_set1_ps(s.x);
+    const __m128 sz = _mm_set1_ps(s.z);
+    const __m128 sw = _mm_set1_ps(s.w);
+    for (; i + 4 <= end; i += 4) {
+        const __m128 d = _mm_add_ps(
+                _mm_mul_ps(sx, _mm_loadu_ps(px + i)), _mm_mul_ps(sz, _mm_loadu_ps(pz + i)));
+        const __m128 rr = _mm_sub_ps(sw, _mm_mul_ps(d, d));
+        const uint32_t mask = uint32_t(_mm_movemask_ps(_mm_cmpgt_ps(rr, _mm_setzero_ps())));
+        if (mask) {
+            return i + utils::ctz(mask);
+        }
+    }
+#elif FILAMENT_FROXELIZER_HAS_NEON
+    const float32x4_t sx = vdupq_n_f32(s.x);
+    const float32x4_t sz = vdupq_n_f32(s.z);
+    const float32x4_t sw = vdupq_n_f32(s.w);
+    for (; i + 4 <= end; i += 4) {
+        const float32x4_t d = vaddq_f32(
+                vmulq_f32(sx, vld1q_f32(px + i)), vmulq_f32(sz, vld1q_f32(pz + i)));
+        const float32x4_t rr = vsubq_f32(sw, vmulq_f32(d, d));
+        const uint32_t mask = movemask(vcgtq_f32(rr, vdupq_n_f32(0)));
+        if (mask) {
+            return i + utils::ctz(mask);
+        }
+    }
+#endif
+    for (; i < end; ++i) {
+        if (spherePlaneDistanceSquared(s, px[i], pz[i]) > 0) {
+            break;
+        }
+    }
+    return i;
+}
+
+// Returns one past the index of the last x-plane in [begin, end) intersecting the sphere s
+// (radius squared), or min(begin, end) if there are none.
+static size_t findLastIntersection(float4 const& s,
+        float const* UTILS_RESTRICT px, float const* UTILS_RESTRICT pz,
+        size_t begin, size_t end) noexcept {
+    size_t i = end;
+#if FILAMENT_FROXELIZER_HAS_SSE2
+    const __m128 sx = _mm_set1_ps(s.x);
+    const __m128 sz = _mm_set1_ps(s.z);
+    const __m128 sw = _mm_set1_ps(s.w);
+    for (; i >= begin + 4; i -= 4) {
+        const __m128 d = _mm_add_ps(_mm_mul_ps(sx, _mm_loadu_ps(px + i - 4)),
+                _mm_mul_ps(sz, _mm_loadu_ps(pz + i - 4)));
+        const __m128 rr = _mm_sub_ps(sw, _mm_mul_ps(d, d));
+        const uint32_t mask = uint32_t(_mm_movemask_ps(_mm_cmpgt_ps(rr, _mm_setzero_ps())));
+        if (mask) {
+            return i - 4 + (32 - utils::clz(mask));
+        }
+    }
+#elif FILAMENT_FROXELIZER_HAS_NEON
+    const float32x4_t sx = vdupq_n_f32(s.x);
+    const float32x4_t sz = vdupq_n_f32(s.z);
+    const float32x4_t sw = vdupq_n_f32(s.w);
+    for (; i >= begin + 4; i -= 4) {
+        const float32x4_t d = vaddq_f32(
+                vmulq_f32(sx, vld1q_f32(px + i - 4)), vmulq_f32(sz, vld1q_f32(pz + i - 4)));
+        const float32x4_t rr = vsubq_f32(sw, vmulq_f32(d, d));
+        const uint32_t mask = movemask(vcgtq_f32(rr, vdupq_n_f32(0)));
+        if (mask) {
+            return i - 4 + (32 - utils::clz(mask));
+        }
+    }
+#endif
+    for (; i > begin; --i) {
+        if (spherePlaneDistanceSquared(s, px[i - 1], pz[i - 1]) > 0) {
+            return i;
+        }
+    }
+    return std::min(begin, end);
+}
+
+// ORs 'value' into out[i] for each of the 'count' froxel bounding spheres intersecting the cone,
+// this is sphereConeIntersectionFast() 4 spheres at a time.
+static void coneIntersections(Froxelizer::LightGroupType* UTILS_RESTRICT out,
+        float4 const* UTILS_RESTRICT spheres, size_t count,
+        float3 const& position, float3 const& axis, float invSin, float cosSqr,
+        Froxelizer::LightGroupType value) noexcept {
+    size_t i = 0;
+#if FILAMENT_FROXELIZER_HAS_SSE2
+    const __m128 px = _mm_set1_ps(position.x);
+    const __m128 py = _mm_set1_ps(position.y);
+    const __m128 pz = _mm_set1_ps(position.z);
+    const __m128 ax = _mm_set1_ps(axis.x);
+    const __m128 ay = _mm_set1_ps(axis.y);
+    const __m128 az = _mm_set1_ps(axis.z);
+    const __m128 is = _mm_set1_ps(invSin);
+    const __m128 cs = _mm_set1_ps(cosSqr);
+    const __m128i v = _mm_set1_epi32(int32_t(value));
+    for (; i + 4 <= count; i += 4) {
+        __m128 sx = _mm_loadu_ps(&spheres[i + 0].x);
+        __m128 sy = _mm_loadu_ps(&spheres[i + 1].x);
+        __m128 sz = _mm_loadu_ps(&spheres[i + 2].x);
+        __m128 sw = _mm_loadu_ps(&spheres[i + 3].x);
+        _MM_TRANSPOSE4_PS(sx, sy, sz, sw);
+        const __m128 k = _mm_mul_ps(sw, is);
+        const __m128 dx = _mm_sub_ps(sx, _mm_sub_ps(px, _mm_mul_ps(k, ax)));
+        const __m128 dy = _mm_sub_ps(sy, _mm_sub_ps(py, _mm_mul_ps(k, ay)));
+        const __m128 dz = _mm_sub_ps(sz, _mm_sub_ps(pz, _mm_mul_ps(k, az)));
+        const __m128 e = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(ax, dx), _mm_mul_ps(ay, dy)), _mm_mul_ps(az, dz));
+        const __m128 dd = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        const __m128 mask = _mm_and_ps(
+                _mm_cmpge_ps(_mm_mul_ps(e, e), _mm_mul_ps(dd, cs)),
+                _mm_cmpgt_ps(e, _mm_setzero_ps()));
+        __m128i* const p = reinterpret_cast<__m128i*>(out + i);
+        _mm_storeu_si128(p, _mm_or_si128(_mm_loadu_si128(p),
+                _mm_and_si128(_mm_castps_si128(mask), v)));
+    }
+#elif FILAMENT_FROXELIZER_HAS_NEON
+    const float32x4_t px = vdupq_n_f32(position.x);
+    const float32x4_t py = vdupq_n_f32(position.y);
+    const float32x4_t pz = vdupq_n_f32(position.z);
+    const float32x4_t ax = vdupq_n_f32(axis.x);
+    const float32x4_t ay = vdupq_n_f32(axis.y);
+    const float32x4_t az = vdupq_n_f32(axis.z);
+    const float32x4_t is = vdupq_n_f32(invSin);
+    const float32x4_t cs = vdupq_n_f32(cosSqr);
+    const uint32x4_t v = vdupq_n_u32(value);
+    for (; i + 4 <= count; i += 4) {
+        // de-interleaves the 4 spheres into x, y, z and w
+        const float32x4x4_t s = vld4q_f32(&spheres[i].x);
+        const float32x4_t k = vmulq_f32(s.val[3], is);
+        const float32x4_t dx = vsubq_f32(s.val[0], vsubq_f32(px, vmulq_f32(k, ax)));
+        const float32x4_t dy = vsubq_f32(s.val[1], vsubq_f32(py, vmulq_f32(k, ay)));
+        const float32x4_t dz = vsubq_f32(s.val[2], vsubq_f32(pz, vmulq_f32(k, az)));
+        const float32x4_t e = vaddq_f32(vaddq_f32(
+                vmulq_f32(ax, dx), vmulq_f32(ay, dy)), vmulq_f32(az, dz));
+        const float32x4_t dd = vaddq_f32(vaddq_f32(
+                vmulq_f32(dx, dx), vmulq_f32(dy, dy)), vmulq_f32(dz, dz));
+        const uint32x4_t mask = vandq_u32(
+                vcgeq_f32(vmulq_f32(e, e), vmulq_f32(dd, cs)),
+                vcgtq_f32(e, vdupq_n_f32(0)));
+        vst1q_u32(out + i, vorrq_u32(vld1q_u32(out + i), vandq_u32(mask, v)));
+    }
+#endif
+    for (; i < count; ++i) {
+        const bool intersect = sphereConeIntersectionFast(spheres[i],
+                position, axis, invSin, cosSqr);
+        out[i] |= Froxelizer::LightGroupType(intersect) * value;
+    }
+}
+
+Froxelizer::LightBounds Froxelizer::computeLightBounds(
         mat4f const& UTILS_RESTRICT p,
         const Froxelizer::LightParams& UTILS_RESTRICT light) const noexcept {
 
@@ -782,12 +1372,9 @@ void Froxelizer::froxelizePointAndSpotLight(
         // This light is fully behind LightFar, it doesn't light anything
         // (we could avoid this check if we culled lights using LightFar instead of the
         // culling camera's far plane)
-        return;
+        return {};
     }
 
-    // the code below works with radius^2
-    const float4 s = { light.position, light.radius * light.radius };
-
 #ifdef DEBUG_FROXEL
     const size_t x0 = 0;
     const size_t x1 = mFroxelCountX;
@@ -828,11 +1415,37 @@ void Froxelizer::froxelizePointAndSpotLight(
     assert(z0 <= z1);
 #endif
 
+    return { uint16_t(x0), uint16_t(x1), uint16_t(y0), uint16_t(y1), uint16_t(z0), uint16_t(z1) };
+}
+
+void Froxelizer::froxelizePointAndSpotLight(
+        FroxelThreadData& froxelThread, size_t bit,
+        mat4f const& UTILS_RESTRICT p,
+        const Froxelizer::LightParams& UTILS_RESTRICT light) const noexcept {
+
+    const LightBounds bounds = computeLightBounds(p, light);
+    if (UTILS_UNLIKELY(bounds.x0 == bounds.x1)) {
+        return;
+    }
+
+    // the code below works with radius^2
+    const float4 s = { light.position, light.radius * light.radius };
+
+    const size_t x0 = bounds.x0;
+    const size_t x1 = bounds.x1;
+    const size_t y0 = bounds.y0;
+    const size_t y1 = bounds.y1;
+    const size_t z0 = bounds.z0;
+    const size_t z1 = bounds.z1;
+
     const size_t zcenter = findSliceZ(s.z);
     float4 const * const UTILS_RESTRICT planesX = mPlanesX;
     float4 const * const UTILS_RESTRICT planesY = mPlanesY;
     float const * const UTILS_RESTRICT planesZ = mDistancesZ;
     float4 const * const UTILS_RESTRICT boundingSpheres = mBoundingSpheres;
+    float const * const UTILS_RESTRICT planesXx = mPlanesXx;
+    float const * const UTILS_RESTRICT planesXz = mPlanesXz;
+    const bool simd = mSimdEnabled;
     for (size_t iz = z0 ; iz <= z1; ++iz) {
         float4 cz(s);
         if (UTILS_LIKELY(iz != zcenter)) {
@@ -855,22 +1468,27 @@ void Froxelizer::froxelizePointAndSpotLight(
                 }
                 if (cy.w > 0) { // intersection of light with this horizontal plane
                     size_t bx, ex; // horizontal begin/end indices
-                    // find the begin index (left side)
-                    for (bx = x0; bx <= xcenter; ++bx) {
-                        if (spherePlaneDistanceSquared(cy, planesX[bx].x, planesX[bx].z) > 0) {
-                            // intersection
-                            break;
+                    if (UTILS_LIKELY(simd)) {
+                        bx = findFirstIntersection(cy, planesXx, planesXz, x0, xcenter + 1);
+                        ex = findLastIntersection(cy, planesXx, planesXz, xcenter + 1, x1);
+                    } else {
+                        // find the begin index (left side)
+                        for (bx = x0; bx <= xcenter; ++bx) {
+                            if (spherePlaneDistanceSquared(cy, planesX[bx].x, planesX[bx].z) > 0) {
+                                // intersection
+                                break;
+                            }
                         }
-                    }
 
-                    // find the end index (right side), x1 is past the end
-                    for (ex = x1; --ex > xcenter;) {
-                        if (spherePlaneDistanceSquared(cy, planesX[ex].x, planesX[ex].z) > 0) {
-                            // intersection
-                            break;
+                        // find the end index (right side), x1 is past the end
+                        for (ex = x1; --ex > xcenter;) {
+                            if (spherePlaneDistanceSquared(cy, planesX[ex].x, planesX[ex].z) > 0) {
+                                // intersection
+                                break;
+                            }
                         }
+                        ++ex;
                     }
-                    ++ex;
 
                     if (UTILS_UNLIKELY(bx >= ex)) {
                         continue;
@@ -882,12 +1500,18 @@ void Froxelizer::froxelizePointAndSpotLight(
                     size_t fi = getFroxelIndex(bx, iy, iz) + 1;
                     if (light.invSin != std::numeric_limits<float>::infinity()) {
                         // This is a spotlight (common case)
-                        // this loops gets vectorized (on arm64) w/ clang
-                        while (bx++ != ex) {
-                            // see if this froxel intersects the cone
-                            bool intersect = sphereConeIntersectionFast(boundingSpheres[fi - 1],
-                                    light.position, light.axis, light.invSin, light.cosSqr);
-                            froxelThread[fi++] |= LightGroupType(intersect) << bit;
+                        if (UTILS_LIKELY(simd)) {
+                            coneIntersections(froxelThread.data() + fi, boundingSpheres + fi - 1,
+                                    ex - bx, light.position, light.axis, light.invSin, light.cosSqr,
+                                    LightGroupType(1) << bit);
+                        } else {
+                            while (bx++ != ex) {
+                                // see if this froxel intersects the cone
+                                bool intersect = sphereConeIntersectionFast(
+                                        boundingSpheres[fi - 1], light.position, light.axis,
+                                        light.invSin, light.cosSqr);
+                                froxelThread[fi++] |= LightGroupType(intersect) << bit;
+                            }
                         }
                     } else {
                         // this loops gets vectorized (on arm64) w/ clang
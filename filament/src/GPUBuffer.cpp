@@ -120,8 +120,21 @@ void GPUBuffer::terminate(backend::DriverApi& driverApi) noexcept {
 void GPUBuffer::commitSlow(backend::DriverApi& driverApi, void const* begin, void const* end) noexcept {
     const uintptr_t sizeInBytes = uintptr_t(end) - uintptr_t(begin);
     assert(sizeInBytes <= mRowSizeInBytes * mHeight);
-    driverApi.update2DImage(mTexture, 0, 0, 0, mWidth, mHeight,
-            { begin, sizeInBytes, mFormat, mType });
+
+    // only upload the rows covered by the data, the last one can be partial
+    const size_t elementSize = dataTypeToSize(mElement);
+    const size_t rowCount = sizeInBytes / mRowSizeInBytes;
+    const size_t lastRowSize = sizeInBytes - rowCount * mRowSizeInBytes;
+    if (rowCount) {
+        driverApi.update2DImage(mTexture, 0, 0, 0, mWidth, uint32_t(rowCount),
+                { begin, rowCount * mRowSizeInBytes, mFormat, mType });
+    }
+    if (lastRowSize) {
+        driverApi.update2DImage(mTexture, 0, 0, uint32_t(rowCount),
+                uint32_t(lastRowSize / elementSize), 1,
+                { static_cast<char const*>(begin) + rowCount * mRowSizeInBytes, lastRowSize,
+                  mFormat, mType });
+    }
 }
 
 } // namespace filament
@@ -78,6 +78,14 @@ public:
         group.setSampler(index, { getHandle(), getSamplerParams() });
     }
 
+    // true if this buffer is the one set at index in group
+    bool isSamplerSet(size_t index, backend::SamplerGroup const& group) const noexcept {
+        return group.getSamplers()[index].t == getHandle();
+    }
+
+    // false until the buffer is created
+    bool isValid() const noexcept { return bool(mTexture); }
+
 private:
     // this is really hidden implementation details (the fact we're using a texture should be
     // exposed as little as possible)
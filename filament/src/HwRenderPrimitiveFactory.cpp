@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/HwRenderPrimitiveFactory.h"
+
+#include "private/backend/CommandStream.h"
+
+#include <utils/Panic.h>
+
+namespace filament {
+namespace details {
+
+using namespace backend;
+
+static_assert(sizeof(HwRenderPrimitiveFactory::Key) == 8 * sizeof(uint32_t),
+        "HwRenderPrimitiveFactory::Key must not have padding");
+
+HwRenderPrimitiveFactory::HwRenderPrimitiveFactory() noexcept = default;
+
+HwRenderPrimitiveFactory::~HwRenderPrimitiveFactory() noexcept {
+    assert(mEntries.empty());
+}
+
+void HwRenderPrimitiveFactory::terminate(DriverApi& driver) noexcept {
+    for (auto const& item : mEntries) {
+        driver.destroyRenderPrimitive(item.second.handle);
+    }
+    mEntries.clear();
+}
+
+RenderPrimitiveHandle HwRenderPrimitiveFactory::acquire(
+        DriverApi& driver, Key const& key) noexcept {
+    auto pos = mEntries.find(key);
+    if (pos != mEntries.end()) {
+        pos.value().refs++;
+        return pos->second.handle;
+    }
+
+    RenderPrimitiveHandle handle = driver.createRenderPrimitive();
+    if (key.vbh && key.ibh) {
+        driver.setRenderPrimitiveBuffer(handle, key.vbh, key.ibh, key.enabledAttributes);
+        driver.setRenderPrimitiveRange(handle, PrimitiveType(key.type),
+                key.offset, key.minIndex, key.maxIndex, key.count);
+    }
+    mEntries.insert({ key, { handle, 1 }});
+    return handle;
+}
+
+void HwRenderPrimitiveFactory::release(DriverApi& driver, Key const& key) noexcept {
+    auto pos = mEntries.find(key);
+    ASSERT_PRECONDITION_NON_FATAL(pos != mEntries.end(), "unknown render primitive");
+    if (pos != mEntries.end() && --pos.value().refs == 0) {
+        driver.destroyRenderPrimitive(pos->second.handle);
+        mEntries.erase(pos);
+    }
+}
+
+} // namespace details
+} // namespace filament
@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/OcclusionCuller.h"
+
+#include <utils/JobSystem.h>
+#include <utils/Systrace.h>
+
+#include <math/vec2.h>
+#include <math/vec4.h>
+
+#include <algorithm>
+#include <limits>
+
+#include <math.h>
+
+using namespace filament::math;
+using namespace utils;
+
+namespace filament {
+namespace details {
+
+OcclusionCuller::OcclusionCuller() noexcept = default;
+
+OcclusionCuller::~OcclusionCuller() noexcept = default;
+
+void OcclusionCuller::begin(mat4f const& viewProjection) noexcept {
+    mViewProjection = viewProjection;
+    mTriangles.clear();
+    // the buffers are cleared by rasterize(), in parallel
+    mDepth.resize(WIDTH * HEIGHT);
+    mHiZ.resize(TILE_COUNT_X * TILE_COUNT_Y);
+}
+
+void OcclusionCuller::addOccluder(mat3x4f const& world,
+        float3 const* vertices, size_t vertexCount,
+        uint16_t const* indices, size_t indexCount) {
+    const mat4f m = mViewProjection * world.toMat4();
+    mClipVertices.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++) {
+        mClipVertices[i] = m * float4{ vertices[i], 1.0f };
+    }
+
+    const float2 viewport{ float(WIDTH), float(HEIGHT) };
+    for (size_t t = 0; t + 2 < indexCount; t += 3) {
+        float4 const& c0 = mClipVertices[indices[t    ]];
+        float4 const& c1 = mClipVertices[indices[t + 1]];
+        float4 const& c2 = mClipVertices[indices[t + 2]];
+
+        // we don't clip, triangles crossing the near plane just don't occlude anything
+        if (c0.z < -c0.w || c1.z < -c1.w || c2.z < -c2.w ||
+            c0.w <= 0.0f || c1.w <= 0.0f || c2.w <= 0.0f) {
+            continue;
+        }
+
+        // to window coordinates, in pixels
+        float2 p0 = (c0.xy / c0.w * 0.5f + 0.5f) * viewport;
+        float2 p1 = (c1.xy / c1.w * 0.5f + 0.5f) * viewport;
+        float2 p2 = (c2.xy / c2.w * 0.5f + 0.5f) * viewport;
+        float z0 = c0.z / c0.w;
+        float z1 = c1.z / c1.w;
+        float z2 = c2.z / c2.w;
+
+        // occluders are double-sided, we just make all triangles counter-clockwise
+        float area = (p1.x - p0.x) * (p2.y - p0.y) - (p1.y - p0.y) * (p2.x - p0.x);
+        if (area < 0) {
+            std::swap(p1, p2);
+            std::swap(z1, z2);
+            area = -area;
+        }
+        if (area < std::numeric_limits<float>::epsilon()) {
+            continue;
+        }
+
+        Triangle tri;
+        tri.xmin = std::max(0,              int32_t(floorf(std::min({ p0.x, p1.x, p2.x }))));
+        tri.ymin = std::max(0,              int32_t(floorf(std::min({ p0.y, p1.y, p2.y }))));
+        tri.xmax = std::min(int32_t(WIDTH  - 1), int32_t(ceilf(std::max({ p0.x, p1.x, p2.x }))));
+        tri.ymax = std::min(int32_t(HEIGHT - 1), int32_t(ceilf(std::max({ p0.y, p1.y, p2.y }))));
+        if (tri.xmin > tri.xmax || tri.ymin > tri.ymax) {
+            continue;
+        }
+
+        // edge (a, b): (a.y - b.y) * (x - a.x) + (b.x - a.x) * (y - a.y)
+        auto edge = [](float2 a, float2 b) -> float3 {
+            const float ea = a.y - b.y;
+            const float eb = b.x - a.x;
+            return { ea, eb, -(ea * a.x + eb * a.y) };
+        };
+        tri.edges[0] = edge(p0, p1);
+        tri.edges[1] = edge(p1, p2);
+        tri.edges[2] = edge(p2, p0);
+
+        const float dzdx = ((z1 - z0) * (p2.y - p0.y) - (z2 - z0) * (p1.y - p0.y)) / area;
+        const float dzdy = ((z2 - z0) * (p1.x - p0.x) - (z1 - z0) * (p2.x - p0.x)) / area;
+        tri.depth = { dzdx, dzdy, z0 - dzdx * p0.x - dzdy * p0.y };
+
+        mTriangles.push_back(tri);
+    }
+}
+
+void OcclusionCuller::rasterize(JobSystem& js) noexcept {
+    SYSTRACE_CALL();
+    auto work = [this](uint32_t first, uint32_t count) {
+        for (uint32_t row = first, last = first + count; row < last; row++) {
+            rasterizeTileRow(row);
+        }
+    };
+    js.runAndWait(jobs::parallel_for(js, nullptr, 0, uint32_t(TILE_COUNT_Y),
+            std::cref(work), jobs::CountSplitter<1, 8>()));
+}
+
+void OcclusionCuller::rasterizeTileRow(uint32_t row) noexcept {
+    const int32_t y0 = int32_t(row * TILE_SIZE);
+    const int32_t y1 = y0 + int32_t(TILE_SIZE) - 1;
+    float* const UTILS_RESTRICT depth = mDepth.data();
+
+    std::fill(depth + y0 * WIDTH, depth + (y1 + 1) * WIDTH,
+            std::numeric_limits<float>::infinity());
+
+    for (Triangle const& tri : mTriangles) {
+        const int32_t ymin = std::max(tri.ymin, y0);
+        const int32_t ymax = std::min(tri.ymax, y1);
+        for (int32_t y = ymin; y <= ymax; y++) {
+            // evaluate at pixel centers
+            const float py = y + 0.5f;
+            const float e0 = tri.edges[0].y * py + tri.edges[0].z;
+            const float e1 = tri.edges[1].y * py + tri.edges[1].z;
+            const float e2 = tri.edges[2].y * py + tri.edges[2].z;
+            const float ez = tri.depth.y * py + tri.depth.z;
+            float* const UTILS_RESTRICT line = depth + y * WIDTH;
+
+            // this loop is written without branches so the compiler can vectorize it
+            for (int32_t x = tri.xmin; x <= tri.xmax; x++) {
+                const float px = x + 0.5f;
+                const bool inside = (tri.edges[0].x * px + e0 >= 0.0f) &
+                                    (tri.edges[1].x * px + e1 >= 0.0f) &
+                                    (tri.edges[2].x * px + e2 >= 0.0f);
+                const float z = tri.depth.x * px + ez;
+                const float d = line[x];
+                line[x] = (inside & (z < d)) ? z : d;
+            }
+        }
+    }
+
+    // reduce this row of tiles to the farthest depth of each tile
+    float* const UTILS_RESTRICT hiz = mHiZ.data() + row * TILE_COUNT_X;
+    for (size_t tx = 0; tx < TILE_COUNT_X; tx++) {
+        float farthest = -std::numeric_limits<float>::infinity();
+        for (int32_t y = y0; y <= y1; y++) {
+            float const* const UTILS_RESTRICT line = depth + y * WIDTH + tx * TILE_SIZE;
+            for (size_t x = 0; x < TILE_SIZE; x++) {
+                farthest = std::max(farthest, line[x]);
+            }
+        }
+        hiz[tx] = farthest;
+    }
+}
+
+bool OcclusionCuller::isOccluded(float3 const& center, float3 const& extent) const noexcept {
+    mat4f const& m = mViewProjection;
+
+    // corners of the box in clip-space: c +/- ex +/- ey +/- ez
+    const float4 c  = m * float4{ center, 1.0f };
+    const float4 ex = m[0] * extent.x;
+    const float4 ey = m[1] * extent.y;
+    const float4 ez = m[2] * extent.z;
+
+    float2 pmin{ std::numeric_limits<float>::infinity() };
+    float2 pmax{ -std::numeric_limits<float>::infinity() };
+    float zmin = std::numeric_limits<float>::infinity();
+    for (size_t i = 0; i < 8; i++) {
+        const float4 p = c + ((i & 1) ? ex : -ex) + ((i & 2) ? ey : -ey) + ((i & 4) ? ez : -ez);
+        if (p.z < -p.w || p.w <= 0.0f) {
+            // the box crosses the near plane
+            return false;
+        }
+        const float2 xy = p.xy / p.w;
+        pmin = min(pmin, xy);
+        pmax = max(pmax, xy);
+        zmin = std::min(zmin, p.z / p.w);
+    }
+
+    // screen-space bounds in tiles
+    const float2 viewport{ float(WIDTH), float(HEIGHT) };
+    pmin = (pmin * 0.5f + 0.5f) * viewport;
+    pmax = (pmax * 0.5f + 0.5f) * viewport;
+    if (pmax.x < 0 || pmax.y < 0 || pmin.x >= WIDTH || pmin.y >= HEIGHT) {
+        // off-screen, this is for the frustum culling to decide
+        return false;
+    }
+    const size_t tx0 = size_t(std::max(0.0f, pmin.x)) / TILE_SIZE;
+    const size_t ty0 = size_t(std::max(0.0f, pmin.y)) / TILE_SIZE;
+    const size_t tx1 = std::min(size_t(pmax.x), WIDTH  - 1) / TILE_SIZE;
+    const size_t ty1 = std::min(size_t(pmax.y), HEIGHT - 1) / TILE_SIZE;
+
+    float const* const UTILS_RESTRICT hiz = mHiZ.data();
+    for (size_t ty = ty0; ty <= ty1; ty++) {
+        for (size_t tx = tx0; tx <= tx1; tx++) {
+            if (zmin <= hiz[ty * TILE_COUNT_X + tx]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void OcclusionCuller::cull(JobSystem& js, Culler::result_type* results,
+        float3 const* center, float3 const* extent, size_t count, size_t bit) const noexcept {
+    SYSTRACE_CALL();
+    if (mTriangles.empty()) {
+        return;
+    }
+    const Culler::result_type mask = Culler::result_type(1u << bit);
+    auto work = [this, results, center, extent, mask](uint32_t start, uint32_t n) {
+        for (uint32_t i = start, last = start + n; i < last; i++) {
+            if ((results[i] & mask) && isOccluded(center[i], extent[i])) {
+                results[i] &= ~mask;
+            }
+        }
+    };
+    js.runAndWait(jobs::parallel_for(js, nullptr, 0, uint32_t(count),
+            std::cref(work), jobs::CountSplitter<64, 8>()));
+}
+
+} // namespace details
+} // namespace filament
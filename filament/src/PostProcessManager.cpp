@@ -201,7 +201,7 @@ FrameGraphResource PostProcessManager::toneMapping(FrameGraph& fg, FrameGraphRes
 
                 auto const& target = resources.getRenderTarget(data.output);
                 driver.beginRenderPass(target.target, target.params);
-                driver.draw(pipeline, fullScreenRenderPrimitive);
+                driver.draw(pipeline, fullScreenRenderPrimitive, 1);
                 driver.endRenderPass();
             });
 
@@ -255,7 +255,7 @@ FrameGraphResource PostProcessManager::fxaa(FrameGraph& fg,
 
                 auto const& target = resources.getRenderTarget(data.output);
                 driver.beginRenderPass(target.target, target.params);
-                driver.draw(pipeline, fullScreenRenderPrimitive);
+                driver.draw(pipeline, fullScreenRenderPrimitive, 1);
                 driver.endRenderPass();
             });
 
@@ -420,7 +420,7 @@ FrameGraphResource PostProcessManager::ssao(FrameGraph& fg, RenderPass& pass,
                 pipeline.rasterState.depthFunc = RasterState::DepthFunc::G;
 
                 driver.beginRenderPass(ssao.target, ssao.params);
-                driver.draw(pipeline, fullScreenRenderPrimitive);
+                driver.draw(pipeline, fullScreenRenderPrimitive, 1);
                 driver.endRenderPass();
             });
 
@@ -520,7 +520,7 @@ FrameGraphResource PostProcessManager::mipmapPass(FrameGraph& fg,
                 pipeline.rasterState = mMipmapDepth.getMaterial()->getRasterState();
 
                 driver.beginRenderPass(out.target, out.params);
-                driver.draw(pipeline, fullScreenRenderPrimitive);
+                driver.draw(pipeline, fullScreenRenderPrimitive, 1);
                 driver.endRenderPass();
             });
 
@@ -581,7 +581,7 @@ FrameGraphResource PostProcessManager::blurPass(FrameGraph& fg, FrameGraphResour
                 pipeline.rasterState.depthFunc = RasterState::DepthFunc::G;
 
                 driver.beginRenderPass(blurred.target, blurred.params);
-                driver.draw(pipeline, fullScreenRenderPrimitive);
+                driver.draw(pipeline, fullScreenRenderPrimitive, 1);
                 driver.endRenderPass();
             });
 
@@ -26,11 +26,14 @@
 // NOTE: We only need Renderer.h here because the definition of some FRenderer methods are here
 #include "details/Renderer.h"
 
+#include <private/filament/EngineEnums.h>
 #include <private/filament/UibGenerator.h>
 
 #include <utils/JobSystem.h>
 #include <utils/Systrace.h>
 
+#include <algorithm>
+#include <iterator>
 #include <utility>
 
 using namespace utils;
@@ -47,6 +50,14 @@ RenderPass::RenderPass(FEngine& engine,
         : mEngine(engine), mCommands(commands) {
 }
 
+RenderPass::~RenderPass() noexcept {
+    // the commands using these have been recorded by now
+    DriverApi& driver = mEngine.getDriverApi();
+    for (InstanceBuffer const& buffer : mInstanceBuffers) {
+        driver.destroyUniformBuffer(buffer.ubh);
+    }
+}
+
 void RenderPass::setGeometry(FScene& scene, Range<uint32_t> vr) noexcept {
     mScene = &scene;
     mVisibleRenderables = vr;
@@ -60,6 +71,14 @@ void RenderPass::setRenderFlags(RenderPass::RenderFlags flags) noexcept {
     mFlags = flags;
 }
 
+void RenderPass::setCommandCache(CommandCache* cache) noexcept {
+    mCommandCache = cache;
+}
+
+void RenderPass::setVisibilityMask(uint8_t mask) noexcept {
+    mVisibilityMask = mask;
+}
+
 void RenderPass::overridePolygonOffset(backend::PolygonOffset* polygonOffset) noexcept {
     if ((mPolygonOffsetOverride = (polygonOffset != nullptr))) {
         mPolygonOffset = *polygonOffset;
@@ -67,12 +86,46 @@ void RenderPass::overridePolygonOffset(backend::PolygonOffset* polygonOffset) no
 }
 
 RenderPass::Command const* RenderPass::appendSortedCommands(CommandTypeFlags const commandTypeFlags) noexcept {
+    // up-to-date summed primitive counts needed for generateCommands()
+    updateSummedPrimitiveCounts(mScene->getRenderableData(), mVisibleRenderables);
+    return appendCommands(commandTypeFlags);
+}
+
+void RenderPass::appendSortedCommands(JobSystem& js, RenderPass* const* passes, size_t count,
+        CommandTypeFlags const commandTypeFlags) noexcept {
+    SYSTRACE_CALL();
+    if (count == 1) {
+        passes[0]->appendSortedCommands(commandTypeFlags);
+        return;
+    }
+
+    // the passes share their geometry, so the summed primitive counts are only updated once,
+    // each pass then only writes in its own commands buffer.
+    updateSummedPrimitiveCounts(passes[0]->mScene->getRenderableData(),
+            passes[0]->mVisibleRenderables);
+
+    auto parent = js.createJob();
+    for (size_t i = 0; i < count; i++) {
+        RenderPass* const pass = passes[i];
+        assert(pass->mScene == passes[0]->mScene);
+        assert(pass->mVisibleRenderables.first == passes[0]->mVisibleRenderables.first);
+        assert(pass->mVisibleRenderables.last == passes[0]->mVisibleRenderables.last);
+        assert(!pass->mCommandCache && !(pass->mFlags & HAS_INSTANCING));
+        js.run(js.createJob(parent, [pass, commandTypeFlags](JobSystem&, JobSystem::Job*) {
+            pass->appendCommands(commandTypeFlags);
+        }));
+    }
+    js.runAndWait(parent);
+}
+
+RenderPass::Command const* RenderPass::appendCommands(CommandTypeFlags const commandTypeFlags) noexcept {
     SYSTRACE_CONTEXT();
 
     FEngine& engine = mEngine;
     JobSystem& js = engine.getJobSystem();
     GrowingSlice<Command>& commands = mCommands;
     const RenderFlags renderFlags = mFlags;
+    const uint8_t visibilityMask = mVisibilityMask;
     CameraInfo const& camera = mCamera;
     FScene& scene = *mScene;
     utils::Range<uint32_t> vr = mVisibleRenderables;
@@ -81,9 +134,6 @@ RenderPass::Command const* RenderPass::appendSortedCommands(CommandTypeFlags con
     // trace the number of visible renderables
     SYSTRACE_VALUE32("visibleRenderables", vr.size());
 
-    // up-to-date summed primitive counts needed for generateCommands()
-    updateSummedPrimitiveCounts(const_cast<FScene::RenderableSoa&>(soa), vr);
-
     // compute how much maximum storage we need for this pass
     uint32_t growBy = FScene::getPrimitiveCount(soa, vr.last);
     // double the color pass for transparent objects that need to render twice
@@ -95,19 +145,48 @@ RenderPass::Command const* RenderPass::appendSortedCommands(CommandTypeFlags con
     // we extract camera position/forward outside of the loop, because these are not cheap.
     const float3 cameraPosition(camera.getPosition());
     const float3 cameraForwardVector(camera.getForwardVector());
-    auto work = [commandTypeFlags, curr, &soa, renderFlags, cameraPosition, cameraForwardVector]
-            (uint32_t startIndex, uint32_t indexCount) {
-        RenderPass::generateCommands(commandTypeFlags, curr,
-                soa, { startIndex, startIndex + indexCount }, renderFlags,
-                cameraPosition, cameraForwardVector);
-    };
 
-    auto jobCommandsParallel = jobs::parallel_for(js, nullptr, vr.first, (uint32_t)vr.size(),
-            std::cref(work), jobs::CountSplitter<JOBS_PARALLEL_FOR_COMMANDS_COUNT, 8>());
+    CommandCache::Entry* const cacheEntry =
+            mCommandCache ? &mCommandCache->acquire(commandTypeFlags) : nullptr;
+    const CacheState cacheState = cacheEntry ?
+            validateCache(*cacheEntry, commandTypeFlags, cameraPosition, cameraForwardVector) :
+            CacheState::MISS;
+
+    if (cacheState == CacheState::HIT) {
+        SYSTRACE_NAME("cached commands");
+        mCommandCache->mStats.hits++;
+        std::vector<Command> const& cached = cacheEntry->commands;
+        std::copy(cached.begin(), cached.end(), curr);
+        commands.resize(uint32_t(curr + cached.size() - commands.begin()));
+    } else if (cacheState == CacheState::PATCH) {
+        SYSTRACE_NAME("patch cached commands");
+        mCommandCache->mStats.patches++;
+        const uint32_t count = patchCommands(*cacheEntry, curr,
+                cameraPosition, cameraForwardVector);
+        commands.resize(uint32_t(curr + count - commands.begin()));
+    } else {
+        auto work = [commandTypeFlags, curr, &soa, renderFlags, visibilityMask,
+                cameraPosition, cameraForwardVector](uint32_t startIndex, uint32_t indexCount) {
+            RenderPass::generateCommands(commandTypeFlags, curr,
+                    soa, { startIndex, startIndex + indexCount }, renderFlags, visibilityMask,
+                    cameraPosition, cameraForwardVector);
+        };
+
+        auto jobCommandsParallel = jobs::parallel_for(js, nullptr, vr.first, (uint32_t)vr.size(),
+                std::cref(work), jobs::CountSplitter<JOBS_PARALLEL_FOR_COMMANDS_COUNT, 8>());
+
+        { // scope for systrace
+            SYSTRACE_NAME("jobCommandsParallel");
+            js.runAndWait(jobCommandsParallel);
+        }
 
-    { // scope for systrace
-        SYSTRACE_NAME("jobCommandsParallel");
-        js.runAndWait(jobCommandsParallel);
+        { // sort all commands
+            SYSTRACE_NAME("sort commands");
+            // the unused part of the commands buffer is used as scratch space for the radix sort
+            Command* const scratch = commands.remain() >= size_t(commands.end() - curr) ?
+                    commands.end() : nullptr;
+            sortCommands(js, curr, commands.end(), scratch);
+        }
     }
 
     // always add an "eof" command
@@ -115,11 +194,6 @@ RenderPass::Command const* RenderPass::appendSortedCommands(CommandTypeFlags con
     // command buffer.
     commands.grow(1)->key = uint64_t(Pass::SENTINEL);
 
-    { // sort all commands
-        SYSTRACE_NAME("sort commands");
-        std::sort(curr, commands.end());
-    }
-
     mCommandsHighWatermark = std::max(mCommandsHighWatermark, size_t(commands.size()));
 
     // find the last command
@@ -130,9 +204,315 @@ RenderPass::Command const* RenderPass::appendSortedCommands(CommandTypeFlags con
 
     commands.resize(uint32_t(last - commands.begin()));
 
+    if (cacheEntry && cacheState == CacheState::MISS) {
+        mCommandCache->mStats.misses++;
+        cacheEntry->commands.assign(static_cast<Command const*>(curr), last);
+        cacheEntry->valid = true;
+    }
+
+    // merge identical commands into instanced draws, this is done after caching because the
+    // index of merged commands doesn't refer to a renderable anymore.
+    const uint32_t instanceCount =
+            (renderFlags & HAS_INSTANCING) ? getInstanceCount(curr, last) : 0;
+    if (instanceCount) {
+        SYSTRACE_NAME("instance commands");
+        DriverApi& driver = engine.getDriverApi();
+        const size_t size = FScene::getPerRenderableUboSize(instanceCount);
+        void* const instances = driver.allocate(size);
+        Command* const end = instanceCommands(curr, commands.end(), soa, instances);
+        Handle<HwUniformBuffer> ubh = driver.createUniformBuffer(size, BufferUsage::STREAM);
+        driver.loadUniformBuffer(ubh, { instances, size });
+        mInstanceBuffers.push_back({ curr, end, ubh });
+        commands.resize(uint32_t(end - commands.begin()));
+    }
+
     return commands.end();
 }
 
+// whether two commands can be drawn by a single instanced draw call
+static inline bool canInstance(RenderPass::PrimitiveInfo const& lhs,
+        RenderPass::PrimitiveInfo const& rhs) noexcept {
+    return lhs.primitiveHandle == rhs.primitiveHandle &&
+           lhs.mi == rhs.mi &&
+           lhs.materialVariant.key == rhs.materialVariant.key &&
+           lhs.rasterState.u == rhs.rasterState.u &&
+           !lhs.materialVariant.hasSkinning();
+}
+
+// returns the end of the run of commands starting at 'first' that can be instanced together
+static inline RenderPass::Command const* findInstances(
+        RenderPass::Command const* first, RenderPass::Command const* last) noexcept {
+    RenderPass::Command const* const end =
+            first + std::min(size_t(last - first), CONFIG_MAX_INSTANCES);
+    RenderPass::Command const* curr = first + 1;
+    while (curr < end && canInstance(first->primitive, curr->primitive)) {
+        ++curr;
+    }
+    return curr;
+}
+
+uint32_t RenderPass::getInstanceCount(Command const* first, Command const* last) noexcept {
+    uint32_t count = 0;
+    while (first != last) {
+        Command const* const end = findInstances(first, last);
+        const uint32_t n = uint32_t(end - first);
+        count += n > 1 ? n : 0;
+        first = end;
+    }
+    return count;
+}
+
+RenderPass::Command* RenderPass::instanceCommands(Command* first, Command* last,
+        FScene::RenderableSoa const& soa, void* instances) noexcept {
+    SYSTRACE_CALL();
+    mat3x4f const* const UTILS_RESTRICT transforms = soa.data<FScene::WORLD_TRANSFORM>();
+    mat3f const* const UTILS_RESTRICT normals = soa.data<FScene::WORLD_NORMAL>();
+    Command* out = first;
+    uint32_t instanceIndex = 0;
+    while (first != last) {
+        const size_t count = size_t(findInstances(first, last) - first);
+        *out = *first;
+        if (count > 1) {
+            for (size_t i = 0; i < count; i++) {
+                const uint32_t row = first[i].primitive.index;
+                FScene::setPerRenderableUniforms(instances,
+                        (instanceIndex + i) * sizeof(PerRenderableUib),
+                        transforms[row], normals[row]);
+            }
+            out->primitive.index = uint16_t(instanceIndex);
+            out->primitive.instanceCount = uint8_t(count);
+            instanceIndex += count;
+        }
+        ++out;
+        first += count;
+    }
+    return out;
+}
+
+Handle<HwUniformBuffer> RenderPass::getInstanceBuffer(Command const* first) const noexcept {
+    // the commands buffer is reused after the shadow pass, so the most recent range wins
+    auto pos = std::find_if(mInstanceBuffers.rbegin(), mInstanceBuffers.rend(),
+            [first](InstanceBuffer const& buffer) {
+                return first >= buffer.first && first < buffer.last;
+            });
+    return pos != mInstanceBuffers.rend() ? pos->ubh : Handle<HwUniformBuffer>{};
+}
+
+RenderPass::CacheState RenderPass::validateCache(CommandCache::Entry& entry,
+        uint32_t commandTypeFlags, float3 cameraPosition, float3 cameraForward) const noexcept {
+    FScene const& scene = *mScene;
+    FRenderableManager const& rcm = mEngine.getRenderableManager();
+    const Range<uint32_t> vr = mVisibleRenderables;
+    FScene::RenderableSoa const& soa = scene.getRenderableData();
+    auto const* const UTILS_RESTRICT soaInstance = soa.data<FScene::RENDERABLE_INSTANCE>();
+    auto const* const UTILS_RESTRICT soaWorldAABBCenter = soa.data<FScene::WORLD_AABB_CENTER>();
+    auto const* const UTILS_RESTRICT soaPrimitives = soa.data<FScene::PRIMITIVES>();
+    auto const* const UTILS_RESTRICT soaVisibleMask = soa.data<FScene::VISIBLE_MASK>();
+    const uint8_t visibilityMask = mVisibilityMask;
+
+    // all commands depend on the camera, through the distance of each renderable
+    bool compatible = entry.valid && entry.scene == &scene &&
+            entry.commandTypeFlags == commandTypeFlags &&
+            entry.renderFlags == mFlags &&
+            entry.visibilityMask == mVisibilityMask &&
+            entry.cameraPosition == cameraPosition &&
+            entry.cameraForward == cameraForward &&
+            entry.vr.first == vr.first && entry.vr.last == vr.last;
+
+    entry.scene = &scene;
+    entry.commandTypeFlags = commandTypeFlags;
+    entry.renderFlags = mFlags;
+    entry.visibilityMask = mVisibilityMask;
+    entry.cameraPosition = cameraPosition;
+    entry.cameraForward = cameraForward;
+    entry.vr = vr;
+    entry.rows.resize(vr.size());
+    entry.dirtyRows.resize(vr.size());
+
+    // Commands reference their renderable by index, so if a row now holds another renderable
+    // (e.g. after the scene changed), all the cached commands are stale.
+    uint32_t dirtyCount = 0;
+    CommandCache::Row* const UTILS_RESTRICT rows = entry.rows.data();
+    uint8_t* const UTILS_RESTRICT dirtyRows = entry.dirtyRows.data();
+    for (uint32_t i = vr.first, k = 0; i < vr.last; ++i, ++k) {
+        const CommandCache::Row row{
+                soaInstance[i], rcm.getGeneration(soaInstance[i]),
+                soaWorldAABBCenter[i], soaPrimitives[i].data(),
+                uint8_t(soaVisibleMask[i] & visibilityMask) };
+        compatible = compatible && rows[k].ri == row.ri;
+        const bool dirty = !(rows[k] == row);
+        dirtyRows[k] = uint8_t(dirty);
+        dirtyCount += dirty;
+        rows[k] = row;
+    }
+
+    SYSTRACE_VALUE32("commandCacheDirtyRows", dirtyCount);
+
+    // past a certain point, it's cheaper to regenerate everything
+    if (!compatible || dirtyCount > vr.size() / 4) {
+        entry.valid = false;
+        return CacheState::MISS;
+    }
+    return dirtyCount ? CacheState::PATCH : CacheState::HIT;
+}
+
+uint32_t RenderPass::patchCommands(CommandCache::Entry& entry, Command* const commands,
+        float3 cameraPosition, float3 cameraForward) const noexcept {
+    FScene::RenderableSoa const& soa = mScene->getRenderableData();
+    const Range<uint32_t> vr = mVisibleRenderables;
+    const uint32_t commandTypeFlags = entry.commandTypeFlags;
+    const bool colorPass  = bool(commandTypeFlags & CommandTypeFlags::COLOR);
+    const bool depthPass  = bool(commandTypeFlags & CommandTypeFlags::DEPTH);
+    const uint32_t commandsPerPrimitive = uint32_t(colorPass * 2 + depthPass);
+    uint8_t const* const dirtyRows = entry.dirtyRows.data();
+
+    // regenerate the commands of the dirty rows, at their usual place in the commands buffer
+    std::vector<Command>& patch = entry.patch;
+    patch.clear();
+    for (uint32_t i = vr.first; i < vr.last; ++i) {
+        if (dirtyRows[i - vr.first]) {
+            generateCommands(commandTypeFlags, commands, soa, { i, i + 1 }, mFlags,
+                    mVisibilityMask, cameraPosition, cameraForward);
+            Command const* const first =
+                    commands + FScene::getPrimitiveCount(soa, i) * commandsPerPrimitive;
+            Command const* const last =
+                    commands + FScene::getPrimitiveCount(soa, i + 1) * commandsPerPrimitive;
+            std::copy_if(first, last, std::back_inserter(patch), [](Command const& c) {
+                return ((c.key & PASS_MASK) >> PASS_SHIFT) != 0xFF;
+            });
+        }
+    }
+    std::sort(patch.begin(), patch.end());
+
+    // drop the stale commands and merge the new ones
+    std::vector<Command>& cached = entry.commands;
+    cached.erase(std::remove_if(cached.begin(), cached.end(),
+            [dirtyRows, first = vr.first](Command const& c) {
+                return dirtyRows[c.primitive.index - first];
+            }), cached.end());
+
+    Command* const last = std::merge(cached.begin(), cached.end(),
+            patch.begin(), patch.end(), commands);
+    cached.assign(commands, last);
+    return uint32_t(last - commands);
+}
+
+void RenderPass::CommandCache::clear() noexcept {
+    for (Entry& entry : mEntries) {
+        entry = Entry{};
+    }
+    mStats = {};
+}
+
+RenderPass::CommandCache::Entry& RenderPass::CommandCache::acquire(
+        uint32_t commandTypeFlags) noexcept {
+    Entry* lru = &mEntries[0];
+    for (Entry& entry : mEntries) {
+        if (entry.valid && entry.commandTypeFlags == commandTypeFlags) {
+            lru = &entry;
+            break;
+        }
+        if (entry.lastUse < lru->lastUse) {
+            lru = &entry;
+        }
+    }
+    lru->lastUse = ++mUseCount;
+    return *lru;
+}
+
+void RenderPass::sortCommands(JobSystem& js,
+        Command* first, Command* last, Command* scratch) noexcept {
+    if (scratch && size_t(last - first) >= RADIX_SORT_MIN_COUNT) {
+        radixSortCommands(js, first, last, scratch);
+    } else {
+        std::sort(first, last);
+    }
+}
+
+void RenderPass::radixSortCommands(JobSystem& js,
+        Command* first, Command* last, Command* scratch) noexcept {
+    const uint32_t count = uint32_t(last - first);
+    const uint32_t chunkCount = uint32_t(std::min(RADIX_SORT_MAX_CHUNK_COUNT,
+            std::max(size_t(1), count / RADIX_SORT_MIN_CHUNK_SIZE)));
+    auto chunkBegin = [count, chunkCount](uint32_t chunk) -> uint32_t {
+        return uint32_t((uint64_t(count) * chunk) / chunkCount);
+    };
+
+    // find which bytes of the key actually vary, the other ones don't need a pass
+    CommandKey differences[RADIX_SORT_MAX_CHUNK_COUNT];
+    const CommandKey reference = first->key;
+    auto findDifferences = [&](uint32_t startChunk, uint32_t chunks) {
+        for (uint32_t c = startChunk, e = startChunk + chunks; c < e; c++) {
+            CommandKey diff = 0;
+            for (uint32_t i = chunkBegin(c), n = chunkBegin(c + 1); i < n; i++) {
+                diff |= first[i].key ^ reference;
+            }
+            differences[c] = diff;
+        }
+    };
+    js.runAndWait(jobs::parallel_for(js, nullptr, 0, chunkCount,
+            std::cref(findDifferences), jobs::CountSplitter<1, 8>()));
+
+    CommandKey difference = 0;
+    for (uint32_t c = 0; c < chunkCount; c++) {
+        difference |= differences[c];
+    }
+
+    // the histograms are turned in-place into each chunk's output offsets
+    uint32_t offsets[RADIX_SORT_MAX_CHUNK_COUNT][256];
+    Command* src = first;
+    Command* dst = scratch;
+    for (uint32_t shift = 0; shift < sizeof(CommandKey) * 8; shift += 8) {
+        if (!((difference >> shift) & 0xFF)) {
+            continue;
+        }
+
+        auto histogram = [&, shift](uint32_t startChunk, uint32_t chunks) {
+            for (uint32_t c = startChunk, e = startChunk + chunks; c < e; c++) {
+                uint32_t* const UTILS_RESTRICT h = offsets[c];
+                std::fill_n(h, 256, 0);
+                for (uint32_t i = chunkBegin(c), n = chunkBegin(c + 1); i < n; i++) {
+                    h[(src[i].key >> shift) & 0xFF]++;
+                }
+            }
+        };
+        js.runAndWait(jobs::parallel_for(js, nullptr, 0, chunkCount,
+                std::cref(histogram), jobs::CountSplitter<1, 8>()));
+
+        // each digit's commands from chunk c go right after the ones from chunks [0, c)
+        uint32_t offset = 0;
+        for (size_t digit = 0; digit < 256; digit++) {
+            for (uint32_t c = 0; c < chunkCount; c++) {
+                const uint32_t n = offsets[c][digit];
+                offsets[c][digit] = offset;
+                offset += n;
+            }
+        }
+
+        auto scatter = [&, shift](uint32_t startChunk, uint32_t chunks) {
+            for (uint32_t c = startChunk, e = startChunk + chunks; c < e; c++) {
+                uint32_t* const UTILS_RESTRICT o = offsets[c];
+                for (uint32_t i = chunkBegin(c), n = chunkBegin(c + 1); i < n; i++) {
+                    dst[o[(src[i].key >> shift) & 0xFF]++] = src[i];
+                }
+            }
+        };
+        js.runAndWait(jobs::parallel_for(js, nullptr, 0, chunkCount,
+                std::cref(scatter), jobs::CountSplitter<1, 8>()));
+
+        std::swap(src, dst);
+    }
+
+    // after an odd number of passes, the sorted commands are in the scratch buffer
+    if (src != first) {
+        auto copy = [src, first](uint32_t start, uint32_t n) {
+            std::copy_n(src + start, n, first + start);
+        };
+        js.runAndWait(jobs::parallel_for(js, nullptr, 0, count,
+                std::cref(copy), jobs::CountSplitter<RADIX_SORT_MIN_CHUNK_SIZE, 8>()));
+    }
+}
+
 void RenderPass::execute(const char* name,
         backend::Handle<backend::HwRenderTarget> renderTarget,
         backend::RenderPassParams params,
@@ -147,13 +527,14 @@ void RenderPass::execute(const char* name,
     // Now, execute all commands
     driver.pushGroupMarker(name);
     driver.beginRenderPass(renderTarget, params);
-    RenderPass::recordDriverCommands(driver, scene, first, last);
+    RenderPass::recordDriverCommandsParallel(driver, scene, getInstanceBuffer(first), first, last);
     driver.endRenderPass();
     driver.popGroupMarker();
 }
 
 UTILS_NOINLINE // no need to be inlined
 void RenderPass::recordDriverCommands(FEngine::DriverApi& driver, FScene& scene,
+        Handle<HwUniformBuffer> instanceUbh,
         const Command* UTILS_RESTRICT first, const Command* last)  const noexcept {
     SYSTRACE_CALL();
 
@@ -166,6 +547,7 @@ void RenderPass::recordDriverCommands(FEngine::DriverApi& driver, FScene& scene,
                 mPolygonOffsetOverride ? &dummyPolyOffset : &pipeline.polygonOffset;
 
         Handle<HwUniformBuffer> uboHandle = scene.getRenderableUBO();
+        Handle<HwUniformBuffer> bonesHandle = mEngine.getRenderableManager().getBonePaletteUbh();
         FMaterialInstance const* UTILS_RESTRICT mi = nullptr;
         FMaterial const* UTILS_RESTRICT ma = nullptr;
         while (first != last) {
@@ -186,16 +568,89 @@ void RenderPass::recordDriverCommands(FEngine::DriverApi& driver, FScene& scene,
 
             pipeline.program = ma->getProgram(info.materialVariant.key);
             size_t offset = info.index * sizeof(PerRenderableUib);
-            if (info.perRenderableBones) {
-                driver.bindUniformBuffer(BindingPoints::PER_RENDERABLE_BONES, info.perRenderableBones);
+            if (UTILS_UNLIKELY(info.materialVariant.hasSkinning())) {
+                // the bones of all the renderables are in the bone palette
+                driver.bindUniformBufferRange(BindingPoints::PER_RENDERABLE_BONES, bonesHandle,
+                        info.bonesOffset, BonePalette::BINDING_SIZE);
             }
-            driver.bindUniformBufferRange(BindingPoints::PER_RENDERABLE, uboHandle, offset, sizeof(PerRenderableUib));
-            driver.draw(pipeline, info.primitiveHandle);
+            // the shaders always see CONFIG_MAX_INSTANCES instances, see getPerRenderableUboSize()
+            driver.bindUniformBufferRange(BindingPoints::PER_RENDERABLE,
+                    info.instanceCount > 1 ? instanceUbh : uboHandle,
+                    offset, CONFIG_MAX_INSTANCES * sizeof(PerRenderableUib));
+            driver.draw(pipeline, info.primitiveHandle, info.instanceCount);
             ++first;
         }
     }
 }
 
+// Upper bound of the size of the driver commands recordDriverCommands() records for a Command:
+// FMaterialInstance::use(), the bones and per-renderable bindings, and the draw.
+static constexpr size_t MAX_DRIVER_COMMANDS_SIZE =
+        CommandBase::align(sizeof(COMMAND_TYPE(bindUniformBuffer))) +
+        CommandBase::align(sizeof(COMMAND_TYPE(bindSamplers))) +
+        CommandBase::align(sizeof(COMMAND_TYPE(setViewportScissor))) +
+        CommandBase::align(sizeof(COMMAND_TYPE(bindUniformBufferRange))) * 2 +
+        CommandBase::align(sizeof(COMMAND_TYPE(draw)));
+
+// maximum number of commands recorded into a secondary driver api between two splices
+static constexpr size_t PARALLEL_RECORD_MAX_CHUNK_SIZE =
+        CONFIG_SECONDARY_COMMAND_BUFFERS_SIZE / MAX_DRIVER_COMMANDS_SIZE;
+
+UTILS_NOINLINE // no need to be inlined
+void RenderPass::recordDriverCommandsParallel(FEngine::DriverApi& driver, FScene& scene,
+        Handle<HwUniformBuffer> instanceUbh,
+        const Command* first, const Command* last) const noexcept {
+    const size_t count = size_t(last - first);
+    // a capture only sees the commands recorded directly in the driver api
+    if (count < PARALLEL_RECORD_MIN_COUNT || driver.isCapturing()) {
+        recordDriverCommands(driver, scene, instanceUbh, first, last);
+        return;
+    }
+
+    SYSTRACE_CALL();
+
+    FEngine& engine = mEngine;
+    JobSystem& js = engine.getJobSystem();
+
+    // getProgram() creates the missing programs with the driver api of this thread
+    for (Command const* command = first; command != last; ++command) {
+        PrimitiveInfo const& info = command->primitive;
+        info.mi->getMaterial()->getProgram(info.materialVariant.key);
+    }
+
+    // one chunk per secondary driver api, unless they'd be too small or too large
+    constexpr size_t streamCount = CONFIG_SECONDARY_COMMAND_STREAM_COUNT;
+    const size_t chunkSize = std::min(PARALLEL_RECORD_MAX_CHUNK_SIZE,
+            std::max(PARALLEL_RECORD_MIN_CHUNK_SIZE, (count + streamCount - 1) / streamCount));
+
+    while (first != last) {
+        // each round records at most one chunk in each secondary driver api
+        Command const* const roundLast =
+                first + std::min(size_t(last - first), chunkSize * streamCount);
+        const size_t chunkCount = (size_t(roundLast - first) + chunkSize - 1) / chunkSize;
+
+        auto work = [this, &engine, &scene, instanceUbh, first, roundLast, chunkSize](
+                uint32_t startIndex, uint32_t indexCount) {
+            for (uint32_t i = startIndex; i < startIndex + indexCount; i++) {
+                DriverApi& secondary = engine.getSecondaryDriverApi(i);
+                secondary.debugThreading();
+                Command const* const chunkFirst = first + i * chunkSize;
+                recordDriverCommands(secondary, scene, instanceUbh,
+                        chunkFirst, std::min(chunkFirst + chunkSize, roundLast));
+            }
+        };
+
+        js.runAndWait(jobs::parallel_for(js, nullptr, 0, uint32_t(chunkCount),
+                std::cref(work), jobs::CountSplitter<1, 8>()));
+
+        for (size_t i = 0; i < chunkCount; i++) {
+            driver.splice(engine.getSecondaryDriverApi(i));
+        }
+
+        first = roundLast;
+    }
+}
+
 /* static */
 UTILS_ALWAYS_INLINE // this function exists only to make the code more readable. we want it inlined.
 inline              // and we don't need it in the compilation unit
@@ -247,7 +702,7 @@ void RenderPass::setupColorCommand(Command& cmdDraw, bool hasDepthPass,
 UTILS_NOINLINE
 void RenderPass::generateCommands(uint32_t commandTypeFlags, Command* const commands,
         FScene::RenderableSoa const& soa, Range<uint32_t> range, RenderFlags renderFlags,
-        float3 cameraPosition, float3 cameraForward) noexcept {
+        uint8_t visibilityMask, float3 cameraPosition, float3 cameraForward) noexcept {
 
     // generateCommands() writes both the draw and depth commands simultaneously such that
     // we go throw the list of renderables just once.
@@ -274,15 +729,15 @@ void RenderPass::generateCommands(uint32_t commandTypeFlags, Command* const comm
     switch (commandTypeFlags & CommandTypeFlags::COLOR_AND_DEPTH) {
         case CommandTypeFlags::COLOR:
             generateCommandsImpl<CommandTypeFlags::COLOR>(commandTypeFlags, curr,
-                    soa, range, renderFlags, cameraPosition, cameraForward);
+                    soa, range, renderFlags, visibilityMask, cameraPosition, cameraForward);
             break;
         case CommandTypeFlags::DEPTH:
             generateCommandsImpl<CommandTypeFlags::DEPTH>(commandTypeFlags, curr,
-                    soa, range, renderFlags, cameraPosition, cameraForward);
+                    soa, range, renderFlags, visibilityMask, cameraPosition, cameraForward);
             break;
         case CommandTypeFlags::COLOR_AND_DEPTH:
             generateCommandsImpl<CommandTypeFlags::COLOR_AND_DEPTH>(commandTypeFlags, curr,
-                    soa, range, renderFlags, cameraPosition, cameraForward);
+                    soa, range, renderFlags, visibilityMask, cameraPosition, cameraForward);
             break;
     }
 }
@@ -293,7 +748,7 @@ UTILS_NOINLINE
 void RenderPass::generateCommandsImpl(uint32_t extraFlags,
         Command* UTILS_RESTRICT curr,
         FScene::RenderableSoa const& UTILS_RESTRICT soa, Range<uint32_t> range,
-        RenderFlags renderFlags,
+        RenderFlags renderFlags, uint8_t visibilityMask,
         float3 cameraPosition, float3 cameraForward) noexcept {
 
     // generateCommands() writes both the draw and depth commands simultaneously such that
@@ -310,7 +765,8 @@ void RenderPass::generateCommandsImpl(uint32_t extraFlags,
     auto const* const UTILS_RESTRICT soaWorldAABBCenter = soa.data<FScene::WORLD_AABB_CENTER>();
     auto const* const UTILS_RESTRICT soaVisibility      = soa.data<FScene::VISIBILITY_STATE>();
     auto const* const UTILS_RESTRICT soaPrimitives      = soa.data<FScene::PRIMITIVES>();
-    auto const* const UTILS_RESTRICT soaBonesUbh        = soa.data<FScene::BONES_UBH>();
+    auto const* const UTILS_RESTRICT soaBonesOffset     = soa.data<FScene::BONES_OFFSET>();
+    auto const* const UTILS_RESTRICT soaVisibleMask     = soa.data<FScene::VISIBLE_MASK>();
 
     const bool hasShadowing = renderFlags & HAS_SHADOWING;
     const bool inverseFrontFaces = renderFlags & HAS_INVERSE_FRONT_FACES;
@@ -364,7 +820,7 @@ void RenderPass::generateCommandsImpl(uint32_t extraFlags,
 
         cmdColor.key = makeField(soaVisibility[i].priority, PRIORITY_MASK, PRIORITY_SHIFT);
         cmdColor.primitive.index = (uint16_t)i;
-        cmdColor.primitive.perRenderableBones = soaBonesUbh[i];
+        cmdColor.primitive.bonesOffset = soaBonesOffset[i];
         materialVariant.setShadowReceiver(soaVisibility[i].receiveShadows & hasShadowing);
         materialVariant.setSkinning(soaVisibility[i].skinning);
 
@@ -374,12 +830,15 @@ void RenderPass::generateCommandsImpl(uint32_t extraFlags,
         cmdDepth.key |= makeField(soaVisibility[i].priority, PRIORITY_MASK, PRIORITY_SHIFT);
         cmdDepth.key |= makeField(distanceBits, DISTANCE_BITS_MASK, DISTANCE_BITS_SHIFT);
         cmdDepth.primitive.index = (uint16_t)i;
-        cmdDepth.primitive.perRenderableBones = soaBonesUbh[i];
+        cmdDepth.primitive.bonesOffset = soaBonesOffset[i];
         cmdDepth.primitive.materialVariant.setSkinning(soaVisibility[i].skinning);
 
         const bool shadowCaster = soaVisibility[i].castShadows & hasShadowing;
         const bool writeDepthForShadowCasters = depthContainsShadowCasters & shadowCaster;
 
+        // cancels the commands of the renderables filtered out by the visibility mask
+        const uint64_t hidden = select(!(soaVisibleMask[i] & visibilityMask));
+
         const Slice<FRenderPrimitive>& primitives = soaPrimitives[i];
 
         /*
@@ -436,6 +895,8 @@ void RenderPass::generateCommandsImpl(uint32_t extraFlags,
                     // correct for TransparencyMode::DEFAULT -- i.e. cancel the command
                     key |= select(mode == TransparencyMode::DEFAULT);
 
+                    key |= hidden;
+
                     *curr = cmdColor;
                     curr->key = key;
                     ++curr;
@@ -470,6 +931,7 @@ void RenderPass::generateCommandsImpl(uint32_t extraFlags,
                 *curr = cmdColor;
                 // handle the case where this primitive is empty / no-op
                 curr->key |= select(primitive.getPrimitiveType() == PrimitiveType::NONE);
+                curr->key |= hidden;
                 ++curr;
             }
 
@@ -489,6 +951,7 @@ void RenderPass::generateCommandsImpl(uint32_t extraFlags,
                                 | writeDepthForShadowCasters;
 
                 curr->key |= select(!issueDepth);
+                curr->key |= hidden;
 
                 // handle the case where this primitive is empty / no-op
                 curr->key |= select(primitive.getPrimitiveType() == PrimitiveType::NONE);
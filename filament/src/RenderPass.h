@@ -28,8 +28,11 @@
 #include <private/filament/Variant.h>
 
 #include <utils/compiler.h>
+#include <utils/Range.h>
 #include <utils/Slice.h>
 
+#include <vector>
+
 namespace utils {
 class JobSystem;
 }
@@ -190,11 +193,11 @@ public:
     struct PrimitiveInfo { // 24 bytes
         FMaterialInstance const* mi = nullptr;                          // 8 bytes (4)
         backend::Handle<backend::HwRenderPrimitive> primitiveHandle;    // 4 bytes
-        backend::Handle<backend::HwUniformBuffer> perRenderableBones;   // 4 bytes
+        uint32_t bonesOffset = 0;                                       // 4 bytes
         backend::RasterState rasterState;                               // 4 bytes
         uint16_t index = 0;                                             // 2 bytes
         Variant materialVariant;                                        // 1 byte
-        uint8_t reserved = {};                                          // 1 byte
+        uint8_t instanceCount = 1;                                      // 1 byte
     };
 
     struct alignas(8) Command {     // 32 bytes
@@ -215,19 +218,127 @@ public:
     static constexpr RenderFlags HAS_DIRECTIONAL_LIGHT   = 0x02;
     static constexpr RenderFlags HAS_DYNAMIC_LIGHTING    = 0x04;
     static constexpr RenderFlags HAS_INVERSE_FRONT_FACES = 0x08;
+    static constexpr RenderFlags HAS_INSTANCING          = 0x10;
+
+    /*
+     * Keeps the sorted commands of the previous frames, so they can be reused when neither the
+     * camera nor the visible renderables changed, or patched when only a few renderables did.
+     * It is owned by FView and has one entry per kind of pass (e.g. color, depth, shadows).
+     */
+    class CommandCache {
+    public:
+        struct Stats {
+            uint32_t hits = 0;      // commands reused as is
+            uint32_t patches = 0;   // commands of a few renderables regenerated
+            uint32_t misses = 0;    // all commands regenerated
+        };
+
+        // frees all cached commands
+        void clear() noexcept;
+
+        Stats const& getStats() const noexcept { return mStats; }
+
+    private:
+        friend class RenderPass;
+
+        // what the commands of a visible renderable depend on, beside the pass' parameters
+        struct Row {
+            FRenderableManager::Instance ri;
+            uint32_t generation;
+            math::float3 worldAABBCenter;
+            FRenderPrimitive const* primitives;
+            uint8_t visibility;     // VISIBLE_MASK bits of the pass' visibility mask
+            bool operator==(Row const& rhs) const noexcept {
+                return ri == rhs.ri && generation == rhs.generation &&
+                       primitives == rhs.primitives && worldAABBCenter == rhs.worldAABBCenter &&
+                       visibility == rhs.visibility;
+            }
+        };
+
+        struct Entry {
+            FScene const* scene = nullptr;
+            uint32_t commandTypeFlags = 0;
+            RenderFlags renderFlags = 0;
+            uint8_t visibilityMask = 0xFF;
+            math::float3 cameraPosition;
+            math::float3 cameraForward;
+            utils::Range<uint32_t> vr{};
+            uint32_t lastUse = 0;
+            bool valid = false;
+            std::vector<Row> rows;
+            std::vector<uint8_t> dirtyRows;
+            std::vector<Command> commands;  // sorted, without the sentinel
+            std::vector<Command> patch;
+        };
+
+        // finds the entry for this kind of pass, or recycles the least recently used one
+        Entry& acquire(uint32_t commandTypeFlags) noexcept;
+
+        static constexpr size_t ENTRY_COUNT = 4;
+        Entry mEntries[ENTRY_COUNT];
+        uint32_t mUseCount = 0;
+        Stats mStats;
+    };
 
 
     RenderPass(FEngine& engine, utils::GrowingSlice<Command>& commands) noexcept;
+    ~RenderPass() noexcept;
+    RenderPass(RenderPass const& rhs) = delete;
+    RenderPass& operator=(RenderPass const& rhs) = delete;
     void overridePolygonOffset(backend::PolygonOffset* polygonOffset) noexcept;
     void setGeometry(FScene& scene, utils::Range<uint32_t> vr) noexcept;
     void setCamera(const CameraInfo& camera) noexcept;
     void setRenderFlags(RenderFlags flags) noexcept;
+    RenderFlags getRenderFlags() const noexcept { return mFlags; }
+    void setCommandCache(CommandCache* cache) noexcept;
+
+    // Only the renderables with one of these bits set in the scene's VISIBLE_MASK generate
+    // commands (e.g. the shadow casters of one shadow cascade). All of them by default.
+    void setVisibilityMask(uint8_t mask) noexcept;
+
     Command const* appendSortedCommands(CommandTypeFlags const commandTypeFlags) noexcept;
+
+    // Appends the sorted commands of several passes sharing the same geometry, in parallel.
+    // With more than one pass, the passes must not use a command cache nor HAS_INSTANCING,
+    // which are not thread-safe.
+    static void appendSortedCommands(utils::JobSystem& js,
+            RenderPass* const* passes, size_t count,
+            CommandTypeFlags const commandTypeFlags) noexcept;
     void execute(const char* name,
             backend::Handle<backend::HwRenderTarget> renderTarget,
             backend::RenderPassParams params,
             Command const* first, Command const* last) const noexcept;
 
+    // Sorts commands by key. This is a parallel LSD radix sort when a scratch buffer of at least
+    // (last - first) commands is provided and there are enough commands; otherwise it falls back
+    // to std::sort. The radix sort is stable and skips the bytes of the key that are identical
+    // in all commands (e.g. the zero padding between fields).
+    static void sortCommands(utils::JobSystem& js,
+            Command* first, Command* last, Command* scratch) noexcept;
+
+    // Updates the SUMMED_PRIMITIVE_COUNT of the renderables in 'vr', after which
+    // FScene::getPrimitiveCount(soa, vr.last) is the number of primitives in 'vr'. A pass needs
+    // that many commands per command type (twice for the color pass), plus the sentinel.
+    static void updateSummedPrimitiveCounts(
+            FScene::RenderableSoa& renderableData, utils::Range<uint32_t> vr) noexcept;
+
+    // Instancing
+    // ----------
+    // With HAS_INSTANCING, consecutive sorted commands drawing the same render primitive with the
+    // same material instance, variant and raster state are merged into a single instanced
+    // command. Skinned renderables are never merged. The PerRenderableUib of the instances of
+    // merged commands are copied into a separate buffer, the index of a merged command is the
+    // index of its first instance in that buffer and its instanceCount is larger than one.
+
+    // returns the number of instances of the commands instanceCommands() will merge
+    static uint32_t getInstanceCount(Command const* first, Command const* last) noexcept;
+
+    // Merges the commands and writes the PerRenderableUib of their instances into 'instances',
+    // which must be at least FScene::getPerRenderableUboSize(getInstanceCount()) bytes.
+    // Returns the new end of the commands.
+    static Command* instanceCommands(Command* first, Command* last,
+            FScene::RenderableSoa const& soa, void* instances) noexcept;
+
     utils::GrowingSlice<Command>& getCommands() { return mCommands; }
     utils::Slice<Command> const& getCommands() const { return mCommands; }
 
@@ -247,23 +358,64 @@ private:
     static_assert(JOBS_PARALLEL_FOR_COMMANDS_SIZE % utils::CACHELINE_SIZE == 0,
             "Size of Commands jobs must be multiple of a cache-line size");
 
+    // below this many commands std::sort is faster than the radix sort
+    static constexpr size_t RADIX_SORT_MIN_COUNT = 4096;
+    // number of commands each job of the radix sort processes, at a minimum
+    static constexpr size_t RADIX_SORT_MIN_CHUNK_SIZE = 2048;
+    // maximum number of jobs each pass of the radix sort is split into
+    static constexpr size_t RADIX_SORT_MAX_CHUNK_COUNT = 16;
+
+    // below this many commands the driver commands are recorded on the render thread only
+    static constexpr size_t PARALLEL_RECORD_MIN_COUNT = 512;
+    // number of commands each job recording driver commands processes, at a minimum
+    static constexpr size_t PARALLEL_RECORD_MIN_CHUNK_SIZE = 128;
+
+    static void radixSortCommands(utils::JobSystem& js,
+            Command* first, Command* last, Command* scratch) noexcept;
+
+    // appendSortedCommands() without updating the summed primitive counts
+    Command const* appendCommands(CommandTypeFlags const commandTypeFlags) noexcept;
+
     static inline void generateCommands(uint32_t commandTypeFlags, Command* commands,
             FScene::RenderableSoa const& soa, utils::Range<uint32_t> range, RenderFlags renderFlags,
+            uint8_t visibilityMask,
             math::float3 cameraPosition, math::float3 cameraForward) noexcept;
 
     template<uint32_t commandTypeFlags>
     static inline void generateCommandsImpl(uint32_t, Command* commands, FScene::RenderableSoa const& soa,
-            utils::Range<uint32_t> range, RenderFlags renderFlags, math::float3 cameraPosition,
-            math::float3 cameraForward) noexcept;
+            utils::Range<uint32_t> range, RenderFlags renderFlags, uint8_t visibilityMask,
+            math::float3 cameraPosition, math::float3 cameraForward) noexcept;
 
     static void setupColorCommand(Command& cmdDraw, bool hasDepthPass,
             FMaterialInstance const* mi) noexcept;
 
     void recordDriverCommands(FEngine::DriverApi& driver, FScene& scene,
+            backend::Handle<backend::HwUniformBuffer> instanceUbh,
             const Command* first, const Command* last) const noexcept;
 
-    static void updateSummedPrimitiveCounts(
-            FScene::RenderableSoa& renderableData, utils::Range<uint32_t> vr) noexcept;
+    // same as recordDriverCommands() but the commands are split in chunks recorded in parallel
+    // into the secondary driver apis, which are then spliced in order into 'driver'
+    void recordDriverCommandsParallel(FEngine::DriverApi& driver, FScene& scene,
+            backend::Handle<backend::HwUniformBuffer> instanceUbh,
+            const Command* first, const Command* last) const noexcept;
+
+    // the buffer holding the instances of the merged commands starting at 'first'
+    backend::Handle<backend::HwUniformBuffer> getInstanceBuffer(
+            Command const* first) const noexcept;
+
+    enum class CacheState : uint8_t {
+        MISS,   // the cached commands can't be used
+        HIT,    // the cached commands can be used as is
+        PATCH   // the cached commands of the rows flagged in dirtyRows must be regenerated
+    };
+
+    // compares the cached entry with the current pass and updates its state
+    CacheState validateCache(CommandCache::Entry& entry, uint32_t commandTypeFlags,
+            math::float3 cameraPosition, math::float3 cameraForward) const noexcept;
+
+    // regenerates the commands of the dirty rows and merges them with the cached ones
+    uint32_t patchCommands(CommandCache::Entry& entry, Command* commands,
+            math::float3 cameraPosition, math::float3 cameraForward) const noexcept;
 
 
     FEngine& mEngine;
@@ -272,9 +424,19 @@ private:
     utils::Range<uint32_t> mVisibleRenderables{};
     CameraInfo mCamera;
     RenderFlags mFlags{};
+    uint8_t mVisibilityMask = 0xFF;
+    CommandCache* mCommandCache = nullptr;
     bool mPolygonOffsetOverride = false;
     backend::PolygonOffset mPolygonOffset{};
     size_t mCommandsHighWatermark = 0;
+
+    // each call to appendSortedCommands() that merges commands creates a buffer of instances
+    struct InstanceBuffer {
+        Command const* first;
+        Command const* last;
+        backend::Handle<backend::HwUniformBuffer> ubh;
+    };
+    std::vector<InstanceBuffer> mInstanceBuffers;
 };
 
 } // namespace details
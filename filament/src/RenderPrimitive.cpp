@@ -24,51 +24,57 @@
 namespace filament {
 namespace details {
 
-void FRenderPrimitive::init(backend::DriverApi& driver,
+void FRenderPrimitive::init(FEngine& engine,
         const RenderableManager::Builder::Entry& entry) noexcept {
 
     assert(entry.materialInstance);
 
-    mHandle = driver.createRenderPrimitive();
     mMaterialInstance = upcast(entry.materialInstance);
     mBlendOrder = entry.blendOrder;
 
+    HwRenderPrimitiveFactory::Key key;
     if (entry.indices && entry.vertices) {
         FVertexBuffer* vertexBuffer = upcast(entry.vertices);
         FIndexBuffer* indexBuffer = upcast(entry.indices);
 
         AttributeBitset enabledAttributes = vertexBuffer->getDeclaredAttributes();
 
-        auto const& ebh = vertexBuffer->getHwHandle();
-        auto const& ibh = indexBuffer->getHwHandle();
-
-        driver.setRenderPrimitiveBuffer(mHandle, ebh, ibh, (uint32_t)enabledAttributes.getValue());
-        driver.setRenderPrimitiveRange(mHandle, entry.type,
-                (uint32_t)entry.offset, (uint32_t)entry.minIndex, (uint32_t)entry.maxIndex,
-                (uint32_t)entry.count);
+        key.vbh = vertexBuffer->getHwHandle();
+        key.ibh = indexBuffer->getHwHandle();
+        key.enabledAttributes = (uint32_t)enabledAttributes.getValue();
+        key.type = uint32_t(entry.type);
+        key.offset = (uint32_t)entry.offset;
+        key.minIndex = (uint32_t)entry.minIndex;
+        key.maxIndex = (uint32_t)entry.maxIndex;
+        key.count = (uint32_t)entry.count;
 
         mPrimitiveType = entry.type;
         mEnabledAttributes = enabledAttributes;
     }
+    mKey = key;
+    mHandle = engine.getRenderPrimitiveFactory().acquire(engine.getDriverApi(), key);
 }
 
 void FRenderPrimitive::terminate(FEngine& engine) {
-    FEngine::DriverApi& driver = engine.getDriverApi();
-    driver.destroyRenderPrimitive(mHandle);
+    engine.getRenderPrimitiveFactory().release(engine.getDriverApi(), mKey);
+    mHandle.clear();
 }
 
 void FRenderPrimitive::set(FEngine& engine, RenderableManager::PrimitiveType type,
         FVertexBuffer* vertices, FIndexBuffer* indices, size_t offset,
         size_t minIndex, size_t maxIndex, size_t count) noexcept {
     AttributeBitset enabledAttributes = vertices->getDeclaredAttributes();
-    auto const& ebh = vertices->getHwHandle();
-    auto const& ibh = indices->getHwHandle();
 
-    FEngine::DriverApi& driver = engine.getDriverApi();
-
-    driver.setRenderPrimitiveBuffer(mHandle, ebh, ibh, (uint32_t)enabledAttributes.getValue());
-    driver.setRenderPrimitiveRange(mHandle, type,
-            (uint32_t)offset, (uint32_t)minIndex, (uint32_t)maxIndex, (uint32_t)count);
+    HwRenderPrimitiveFactory::Key key;
+    key.vbh = vertices->getHwHandle();
+    key.ibh = indices->getHwHandle();
+    key.enabledAttributes = (uint32_t)enabledAttributes.getValue();
+    key.type = uint32_t(type);
+    key.offset = (uint32_t)offset;
+    key.minIndex = (uint32_t)minIndex;
+    key.maxIndex = (uint32_t)maxIndex;
+    key.count = (uint32_t)count;
+    setKey(engine, key);
 
     mPrimitiveType = type;
     mEnabledAttributes = enabledAttributes;
@@ -76,11 +82,26 @@ void FRenderPrimitive::set(FEngine& engine, RenderableManager::PrimitiveType typ
 
 void FRenderPrimitive::set(FEngine& engine, RenderableManager::PrimitiveType type, size_t offset,
         size_t minIndex, size_t maxIndex, size_t count) noexcept {
-    FEngine::DriverApi& driver = engine.getDriverApi();
-    driver.setRenderPrimitiveRange(mHandle, type,
-            (uint32_t)offset, (uint32_t)minIndex, (uint32_t)maxIndex, (uint32_t)count);
+    HwRenderPrimitiveFactory::Key key = mKey;
+    key.type = uint32_t(type);
+    key.offset = (uint32_t)offset;
+    key.minIndex = (uint32_t)minIndex;
+    key.maxIndex = (uint32_t)maxIndex;
+    key.count = (uint32_t)count;
+    setKey(engine, key);
+
     mPrimitiveType = type;
 }
 
+void FRenderPrimitive::setKey(FEngine& engine, HwRenderPrimitiveFactory::Key const& key) noexcept {
+    // the handle may be shared with other primitives, so we never modify it, instead we switch
+    // to the handle of the new geometry. We acquire it first, in case it's the same.
+    FEngine::DriverApi& driver = engine.getDriverApi();
+    HwRenderPrimitiveFactory& factory = engine.getRenderPrimitiveFactory();
+    mHandle = factory.acquire(driver, key);
+    factory.release(driver, mKey);
+    mKey = key;
+}
+
 } // namespace details
 } // namespace filament
@@ -206,19 +206,25 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
 
     RenderPass pass(engine, commands);
     RenderPass::RenderFlags renderFlags = 0;
-    if (view.hasShadowing())               renderFlags |= RenderPass::HAS_SHADOWING;
-    if (view.hasDirectionalLight())        renderFlags |= RenderPass::HAS_DIRECTIONAL_LIGHT;
+    // the shadows of the point and spot lights are only in the variants with directional lighting
+    const bool hasShadowing = view.hasShadowing() || view.hasPunctualShadowing();
+    if (hasShadowing)                      renderFlags |= RenderPass::HAS_SHADOWING;
+    if (view.hasDirectionalLight() || view.hasPunctualShadowing()) {
+        renderFlags |= RenderPass::HAS_DIRECTIONAL_LIGHT;
+    }
     if (view.hasDynamicLighting())         renderFlags |= RenderPass::HAS_DYNAMIC_LIGHTING;
     if (view.isFrontFaceWindingInverted()) renderFlags |= RenderPass::HAS_INVERSE_FRONT_FACES;
+    if (engine.isAutomaticInstancingEnabled()) renderFlags |= RenderPass::HAS_INSTANCING;
     pass.setRenderFlags(renderFlags);
+    pass.setCommandCache(view.getCommandCache());
 
 
     /*
      * Shadow pass
      */
 
-    if (view.hasShadowing()) {
-        view.getShadowMap().render(driver, pass, view);
+    if (hasShadowing) {
+        view.getShadowMapManager().render(arena, driver, pass, view);
         driver.flush(); // Kick the GPU since we're done with this render target
         engine.flush(); // Wake-up the driver thread
         commands.clear();
@@ -529,6 +535,7 @@ void FRenderer::endFrame() {
     auto job = js.runAndRetain(jobs::createJob(js, nullptr, &FEngine::gc, &engine)); // gc all managers
 
     engine.flush();     // flush command stream
+    engine.updateCommandBufferStatistics();
 
     // make sure we're done with the gcs
     js.waitAndRelease(job);
@@ -19,19 +19,26 @@
 #include "components/LightManager.h"
 #include "components/RenderableManager.h"
 
+#include <private/filament/EngineEnums.h>
 #include <private/filament/UibGenerator.h>
 
 #include "details/Culler.h"
 #include "details/Engine.h"
+#include "details/Froxelizer.h"
 #include "details/IndirectLight.h"
 #include "details/Skybox.h"
 
 #include <utils/compiler.h>
 #include <utils/EntityManager.h>
 #include <utils/Range.h>
+#include <utils/Systrace.h>
 #include <utils/Zip2Iterator.h>
 
 #include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#include <string.h>
 
 using namespace filament::math;
 using namespace utils;
@@ -41,6 +48,54 @@ namespace details {
 
 // ------------------------------------------------------------------------------------------------
 
+namespace {
+
+// Sets the WORLD_NORMAL of the rows of a RenderableSoa. The normal matrix of a rigid or
+// uniformly scaled transform is just its rotation, the others are batched so that their
+// inverse-transpose is computed by a loop the compiler can vectorize.
+class NormalBatch {
+public:
+    explicit NormalBatch(FScene::RenderableSoa& soa) noexcept
+            : mTransforms(soa.data<FScene::WORLD_TRANSFORM>()),
+              mNormals(soa.data<FScene::WORLD_NORMAL>()) {
+    }
+
+    ~NormalBatch() noexcept { flush(); }
+
+    void add(size_t row, FTransformManager::TransformType type) noexcept {
+        if (UTILS_LIKELY(type != FTransformManager::TransformType::GENERAL)) {
+            mNormals[row] = FScene::getNormalMatrix(mTransforms[row], type);
+            return;
+        }
+        mModels[mCount] = mTransforms[row];
+        mRows[mCount] = uint32_t(row);
+        if (UTILS_UNLIKELY(++mCount == SIZE)) {
+            flush();
+        }
+    }
+
+    void flush() noexcept {
+        mat3f normals[SIZE];
+        FScene::computeNormals(normals, mModels, mCount);
+        for (size_t i = 0; i < mCount; i++) {
+            mNormals[mRows[i]] = normals[i];
+        }
+        mCount = 0;
+    }
+
+private:
+    static constexpr size_t SIZE = 64;
+    mat3x4f const* const mTransforms;
+    mat3f* const mNormals;
+    size_t mCount = 0;
+    mat3x4f mModels[SIZE];
+    uint32_t mRows[SIZE];
+};
+
+} // anonymous namespace
+
+// ------------------------------------------------------------------------------------------------
+
 FScene::FScene(FEngine& engine) :
         mEngine(engine),
         mIndirectLight(engine.getDefaultIndirectLight()) {
@@ -49,25 +104,77 @@ FScene::FScene(FEngine& engine) :
 FScene::~FScene() noexcept = default;
 
 
-void FScene::prepare(const mat4f& worldOriginTransform) {
-    // TODO: can we skip this in most cases? Since we rely on indices staying the same,
-    //       we could only skip, if nothing changed in the RCM.
+void FScene::prepare(JobSystem& js, const mat4f& worldOriginTransform) {
+    SYSTRACE_CALL();
 
     FEngine& engine = mEngine;
-    EntityManager& em = engine.getEntityManager();
     FRenderableManager& rcm = engine.getRenderableManager();
     FTransformManager& tcm = engine.getTransformManager();
     FLightManager& lcm = engine.getLightManager();
+
+    // Changes made after this point will be seen by the next prepare()
+    const uint32_t renderableGeneration = rcm.advanceGeneration();
+    const uint32_t transformGeneration = tcm.advanceGeneration();
+    const uint32_t lightGeneration = lcm.advanceGeneration();
+
+    // The cached renderable rows and list of lights are only valid as long as the set of
+    // entities and the component instances they refer to stay the same.
+    const bool rebuild = mEntitiesChanged ||
+            rcm.getStructureGeneration() > mRenderableGeneration ||
+            tcm.getStructureGeneration() > mTransformGeneration ||
+            lcm.getStructureGeneration() > mLightGeneration;
+
+    // updateRenderables() only records the bounds that changed when the world origin didn't
+    mChangedAll = rebuild ||
+            memcmp(&worldOriginTransform, &mWorldOrigin, sizeof(mat4f)) != 0;
+    mChangedBounds.clear();
+    mChangedStaticCasters = mChangedAll;
+    mPrepareCount++;
+
+    size_t rowsTouched;
+    if (rebuild) {
+        rowsTouched = gatherEntities(js, worldOriginTransform);
+    } else {
+        rowsTouched = updateRenderables(js, worldOriginTransform);
+    }
+    prepareLights(worldOriginTransform);
+
+    if (mHierarchicalCulling) {
+        updateCullingHierarchy(rebuild);
+    }
+
+    mWorldOrigin = worldOriginTransform;
+    mRenderableGeneration = renderableGeneration;
+    mTransformGeneration = transformGeneration;
+    mLightGeneration = lightGeneration;
+    mEntitiesChanged = false;
+
+    mRowsTouched = rowsTouched;
+    SYSTRACE_VALUE32("sceneRowsTouched", rowsTouched);
+}
+
+size_t FScene::gatherEntities(JobSystem& js, const mat4f& worldOriginTransform) {
+    SYSTRACE_CALL();
+
+    FEngine& engine = mEngine;
+    EntityManager const& em = engine.getEntityManager();
+    FRenderableManager const& rcm = engine.getRenderableManager();
+    FTransformManager const& tcm = engine.getTransformManager();
+    FLightManager const& lcm = engine.getLightManager();
     // go through the list of entities, and gather the data of those that are renderables
     auto& sceneData = mRenderableData;
-    auto& lightData = mLightData;
-    auto const& entities = mEntities;
+    // the world origin is a rigid transform
+    const mat3x4f worldOrigin(worldOriginTransform);
 
+    // we need random access to the entities to process them in parallel
+    auto& entities = mEntityList;
+    entities.assign(mEntities.begin(), mEntities.end());
+    const size_t entityCount = entities.size();
 
     // NOTE: we can't know in advance how many entities are renderable or lights because the corresponding
     // component can be added after the entity is added to the scene.
 
-    size_t renderableDataCapacity = entities.size();
+    size_t renderableDataCapacity = entityCount;
     // we need the capacity to be multiple of 16 for SIMD loops
     renderableDataCapacity = (renderableDataCapacity + 0xF) & ~0xF;
     // we need 1 extra entry at the end for the summed primitive count
@@ -78,9 +185,190 @@ void FScene::prepare(const mat4f& worldOriginTransform) {
         sceneData.setCapacity(renderableDataCapacity);
     }
 
+    // Each chunk of entities writes its renderables and lights starting at the chunk's first
+    // entity index, the chunks are compacted afterwards.
+    const size_t chunkCount = (entityCount + PREPARE_CHUNK_SIZE - 1) / PREPARE_CHUNK_SIZE;
+    sceneData.resize(entityCount);
+    mLightScratch.resize(entityCount);
+    mChunks.resize(chunkCount);
+
+    auto work = [&, this](uint32_t start, uint32_t count) {
+        auto& lights = mLightScratch;
+        NormalBatch normals(sceneData);
+        for (size_t c = start, e = start + count; c < e; c++) {
+            const size_t first = c * PREPARE_CHUNK_SIZE;
+            const size_t last = std::min(first + PREPARE_CHUNK_SIZE, entityCount);
+            size_t row = first;
+            size_t light = first;
+            for (size_t i = first; i < last; i++) {
+                const Entity entity = entities[i];
+                if (!em.isAlive(entity))
+                    continue;
+
+                // getInstance() always returns null if the entity is the Null entity
+                // so we don't need to check for that, but we need to check it's alive
+                auto ri = rcm.getInstance(entity);
+                auto li = lcm.getInstance(entity);
+                if (!ri & !li)
+                    continue;
+
+                // get the world transform
+                auto ti = tcm.getInstance(entity);
+
+                // don't even draw this object if it doesn't have a transform (which shouldn't
+                // happen because one is always created when creating a Renderable component).
+                if (ri && ti) {
+                    const mat3x4f worldTransform = worldOrigin * tcm.getAffineWorldTransform(ti);
+
+                    // compute the world AABB so we can perform culling
+                    const Box worldAABB = rigidTransform(rcm.getAABB(ri), worldTransform);
+
+                    sceneData.elementAt<RENDERABLE_INSTANCE>(row) = ri;
+                    sceneData.elementAt<WORLD_TRANSFORM>(row)     = worldTransform;
+                    sceneData.elementAt<VISIBILITY_STATE>(row)    = rcm.getVisibility(ri);
+                    sceneData.elementAt<BONES_OFFSET>(row)        = rcm.getBonesOffset(ri);
+                    sceneData.elementAt<WORLD_AABB_CENTER>(row)   = worldAABB.center;
+                    sceneData.elementAt<VISIBLE_MASK>(row)        = 0;
+                    sceneData.elementAt<LAYERS>(row)              = rcm.getLayerMask(ri);
+                    sceneData.elementAt<WORLD_AABB_EXTENT>(row)   = worldAABB.halfExtent;
+                    sceneData.elementAt<TRANSFORM_INSTANCE>(row)  = ti;
+                    sceneData.elementAt<LEVEL_OF_DETAIL>(row)     = 0;
+                    normals.add(row, tcm.getWorldTransformType(ti));
+                    row++;
+                }
+
+                if (li) {
+                    lights[light++] = { li, ti };
+                }
+            }
+            mChunks[c] = { uint32_t(row - first), uint32_t(light - first) };
+        }
+    };
+
+    auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(chunkCount),
+            std::cref(work), jobs::CountSplitter<1, 8>());
+    js.runAndWait(job);
+
+    // compact the chunks
+    auto const begin = sceneData.begin();
+    auto rows = begin;
+    mLights.clear();
+    for (size_t c = 0; c < chunkCount; c++) {
+        const size_t first = c * PREPARE_CHUNK_SIZE;
+        if (rows == begin + first) {
+            // nothing to move (yet)
+            rows += mChunks[c].renderables;
+        } else {
+            rows = std::move(begin + first, begin + first + mChunks[c].renderables, rows);
+        }
+        mLights.insert(mLights.end(), mLightScratch.begin() + first,
+                mLightScratch.begin() + first + mChunks[c].lights);
+    }
+    sceneData.resize(size_t(rows - begin));
+
+    return sceneData.size();
+}
+
+size_t FScene::updateRenderables(JobSystem& js, const mat4f& worldOriginTransform) noexcept {
+    SYSTRACE_CALL();
+
+    FEngine& engine = mEngine;
+    FRenderableManager const& rcm = engine.getRenderableManager();
+    FTransformManager const& tcm = engine.getTransformManager();
+    auto& sceneData = mRenderableData;
+
+    // Moving the world origin (e.g. when the camera moves) invalidates all world transforms,
+    // but we still save the lookups and the renderable's state.
+    const bool originChanged = memcmp(&worldOriginTransform, &mWorldOrigin, sizeof(mat4f)) != 0;
+    const mat3x4f worldOrigin(worldOriginTransform);
+    const uint32_t renderableGeneration = mRenderableGeneration;
+    const uint32_t transformGeneration = mTransformGeneration;
+
+    const bool hierarchicalCulling = mHierarchicalCulling;
+    if (hierarchicalCulling) {
+        mCullingDirtyRows.assign(sceneData.size(), 0);
+    }
+
+    if (!originChanged &&
+            rcm.getChangeGeneration() <= renderableGeneration &&
+            tcm.getChangeGeneration() <= transformGeneration) {
+        // nothing changed since the last time we were called
+        return 0;
+    }
+
+    // Note: the rows may have been re-ordered by FView since the last call, this is fine since
+    // we only update them in place.
+    std::atomic<uint32_t> rowsTouched{ 0 };
+    auto work = [&, this](uint32_t start, uint32_t count) {
+        auto const* const UTILS_RESTRICT instances = sceneData.data<RENDERABLE_INSTANCE>();
+        auto const* const UTILS_RESTRICT transforms = sceneData.data<TRANSFORM_INSTANCE>();
+        NormalBatch normals(sceneData);
+        uint32_t touched = 0;
+        Aabb changed;
+        bool hasChanged = false;
+        bool staticChanged = false;
+        for (size_t i = start, e = start + count; i < e; i++) {
+            const auto ri = instances[i];
+            const auto ti = transforms[i];
+            const bool renderableChanged = rcm.getGeneration(ri) > renderableGeneration;
+            const bool transformChanged = tcm.getGeneration(ti) > transformGeneration;
+            if (!(originChanged || renderableChanged || transformChanged)) {
+                continue;
+            }
+
+            const mat3x4f worldTransform = worldOrigin * tcm.getAffineWorldTransform(ti);
+            const Box worldAABB = rigidTransform(rcm.getAABB(ri), worldTransform);
+            if (!originChanged) {
+                // the renderable may have moved, we need where it was and where it is now
+                const float3 center = sceneData.elementAt<WORLD_AABB_CENTER>(i);
+                const float3 extent = sceneData.elementAt<WORLD_AABB_EXTENT>(i);
+                changed.min = min(min(changed.min, center - extent), worldAABB.getMin());
+                changed.max = max(max(changed.max, center + extent), worldAABB.getMax());
+                hasChanged = true;
+                // a renderable that is, or was, a static shadow caster
+                staticChanged = staticChanged ||
+                        sceneData.elementAt<VISIBILITY_STATE>(i).staticShadowCaster ||
+                        (renderableChanged && rcm.getVisibility(ri).staticShadowCaster);
+            }
+            sceneData.elementAt<WORLD_TRANSFORM>(i)   = worldTransform;
+            sceneData.elementAt<WORLD_AABB_CENTER>(i) = worldAABB.center;
+            sceneData.elementAt<WORLD_AABB_EXTENT>(i) = worldAABB.halfExtent;
+            normals.add(i, tcm.getWorldTransformType(ti));
+            if (renderableChanged) {
+                sceneData.elementAt<VISIBILITY_STATE>(i) = rcm.getVisibility(ri);
+                sceneData.elementAt<BONES_OFFSET>(i)     = rcm.getBonesOffset(ri);
+                sceneData.elementAt<LAYERS>(i)           = rcm.getLayerMask(ri);
+            }
+            if (UTILS_UNLIKELY(hierarchicalCulling)) {
+                mCullingDirtyRows[i] = uint8_t(renderableChanged || transformChanged);
+            }
+            touched++;
+        }
+        rowsTouched.fetch_add(touched, std::memory_order_relaxed);
+        if (hasChanged) {
+            std::lock_guard<utils::Mutex> lock(mChangedBoundsLock);
+            mChangedBounds.push_back(changed);
+            mChangedStaticCasters = mChangedStaticCasters || staticChanged;
+        }
+    };
+
+    auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(sceneData.size()),
+            std::cref(work), jobs::CountSplitter<PREPARE_CHUNK_SIZE, 8>());
+    js.runAndWait(job);
+
+    return rowsTouched.load(std::memory_order_relaxed);
+}
+
+void FScene::prepareLights(const mat4f& worldOriginTransform) noexcept {
+    FEngine& engine = mEngine;
+    FTransformManager const& tcm = engine.getTransformManager();
+    FLightManager const& lcm = engine.getLightManager();
+    auto& lightData = mLightData;
+    const mat3x4f worldOrigin(worldOriginTransform);
+
     // The light data list will always contain at least one entry for the
     // dominating directional light, even if there are no entities.
-    size_t lightDataCapacity = std::max<size_t>(1, entities.size());
+    size_t lightDataCapacity = std::max<size_t>(1, mLights.size() + DIRECTIONAL_LIGHTS_COUNT);
     // we need the capacity to be multiple of 16 for SIMD loops
     lightDataCapacity = (lightDataCapacity + 0xF) & ~0xF;
 
@@ -91,68 +379,36 @@ void FScene::prepare(const mat4f& worldOriginTransform) {
     // the first entries are reserved for the directional lights (currently only one)
     lightData.resize(DIRECTIONAL_LIGHTS_COUNT);
 
-
     // find the max intensity directional light index in our local array
     float maxIntensity = 0.0f;
 
-    for (Entity e : entities) {
-        if (!em.isAlive(e))
-            continue;
-
-        // getInstance() always returns null if the entity is the Null entity
-        // so we don't need to check for that, but we need to check it's alive
-        auto ri = rcm.getInstance(e);
-        auto li = lcm.getInstance(e);
-        if (!ri & !li)
-            continue;
-
-        // get the world transform
-        auto ti = tcm.getInstance(e);
-        const mat4f worldTransform = worldOriginTransform * tcm.getWorldTransform(ti);
-
-        // don't even draw this object if it doesn't have a transform (which shouldn't happen
-        // because one is always created when creating a Renderable component).
-        if (ri && ti) {
-            // compute the world AABB so we can perform culling
-            const Box worldAABB = rigidTransform(rcm.getAABB(ri), worldTransform);
-
-            // we know there is enough space in the array
-            sceneData.push_back_unsafe(
-                    ri,
-                    worldTransform,
-                    rcm.getVisibility(ri),
-                    rcm.getBonesUbh(ri),
-                    worldAABB.center,
-                    0,
-                    rcm.getLayerMask(ri),
-                    worldAABB.halfExtent,
-                    {}, {});
-        }
-
-        if (li) {
-            // find the dominant directional light
-            if (UTILS_UNLIKELY(lcm.isDirectionalLight(li))) {
-                // we don't store the directional lights, because we only have a single one
-                if (lcm.getIntensity(li) >= maxIntensity) {
-                    maxIntensity = lcm.getIntensity(li);
-                    float3 d = lcm.getLocalDirection(li);
-                    // using the inverse-transpose handles non-uniform scaling
-                    d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
-                    lightData.elementAt<FScene::POSITION_RADIUS>(0) = float4{ 0, 0, 0, std::numeric_limits<float>::infinity() };
-                    lightData.elementAt<FScene::DIRECTION>(0)       = d;
-                    lightData.elementAt<FScene::LIGHT_INSTANCE>(0)  = li;
-                }
-            } else {
-                const float4 p = worldTransform * float4{ lcm.getLocalPosition(li), 1 };
-                float3 d = 0;
-                if (!lcm.isPointLight(li) || lcm.isIESLight(li)) {
-                    d = lcm.getLocalDirection(li);
-                    // using the inverse-transpose handles non-uniform scaling
-                    d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
-                }
-                lightData.push_back_unsafe(
-                        float4{ p.xyz, lcm.getRadius(li) }, d, li, {}, {});
+    for (auto const& light : mLights) {
+        const auto li = light.first;
+        const auto ti = light.second;
+        const mat3x4f worldTransform = worldOrigin * tcm.getAffineWorldTransform(ti);
+
+        // find the dominant directional light
+        if (UTILS_UNLIKELY(lcm.isDirectionalLight(li))) {
+            // we don't store the directional lights, because we only have a single one
+            if (lcm.getIntensity(li) >= maxIntensity) {
+                maxIntensity = lcm.getIntensity(li);
+                float3 d = lcm.getLocalDirection(li);
+                // using the inverse-transpose handles non-uniform scaling
+                d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
+                lightData.elementAt<FScene::POSITION_RADIUS>(0) = float4{ 0, 0, 0, std::numeric_limits<float>::infinity() };
+                lightData.elementAt<FScene::DIRECTION>(0)       = d;
+                lightData.elementAt<FScene::LIGHT_INSTANCE>(0)  = li;
             }
+        } else {
+            const float3 p = worldTransform * lcm.getLocalPosition(li);
+            float3 d = 0;
+            if (!lcm.isPointLight(li) || lcm.isIESLight(li)) {
+                d = lcm.getLocalDirection(li);
+                // using the inverse-transpose handles non-uniform scaling
+                d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
+            }
+            lightData.push_back_unsafe(
+                    float4{ p, lcm.getRadius(li) }, d, li, {}, {}, float2{ -1, 0 });
         }
     }
 
@@ -164,43 +420,180 @@ void FScene::prepare(const mat4f& worldOriginTransform) {
     }
 }
 
+void FScene::updateCullingHierarchy(bool rebuilt) noexcept {
+    SYSTRACE_CALL();
+
+    FEngine& engine = mEngine;
+    FRenderableManager const& rcm = engine.getRenderableManager();
+    FTransformManager const& tcm = engine.getTransformManager();
+    auto const& sceneData = mRenderableData;
+    const size_t count = sceneData.size();
+    auto const* const instances = sceneData.data<RENDERABLE_INSTANCE>();
+    auto const* const transforms = sceneData.data<TRANSFORM_INSTANCE>();
+    BoundingVolumeHierarchy& bvh = mCullingHierarchy;
+
+    // Boxes are identified by the renderable's row at the time the hierarchy was built; the
+    // hierarchy doesn't use the world origin, so that it stays valid when the camera moves.
+    auto worldAABB = [&](size_t row) {
+        return rigidTransform(rcm.getAABB(instances[row]),
+                tcm.getAffineWorldTransform(transforms[row]));
+    };
+
+    if (rebuilt || bvh.size() != count) {
+        // rows are freshly gathered, the hierarchy must be refit or rebuilt if their order
+        // doesn't match the boxes'.
+        mCullingAABBCenter.resize(count);
+        mCullingAABBExtent.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            const Box box = worldAABB(i);
+            mCullingAABBCenter[i] = box.center;
+            mCullingAABBExtent[i] = box.halfExtent;
+        }
+
+        bool rebuild = bvh.size() != count || !std::equal(instances, instances + count,
+                mCullingHierarchyInstances.begin());
+        if (!rebuild) {
+            bvh.refit(mCullingAABBCenter.data(), mCullingAABBExtent.data(), count);
+            rebuild = bvh.needsRebuild();
+        }
+        if (rebuild) {
+            mCullingHierarchyInstances.assign(instances, instances + count);
+            bvh.build(mCullingAABBCenter.data(), mCullingAABBExtent.data(), count);
+        }
+
+        // map renderable instances to boxes
+        mCullingBoxes.clear();
+        for (size_t i = 0; i < count; i++) {
+            const size_t index = instances[i].asValue();
+            if (mCullingBoxes.size() <= index) {
+                mCullingBoxes.resize(index + 1);
+            }
+            mCullingBoxes[index] = uint32_t(i);
+        }
+    } else {
+        // only refit the boxes that changed since the last time
+        size_t changed = 0;
+        for (size_t row = 0; row < count; row++) {
+            if (mCullingDirtyRows[row]) {
+                const uint32_t i = mCullingBoxes[instances[row].asValue()];
+                const Box box = worldAABB(row);
+                mCullingAABBCenter[i] = box.center;
+                mCullingAABBExtent[i] = box.halfExtent;
+                changed++;
+            }
+        }
+        if (changed) {
+            bvh.refit(mCullingAABBCenter.data(), mCullingAABBExtent.data(), count);
+            if (bvh.needsRebuild()) {
+                bvh.build(mCullingAABBCenter.data(), mCullingAABBExtent.data(), count);
+            }
+        }
+    }
+
+    // FView may have re-ordered the rows since the hierarchy was built, make sure cull()
+    // writes its results to the current row of each box.
+    mCullingRows.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        mCullingRows[mCullingBoxes[instances[i].asValue()]] = uint32_t(i);
+    }
+    bvh.remap(mCullingRows.data());
+}
+
+void FScene::setHierarchicalCullingEnabled(bool enabled) noexcept {
+    mHierarchicalCulling = enabled;
+    if (!enabled) {
+        // reset the hierarchy, it'll be rebuilt when re-enabled
+        mCullingHierarchy.build(nullptr, nullptr, 0);
+        mCullingHierarchyInstances.clear();
+        mCullingAABBCenter.clear();
+        mCullingAABBExtent.clear();
+        mCullingBoxes.clear();
+        mCullingRows.clear();
+    }
+}
+
 void FScene::updateUBOs(utils::Range<uint32_t> visibleRenderables, backend::Handle<backend::HwUniformBuffer> renderableUbh) noexcept {
     FEngine::DriverApi& driver = mEngine.getDriverApi();
-    const size_t size = visibleRenderables.size() * sizeof(PerRenderableUib);
+    const size_t size = getPerRenderableUboSize(visibleRenderables.size());
 
     // allocate space into the command stream directly
     void* const buffer = driver.allocate(size);
 
-    auto& sceneData = mRenderableData;
+    writeUBOs(buffer, visibleRenderables);
+
+    // TODO: handle static objects separately
+    mRenderableViewUbh = renderableUbh;
+    driver.loadUniformBuffer(renderableUbh, { buffer, size });
+}
+
+void FScene::writeUBOs(void* buffer, utils::Range<uint32_t> visibleRenderables) const noexcept {
+    // the normal matrices are computed in prepare(), only when the transforms change
+    auto const& sceneData = mRenderableData;
+    mat3x4f const* const UTILS_RESTRICT models = sceneData.data<WORLD_TRANSFORM>();
+    mat3f const* const UTILS_RESTRICT normals = sceneData.data<WORLD_NORMAL>();
+    auto const* const UTILS_RESTRICT visibility = sceneData.data<VISIBILITY_STATE>();
     for (uint32_t i : visibleRenderables) {
-        mat4f const& model = sceneData.elementAt<WORLD_TRANSFORM>(i);
         const size_t offset = i * sizeof(PerRenderableUib);
+        setPerRenderableUniforms(buffer, offset, models[i], normals[i]);
+        // only read by the skinned renderables, see getters.vs
+        UniformBuffer::setUniform(buffer, offset + offsetof(PerRenderableUib, boneFormat),
+                visibility[i].dualQuaternionBones ? 1.0f : 0.0f);
+    }
+}
 
-        UniformBuffer::setUniform(buffer,
-                offset + offsetof(PerRenderableUib, worldFromModelMatrix),
-                model);
-
-        // Using the inverse-transpose handles non-uniform scaling, but DOESN'T guarantee that
-        // the transformed normals will have unit-length, therefore they need to be normalized
-        // in the shader (that's already the case anyways, since normalization is needed after
-        // interpolation).
-        //
-        // We pre-scale normals by the inverse of the largest scale factor to avoid
-        // large post-transform magnitudes in the shader, especially in the fragment shader, where
-        // we use medium precision.
-        //
-        // Note: if the model matrix is known to be a rigid-transform, we could just use it directly.
-
-        mat3f m = transpose(inverse(model.upperLeft()));
-        m *= mat3f(1.0f / std::sqrt(max(float3{length2(m[0]), length2(m[1]), length2(m[2])})));
-
-        UniformBuffer::setUniform(buffer,
-                offset + offsetof(PerRenderableUib, worldFromModelNormalMatrix), m);
+size_t FScene::getPerRenderableUboSize(size_t count) noexcept {
+    return (count + CONFIG_MAX_INSTANCES - 1) * sizeof(PerRenderableUib);
+}
+
+void FScene::setPerRenderableUniforms(void* buffer, size_t offset,
+        mat3x4f const& model, mat3f const& normal) noexcept {
+    UniformBuffer::setUniform(buffer,
+            offset + offsetof(PerRenderableUib, worldFromModelMatrix),
+            model);
+
+    UniformBuffer::setUniform(buffer,
+            offset + offsetof(PerRenderableUib, worldFromModelNormalMatrix),
+            normal);
+}
+
+mat3f FScene::getNormalMatrix(mat3x4f const& model,
+        FTransformManager::TransformType type) noexcept {
+    assert(type != FTransformManager::TransformType::GENERAL);
+    // The inverse-transpose of a rotation is itself. With a uniform scale s, it's the rotation
+    // divided by s, which computeNormals() would scale back by s.
+    mat3f m = model.upperLeft();
+    if (type == FTransformManager::TransformType::UNIFORM_SCALE) {
+        m *= mat3f(1.0f / std::sqrt(length2(m[0])));
     }
+    return m;
+}
 
-    // TODO: handle static objects separately
-    mRenderableViewUbh = renderableUbh;
-    driver.loadUniformBuffer(renderableUbh, { buffer, size });
+void FScene::computeNormals(mat3f* UTILS_RESTRICT normals,
+        mat3x4f const* UTILS_RESTRICT models, size_t count) noexcept {
+    // Using the inverse-transpose handles non-uniform scaling, but DOESN'T guarantee that
+    // the transformed normals will have unit-length, therefore they need to be normalized
+    // in the shader (that's already the case anyways, since normalization is needed after
+    // interpolation).
+    //
+    // We pre-scale normals by the inverse of the largest scale factor to avoid
+    // large post-transform magnitudes in the shader, especially in the fragment shader, where
+    // we use medium precision.
+    //
+    // The inverse-transpose is the matrix of cofactors divided by the determinant, and the
+    // pre-scaling cancels the magnitude of the determinant, so only its sign is needed. This
+    // leaves a single division, and no branches, per matrix.
+    for (size_t i = 0; i < count; i++) {
+        const float3 c0 = models[i][0];
+        const float3 c1 = models[i][1];
+        const float3 c2 = models[i][2];
+        const float3 x = cross(c1, c2);
+        const float3 y = cross(c2, c0);
+        const float3 z = cross(c0, c1);
+        const float det = dot(c0, x);
+        const float scale = std::copysign(1.0f, det) /
+                std::sqrt(std::max(std::max(dot(x, x), dot(y, y)), dot(z, z)));
+        normals[i] = mat3f(x * scale, y * scale, z * scale);
+    }
 }
 
 void FScene::terminate(FEngine& engine) {
@@ -208,14 +601,16 @@ void FScene::terminate(FEngine& engine) {
     mRenderableViewUbh.clear();
 }
 
-void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootArena, backend::Handle<backend::HwUniformBuffer> lightUbh) noexcept {
+void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootArena,
+        backend::Handle<backend::HwUniformBuffer> lightUbh, GPUBuffer& lightBuffer) noexcept {
     FEngine::DriverApi& driver = mEngine.getDriverApi();
     FLightManager& lcm = mEngine.getLightManager();
     FScene::LightSoa& lightData = getLightData();
 
     /*
      * Here we copy our lights data into the GPU buffer, some lights might be left out if there
-     * are more than the GPU buffer allows (i.e. 256).
+     * are more than the GPU buffer allows (i.e. 256, or 4096 in clustered mode, in which case
+     * the lights go to a texture instead of the UBO).
      *
      * We always sort lights by distance to the camera plane so that:
      * - we can build light trees
@@ -237,7 +632,8 @@ void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootAren
             [](auto const& lhs, auto const& rhs) { return lhs.second < rhs.second; });
 
     // drop excess lights
-    lightData.resize(std::min(lightData.size(), CONFIG_MAX_LIGHT_COUNT + DIRECTIONAL_LIGHTS_COUNT));
+    lightData.resize(std::min(lightData.size(),
+            CONFIG_MAX_CLUSTERED_LIGHT_COUNT + DIRECTIONAL_LIGHTS_COUNT));
 
     // number of point/spot lights
     size_t positionalLightCount = lightData.size() - DIRECTIONAL_LIGHTS_COUNT;
@@ -250,16 +646,22 @@ void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootAren
 
     auto const* UTILS_RESTRICT directions   = lightData.data<FScene::DIRECTION>();
     auto const* UTILS_RESTRICT instances    = lightData.data<FScene::LIGHT_INSTANCE>();
+    auto const* UTILS_RESTRICT shadowInfo   = lightData.data<FScene::SHADOW_INFO>();
     for (size_t i = DIRECTIONAL_LIGHTS_COUNT, c = lightData.size(); i < c; ++i) {
         const size_t gpuIndex = i - DIRECTIONAL_LIGHTS_COUNT;
         auto li = instances[i];
         lp[gpuIndex].positionFalloff      = { spheres[i].xyz, lcm.getSquaredFalloffInv(li) };
         lp[gpuIndex].colorIntensity       = { lcm.getColor(li), lcm.getIntensity(li) };
         lp[gpuIndex].directionIES         = { directions[i], 0 };
-        lp[gpuIndex].spotScaleOffset.xy   = { lcm.getSpotParams(li).scaleOffset };
+        lp[gpuIndex].spotScaleOffset      = {
+                lcm.getSpotParams(li).scaleOffset, shadowInfo[i].x, shadowInfo[i].y };
     }
 
-    driver.loadUniformBuffer(lightUbh, { lp, positionalLightCount * sizeof(LightsUib) });
+    if (UTILS_UNLIKELY(Froxelizer::isClustered(positionalLightCount))) {
+        lightBuffer.commit(driver, lp, lp + positionalLightCount);
+    } else {
+        driver.loadUniformBuffer(lightUbh, { lp, positionalLightCount * sizeof(LightsUib) });
+    }
 }
 
 // These methods need to exist so clang honors the __restrict__ keyword, which in turn
@@ -316,14 +718,17 @@ inline void FScene::computeLightRanges(
 
 void FScene::addEntity(Entity entity) {
     mEntities.insert(entity);
+    mEntitiesChanged = true;
 }
 
 void FScene::addEntities(const Entity* entities, size_t count) {
     mEntities.insert(entities, entities + count);
+    mEntitiesChanged = true;
 }
 
 void FScene::remove(Entity entity) {
     mEntities.erase(entity);
+    mEntitiesChanged = true;
 }
 
 size_t FScene::getRenderableCount() const noexcept {
@@ -404,4 +809,12 @@ bool Scene::hasEntity(Entity entity) const noexcept {
     return upcast(this)->hasEntity(entity);
 }
 
+void Scene::setHierarchicalCullingEnabled(bool enabled) noexcept {
+    upcast(this)->setHierarchicalCullingEnabled(enabled);
+}
+
+bool Scene::isHierarchicalCullingEnabled() const noexcept {
+    return upcast(this)->isHierarchicalCullingEnabled();
+}
+
 } // namespace filament
@@ -21,11 +21,6 @@
 #include "details/Engine.h"
 #include "details/ShadowMap.h"
 #include "details/Scene.h"
-#include "details/View.h"
-
-#include "RenderPass.h"
-
-#include <private/filament/SibGenerator.h>
 
 #include <backend/DriverEnums.h>
 
@@ -44,6 +39,10 @@ static constexpr bool USE_DEPTH_CLAMP = false;
 
 static constexpr bool ENABLE_LISPSM = true;
 
+// margin, in texels, kept around the frustums of the punctual lights so that the shadow
+// filtering of their edges doesn't read the neighboring tiles of the atlas
+static constexpr float PUNCTUAL_FILTER_MARGIN = 2.0f;
+
 ShadowMap::ShadowMap(FEngine& engine) noexcept :
         mEngine(engine),
         mClipSpaceFlipped(engine.getBackend() == Backend::VULKAN ||
@@ -66,41 +65,11 @@ ShadowMap::~ShadowMap() {
     mEngine.destroy(mDebugCamera->getEntity());
 }
 
-UTILS_NOINLINE
-void ShadowMap::fillWithDebugPattern(backend::DriverApi& driverApi) const noexcept {
-    const size_t dim = mShadowMapDimension;
-    size_t size = dim * dim;
-    uint8_t* ptr = (uint8_t*)malloc(size);
-    driverApi.update2DImage(mShadowMapHandle, 0, 0, 0, dim, dim, {
-        ptr, size, PixelDataFormat::DEPTH_COMPONENT, PixelDataType::UBYTE, (BufferDescriptor::Callback)&free
-    });
-    for (size_t y = 0; y < dim; ++y) {
-        for (size_t x = 0; x < dim; ++x) {
-            ptr[x + y * dim] = ((x ^ y) & 0x8u) ? 0u : 0xFFu;
-        }
-    }
-}
-
-void ShadowMap::prepare(DriverApi& driver, SamplerGroup& sb) noexcept {
+void ShadowMap::prepare(TextureFormat format) noexcept {
     assert(mShadowMapDimension);
 
-    uint32_t dim = mShadowMapDimension;
-    uint32_t currentDimension = mViewport.width + 2;
-    if (currentDimension == dim) {
-        // nothing to do here.
-        assert(mShadowMapHandle);
-        return;
-    }
-
-    // destroy the current rendertarget and texture
-    if (mShadowMapRenderTarget) {
-        driver.destroyRenderTarget(mShadowMapRenderTarget);
-    }
-    if (mShadowMapHandle) {
-        driver.destroyTexture(mShadowMapHandle);
-    }
+    const uint32_t dim = mShadowMapDimension;
 
-    // allocate new ones...
     // we set a viewport with a 1-texel border for when we index outside of the texture
     // DON'T CHANGE this unless computeLightSpaceMatrix() is updated too.
     // see: computeLightSpaceMatrix()
@@ -111,8 +80,6 @@ void ShadowMap::prepare(DriverApi& driver, SamplerGroup& sb) noexcept {
     mViewport = { 1, 1, dim - 2, dim - 2 };
     mShadowMapResolution.xy = 1.0f / (dim - 2);
 
-    // 16-bits seems enough. TODO: make it an option.
-    TextureFormat format = TextureFormat::DEPTH16;
     switch (format) {
         default:
             // this should not happen
@@ -126,49 +93,11 @@ void ShadowMap::prepare(DriverApi& driver, SamplerGroup& sb) noexcept {
             mShadowMapResolution.z = 1.0f / (1u << 24u);
             break;
     }
-
-    mShadowMapHandle = driver.createTexture(
-            SamplerType::SAMPLER_2D, 1, format, 1, dim, dim, 1,
-            TextureUsage::DEPTH_ATTACHMENT | TextureUsage::SAMPLEABLE);
-
-    mShadowMapRenderTarget = driver.createRenderTarget(
-            TargetBufferFlags::DEPTH, dim, dim, 1,
-            {}, { mShadowMapHandle }, {});
-
-    SamplerParams s;
-    s.filterMag = SamplerMagFilter::LINEAR;
-    s.filterMin = SamplerMinFilter::LINEAR;
-    s.compareFunc = SamplerCompareFunc::LE;
-    s.compareMode = SamplerCompareMode::COMPARE_TO_TEXTURE;
-    s.depthStencil = true;
-    sb.setSampler(PerViewSib::SHADOW_MAP, { mShadowMapHandle, s });
 }
 
-void ShadowMap::render(DriverApi& driver, RenderPass& pass, FView& view) noexcept {
-    FEngine& engine = mEngine;
-
-    if (UTILS_UNLIKELY(engine.debug.shadowmap.checkerboard)) {
-        // TODO: eventually this will be handled as a optional pass in the framefraph
-        fillWithDebugPattern(driver);
-        return;
-    }
-
-    FScene& scene = *view.getScene();
-    filament::Viewport const& viewport = mViewport;
-
-    // FIXME: in the future this will come from the framegraph
-    RenderPassParams params = {};
-    params.flags.clear = TargetBufferFlags::DEPTH;
-    params.flags.discardStart = TargetBufferFlags::DEPTH;
-    params.flags.discardEnd = TargetBufferFlags::COLOR_AND_STENCIL;
-    params.clearDepth = 1.0;
-    params.viewport = viewport;
-    // disable scissor for clearing so the whole surface, but set the viewport to the
-    // the inset-by-1 rectangle.
-    params.flags.clear |= RenderPassFlags::IGNORE_SCISSOR;
-
+details::CameraInfo ShadowMap::getCameraInfo() const noexcept {
     FCamera const& camera = getCamera();
-    details::CameraInfo cameraInfo = {
+    return {
             .projection         = mat4f{ camera.getProjectionMatrix() },
             .cullingProjection  = mat4f{ camera.getCullingProjectionMatrix() },
             .model              = camera.getModelMatrix(),
@@ -176,34 +105,12 @@ void ShadowMap::render(DriverApi& driver, RenderPass& pass, FView& view) noexcep
             .zn                 = camera.getNear(),
             .zf                 = camera.getCullingFar(),
     };
-    pass.setCamera(cameraInfo);
-
-    FView::Range visibleRenderables = view.getVisibleShadowCasters();
-    pass.setGeometry(scene, visibleRenderables);
-
-    view.updatePrimitivesLod(engine, cameraInfo, scene.getRenderableData(), visibleRenderables);
-    view.prepareCamera(cameraInfo, viewport);
-    view.commitUniforms(driver);
-
-    pass.overridePolygonOffset(&mPolygonOffset);
-    pass.appendSortedCommands(RenderPass::SHADOW);
-    pass.execute("Shadow map Pass", getRenderTarget(), params,
-            pass.getCommands().begin(), pass.getCommands().end());
-    pass.overridePolygonOffset(nullptr);
-}
-
-void ShadowMap::terminate(DriverApi& driverApi) noexcept {
-    if (mShadowMapRenderTarget) {
-        driverApi.destroyRenderTarget(mShadowMapRenderTarget);
-    }
-    if (mShadowMapHandle) {
-        driverApi.destroyTexture(mShadowMapHandle);
-    }
 }
 
 void ShadowMap::update(
         const FScene::LightSoa& lightData, size_t index, FScene const* scene,
-        details::CameraInfo const& camera, uint8_t visibleLayers) noexcept {
+        details::CameraInfo const& camera, uint8_t visibleLayers,
+        float zn, float zf) noexcept {
     // this is the hard part here, find a good frustum for our camera
 
     auto& lcm = mEngine.getLightManager();
@@ -217,9 +124,11 @@ void ShadowMap::update(
             .slope = params.options.polygonOffsetSlope
     };
     mat4f projection(camera.cullingProjection);
-    if (params.options.shadowFar > 0.0f) {
-        float n = camera.zn;
-        float f = params.options.shadowFar;
+    if (zn != camera.zn || zf != camera.zf) {
+        // only the part of the view frustum between zn and zf receives shadows from this map
+        // (e.g. up to shadowFar, or a cascade)
+        const float n = zn;
+        const float f = zf;
         if (std::abs(projection[2].w) <= std::numeric_limits<float>::epsilon()) {
             // perspective projection
             projection[2].z =     (f + n) / (n - f);
@@ -267,6 +176,68 @@ void ShadowMap::update(
     }
 }
 
+void ShadowMap::updatePunctual(FLightManager::ShadowParams const& params,
+        float3 const& position, float3 const& direction, float3 const& up,
+        float halfAngle, float radius, uint32_t dimension,
+        uint2 tileOrigin, uint32_t atlasDimension) noexcept {
+    mShadowMapDimension = dimension;
+    mPolygonOffset = {
+            .constant = params.options.polygonOffsetConstant,
+            .slope = params.options.polygonOffsetSlope
+    };
+
+    // the 1-texel border is kept, like for the directional light (see getTextureCoordsMapping())
+    mViewport = { int32_t(tileOrigin.x + 1), int32_t(tileOrigin.y + 1),
+            dimension - 2, dimension - 2 };
+    mShadowMapResolution.xy = 1.0f / (dimension - 2);
+
+    // widen the field of view so that halfAngle ends PUNCTUAL_FILTER_MARGIN texels inside the
+    // viewport
+    const float size = float(dimension - 2);
+    const float t = std::tan(halfAngle) * size / (size - 2.0f * PUNCTUAL_FILTER_MARGIN);
+
+    // the near plane trades the depth precision for the casters closest to the light
+    const float n = radius * 0.01f;
+    const float f = radius;
+    const mat4f Mp(mat4f::row_major_init{
+            1 / t,     0,                 0,                     0,
+                0, 1 / t,                 0,                     0,
+                0,     0, (f + n) / (n - f), (2 * f * n) / (n - f),
+                0,     0,                -1,                     0
+    });
+
+    const mat4f M = mat4f::lookAt(position, position + direction, up);
+    const mat4f Mv = FCamera::rigidTransformInverse(M);
+    const mat4f S = Mp * Mv;
+
+    // the atlas transform maps the tile's texture coordinates to the tile in the atlas
+    const float s = float(dimension) / float(atlasDimension);
+    const float2 o = {
+            float(tileOrigin.x) / float(atlasDimension),
+            mClipSpaceFlipped ?
+                    1.0f - float(tileOrigin.y + dimension) / float(atlasDimension) :
+                    float(tileOrigin.y) / float(atlasDimension)
+    };
+    const mat4f Ma(mat4f::row_major_init{
+            s, 0, 0, o.x,
+            0, s, 0, o.y,
+            0, 0, 1,   0,
+            0, 0, 0,   1
+    });
+    mLightSpace = Ma * getTextureCoordsMapping() * S;
+
+    // size of a texel at a distance of 1 from the light, the shader scales it by the distance
+    mTexelSizeWs = 2.0f * t / size;
+
+    // the constant bias is applied along the axis of the frustum, which is an approximation
+    // away from it
+    const mat4f Sb = S * mat4f::translation(direction * params.options.constantBias);
+    mCamera->setCustomProjection(mat4(Sb), n, f);
+    mDebugCamera->setCustomProjection(mat4(Sb), n, f);
+
+    mHasVisibleShadows = true;
+}
+
 void ShadowMap::computeShadowCameraDirectional(
         float3 const& dir, FScene const* scene, CameraInfo const& camera,
         FLightManager::ShadowParams const& params,
@@ -0,0 +1,839 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/ShadowMapManager.h"
+
+#include "components/LightManager.h"
+
+#include "details/Culler.h"
+#include "details/Engine.h"
+#include "details/View.h"
+
+#include "RenderPass.h"
+
+#include <private/filament/SibGenerator.h>
+
+#include <backend/DriverEnums.h>
+
+#include <utils/JobSystem.h>
+#include <utils/Slice.h>
+#include <utils/Systrace.h>
+
+#include <math/scalar.h>
+
+#include <algorithm>
+#include <limits>
+
+using namespace filament::math;
+using namespace utils;
+
+namespace filament {
+
+using namespace backend;
+
+namespace details {
+
+// spot lights wider than this are shadowed with a cube map, like the point lights
+static constexpr float MAX_SPOT_SHADOW_HALF_ANGLE = float(M_PI / 3.0);
+
+// returns the even bits of x, packed in its 16 lower bits (i.e. de-interleaves a Morton code)
+static inline uint32_t compactEvenBits(uint32_t x) noexcept {
+    x &= 0x55555555u;
+    x = (x | (x >> 1u)) & 0x33333333u;
+    x = (x | (x >> 2u)) & 0x0F0F0F0Fu;
+    x = (x | (x >> 4u)) & 0x00FF00FFu;
+    x = (x | (x >> 8u)) & 0x0000FFFFu;
+    return x;
+}
+
+ShadowMapManager::ShadowMapManager(FEngine& engine) noexcept
+        : mEngine(engine),
+          // Vulkan and Metal render targets can't select a layer of a texture array (yet)
+          mHasLayeredRenderTargets(engine.getBackend() == Backend::OPENGL),
+          mHasScissoredClears(engine.getBackend() == Backend::OPENGL),
+          // Vulkan and Metal only blit color buffers (yet)
+          mHasDepthBlits(engine.getBackend() == Backend::OPENGL) {
+    // the first cascade always exists, it holds the debug camera
+    mCascades[0] = std::make_unique<ShadowMap>(engine);
+}
+
+ShadowMapManager::~ShadowMapManager() = default;
+
+void ShadowMapManager::terminate(DriverApi& driver) noexcept {
+    for (Handle<HwRenderTarget>& renderTarget : mRenderTargets) {
+        if (renderTarget) {
+            driver.destroyRenderTarget(renderTarget);
+            renderTarget.clear();
+        }
+    }
+    if (mTexture) {
+        driver.destroyTexture(mTexture);
+        mTexture.clear();
+    }
+    mTextureDimension = 0;
+    mTextureLayers = 0;
+
+    if (mAtlasRenderTarget) {
+        driver.destroyRenderTarget(mAtlasRenderTarget);
+        mAtlasRenderTarget.clear();
+    }
+    if (mAtlasTexture) {
+        driver.destroyTexture(mAtlasTexture);
+        mAtlasTexture.clear();
+    }
+    mAtlasDimension = 0;
+    mAtlasValid = false;
+
+    destroyStaticTexture(driver);
+}
+
+void ShadowMapManager::update(const FScene::LightSoa& lightData, size_t index,
+        FScene const* scene, details::CameraInfo const& camera, uint8_t visibleLayers) noexcept {
+    FLightManager const& lcm = mEngine.getLightManager();
+    FLightManager::Instance li = lightData.elementAt<FScene::LIGHT_INSTANCE>(index);
+    LightManager::ShadowOptions const& options = lcm.getShadowParams(li).options;
+
+    const size_t cascadeCount = mHasLayeredRenderTargets ?
+            clamp(size_t(options.shadowCascades), size_t(1), CONFIG_MAX_SHADOW_CASCADES) : 1;
+
+    // the cascades split the view frustum between the near plane and shadowFar
+    const float near = camera.zn;
+    const float far = options.shadowFar > 0.0f ? options.shadowFar : camera.zf;
+
+    mCascadeCount = cascadeCount;
+    mCascadeLight = li;
+    mCacheStaticCasters = mHasDepthBlits && options.cacheStaticCasters;
+    mCascadeSplits = float4{ std::numeric_limits<float>::lowest() };
+    mHasVisibleShadows = false;
+
+    float zn = near;
+    for (size_t i = 0; i < cascadeCount; i++) {
+        const float zf = (i + 1 < cascadeCount) ?
+                mix(near, far, saturate(options.cascadeSplitPositions[i])) : far;
+        if (!mCascades[i]) {
+            mCascades[i] = std::make_unique<ShadowMap>(mEngine);
+        }
+        ShadowMap& shadowMap = *mCascades[i];
+        shadowMap.update(lightData, index, scene, camera, visibleLayers, zn, zf);
+        mHasVisibleShadows = mHasVisibleShadows || shadowMap.hasVisibleShadows();
+        mCascadeSplits[i] = -zf;
+        zn = zf;
+    }
+}
+
+bool ShadowMapManager::updatePunctual(FScene::LightSoa& lightData,
+        details::CameraInfo const& camera, Frustum const& frustum,
+        uint32_t viewportHeight) noexcept {
+    SYSTRACE_CALL();
+
+    FLightManager const& lcm = mEngine.getLightManager();
+    auto const* const UTILS_RESTRICT spheres    = lightData.data<FScene::POSITION_RADIUS>();
+    auto const* const UTILS_RESTRICT directions = lightData.data<FScene::DIRECTION>();
+    auto const* const UTILS_RESTRICT instances  = lightData.data<FScene::LIGHT_INSTANCE>();
+    auto      * const UTILS_RESTRICT shadowInfo = lightData.data<FScene::SHADOW_INFO>();
+
+    // the projected diameter, in pixels, is radius * scale / distance
+    const float scale = camera.projection[1][1] * float(viewportHeight);
+    const bool perspective = camera.projection[2][3] != 0.0f;
+    const float3 cameraPosition = camera.getPosition();
+
+    std::vector<PunctualShadow>& shadows = mPunctualShadows;
+    shadows.clear();
+    for (size_t i = FScene::DIRECTIONAL_LIGHTS_COUNT, c = lightData.size(); i < c; i++) {
+        FLightManager::Instance const li = instances[i];
+        if (!lcm.isShadowCaster(li) || !lcm.isLightCaster(li) || lcm.getIntensity(li) <= 0.0f) {
+            continue;
+        }
+        float4 const& sphere = spheres[i];
+        if (!Culler::intersects(frustum, sphere)) {
+            continue;
+        }
+
+        float size = sphere.w * scale;
+        if (perspective) {
+            const float d2 = length2(sphere.xyz - cameraPosition);
+            const float r2 = sphere.w * sphere.w;
+            size = d2 > r2 ? size / std::sqrt(d2 - r2) : std::numeric_limits<float>::infinity();
+        }
+
+        // the tiles are sized after the light on screen, up to the light's shadow map size
+        const uint32_t maxDimension = std::max(MIN_TILE_DIMENSION, lcm.getShadowMapSize(li));
+        uint32_t dimension = MIN_TILE_DIMENSION;
+        while (dimension < size && dimension * 2 <= maxDimension) {
+            dimension *= 2;
+        }
+
+        float halfAngle = 0.0f;
+        if (lcm.isSpotLight(li)) {
+            float2 const& scaleOffset = lcm.getSpotParams(li).scaleOffset;
+            const float outer = std::acos(clamp(-scaleOffset.y / scaleOffset.x, -1.0f, 1.0f));
+            halfAngle = outer <= MAX_SPOT_SHADOW_HALF_ANGLE ? outer : 0.0f;
+        }
+
+        PunctualShadow shadow;
+        shadow.li = li;
+        shadow.sphere = sphere;
+        shadow.direction = directions[i];
+        shadow.halfAngle = halfAngle;
+        shadow.priority = size;
+        shadow.dimension = dimension;
+        shadow.tileCount = uint8_t(halfAngle > 0.0f ? 1 : 6);
+        shadow.index = uint32_t(i);
+        shadows.push_back(shadow);
+    }
+
+    // the lights that appear the largest get the shadows, the sort is stable to keep the same
+    // tiles from one frame to the next
+    std::stable_sort(shadows.begin(), shadows.end(),
+            [](PunctualShadow const& lhs, PunctualShadow const& rhs) {
+                return lhs.priority > rhs.priority;
+            });
+
+    size_t tileCount = 0;
+    size_t lightCount = 0;
+    uint32_t dimensions[CONFIG_MAX_SHADOW_ATLAS_TILES];
+    uint8_t tileCounts[CONFIG_MAX_SHADOW_ATLAS_TILES];
+    for (PunctualShadow const& shadow : shadows) {
+        if (tileCount + shadow.tileCount <= CONFIG_MAX_SHADOW_ATLAS_TILES) {
+            dimensions[lightCount] = shadow.dimension;
+            tileCounts[lightCount] = shadow.tileCount;
+            shadows[lightCount++] = shadow;
+            tileCount += shadow.tileCount;
+        }
+    }
+
+    uint2 origins[CONFIG_MAX_SHADOW_ATLAS_TILES];
+    lightCount = packAtlas(dimensions, tileCounts, lightCount,
+            ATLAS_DIMENSION, MIN_TILE_DIMENSION, origins);
+    shadows.resize(lightCount);
+
+    // faces of the cube maps, in the order expected by the shaders
+    static constexpr float3 faceDirections[6] = {
+            { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+    static constexpr float3 faceUps[6] = {
+            { 0, 1, 0 }, {  0, 1, 0 }, { 0, 0, 1 }, { 0,  0, 1 }, { 0, 1, 0 }, { 0,  1,  0 } };
+
+    size_t tile = 0;
+    for (size_t k = 0; k < lightCount; k++) {
+        PunctualShadow& shadow = shadows[k];
+        shadow.dimension = dimensions[k];
+        shadow.firstTile = uint8_t(tile);
+
+        FLightManager::ShadowParams const& params = lcm.getShadowParams(shadow.li);
+        const float3 position = shadow.sphere.xyz;
+        const float radius = shadow.sphere.w;
+        for (size_t face = 0; face < shadow.tileCount; face++, tile++) {
+            if (!mTiles[tile]) {
+                mTiles[tile] = std::make_unique<ShadowMap>(mEngine);
+            }
+            if (shadow.halfAngle > 0.0f) {
+                const float3 up = std::abs(shadow.direction.y) < 0.9f ?
+                        float3{ 0, 1, 0 } : float3{ 1, 0, 0 };
+                mTiles[tile]->updatePunctual(params, position, shadow.direction, up,
+                        shadow.halfAngle, radius, shadow.dimension, origins[tile],
+                        ATLAS_DIMENSION);
+            } else {
+                mTiles[tile]->updatePunctual(params, position, faceDirections[face],
+                        faceUps[face], float(M_PI / 4.0), radius, shadow.dimension,
+                        origins[tile], ATLAS_DIMENSION);
+            }
+            mTileLights[tile] = uint8_t(k);
+        }
+
+        if (shadow.tileCount == 1) {
+            shadow.frustum = mTiles[shadow.firstTile]->getCamera().getFrustum();
+        } else {
+            // the casters of a cube map are within the bounding box of the light
+            shadow.frustum = Frustum(mat4f::ortho(
+                    position.x - radius, position.x + radius,
+                    position.y - radius, position.y + radius,
+                    -(position.z + radius), -(position.z - radius)));
+        }
+
+        // see getPunctualShadowVisibility() in light_punctual.fs
+        const float normalBias = lcm.getShadowNormalBias(shadow.li) *
+                mTiles[shadow.firstTile]->getTexelSizeWorldSpace();
+        const size_t firstTile = shadow.firstTile +
+                (shadow.tileCount > 1 ? CONFIG_MAX_SHADOW_ATLAS_TILES : 0);
+        shadowInfo[shadow.index] = float2{ float(firstTile), normalBias };
+    }
+    mTileCount = tile;
+
+    return mTileCount > 0;
+}
+
+size_t ShadowMapManager::packAtlas(uint32_t* dimensions, uint8_t const* tileCounts, size_t count,
+        uint32_t atlasDimension, uint32_t minDimension, uint2* origins) noexcept {
+    // areas are counted in tiles of minDimension
+    auto area = [dimensions, tileCounts, minDimension](size_t i) {
+        const uint32_t d = dimensions[i] / minDimension;
+        return d * d * tileCounts[i];
+    };
+
+    const uint32_t capacity = (atlasDimension / minDimension) * (atlasDimension / minDimension);
+    uint32_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += area(i);
+    }
+
+    while (count && total > capacity) {
+        // halve the largest tiles, lowest priority first
+        size_t candidate = count;
+        for (size_t i = count; i-- > 0;) {
+            if (dimensions[i] > minDimension &&
+                (candidate == count || dimensions[i] > dimensions[candidate])) {
+                candidate = i;
+            }
+        }
+        if (candidate < count) {
+            total -= area(candidate);
+            dimensions[candidate] /= 2;
+            total += area(candidate);
+        } else {
+            // all the tiles have the minimum dimension, drop the lowest priority light
+            count--;
+            total -= area(count);
+        }
+    }
+
+    // The tiles are placed by decreasing dimension along a Z-order curve. All the dimensions
+    // being powers of two, each tile starts on a multiple of its area and they leave no gaps.
+    uint8_t lights[CONFIG_MAX_SHADOW_ATLAS_TILES];
+    uint8_t tiles[CONFIG_MAX_SHADOW_ATLAS_TILES];
+    size_t tileCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        for (size_t j = 0; j < tileCounts[i]; j++, tileCount++) {
+            assert(tileCount < CONFIG_MAX_SHADOW_ATLAS_TILES);
+            lights[tileCount] = uint8_t(i);
+            tiles[tileCount] = uint8_t(tileCount);
+        }
+    }
+    std::stable_sort(tiles, tiles + tileCount, [dimensions, &lights](uint8_t lhs, uint8_t rhs) {
+        return dimensions[lights[lhs]] > dimensions[lights[rhs]];
+    });
+
+    uint32_t position = 0;
+    for (size_t i = 0; i < tileCount; i++) {
+        const uint8_t tile = tiles[i];
+        const uint32_t d = dimensions[lights[tile]] / minDimension;
+        origins[tile] = uint2{
+                compactEvenBits(position), compactEvenBits(position >> 1u) } * minDimension;
+        position += d * d;
+    }
+    return count;
+}
+
+void ShadowMapManager::prepare(DriverApi& driver, SamplerGroup& sb,
+        bool hasCascades, bool hasPunctualShadows) noexcept {
+    // 16-bits seems enough. TODO: make it an option.
+    const TextureFormat format = TextureFormat::DEPTH16;
+
+    uint32_t dim = 1;
+    uint32_t layers = 1;
+    if (hasCascades) {
+        for (size_t i = 0; i < mCascadeCount; i++) {
+            mCascades[i]->prepare(format);
+        }
+        // all the cascades have the dimension of the light's shadow map
+        dim = mCascades[0]->getDimension();
+        layers = uint32_t(mCascadeCount);
+    }
+    if (!mTexture || (hasCascades && (dim != mTextureDimension || layers != mTextureLayers))) {
+        createTexture(driver, dim, layers);
+    }
+    if (mCacheStaticCasters) {
+        if (hasCascades && !mStaticTexture) {
+            createStaticTexture(driver, dim, layers);
+        }
+    } else if (mStaticTexture) {
+        destroyStaticTexture(driver);
+    }
+
+    const uint32_t atlasDim = hasPunctualShadows ? ATLAS_DIMENSION : 1;
+    if (!mAtlasTexture || (hasPunctualShadows && atlasDim != mAtlasDimension)) {
+        createAtlas(driver, atlasDim);
+    }
+
+    SamplerParams s;
+    s.filterMag = SamplerMagFilter::LINEAR;
+    s.filterMin = SamplerMinFilter::LINEAR;
+    s.compareFunc = SamplerCompareFunc::LE;
+    s.compareMode = SamplerCompareMode::COMPARE_TO_TEXTURE;
+    s.depthStencil = true;
+    sb.setSampler(PerViewSib::SHADOW_MAP, { mTexture, s });
+    sb.setSampler(PerViewSib::SHADOW_ATLAS, { mAtlasTexture, s });
+}
+
+void ShadowMapManager::createTexture(DriverApi& driver, uint32_t dim, uint32_t layers) noexcept {
+    // destroy the current render targets and texture
+    for (Handle<HwRenderTarget>& renderTarget : mRenderTargets) {
+        if (renderTarget) {
+            driver.destroyRenderTarget(renderTarget);
+            renderTarget.clear();
+        }
+    }
+    if (mTexture) {
+        driver.destroyTexture(mTexture);
+    }
+    // the static casters must have the same dimension
+    destroyStaticTexture(driver);
+
+    // allocate new ones...
+    mTexture = driver.createTexture(
+            SamplerType::SAMPLER_2D_ARRAY, 1, TextureFormat::DEPTH16, 1, dim, dim, layers,
+            TextureUsage::DEPTH_ATTACHMENT | TextureUsage::SAMPLEABLE);
+
+    for (uint32_t layer = 0; layer < layers; layer++) {
+        mRenderTargets[layer] = driver.createRenderTarget(
+                TargetBufferFlags::DEPTH, dim, dim, 1,
+                {}, { mTexture, 0, uint16_t(layer) }, {});
+    }
+
+    mTextureDimension = dim;
+    mTextureLayers = layers;
+}
+
+void ShadowMapManager::createAtlas(DriverApi& driver, uint32_t dim) noexcept {
+    if (mAtlasRenderTarget) {
+        driver.destroyRenderTarget(mAtlasRenderTarget);
+    }
+    if (mAtlasTexture) {
+        driver.destroyTexture(mAtlasTexture);
+    }
+
+    // a texture array with a single layer, so the same sampling code as the cascades is used
+    mAtlasTexture = driver.createTexture(
+            SamplerType::SAMPLER_2D_ARRAY, 1, TextureFormat::DEPTH16, 1, dim, dim, 1,
+            TextureUsage::DEPTH_ATTACHMENT | TextureUsage::SAMPLEABLE);
+    mAtlasRenderTarget = driver.createRenderTarget(
+            TargetBufferFlags::DEPTH, dim, dim, 1, {}, { mAtlasTexture, 0, 0 }, {});
+
+    mAtlasDimension = dim;
+    mAtlasValid = false;
+}
+
+void ShadowMapManager::createStaticTexture(DriverApi& driver, uint32_t dim,
+        uint32_t layers) noexcept {
+    destroyStaticTexture(driver);
+
+    // only used as the source of a copy, it's never sampled
+    mStaticTexture = driver.createTexture(
+            SamplerType::SAMPLER_2D_ARRAY, 1, TextureFormat::DEPTH16, 1, dim, dim, layers,
+            TextureUsage::DEPTH_ATTACHMENT);
+
+    for (uint32_t layer = 0; layer < layers; layer++) {
+        mStaticRenderTargets[layer] = driver.createRenderTarget(
+                TargetBufferFlags::DEPTH, dim, dim, 1,
+                {}, { mStaticTexture, 0, uint16_t(layer) }, {});
+    }
+}
+
+void ShadowMapManager::destroyStaticTexture(DriverApi& driver) noexcept {
+    for (Handle<HwRenderTarget>& renderTarget : mStaticRenderTargets) {
+        if (renderTarget) {
+            driver.destroyRenderTarget(renderTarget);
+            renderTarget.clear();
+        }
+    }
+    if (mStaticTexture) {
+        driver.destroyTexture(mStaticTexture);
+        mStaticTexture.clear();
+    }
+    mStaticValid.fill(false);
+}
+
+UTILS_NOINLINE
+void ShadowMapManager::fillWithDebugPattern(DriverApi& driver) const noexcept {
+    // only the first cascade gets the pattern
+    const size_t dim = mTextureDimension;
+    size_t size = dim * dim;
+    uint8_t* ptr = (uint8_t*)malloc(size);
+    driver.update2DImage(mTexture, 0, 0, 0, dim, dim, {
+        ptr, size, PixelDataFormat::DEPTH_COMPONENT, PixelDataType::UBYTE, (BufferDescriptor::Callback)&free
+    });
+    for (size_t y = 0; y < dim; ++y) {
+        for (size_t x = 0; x < dim; ++x) {
+            ptr[x + y * dim] = ((x ^ y) & 0x8u) ? 0u : 0xFFu;
+        }
+    }
+}
+
+void ShadowMapManager::render(ArenaScope& arena, DriverApi& driver, RenderPass& pass,
+        FView& view) noexcept {
+    SYSTRACE_CALL();
+
+    FEngine& engine = mEngine;
+
+    if (UTILS_UNLIKELY(engine.debug.shadowmap.checkerboard)) {
+        // TODO: eventually this will be handled as a optional pass in the framefraph
+        fillWithDebugPattern(driver);
+        return;
+    }
+
+    // the level of details are selected during culling, they don't depend on the camera
+    view.updatePrimitivesLod(engine, view.getCameraInfo(),
+            view.getScene()->getRenderableData(), view.getVisibleShadowCasters());
+
+    if (view.hasShadowing()) {
+        renderCascades(arena, driver, pass, view);
+    }
+
+    if (view.hasPunctualShadowing()) {
+        renderAtlas(driver, pass, view);
+    }
+
+    // the view's pass is used for the color pass next
+    pass.setVisibilityMask(0xFF);
+}
+
+void ShadowMapManager::renderCascades(ArenaScope& arena, DriverApi& driver, RenderPass& pass,
+        FView& view) noexcept {
+    FEngine& engine = mEngine;
+    FScene& scene = *view.getScene();
+    const FView::Range visibleShadowCasters = view.getVisibleShadowCasters();
+    const size_t cascadeCount = mCascadeCount;
+
+    // the static casters are rendered first, if they changed, and left out of the cascades that
+    // start from a copy of them
+    const uint8_t cachedCascades = mStaticTexture ?
+            renderStaticCasters(driver, pass, view) : uint8_t(0);
+
+    // A single cascade uses the view's pass, along with its command cache and instancing.
+    // Otherwise each cascade has its own pass, writing in its own part of the commands buffer,
+    // so the commands of several cascades can be generated in parallel. The command cache
+    // doesn't see the static casters being left out, so it isn't used with cached cascades.
+    RenderPass* passes[CONFIG_MAX_SHADOW_CASCADES] = { &pass };
+    size_t batchSize = 1;
+    if (cascadeCount > 1 || cachedCascades) {
+        using Command = RenderPass::Command;
+        GrowingSlice<Command>& commands = pass.getCommands();
+
+        // Each cascade needs a command per visible shadow caster primitive, plus the sentinel.
+        // The cascades that don't all fit in the commands buffer are generated and rendered in
+        // batches, each batch reusing the same parts of the buffer.
+        FScene::RenderableSoa& soa = scene.getRenderableData();
+        RenderPass::updateSummedPrimitiveCounts(soa, visibleShadowCasters);
+        const size_t needed = FScene::getPrimitiveCount(soa, visibleShadowCasters.last) + 1;
+        batchSize = std::min(cascadeCount, std::max(size_t(1), commands.remain() / needed));
+
+        const uint32_t capacity = uint32_t(commands.remain() / batchSize);
+        for (size_t i = 0; i < batchSize; i++) {
+            auto* const slice = arena.make<GrowingSlice<Command>>(
+                    commands.end() + i * capacity, capacity);
+            passes[i] = arena.make<RenderPass>(engine, *slice);
+            passes[i]->setRenderFlags(pass.getRenderFlags() & ~RenderPass::HAS_INSTANCING);
+        }
+    }
+
+    for (size_t first = 0; first < cascadeCount; first += batchSize) {
+        const size_t count = std::min(batchSize, cascadeCount - first);
+
+        // the cascades without visible shadows are only cleared
+        RenderPass* visiblePasses[CONFIG_MAX_SHADOW_CASCADES];
+        size_t visibleCount = 0;
+        for (size_t j = 0; j < count; j++) {
+            const size_t i = first + j;
+            ShadowMap const& shadowMap = *mCascades[i];
+            RenderPass& cascadePass = *passes[j];
+            if (first) {
+                // the commands of the previous batch were executed, its slices are reused
+                cascadePass.getCommands().clear();
+            }
+            cascadePass.setCamera(shadowMap.getCameraInfo());
+            cascadePass.setGeometry(scene, visibleShadowCasters);
+            cascadePass.setVisibilityMask(uint8_t(1u << (FView::VISIBLE_SHADOW_CASCADE_BIT + i)));
+            if (shadowMap.hasVisibleShadows()) {
+                visiblePasses[visibleCount++] = &cascadePass;
+            }
+        }
+
+        if (visibleCount) {
+            RenderPass::appendSortedCommands(engine.getJobSystem(),
+                    visiblePasses, visibleCount, RenderPass::SHADOW);
+        }
+
+        for (size_t j = 0; j < count; j++) {
+            const size_t i = first + j;
+            ShadowMap const& shadowMap = *mCascades[i];
+            RenderPass& cascadePass = *passes[j];
+            filament::Viewport const& viewport = shadowMap.getViewport();
+
+            // FIXME: in the future this will come from the framegraph
+            RenderPassParams params = {};
+            params.flags.discardEnd = TargetBufferFlags::COLOR_AND_STENCIL;
+            params.clearDepth = 1.0;
+            params.viewport = viewport;
+            if (cachedCascades & (1u << i)) {
+                // the other casters are rendered on top of a copy of the static casters, which
+                // includes the 1-texel border
+                const uint32_t dim = mTextureDimension;
+                driver.blit(TargetBufferFlags::DEPTH,
+                        mRenderTargets[i], { 0, 0, dim, dim },
+                        mStaticRenderTargets[i], { 0, 0, dim, dim },
+                        SamplerMagFilter::NEAREST);
+            } else {
+                params.flags.clear = TargetBufferFlags::DEPTH;
+                params.flags.discardStart = TargetBufferFlags::DEPTH;
+                // disable scissor for clearing so the whole surface, but set the viewport to the
+                // the inset-by-1 rectangle.
+                params.flags.clear |= RenderPassFlags::IGNORE_SCISSOR;
+            }
+
+            // the uniforms are committed before each cascade is rendered
+            view.prepareCamera(shadowMap.getCameraInfo(), viewport);
+            view.commitUniforms(driver);
+
+            backend::PolygonOffset polygonOffset = shadowMap.getPolygonOffset();
+            cascadePass.overridePolygonOffset(&polygonOffset);
+            cascadePass.execute("Shadow map Pass", mRenderTargets[i], params,
+                    cascadePass.getCommands().begin(), cascadePass.getCommands().end());
+            cascadePass.overridePolygonOffset(nullptr);
+        }
+    }
+
+    // the commands have been sent to the driver, the buffer can be reused
+    pass.getCommands().clear();
+}
+
+uint8_t ShadowMapManager::renderStaticCasters(DriverApi& driver, RenderPass& pass,
+        FView& view) noexcept {
+    SYSTRACE_CALL();
+
+    FEngine& engine = mEngine;
+    FScene& scene = *view.getScene();
+    FScene::RenderableSoa& renderableData = scene.getRenderableData();
+    const FView::Range casters = view.getVisibleShadowCasters();
+    const uint8_t visibleLayers = view.getVisibleLayers();
+
+    // the scene's changes are only known if we saw all of them
+    const bool staticCastersChanged = &scene != mStaticScene ||
+            scene.getPrepareCount() != mStaticScenePrepareCount + 1 ||
+            scene.hasChangedStaticCasters();
+    mStaticScene = &scene;
+    mStaticScenePrepareCount = scene.getPrepareCount();
+
+    // the cascades are rendered one after the other, with the free part of the commands buffer
+    using Command = RenderPass::Command;
+    GrowingSlice<Command>& commands = pass.getCommands();
+    GrowingSlice<Command> staticCommands(commands.end(), commands.remain());
+    RenderPass staticPass(engine, staticCommands);
+    staticPass.setRenderFlags(pass.getRenderFlags());
+    staticPass.setGeometry(scene, casters);
+    staticPass.setVisibilityMask(uint8_t(1u << FView::VISIBLE_SHADOW_TILE_BIT));
+
+    uint8_t* const visibleMask = renderableData.data<FScene::VISIBLE_MASK>();
+    auto const* const visibility = renderableData.data<FScene::VISIBILITY_STATE>();
+    const uint8_t tileBit = uint8_t(1u << FView::VISIBLE_SHADOW_TILE_BIT);
+
+    // The levels of detail are selected with the view's camera, which can move while the light
+    // space stays the same. The cascades of a static caster which switched level are stale.
+    uint8_t levelChangedBits = 0;
+    FRenderableManager const& rcm = engine.getRenderableManager();
+    if (rcm.hasLevels()) {
+        auto const* const instances = renderableData.data<FScene::RENDERABLE_INSTANCE>();
+        uint8_t const* const levels = renderableData.data<FScene::LEVEL_OF_DETAIL>();
+        for (uint32_t j = casters.first; j < casters.last; j++) {
+            if (visibility[j].staticShadowCaster && rcm.getLevelCount(instances[j]) > 1) {
+                const size_t index = instances[j].asValue();
+                if (index >= mStaticLevels.size()) {
+                    mStaticLevels.resize(index + 1, 0);
+                }
+                levelChangedBits |= mStaticLevels[index] != levels[j] ? visibleMask[j] : 0u;
+                mStaticLevels[index] = levels[j];
+            }
+        }
+    }
+
+    uint8_t cachedCascades = 0;
+    for (size_t i = 0; i < mCascadeCount; i++) {
+        ShadowMap const& shadowMap = *mCascades[i];
+        if (!shadowMap.hasVisibleShadows()) {
+            // the cascade is only cleared
+            mStaticValid[i] = false;
+            continue;
+        }
+
+        // the static casters must be rendered again if the cascade's projection changed
+        filament::Viewport const& viewport = shadowMap.getViewport();
+        TileState& state = mStaticStates[i];
+        const bool dirty = !mStaticValid[i] || staticCastersChanged ||
+                state.li != mCascadeLight ||
+                state.lightSpace != shadowMap.getLightSpaceMatrix() ||
+                state.polygonOffset.constant != shadowMap.getPolygonOffset().constant ||
+                state.polygonOffset.slope != shadowMap.getPolygonOffset().slope ||
+                state.visibleLayers != visibleLayers ||
+                (levelChangedBits & (1u << (FView::VISIBLE_SHADOW_CASCADE_BIT + i)));
+        state = { mCascadeLight, viewport, shadowMap.getLightSpaceMatrix(),
+                shadowMap.getPolygonOffset(), visibleLayers };
+        mStaticValid[i] = true;
+        cachedCascades |= uint8_t(1u << i);
+        if (!dirty) {
+            continue;
+        }
+
+        const uint8_t cascadeBit = uint8_t(1u << (FView::VISIBLE_SHADOW_CASCADE_BIT + i));
+        for (uint32_t j = casters.first; j < casters.last; j++) {
+            const bool isStatic = (visibleMask[j] & cascadeBit) &&
+                    visibility[j].staticShadowCaster;
+            visibleMask[j] = uint8_t((visibleMask[j] & ~tileBit) | (isStatic ? tileBit : 0u));
+        }
+
+        const CameraInfo cameraInfo = shadowMap.getCameraInfo();
+        staticPass.setCamera(cameraInfo);
+        staticPass.appendSortedCommands(RenderPass::SHADOW);
+
+        RenderPassParams params = {};
+        params.flags.clear = TargetBufferFlags::DEPTH;
+        params.flags.clear |= RenderPassFlags::IGNORE_SCISSOR;
+        params.flags.discardStart = TargetBufferFlags::DEPTH;
+        params.flags.discardEnd = TargetBufferFlags::COLOR_AND_STENCIL;
+        params.clearDepth = 1.0;
+        params.viewport = viewport;
+
+        view.prepareCamera(cameraInfo, viewport);
+        view.commitUniforms(driver);
+
+        backend::PolygonOffset polygonOffset = shadowMap.getPolygonOffset();
+        staticPass.overridePolygonOffset(&polygonOffset);
+        staticPass.execute("Static shadow map Pass", mStaticRenderTargets[i], params,
+                staticCommands.begin(), staticCommands.end());
+        staticPass.overridePolygonOffset(nullptr);
+        staticCommands.clear();
+    }
+
+    // the cached cascades only render the other casters
+    const uint8_t cachedBits = uint8_t(cachedCascades << FView::VISIBLE_SHADOW_CASCADE_BIT);
+    for (uint32_t j = casters.first; j < casters.last; j++) {
+        visibleMask[j] &= visibility[j].staticShadowCaster ? uint8_t(~cachedBits) : 0xFFu;
+    }
+    return cachedCascades;
+}
+
+void ShadowMapManager::renderAtlas(DriverApi& driver, RenderPass& pass, FView& view) noexcept {
+    SYSTRACE_CALL();
+
+    FEngine& engine = mEngine;
+    FScene& scene = *view.getScene();
+    FScene::RenderableSoa& renderableData = scene.getRenderableData();
+    const FView::Range casters = view.getVisibleShadowCasters();
+    const uint8_t visibleLayers = view.getVisibleLayers();
+
+    // The tiles persist across frames. They're all rendered again, after a full clear, when the
+    // atlas is new or its layout changed, or when the backend can't clear a single tile. The
+    // scene's changes are only known if we saw all of them.
+    bool renderAll = !mAtlasValid || !mHasScissoredClears ||
+            mTileCount != mRenderedTileCount ||
+            &scene != mRenderedScene || scene.getPrepareCount() != mRenderedScenePrepareCount + 1;
+    for (size_t t = 0; t < mTileCount && !renderAll; t++) {
+        filament::Viewport const& viewport = mTiles[t]->getViewport();
+        filament::Viewport const& rendered = mTileStates[t].viewport;
+        renderAll = viewport.left != rendered.left || viewport.bottom != rendered.bottom ||
+                viewport.width != rendered.width || viewport.height != rendered.height;
+    }
+    mAtlasValid = true;
+    mRenderedTileCount = mTileCount;
+    mRenderedScene = &scene;
+    mRenderedScenePrepareCount = scene.getPrepareCount();
+
+    std::vector<Aabb> const& changedBounds = scene.getChangedBounds();
+    const bool changedAll = scene.hasChangedAll();
+
+    // the tiles are rendered one after the other, with the free part of the commands buffer
+    using Command = RenderPass::Command;
+    GrowingSlice<Command>& commands = pass.getCommands();
+    GrowingSlice<Command> tileCommands(commands.end(), commands.remain());
+    RenderPass tilePass(engine, tileCommands);
+    tilePass.setRenderFlags(pass.getRenderFlags());
+    tilePass.setGeometry(scene, casters);
+    tilePass.setVisibilityMask(uint8_t(1u << FView::VISIBLE_SHADOW_TILE_BIT));
+
+    uint8_t* const visibleMask = renderableData.data<FScene::VISIBLE_MASK>();
+    auto const* const visibility = renderableData.data<FScene::VISIBILITY_STATE>();
+    float3 const* const centers = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* const extents = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    const uint8_t tileBit = uint8_t(1u << FView::VISIBLE_SHADOW_TILE_BIT);
+    // the culling kernels process the renderables by groups of 8
+    const uint32_t first = casters.first & ~7u;
+
+    bool clearAll = renderAll;
+    for (size_t t = 0; t < mTileCount; t++) {
+        ShadowMap const& tile = *mTiles[t];
+        PunctualShadow const& light = mPunctualShadows[mTileLights[t]];
+        filament::Viewport const& viewport = tile.getViewport();
+
+        // a tile must be rendered again if its light moved, or if a caster moved near the light
+        TileState& state = mTileStates[t];
+        bool dirty = renderAll || changedAll || state.li != light.li ||
+                state.lightSpace != tile.getLightSpaceMatrix() ||
+                state.polygonOffset.constant != tile.getPolygonOffset().constant ||
+                state.polygonOffset.slope != tile.getPolygonOffset().slope ||
+                state.visibleLayers != visibleLayers;
+        for (size_t i = 0, c = changedBounds.size(); i < c && !dirty; i++) {
+            const float3 closest = clamp(light.sphere.xyz,
+                    changedBounds[i].min, changedBounds[i].max);
+            dirty = length2(closest - light.sphere.xyz) <= light.sphere.w * light.sphere.w;
+        }
+        state = { light.li, viewport, tile.getLightSpaceMatrix(), tile.getPolygonOffset(),
+                visibleLayers };
+        if (!dirty) {
+            continue;
+        }
+
+        // cull the casters with the tile's frustum, the renderables that opted out of culling
+        // are always rendered
+        for (uint32_t i = first; i < casters.last; i++) {
+            visibleMask[i] &= ~tileBit;
+        }
+        Culler::intersects(visibleMask + first, tile.getCamera().getFrustum(),
+                centers + first, extents + first, casters.last - first,
+                FView::VISIBLE_SHADOW_TILE_BIT);
+        for (uint32_t i = casters.first; i < casters.last; i++) {
+            visibleMask[i] |= visibility[i].culling ? 0u : tileBit;
+        }
+
+        const CameraInfo cameraInfo = tile.getCameraInfo();
+        tilePass.setCamera(cameraInfo);
+        tilePass.appendSortedCommands(RenderPass::SHADOW);
+
+        RenderPassParams params = {};
+        params.flags.discardEnd = TargetBufferFlags::COLOR_AND_STENCIL;
+        params.clearDepth = 1.0;
+        params.viewport = viewport;
+        if (clearAll) {
+            // the first pass clears the whole atlas, including the 1-texel border of the tiles
+            params.flags.clear = TargetBufferFlags::DEPTH;
+            params.flags.clear |= RenderPassFlags::IGNORE_SCISSOR;
+            params.flags.discardStart = TargetBufferFlags::DEPTH;
+            clearAll = false;
+        } else if (mHasScissoredClears) {
+            // only this tile is cleared, the others are kept
+            params.flags.clear = TargetBufferFlags::DEPTH;
+        }
+
+        view.prepareCamera(cameraInfo, viewport);
+        view.commitUniforms(driver);
+
+        backend::PolygonOffset polygonOffset = tile.getPolygonOffset();
+        tilePass.overridePolygonOffset(&polygonOffset);
+        tilePass.execute("Shadow atlas Pass", mAtlasRenderTarget, params,
+                tileCommands.begin(), tileCommands.end());
+        tilePass.overridePolygonOffset(nullptr);
+        tileCommands.clear();
+    }
+}
+
+} // namespace details
+} // namespace filament
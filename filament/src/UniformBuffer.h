@@ -28,6 +28,7 @@
 #include <backend/BufferDescriptor.h>
 
 #include <math/mat3.h>
+#include <math/mat3x4.h>
 #include <math/mat4.h>
 
 #include <stddef.h>
@@ -116,6 +117,7 @@ public:
                 std::is_same<math::float3, T>::value ||
                 std::is_same<math::float4, T>::value ||
                 std::is_same<math::mat3f, T>::value ||
+                std::is_same<math::mat3x4f, T>::value ||
                 std::is_same<math::mat4f, T>::value
         >::type;
     };
@@ -141,7 +143,7 @@ public:
     }
 
     // set uniform of known types to the proper offset (e.g.: use offsetof())
-    // (see specialization for mat3f below)
+    // (see specializations for mat3f and mat3x4f below)
     template <typename T, typename = typename is_supported_type<T>::type>
     void setUniform(size_t offset, const T& v) noexcept {
         setUniform(invalidateUniforms(offset, sizeof(T)), 0, v);
@@ -152,6 +154,7 @@ public:
     T const& getUniform(size_t offset) const noexcept {
         // we don't support mat3f because a specialization would force us to return by value.
         static_assert(!std::is_same<math::mat3f, T>::value, "mat3f not supported");
+        static_assert(!std::is_same<math::mat3x4f, T>::value, "mat3x4f not supported");
         return *reinterpret_cast<T const*>(static_cast<char const*>(mBuffer) + offset);
     }
 
@@ -216,6 +219,17 @@ inline void UniformBuffer::setUniform(void* addr, size_t offset, const math::mat
     temp.v[2][3] = 0; // not needed, but doesn't cost anything
 }
 
+// specialization for mat3x4f, stored as its 3 rows so that it takes 3 vec4 instead of the 4 of
+// its columns (which are vec3, see std140 layout rules)
+template<>
+inline void UniformBuffer::setUniform(void* addr, size_t offset, const math::mat3x4f& v) noexcept {
+    addr = static_cast<char*>(addr) + offset;
+    math::float4* const UTILS_RESTRICT rows = static_cast<math::float4*>(addr);
+    rows[0] = v.row(0);
+    rows[1] = v.row(1);
+    rows[2] = v.row(2);
+}
+
 } // namespace filament
 
 #endif // TNT_FILAMENT_DRIVER_UNIFORMBUFFER_H
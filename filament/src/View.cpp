@@ -16,6 +16,7 @@
 
 #include "details/View.h"
 
+#include "details/BoundingVolumeHierarchy.h"
 #include "details/Engine.h"
 #include "details/Culler.h"
 #include "details/DFG.h"
@@ -58,12 +59,20 @@ static constexpr size_t VISIBLE_SHADOW_CASTER_BIT = 1u;
 static constexpr uint8_t VISIBLE_RENDERABLE = 1u << VISIBLE_RENDERABLE_BIT;
 static constexpr uint8_t VISIBLE_SHADOW_CASTER = 1u << VISIBLE_SHADOW_CASTER_BIT;
 static constexpr uint8_t VISIBLE_ALL = VISIBLE_RENDERABLE | VISIBLE_SHADOW_CASTER;
+static constexpr uint8_t VISIBLE_CASCADES = (1u << CONFIG_MAX_SHADOW_CASCADES) - 1u;
+static_assert(FView::VISIBLE_SHADOW_CASCADE_BIT + CONFIG_MAX_SHADOW_CASCADES <=
+        FView::VISIBLE_PUNCTUAL_SHADOW_CASTER_BIT,
+        "the shadow cascades don't fit in the VISIBLE_MASK");
+
+// during culling, the shadow casters of the point and spot lights set the bit after the cascades
+static constexpr size_t PUNCTUAL_SHADOW_CULLING_BIT =
+        VISIBLE_SHADOW_CASTER_BIT + CONFIG_MAX_SHADOW_CASCADES;
 
 FView::FView(FEngine& engine)
     : mFroxelizer(engine),
       mPerViewUb(PerViewUib::getUib().getSize()),
       mPerViewSb(PerViewSib::SAMPLER_COUNT),
-      mDirectionalShadowMap(engine) {
+      mShadowMapManager(engine) {
     DriverApi& driver = engine.getDriverApi();
 
     FDebugRegistry& debugRegistry = engine.getDebugRegistry();
@@ -73,6 +82,7 @@ FView::FView(FEngine& engine)
     // set-up samplers
     mFroxelizer.getRecordBuffer().setSampler(PerViewSib::RECORDS, mPerViewSb);
     mFroxelizer.getFroxelBuffer().setSampler(PerViewSib::FROXELS, mPerViewSb);
+    mFroxelizer.getLightBuffer().setSampler(PerViewSib::LIGHTS, mPerViewSb);
     if (engine.getDFG()->isValid()) {
         TextureSampler sampler(TextureSampler::MagFilter::LINEAR);
         mPerViewSb.setSampler(PerViewSib::IBL_DFG_LUT,
@@ -96,7 +106,7 @@ void FView::terminate(FEngine& engine) {
     driver.destroyUniformBuffer(mLightUbh);
     driver.destroySamplerGroup(mPerViewSbh);
     driver.destroyUniformBuffer(mRenderableUbh);
-    mDirectionalShadowMap.terminate(driver);
+    mShadowMapManager.terminate(driver);
     mFroxelizer.terminate(driver);
 }
 
@@ -280,37 +290,57 @@ bool FView::isSkyboxVisible() const noexcept {
 }
 
 void FView::prepareShadowing(FEngine& engine, backend::DriverApi& driver,
-        FScene::RenderableSoa& renderableData, FScene::LightSoa const& lightData) noexcept {
+        FScene::LightSoa const& lightData) noexcept {
     SYSTRACE_CALL();
 
     // setup shadow mapping
-    // TODO: for now we only consider THE directional light
+    // The point and spot lights with shadows have been selected already, see prepare().
 
     auto& lcm = engine.getLightManager();
+    ShadowMapManager& shadowMapManager = mShadowMapManager;
 
     // dominant directional light is always as index 0
     FLightManager::Instance directionalLight = lightData.elementAt<FScene::LIGHT_INSTANCE>(0);
     mHasShadowing = mShadowingEnabled && directionalLight && lcm.isShadowCaster(directionalLight);
     if (UTILS_UNLIKELY(mHasShadowing)) {
-        // compute the frustum for this light
-        ShadowMap& shadowMap = mDirectionalShadowMap;
-        shadowMap.update(lightData, 0, mScene, mViewingCameraInfo, mVisibleLayers);
-        if (shadowMap.hasVisibleShadows()) {
-            // Cull shadow casters
-            UniformBuffer& u = mPerViewUb;
-            Frustum const& frustum = shadowMap.getCamera().getFrustum();
-            FView::prepareVisibleShadowCasters(engine.getJobSystem(), frustum, renderableData);
-
-            // allocates shadowmap driver resources
-            shadowMap.prepare(driver, mPerViewSb);
-
-            mat4f const& lightFromWorldMatrix = shadowMap.getLightSpaceMatrix();
-            u.setUniform(offsetof(PerViewUib, lightFromWorldMatrix), lightFromWorldMatrix);
-
-            const float texelSizeWorldSpace = shadowMap.getTexelSizeWorldSpace();
+        // compute the frustum of each cascade of this light
+        shadowMapManager.update(lightData, 0, mScene, mViewingCameraInfo, mVisibleLayers);
+    }
+
+    const bool hasCascades = hasShadowing();
+    if (UTILS_UNLIKELY(hasCascades || mHasPunctualShadowing)) {
+        // shadow casters are culled later, along with the renderables
+        UniformBuffer& u = mPerViewUb;
+
+        // allocates shadowmap driver resources
+        shadowMapManager.prepare(driver, mPerViewSb, hasCascades, mHasPunctualShadowing);
+
+        // there are no cascades when only the point and spot lights cast shadows
+        size_t cascadeCount = 0;
+        if (hasCascades) {
+            cascadeCount = shadowMapManager.getCascadeCount();
             const float normalBias = lcm.getShadowNormalBias(directionalLight);
+            float4 cascadeNormalBias{};
+            for (size_t i = 0; i < cascadeCount; i++) {
+                ShadowMap const& shadowMap = shadowMapManager.getCascade(i);
+                mat4f const& lightFromWorldMatrix = shadowMap.getLightSpaceMatrix();
+                u.setUniform(offsetof(PerViewUib, lightFromWorldMatrix) + i * sizeof(mat4f),
+                        lightFromWorldMatrix);
+                cascadeNormalBias[i] = normalBias * shadowMap.getTexelSizeWorldSpace();
+            }
+
+            // the first cascade's normal bias is applied in the vertex shader
             u.setUniform(offsetof(PerViewUib, shadowBias),
-                    float3{ 0, normalBias * texelSizeWorldSpace, 0 });
+                    float3{ 0, cascadeNormalBias[0], 0 });
+            u.setUniform(offsetof(PerViewUib, cascadeSplits),
+                    shadowMapManager.getCascadeSplits());
+            u.setUniform(offsetof(PerViewUib, cascadeNormalBias), cascadeNormalBias);
+        }
+        u.setUniform(offsetof(PerViewUib, cascades), uint32_t(cascadeCount));
+
+        for (size_t i = 0, c = shadowMapManager.getTileCount(); i < c; i++) {
+            u.setUniform(offsetof(PerViewUib, shadowAtlasFromWorldMatrix) + i * sizeof(mat4f),
+                    shadowMapManager.getTile(i).getLightSpaceMatrix());
         }
     }
 }
@@ -323,13 +353,18 @@ void FView::prepareLighting(FEngine& engine, FEngine::DriverApi& driver, ArenaSc
     const CameraInfo& camera = mViewingCameraInfo;
     FScene* const scene = mScene;
 
-    scene->prepareDynamicLights(camera, arena, mLightUbh);
+    scene->prepareDynamicLights(camera, arena, mLightUbh, mFroxelizer.getLightBuffer());
 
-    // here the array of visible lights has been shrunk to CONFIG_MAX_LIGHT_COUNT
+    // here the array of visible lights has been shrunk to CONFIG_MAX_CLUSTERED_LIGHT_COUNT
     auto const& lightData = scene->getLightData();
+    const size_t positionalLightCount = lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT;
 
     // trace the number of visible lights
-    SYSTRACE_VALUE32("visibleLights", lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT);
+    SYSTRACE_VALUE32("visibleLights", positionalLightCount);
+
+    // beyond CONFIG_MAX_LIGHT_COUNT, lights are read from the light buffer instead of the UBO
+    u.setUniform(offsetof(PerViewUib, clusteredLights),
+            uint32_t(Froxelizer::isClustered(positionalLightCount)));
 
     // Exposure
     const float ev100 = camera.ev100;
@@ -386,15 +421,25 @@ void FView::prepareLighting(FEngine& engine, FEngine::DriverApi& driver, ArenaSc
         // Disable the sun if there's no directional light
         float4 sun{ 0.0f, 0.0f, 0.0f, -1.0f };
         u.setUniform(offsetof(PerViewUib, sun), sun);
+
+        // the shadows of the point and spot lights use the directional lighting variants, which
+        // must not add any light
+        u.setUniform(offsetof(PerViewUib, lightColorIntensity), float4{ 0.0f });
     }
 
     // Dynamic lighting
-    mHasDynamicLighting = scene->getLightData().size() > FScene::DIRECTIONAL_LIGHTS_COUNT;
+    mHasDynamicLighting = positionalLightCount > 0;
     if (mHasDynamicLighting) {
         Froxelizer& froxelizer = mFroxelizer;
-        if (froxelizer.prepare(driver, arena, viewport, camera.projection, camera.zn, camera.zf)) {
+        if (froxelizer.prepare(engine, driver, arena, viewport,
+                camera.projection, camera.zn, camera.zf, camera, lightData)) {
             froxelizer.updateUniforms(u); // update our uniform buffer if needed
         }
+        // the clustered mode uses its own (16-bits) record buffer
+        GPUBuffer const& records = froxelizer.getRecordBuffer();
+        if (!records.isSamplerSet(PerViewSib::RECORDS, mPerViewSb)) {
+            records.setSampler(PerViewSib::RECORDS, mPerViewSb);
+        }
     }
 }
 
@@ -461,15 +506,24 @@ void FView::prepare(FEngine& engine, backend::DriverApi& driver, ArenaScope& are
             // world origin transform, use only for debugging
             .worldOrigin        = worldOriginCamera
     };
+    const mat4f cullingModel = worldOriginScene * mCullingCamera->getModelMatrix();
+    const mat4f cullingView = FCamera::getViewMatrix(cullingModel);
     mCullingFrustum = FCamera::getFrustum(
-            mCullingCamera->getCullingProjectionMatrix(),
-            FCamera::getViewMatrix(worldOriginScene * mCullingCamera->getModelMatrix()));
+            mCullingCamera->getCullingProjectionMatrix(), cullingView);
 
     /*
      * Gather all information needed to render this scene. Apply the world origin to all
      * objects in the scene.
      */
-    scene->prepare(worldOriginScene);
+    scene->prepare(js, worldOriginScene);
+
+    /*
+     * Shadows of the point and spot lights: select the lights with shadows and allocate their
+     * tiles in the shadow atlas. This must happen before light culling, which reorders the lights.
+     */
+
+    mHasPunctualShadowing = mShadowingEnabled && mShadowMapManager.updatePunctual(
+            scene->getLightData(), mViewingCameraInfo, mCullingFrustum, viewport.height);
 
     /*
      * Light culling: runs in parallel with Renderable culling (below)
@@ -490,19 +544,41 @@ void FView::prepare(FEngine& engine, backend::DriverApi& driver, ArenaScope& are
         std::uninitialized_fill(cullingMask.begin(), cullingMask.end(), 0);
 
         /*
-         * Culling: as soon as possible we perform our camera-culling
-         * (this will set the VISIBLE_RENDERABLE bit)
+         * Shadowing: compute the shadow camera, its frustum is needed for culling below
          */
 
-        prepareVisibleRenderables(js, mCullingFrustum, renderableData);
+        prepareShadowing(engine, driver, scene->getLightData());
 
+        /*
+         * Culling: as soon as possible we perform our camera-culling and shadow casters
+         * culling, in a single pass over the scene. Renderables too small on screen are culled
+         * and levels of detail are selected in the same pass.
+         * (this will set the VISIBLE_RENDERABLE and VISIBLE_SHADOW_CASTER bits)
+         */
+
+        FRenderableManager const& rcm = engine.getRenderableManager();
+        ScreenSizeParams screenSize{};
+        if (mScreenSizeCullingThreshold > 0.0f || rcm.hasLevels()) {
+            mat4 const& projection = mCullingCamera->getCullingProjectionMatrix();
+            screenSize.rcm = &rcm;
+            screenSize.position = cullingModel[3].xyz;
+            screenSize.scale = float(projection[1][1]) * viewport.height;
+            screenSize.threshold = mScreenSizeCullingThreshold;
+            screenSize.perspective = projection[2][3] != 0.0;
+        }
+
+        prepareVisibleRenderables(js, mCullingFrustum,
+                screenSize.rcm ? &screenSize : nullptr, *scene);
 
         /*
-         * Shadowing: compute the shadow camera and cull shadow casters
-         * (this will set the VISIBLE_SHADOW_CASTER bit)
+         * Occlusion culling: hide renderables that are behind the occluders
+         * (this will clear the VISIBLE_RENDERABLE bit)
          */
 
-        prepareShadowing(engine, driver, renderableData, scene->getLightData());
+        if (mOcclusionCulling) {
+            prepareOcclusionCulling(engine, js,
+                    mat4f{ mCullingCamera->getCullingProjectionMatrix() } * cullingView, *scene);
+        }
 
         /*
          * partition the array of renderable w.r.t their visibility:
@@ -532,11 +608,11 @@ void FView::prepare(FEngine& engine, backend::DriverApi& driver, ArenaScope& are
         merged = Range{ 0, iEnd };
 
         // update those UBOs
-        const size_t size = merged.size() * sizeof(PerRenderableUib);
+        const size_t size = FScene::getPerRenderableUboSize(merged.size());
         if (mRenderableUBOSize < size) {
             // allocate 1/3 extra, with a minimum of 16 objects
             const size_t count = std::max(size_t(16u), (4u * merged.size() + 2u) / 3u);
-            mRenderableUBOSize = uint32_t(count * sizeof(PerRenderableUib));
+            mRenderableUBOSize = uint32_t(FScene::getPerRenderableUboSize(count));
             driver.destroyUniformBuffer(mRenderableUbh);
             mRenderableUbh = driver.createUniformBuffer(mRenderableUBOSize,
                     backend::BufferUsage::STREAM);
@@ -563,9 +639,8 @@ void FView::prepare(FEngine& engine, backend::DriverApi& driver, ArenaScope& are
     mPerViewUb.setUniform(offsetof(PerViewUib, time), fraction);
     mPerViewUb.setUniform(offsetof(PerViewUib, userTime), userTime);
 
-    // upload the renderables's dirty UBOs
-    engine.getRenderableManager().prepare(driver,
-            renderableData.data<FScene::RENDERABLE_INSTANCE>(), merged);
+    // upload the bones of the skinned renderables, all at once
+    engine.getRenderableManager().prepare(driver);
 
     // set uniforms and samplers
     bindPerViewUniformsAndSamplers(driver);
@@ -584,10 +659,20 @@ void FView::computeVisibilityMasks(
         Culler::result_type mask = visibleMask[i];
         FRenderableManager::Visibility v = visibility[i];
         bool inVisibleLayer = layers[i] & visibleLayers;
-        bool visRenderables   = (!v.culling || (mask & VISIBLE_RENDERABLE))    && inVisibleLayer;
-        bool visShadowCasters = (!v.culling || (mask & VISIBLE_SHADOW_CASTER)) && inVisibleLayer && v.castShadows;
+        // culling sets one bit per cascade starting at VISIBLE_SHADOW_CASTER_BIT, they're moved
+        // to VISIBLE_SHADOW_CASCADE_BIT so VISIBLE_SHADOW_CASTER means "in any cascade or
+        // shadow atlas tile"
+        uint8_t cascades = (mask >> VISIBLE_SHADOW_CASTER_BIT) & VISIBLE_CASCADES;
+        cascades = (!v.culling ? VISIBLE_CASCADES : cascades) &
+                ((inVisibleLayer && v.castShadows) ? VISIBLE_CASCADES : 0u);
+        bool punctual = (!v.culling || (mask & (1u << PUNCTUAL_SHADOW_CULLING_BIT))) &&
+                inVisibleLayer && v.castShadows;
+        bool visRenderables   = (!v.culling || (mask & VISIBLE_RENDERABLE)) && inVisibleLayer;
+        bool visShadowCasters = cascades != 0 || punctual;
         visibleMask[i] = Culler::result_type(visRenderables) |
-                         Culler::result_type(visShadowCasters << 1);
+                         Culler::result_type(visShadowCasters << 1) |
+                         Culler::result_type(cascades << FView::VISIBLE_SHADOW_CASCADE_BIT) |
+                         Culler::result_type(punctual << FView::VISIBLE_PUNCTUAL_SHADOW_CASTER_BIT);
     }
 }
 
@@ -597,7 +682,8 @@ UTILS_NOINLINE
         FScene::RenderableSoa::iterator end,
         uint8_t mask) noexcept {
     return std::partition(begin, end, [mask](auto it) {
-        return it.template get<FScene::VISIBLE_MASK>() == mask;
+        // the cascade bits are ignored
+        return (it.template get<FScene::VISIBLE_MASK>() & VISIBLE_ALL) == mask;
     });
 }
 
@@ -665,39 +751,109 @@ void FView::commitFroxels(backend::DriverApi& driverApi) const noexcept {
 }
 
 UTILS_NOINLINE
-void FView::prepareVisibleRenderables(JobSystem& js,
-        Frustum const& frustum, FScene::RenderableSoa& renderableData) const noexcept {
+void FView::prepareVisibleRenderables(JobSystem& js, Frustum const& frustum,
+        ScreenSizeParams const* screenSize, FScene& scene) const noexcept {
     SYSTRACE_CALL();
+    // frustums[i] sets bit 'bit + i'
+    Frustum frustums[1 + CONFIG_MAX_SHADOW_CASCADES];
+    size_t frustumCount = 0;
+    size_t bit = VISIBLE_RENDERABLE_BIT;
     if (UTILS_LIKELY(isFrustumCullingEnabled())) {
-        FView::cullRenderables(js, renderableData, frustum, VISIBLE_RENDERABLE_BIT);
+        frustums[frustumCount++] = frustum;
     } else {
+        FScene::RenderableSoa& renderableData = scene.getRenderableData();
         std::uninitialized_fill(renderableData.begin<FScene::VISIBLE_MASK>(),
                   renderableData.end<FScene::VISIBLE_MASK>(), VISIBLE_RENDERABLE);
+        bit = VISIBLE_SHADOW_CASTER_BIT;
+    }
+    if (hasShadowing()) {
+        static_assert(VISIBLE_SHADOW_CASTER_BIT == VISIBLE_RENDERABLE_BIT + 1,
+                "shadow casters must be culled with the frustum following the camera's");
+        // each cascade sets its own bit, starting at VISIBLE_SHADOW_CASTER_BIT
+        ShadowMapManager const& shadowMapManager = mShadowMapManager;
+        for (size_t i = 0, c = shadowMapManager.getCascadeCount(); i < c; i++) {
+            frustums[frustumCount++] = shadowMapManager.getCascade(i).getCamera().getFrustum();
+        }
+    }
+    if (frustumCount || screenSize) {
+        FView::cullRenderables(js, scene, frustums, frustumCount, bit, screenSize);
+    }
+    if (hasPunctualShadowing()) {
+        FView::cullPunctualShadowCasters(js, scene, mShadowMapManager,
+                PUNCTUAL_SHADOW_CULLING_BIT);
     }
 }
 
-UTILS_NOINLINE
-void FView::prepareVisibleShadowCasters(JobSystem& js,
-        Frustum const& lightFrustum, FScene::RenderableSoa& renderableData) noexcept {
+void FView::prepareOcclusionCulling(FEngine& engine, JobSystem& js,
+        mat4f const& viewProjection, FScene& scene) noexcept {
     SYSTRACE_CALL();
-    FView::cullRenderables(js, renderableData, lightFrustum, VISIBLE_SHADOW_CASTER_BIT);
+    FRenderableManager const& rcm = engine.getRenderableManager();
+    FScene::RenderableSoa& renderableData = scene.getRenderableData();
+    auto const* const instances  = renderableData.data<FScene::RENDERABLE_INSTANCE>();
+    auto const* const transforms = renderableData.data<FScene::WORLD_TRANSFORM>();
+    auto const* const visibility = renderableData.data<FScene::VISIBILITY_STATE>();
+    uint8_t* const visibleArray  = renderableData.data<FScene::VISIBLE_MASK>();
+
+    // only the occluders in the frustum are rasterized
+    OcclusionCuller& occlusionCuller = mOcclusionCuller;
+    occlusionCuller.begin(viewProjection);
+    for (size_t i = 0, c = renderableData.size(); i < c; i++) {
+        if (visibility[i].occluder && (visibleArray[i] & VISIBLE_RENDERABLE)) {
+            FRenderableManager::Occluder const* const occluder = rcm.getOccluder(instances[i]);
+            occlusionCuller.addOccluder(transforms[i],
+                    occluder->vertices.data(), occluder->vertices.size(),
+                    occluder->indices.data(), occluder->indices.size());
+        }
+    }
+
+    SYSTRACE_VALUE32("occluderTriangles", occlusionCuller.getTriangleCount());
+    if (occlusionCuller.getTriangleCount()) {
+        occlusionCuller.rasterize(js);
+        occlusionCuller.cull(js, visibleArray,
+                renderableData.data<FScene::WORLD_AABB_CENTER>(),
+                renderableData.data<FScene::WORLD_AABB_EXTENT>(),
+                renderableData.size(), VISIBLE_RENDERABLE_BIT);
+    }
 }
 
-void FView::cullRenderables(JobSystem& js,
-        FScene::RenderableSoa& renderableData, Frustum const& frustum, size_t bit) noexcept {
+void FView::cullRenderables(JobSystem& js, FScene& scene,
+        Frustum const* frustums, size_t frustumCount, size_t bit,
+        ScreenSizeParams const* screenSize) noexcept {
+
+    FScene::RenderableSoa& renderableData = scene.getRenderableData();
+
+    BoundingVolumeHierarchy const* const bvh = scene.getCullingHierarchy();
+    if (bvh) {
+        // The hierarchy lives in world space, but our frustums have the world origin applied.
+        // Leaves are culled with the same routine as below.
+        for (size_t i = 0; i < frustumCount; i++) {
+            bvh->cull(renderableData.data<FScene::VISIBLE_MASK>(),
+                    Culler::transform(frustums[i], scene.getWorldOrigin()), bit + i);
+        }
+        if (!screenSize) {
+            return;
+        }
+        // the hierarchy doesn't visit all renderables, the screen-size pass is done below
+        frustumCount = 0;
+    }
 
     float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
     float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
     uint8_t     * visibleArray    = renderableData.data<FScene::VISIBLE_MASK>();
 
     // culling job (this runs on multiple threads)
-    auto functor = [&frustum, worldAABBCenter, worldAABBExtent, visibleArray, bit]
-            (uint32_t index, uint32_t c) {
-        Culler::intersects(
-                visibleArray + index,
-                frustum,
-                worldAABBCenter + index,
-                worldAABBExtent + index, c, bit);
+    auto functor = [frustums, frustumCount, worldAABBCenter, worldAABBExtent, visibleArray, bit,
+            screenSize, &renderableData](uint32_t index, uint32_t c) {
+        if (frustumCount) {
+            Culler::intersects(
+                    visibleArray + index,
+                    frustums, frustumCount,
+                    worldAABBCenter + index,
+                    worldAABBExtent + index, c, bit);
+        }
+        if (screenSize) {
+            applyScreenSize(*screenSize, renderableData, index, c);
+        }
     };
 
     // launch the computation on multiple threads
@@ -706,6 +862,79 @@ void FView::cullRenderables(JobSystem& js,
     js.runAndWait(job);
 }
 
+void FView::cullPunctualShadowCasters(JobSystem& js, FScene& scene,
+        ShadowMapManager const& shadowMapManager, size_t bit) noexcept {
+    FScene::RenderableSoa& renderableData = scene.getRenderableData();
+    const size_t count = shadowMapManager.getPunctualShadowCount();
+
+    BoundingVolumeHierarchy const* const bvh = scene.getCullingHierarchy();
+    if (bvh) {
+        for (size_t i = 0; i < count; i++) {
+            bvh->cull(renderableData.data<FScene::VISIBLE_MASK>(),
+                    Culler::transform(shadowMapManager.getPunctualShadowFrustum(i),
+                            scene.getWorldOrigin()), bit);
+        }
+        return;
+    }
+
+    float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    uint8_t     * visibleArray    = renderableData.data<FScene::VISIBLE_MASK>();
+
+    // culling job (this runs on multiple threads), the results of all the lights are OR'ed
+    auto functor = [&shadowMapManager, count, worldAABBCenter, worldAABBExtent, visibleArray,
+            bit](uint32_t index, uint32_t c) {
+        for (size_t i = 0; i < count; i++) {
+            Culler::intersects(
+                    visibleArray + index,
+                    shadowMapManager.getPunctualShadowFrustum(i),
+                    worldAABBCenter + index,
+                    worldAABBExtent + index, c, bit);
+        }
+    };
+
+    // launch the computation on multiple threads
+    auto job = jobs::parallel_for(js, nullptr, 0, (uint32_t)renderableData.size(),
+            std::ref(functor), jobs::CountSplitter<Culler::MODULO * Culler::MIN_LOOP_COUNT_HINT, 8>());
+    js.runAndWait(job);
+}
+
+void FView::applyScreenSize(ScreenSizeParams const& params,
+        FScene::RenderableSoa& renderableData, uint32_t first, uint32_t count) noexcept {
+    FRenderableManager const& rcm = *params.rcm;
+    auto const* const UTILS_RESTRICT instances   = renderableData.data<FScene::RENDERABLE_INSTANCE>();
+    auto const* const UTILS_RESTRICT visibility  = renderableData.data<FScene::VISIBILITY_STATE>();
+    float3 const* const UTILS_RESTRICT centers   = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* const UTILS_RESTRICT extents   = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    uint8_t* const UTILS_RESTRICT visibleArray   = renderableData.data<FScene::VISIBLE_MASK>();
+    uint8_t* const UTILS_RESTRICT levelOfDetails = renderableData.data<FScene::LEVEL_OF_DETAIL>();
+    const bool hasLevels = rcm.hasLevels();
+
+    for (uint32_t i = first, last = first + count; i < last; i++) {
+        // projected diameter of the bounding sphere of the AABB
+        const float radius = length(extents[i]);
+        float size = radius * params.scale;
+        if (params.perspective) {
+            const float distance = length(centers[i] - params.position);
+            size = distance > radius ? size / distance : std::numeric_limits<float>::infinity();
+        }
+
+        // small objects still cast shadows
+        if (size < params.threshold && visibility[i].culling) {
+            visibleArray[i] &= ~VISIBLE_RENDERABLE;
+        }
+
+        uint8_t level = 0;
+        if (hasLevels) {
+            FRenderableManager::Levels const& levels = rcm.getLevels(instances[i]);
+            while (level + 1 < levels.count && size < levels.screenSizes[level]) {
+                level++;
+            }
+        }
+        levelOfDetails[i] = level;
+    }
+}
+
 void FView::prepareVisibleLights(FLightManager const& lcm, utils::JobSystem&,
         Frustum const& frustum, FScene::LightSoa& lightData) noexcept {
     SYSTRACE_CALL();
@@ -766,9 +995,11 @@ void FView::prepareVisibleLights(FLightManager const& lcm, utils::JobSystem&,
 void FView::updatePrimitivesLod(FEngine& engine, const CameraInfo&,
         FScene::RenderableSoa& renderableData, Range visible) noexcept {
     FRenderableManager const& rcm = engine.getRenderableManager();
+    uint8_t const* const levelOfDetails = renderableData.data<FScene::LEVEL_OF_DETAIL>();
     for (uint32_t index : visible) {
-        uint8_t level = 0; // TODO: pick the proper level of detail
+        // the level is selected during culling, using the culling camera for all passes
         auto ri = renderableData.elementAt<FScene::RENDERABLE_INSTANCE>(index);
+        const uint8_t level = std::min(levelOfDetails[index], uint8_t(rcm.getLevelCount(ri) - 1));
         renderableData.elementAt<FScene::PRIMITIVES>(index) = rcm.getRenderPrimitives(ri, level);
     }
 }
@@ -828,6 +1059,22 @@ bool View::isFrustumCullingEnabled() const noexcept {
     return upcast(this)->isFrustumCullingEnabled();
 }
 
+void View::setOcclusionCullingEnabled(bool enabled) noexcept {
+    upcast(this)->setOcclusionCullingEnabled(enabled);
+}
+
+bool View::isOcclusionCullingEnabled() const noexcept {
+    return upcast(this)->isOcclusionCullingEnabled();
+}
+
+void View::setScreenSizeCullingThreshold(float pixels) noexcept {
+    upcast(this)->setScreenSizeCullingThreshold(pixels);
+}
+
+float View::getScreenSizeCullingThreshold() const noexcept {
+    return upcast(this)->getScreenSizeCullingThreshold();
+}
+
 void View::setDebugCamera(Camera* camera) noexcept {
     upcast(this)->setViewingCamera(upcast(camera));
 }
@@ -928,6 +1175,14 @@ void View::setDepthPrepass(View::DepthPrepass prepass) noexcept {
     upcast(this)->setDepthPrepass(prepass);
 }
 
+void View::setCommandCachingEnabled(bool enabled) noexcept {
+    upcast(this)->setCommandCachingEnabled(enabled);
+}
+
+bool View::isCommandCachingEnabled() const noexcept {
+    return upcast(this)->isCommandCachingEnabled();
+}
+
 void View::setDynamicLightingOptions(float zLightNear, float zLightFar) noexcept {
     upcast(this)->setDynamicLightingOptions(zLightNear, zLightFar);
 }
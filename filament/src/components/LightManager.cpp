@@ -20,10 +20,16 @@
 
 #include "details/Engine.h"
 
+#include <private/filament/EngineEnums.h>
+
 #include <math/fast.h>
 #include <math/scalar.h>
 #include <filament/LightManager.h>
 
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
 
 using namespace filament::math;
 using namespace utils;
@@ -159,6 +165,8 @@ void FLightManager::create(const FLightManager::Builder& builder, utils::Entity
     assert(i);
 
     if (i) {
+        mStructureGeneration = mGeneration;
+
         // This needs to happen before we call the set() methods below
         // Type must be set first (some calls depend on it below)
         LightType& lightType = manager[i].lightType;
@@ -173,6 +181,11 @@ void FLightManager::create(const FLightManager::Builder& builder, utils::Entity
         shadowParams.options.shadowFar      = std::max(builder->mShadowOptions.shadowFar, 0.0f);
         shadowParams.options.shadowNearHint = std::max(builder->mShadowOptions.shadowNearHint, 0.0f);
         shadowParams.options.shadowFarHint  = std::max(builder->mShadowOptions.shadowFarHint, 0.0f);
+        shadowParams.options.shadowCascades = clamp(builder->mShadowOptions.shadowCascades,
+                uint8_t(1), uint8_t(CONFIG_MAX_SHADOW_CASCADES));
+        std::copy(std::begin(builder->mShadowOptions.cascadeSplitPositions),
+                std::end(builder->mShadowOptions.cascadeSplitPositions),
+                std::begin(shadowParams.options.cascadeSplitPositions));
 
         // set default values by calling the setters
         setLocalPosition(i, builder->mPosition);
@@ -198,6 +211,7 @@ void FLightManager::destroy(utils::Entity e) noexcept {
     if (i) {
         auto& manager = mManager;
         manager.removeComponent(e);
+        mStructureGeneration = mGeneration;
     }
 }
 
@@ -437,4 +451,35 @@ void LightManager::setShadowOptions(Instance i, ShadowOptions const& options) no
     upcast(this)->setShadowOptions(i, options);
 }
 
+// ------------------------------------------------------------------------------------------------
+
+void LightManager::ShadowCascades::computeUniformSplits(float* splitPositions,
+        uint8_t cascades) noexcept {
+    cascades = std::min(cascades, uint8_t(CONFIG_MAX_SHADOW_CASCADES));
+    for (size_t i = 1; i < cascades; i++) {
+        splitPositions[i - 1] = float(i) / cascades;
+    }
+}
+
+void LightManager::ShadowCascades::computeLogSplits(float* splitPositions, uint8_t cascades,
+        float near, float far) noexcept {
+    cascades = std::min(cascades, uint8_t(CONFIG_MAX_SHADOW_CASCADES));
+    for (size_t i = 1; i < cascades; i++) {
+        const float split = near * std::pow(far / near, float(i) / cascades);
+        splitPositions[i - 1] = (split - near) / (far - near);
+    }
+}
+
+void LightManager::ShadowCascades::computePracticalSplits(float* splitPositions,
+        uint8_t cascades, float near, float far, float lambda) noexcept {
+    cascades = std::min(cascades, uint8_t(CONFIG_MAX_SHADOW_CASCADES));
+    float uniformSplits[CONFIG_MAX_SHADOW_CASCADES];
+    float logSplits[CONFIG_MAX_SHADOW_CASCADES];
+    computeUniformSplits(uniformSplits, cascades);
+    computeLogSplits(logSplits, cascades, near, far);
+    for (size_t i = 1; i < cascades; i++) {
+        splitPositions[i - 1] = mix(uniformSplits[i - 1], logSplits[i - 1], lambda);
+    }
+}
+
 } // namespace filament
@@ -60,9 +60,17 @@ public:
     void prepare(backend::DriverApi& driver) const noexcept;
 
     void gc(utils::EntityManager& em) noexcept {
-        mManager.gc(em);
+        mManager.gc(em, 4, [this](utils::Entity e) {
+            mManager.removeComponent(e);
+            mStructureGeneration = mGeneration;
+        });
     }
 
+    // Change tracking, see FTransformManager. Only creation and destruction of lights is
+    // tracked, since FScene doesn't cache any other light state.
+    uint32_t advanceGeneration() noexcept { return mGeneration++; }
+    uint32_t getStructureGeneration() const noexcept { return mStructureGeneration; }
+
     struct LightType {
         Type type : 3;
         bool shadowCaster : 1;
@@ -272,6 +280,8 @@ private:
 
     Sim mManager;
     FEngine& mEngine;
+    uint32_t mGeneration = 1;
+    uint32_t mStructureGeneration = 0;
 };
 
 FILAMENT_UPCAST(LightManager)
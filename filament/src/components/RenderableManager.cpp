@@ -29,6 +29,8 @@
 #include <utils/Log.h>
 #include <utils/Panic.h>
 
+#include <algorithm>
+
 using namespace filament::math;
 using namespace utils;
 
@@ -45,12 +47,20 @@ struct RenderableManager::BuilderDetails {
     bool mCulling : 1;
     bool mCastShadows : 1;
     bool mReceiveShadows : 1;
+    bool mStaticShadowCaster : 1;
     size_t mSkinningBoneCount = 0;
     Bone const* mUserBones = nullptr;
     mat4f const* mUserBoneMatrices = nullptr;
+    BoneFormat mBoneFormat = BoneFormat::QUATERNION_SCALE;
+    float3 const* mOccluderVertices = nullptr;
+    size_t mOccluderVertexCount = 0;
+    uint16_t const* mOccluderIndices = nullptr;
+    size_t mOccluderIndexCount = 0;
+    float mLevelScreenSizes[MAX_LEVEL_COUNT] = {};
 
     explicit BuilderDetails(size_t count)
-            : mEntries(count), mCulling(true), mCastShadows(false), mReceiveShadows(true) {
+            : mEntries(count), mCulling(true), mCastShadows(false), mReceiveShadows(true),
+              mStaticShadowCaster(false) {
     }
     // this is only needed for the explicit instantiation below
     BuilderDetails() = default;
@@ -133,6 +143,11 @@ RenderableManager::Builder& RenderableManager::Builder::receiveShadows(bool enab
     return *this;
 }
 
+RenderableManager::Builder& RenderableManager::Builder::staticShadowCaster(bool enable) noexcept {
+    mImpl->mStaticShadowCaster = enable;
+    return *this;
+}
+
 RenderableManager::Builder& RenderableManager::Builder::skinning(size_t boneCount) noexcept {
     mImpl->mSkinningBoneCount = boneCount;
     return *this;
@@ -152,6 +167,21 @@ RenderableManager::Builder& RenderableManager::Builder::skinning(
     return *this;
 }
 
+RenderableManager::Builder& RenderableManager::Builder::boneFormat(BoneFormat format) noexcept {
+    mImpl->mBoneFormat = format;
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::occluder(
+        float3 const* vertices, size_t vertexCount,
+        uint16_t const* indices, size_t indexCount) noexcept {
+    mImpl->mOccluderVertices = vertices;
+    mImpl->mOccluderVertexCount = vertexCount;
+    mImpl->mOccluderIndices = indices;
+    mImpl->mOccluderIndexCount = indexCount;
+    return *this;
+}
+
 RenderableManager::Builder& RenderableManager::Builder::blendOrder(size_t index, uint16_t blendOrder) noexcept {
     if (index < mImpl->mEntries.size()) {
         mImpl->mEntries[index].blendOrder = blendOrder;
@@ -159,6 +189,21 @@ RenderableManager::Builder& RenderableManager::Builder::blendOrder(size_t index,
     return *this;
 }
 
+RenderableManager::Builder& RenderableManager::Builder::level(size_t index, uint8_t level) noexcept {
+    if (index < mImpl->mEntries.size()) {
+        mImpl->mEntries[index].level = level;
+    }
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::levelScreenSize(
+        uint8_t level, float pixels) noexcept {
+    if (level < MAX_LEVEL_COUNT) {
+        mImpl->mLevelScreenSizes[level] = pixels;
+    }
+    return *this;
+}
+
 RenderableManager::Builder::Result RenderableManager::Builder::build(Engine& engine, Entity entity) {
     bool isEmpty = true;
 
@@ -170,6 +215,16 @@ RenderableManager::Builder::Result RenderableManager::Builder::build(Engine& eng
     for (size_t i = 0, c = mImpl->mEntries.size(); i < c; i++) {
         auto& entry = mImpl->mEntries[i];
 
+        // levels of detail are consecutive ranges of primitives, in increasing order, and the
+        // first primitive is always at level 0
+        const uint8_t previousLevel = i ? mImpl->mEntries[i - 1].level : uint8_t(0);
+        if (!ASSERT_PRECONDITION_NON_FATAL(entry.level < MAX_LEVEL_COUNT &&
+                (entry.level == previousLevel || (i && entry.level == previousLevel + 1)),
+                "[entity=%u, primitive @ %u] invalid level %u (previous primitive's is %u)",
+                entity.getId(), i, entry.level, previousLevel)) {
+            return Error;
+        }
+
         // entry.materialInstance must be set to something even if indices/vertices are null
         FMaterial const* material = nullptr;
         if (!entry.materialInstance) {
@@ -247,9 +302,7 @@ FRenderableManager::~FRenderableManager() {
 
 void FRenderableManager::create(
         const RenderableManager::Builder& UTILS_RESTRICT builder, Entity entity) {
-    FEngine& engine = mEngine;
     auto& manager = mManager;
-    FEngine::DriverApi& driver = engine.getDriverApi();
 
     if (UTILS_UNLIKELY(manager.hasComponent(entity))) {
         destroy(entity);
@@ -258,55 +311,74 @@ void FRenderableManager::create(
     assert(ci);
 
     if (ci) {
+        mStructureGeneration = mGeneration;
+
         // create and initialize all needed RenderPrimitives
         using size_type = Slice<FRenderPrimitive>::size_type;
         Builder::Entry const * const entries = builder->mEntries.data();
         FRenderPrimitive* rp = new FRenderPrimitive[builder->mEntries.size()];
         for (size_t i = 0, c = builder->mEntries.size(); i < c; ++i) {
-            rp[i].init(driver, entries[i]);
+            rp[i].init(mEngine, entries[i]);
         }
         setPrimitives(ci, { rp, size_type(builder->mEntries.size()) });
 
+        Levels& levels = manager[ci].levels;
+        levels = {};
+        for (size_t i = 0, c = builder->mEntries.size(); i < c; ++i) {
+            levels.count = uint8_t(entries[i].level + 1);
+            levels.offsets[entries[i].level + 1] = uint32_t(i + 1);
+        }
+        std::copy_n(builder->mLevelScreenSizes, MAX_LEVEL_COUNT, levels.screenSizes);
+        mMultiLevelCount += levels.count > 1 ? 1 : 0;
+
         setAxisAlignedBoundingBox(ci, builder->mAABB);
         setLayerMask(ci, builder->mLayerMask);
         setPriority(ci, builder->mPriority);
         setCastShadows(ci, builder->mCastShadows);
         setReceiveShadows(ci, builder->mReceiveShadows);
+        setStaticShadowCaster(ci, builder->mStaticShadowCaster);
         setCulling(ci, builder->mCulling);
         setSkinning(ci, false);
 
+        std::unique_ptr<Occluder>& occluder = manager[ci].occluder;
+        occluder.reset();
+        if (builder->mOccluderIndexCount) {
+            occluder = std::unique_ptr<Occluder>(new Occluder);
+            occluder->vertices.assign(builder->mOccluderVertices,
+                    builder->mOccluderVertices + builder->mOccluderVertexCount);
+            occluder->indices.assign(builder->mOccluderIndices,
+                    builder->mOccluderIndices + builder->mOccluderIndexCount);
+        }
+        Visibility& visibility = manager[ci].visibility;
+        visibility.occluder = bool(occluder);
+
         const size_t count = builder->mSkinningBoneCount;
+        Bones& bones = manager[ci].bones;
+        bones = {};
+        visibility.dualQuaternionBones = builder->mBoneFormat == BoneFormat::DUAL_QUATERNION;
         if (UTILS_UNLIKELY(count)) {
-            std::unique_ptr<Bones>& bones = manager[ci].bones;
-            // Note that we are sizing the bones UBO according to CONFIG_MAX_BONE_COUNT rather than
-            // mSkinningBoneCount. According to the OpenGL ES 3.2 specification in 7.6.3 Uniform
-            // Buffer Object Bindings:
-            //
-            //     the uniform block must be populated with a buffer object with a size no smaller
-            //     than the minimum required size of the uniform block (the value of
-            //     UNIFORM_BLOCK_DATA_SIZE).
-            //
-            // This unfortunately means that we are using a large memory footprint for skinned
-            // renderables. In the future we could try addressing this by implementing a paging
-            // system such that multiple skinned renderables will share regions within a single
-            // large block of bones.
-            bones = std::unique_ptr<Bones>(new Bones{
-                    driver.createUniformBuffer(CONFIG_MAX_BONE_COUNT * sizeof(PerRenderableUibBone),
-                            backend::BufferUsage::DYNAMIC),
-                    UniformBuffer{ count * sizeof(PerRenderableUibBone) },
-                    count
-            });
-            assert(bones);
-            if (bones) {
-                setSkinning(ci, true);
-                if (builder->mUserBones) {
-                    setBones(ci, builder->mUserBones, count);
-                } else if (builder->mUserBoneMatrices) {
-                    setBones(ci, builder->mUserBoneMatrices, count);
+            // The bones live in a range of the bone palette, which is shared by all the skinned
+            // renderables, so that they're uploaded at once and only the range changes between
+            // draws.
+            const BoneFormat format = builder->mBoneFormat;
+            bones.offset = mBonePalette.allocate(uint32_t(count * getBoneSize(format)));
+            bones.count = uint16_t(count);
+            bones.format = format;
+            setSkinning(ci, true);
+            if (builder->mUserBones) {
+                setBones(ci, builder->mUserBones, count);
+            } else if (builder->mUserBoneMatrices) {
+                setBones(ci, builder->mUserBoneMatrices, count);
+            } else {
+                // initialize the bones to identity
+                size_t n = count;
+                void* out = invalidateBones(ci, n, 0);
+                if (format == BoneFormat::DUAL_QUATERNION) {
+                    std::uninitialized_fill_n((PerRenderableUibDualQuaternionBone*)out, n,
+                            PerRenderableUibDualQuaternionBone{});
                 } else {
-                    // initialize the bones to identity
-                    PerRenderableUibBone* out = (PerRenderableUibBone*)bones->bones.invalidate();
-                    std::uninitialized_fill_n(out, count, PerRenderableUibBone{});
+                    std::uninitialized_fill_n((PerRenderableUibBone*)out, n,
+                            PerRenderableUibBone{});
                 }
             }
         }
@@ -319,6 +391,7 @@ void FRenderableManager::destroy(utils::Entity e) noexcept {
     if (ci) {
         destroyComponent(ci);
         mManager.removeComponent(e);
+        mStructureGeneration = mGeneration;
     }
 }
 
@@ -336,6 +409,7 @@ void FRenderableManager::terminate() noexcept {
             manager.removeComponent(manager.getEntity(ci));
         }
     }
+    mBonePalette.terminate(mEngine.getDriverApi());
 }
 
 // This is basically a Renderable's destructor.
@@ -343,15 +417,16 @@ void FRenderableManager::destroyComponent(Instance ci) noexcept {
     auto& manager = mManager;
     FEngine& engine = mEngine;
 
-    FEngine::DriverApi& driver = engine.getDriverApi();
-
     // See create(RenderableManager::Builder&, Entity)
     destroyComponentPrimitives(engine, manager[ci].primitives);
 
-    // destroy the bones structures if any
-    std::unique_ptr<Bones> const& bones = manager[ci].bones;
-    if (bones) {
-        driver.destroyUniformBuffer(bones->handle);
+    Levels const& levels = manager[ci].levels;
+    mMultiLevelCount -= levels.count > 1 ? 1 : 0;
+
+    // return the bones to the palette if any
+    Bones const& bones = manager[ci].bones;
+    if (bones.count) {
+        mBonePalette.free(bones.offset, uint32_t(bones.count * getBoneSize(bones.format)));
     }
 }
 
@@ -364,30 +439,30 @@ void FRenderableManager::destroyComponentPrimitives(
 }
 
 
-void FRenderableManager::prepare(
-        backend::DriverApi& UTILS_RESTRICT driver,
-        Instance const* UTILS_RESTRICT instances,
-        utils::Range<uint32_t> list) const noexcept {
-    auto& manager = mManager;
+void FRenderableManager::prepare(backend::DriverApi& driver) noexcept {
+    mBonePalette.commit(driver);
+}
 
-    std::unique_ptr<Bones>  const * const UTILS_RESTRICT bones = manager.raw_array<BONES>();
-    for (uint32_t index : list) {
-        size_t i = instances[index].asValue();
-        assert(i);  // we should never get the null instance here
-        if (UTILS_UNLIKELY(bones[i])) {
-            if (bones[i]->bones.isDirty()) {
-                driver.loadUniformBuffer(bones[i]->handle, bones[i]->bones.toBufferDescriptor(driver));
-            }
-        }
-    }
+Slice<FRenderPrimitive> FRenderableManager::getRenderPrimitives(
+        Instance instance, uint8_t level) const noexcept {
+    Slice<FRenderPrimitive> primitives = mManager[instance].primitives;
+    Levels const& levels = getLevels(instance);
+    assert(level < levels.count);
+    return { primitives.begin() + levels.offsets[level],
+             primitives.begin() + levels.offsets[level + 1] };
+}
+
+size_t FRenderableManager::getPrimitiveCount(Instance instance, uint8_t level) const noexcept {
+    return getRenderPrimitives(instance, level).size();
 }
 
 void FRenderableManager::setMaterialInstanceAt(Instance instance, uint8_t level,
         size_t primitiveIndex, FMaterialInstance const* mi) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive> primitives = getRenderPrimitives(instance, level);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].setMaterialInstance(upcast(mi));
+            setChanged(instance);
             AttributeBitset required = mi->getMaterial()->getRequiredAttributes();
             AttributeBitset declared = primitives[primitiveIndex].getEnabledAttributes();
             if (UTILS_UNLIKELY((declared & required) != required)) {
@@ -402,7 +477,7 @@ void FRenderableManager::setMaterialInstanceAt(Instance instance, uint8_t level,
 MaterialInstance* FRenderableManager::getMaterialInstanceAt(
         Instance instance, uint8_t level, size_t primitiveIndex) const noexcept {
     if (instance) {
-        const Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive> const primitives = getRenderPrimitives(instance, level);
         if (primitiveIndex < primitives.size()) {
             // We store the material instance as const because we don't want to change it internally
             // but when the user queries it, we want to allow them to call setParameter()
@@ -415,9 +490,10 @@ MaterialInstance* FRenderableManager::getMaterialInstanceAt(
 void FRenderableManager::setBlendOrderAt(Instance instance, uint8_t level,
         size_t primitiveIndex, uint16_t order) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive> primitives = getRenderPrimitives(instance, level);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].setBlendOrder(order);
+            setChanged(instance);
         }
     }
 }
@@ -425,7 +501,7 @@ void FRenderableManager::setBlendOrderAt(Instance instance, uint8_t level,
 AttributeBitset FRenderableManager::getEnabledAttributesAt(
         Instance instance, uint8_t level, size_t primitiveIndex) const noexcept {
     if (instance) {
-        Slice<FRenderPrimitive> const& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive> const primitives = getRenderPrimitives(instance, level);
         if (primitiveIndex < primitives.size()) {
             return primitives[primitiveIndex].getEnabledAttributes();
         }
@@ -437,10 +513,11 @@ void FRenderableManager::setGeometryAt(Instance instance, uint8_t level, size_t
         PrimitiveType type, FVertexBuffer* vertices, FIndexBuffer* indices,
         size_t offset, size_t count) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive> primitives = getRenderPrimitives(instance, level);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].set(mEngine, type, vertices, indices, offset,
                     0, vertices->getVertexCount() - 1, count);
+            setChanged(instance);
         }
     }
 }
@@ -448,27 +525,42 @@ void FRenderableManager::setGeometryAt(Instance instance, uint8_t level, size_t
 void FRenderableManager::setGeometryAt(Instance instance, uint8_t level, size_t primitiveIndex,
         PrimitiveType type, size_t offset, size_t count) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive> primitives = getRenderPrimitives(instance, level);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].set(mEngine, type, offset, 0, 0, count);
+            setChanged(instance);
         }
     }
 }
 
+void* FRenderableManager::invalidateBones(Instance ci, size_t& count, size_t offset) noexcept {
+    Bones const& bones = mManager[ci].bones;
+    assert(bones.count && offset + count <= bones.count);
+    if (!bones.count || offset >= bones.count) {
+        count = 0;
+        return nullptr;
+    }
+    count = std::min(count, bones.count - offset);
+    const size_t size = getBoneSize(bones.format);
+    return mBonePalette.invalidate(uint32_t(bones.offset + offset * size), uint32_t(count * size));
+}
+
 void FRenderableManager::setBones(Instance ci,
         Bone const* UTILS_RESTRICT transforms, size_t boneCount, size_t offset) noexcept {
     if (ci) {
-        std::unique_ptr<Bones> const& bones = mManager[ci].bones;
-        assert(bones && offset + boneCount <= bones->count);
-        if (bones) {
-            boneCount = std::min(boneCount, bones->count - offset);
-            PerRenderableUibBone* UTILS_RESTRICT out = (PerRenderableUibBone*)bones->bones.invalidateUniforms(
-                    offset * sizeof(PerRenderableUibBone),
-                    boneCount * sizeof(PerRenderableUibBone));
+        Bones const& bones = mManager[ci].bones;
+        void* const out = invalidateBones(ci, boneCount, offset);
+        if (bones.format == BoneFormat::DUAL_QUATERNION) {
+            auto* const UTILS_RESTRICT dq = (PerRenderableUibDualQuaternionBone*)out;
             for (size_t i = 0, c = boneCount; i < c; ++i) {
-                out[i].q = transforms[i].unitQuaternion;
-                out[i].t.xyz = transforms[i].translation;
-                out[i].s = out[i].ns = { 1, 1, 1, 0 };
+                makeBone(&dq[i], transforms[i].unitQuaternion, transforms[i].translation);
+            }
+        } else {
+            auto* const UTILS_RESTRICT qs = (PerRenderableUibBone*)out;
+            for (size_t i = 0, c = boneCount; i < c; ++i) {
+                qs[i].q = transforms[i].unitQuaternion;
+                qs[i].t.xyz = transforms[i].translation;
+                qs[i].s = qs[i].ns = { 1, 1, 1, 0 };
             }
         }
     }
@@ -477,15 +569,17 @@ void FRenderableManager::setBones(Instance ci,
 void FRenderableManager::setBones(Instance ci,
         mat4f const* UTILS_RESTRICT transforms, size_t boneCount, size_t offset) noexcept {
     if (ci) {
-        std::unique_ptr<Bones> const& bones = mManager[ci].bones;
-        assert(bones && offset + boneCount <= bones->count);
-        if (bones) {
-            boneCount = std::min(boneCount, bones->count - offset);
-            PerRenderableUibBone* UTILS_RESTRICT out = (PerRenderableUibBone*)bones->bones.invalidateUniforms(
-                    offset * sizeof(PerRenderableUibBone),
-                    boneCount * sizeof(PerRenderableUibBone));
+        Bones const& bones = mManager[ci].bones;
+        void* const out = invalidateBones(ci, boneCount, offset);
+        if (bones.format == BoneFormat::DUAL_QUATERNION) {
+            auto* const UTILS_RESTRICT dq = (PerRenderableUibDualQuaternionBone*)out;
             for (size_t i = 0, c = boneCount; i < c; ++i) {
-                makeBone(&out[i], transforms[i]);
+                makeBone(&dq[i], transforms[i]);
+            }
+        } else {
+            auto* const UTILS_RESTRICT qs = (PerRenderableUibBone*)out;
+            for (size_t i = 0, c = boneCount; i < c; ++i) {
+                makeBone(&qs[i], transforms[i]);
             }
         }
     }
@@ -514,6 +608,22 @@ void FRenderableManager::makeBone(PerRenderableUibBone* UTILS_RESTRICT out, mat4
     out->ns = is / max(abs(is));
 }
 
+void FRenderableManager::makeBone(PerRenderableUibDualQuaternionBone* UTILS_RESTRICT out,
+        mat4f const& t) noexcept {
+    // only keep the rotation, see makeBone(PerRenderableUibBone*, mat4f const&)
+    mat3f m(t.upperLeft());
+    m[0] *= 1.0f / length(m[0]);
+    m[1] *= 1.0f / length(m[1]);
+    m[2] = cross(m[0], m[1]);
+    makeBone(out, normalize(m.toQuaternion()), t[3].xyz);
+}
+
+void FRenderableManager::makeBone(PerRenderableUibDualQuaternionBone* UTILS_RESTRICT out,
+        quatf const& rotation, float3 const& translation) noexcept {
+    out->real = rotation;
+    out->dual = quatf(translation, 0.0f) * rotation * 0.5f;
+}
+
 } // namespace details
 
 
@@ -556,6 +666,10 @@ void RenderableManager::setReceiveShadows(Instance instance, bool enable) noexce
     upcast(this)->setReceiveShadows(instance, enable);
 }
 
+void RenderableManager::setStaticShadowCaster(Instance instance, bool enable) noexcept {
+    upcast(this)->setStaticShadowCaster(instance, enable);
+}
+
 bool RenderableManager::isShadowCaster(Instance instance) const noexcept {
     return upcast(this)->isShadowCaster(instance);
 }
@@ -564,42 +678,52 @@ bool RenderableManager::isShadowReceiver(Instance instance) const noexcept {
     return upcast(this)->isShadowReceiver(instance);
 }
 
+bool RenderableManager::isStaticShadowCaster(Instance instance) const noexcept {
+    return upcast(this)->isStaticShadowCaster(instance);
+}
+
 const Box& RenderableManager::getAxisAlignedBoundingBox(Instance instance) const noexcept {
     return upcast(this)->getAxisAlignedBoundingBox(instance);
 }
 
 size_t RenderableManager::getPrimitiveCount(Instance instance) const noexcept {
-    return upcast(this)->getPrimitiveCount(instance, 0);
+    return upcast(this)->getPrimitiveCount(instance);
 }
 
 void RenderableManager::setMaterialInstanceAt(Instance instance,
         size_t primitiveIndex, MaterialInstance const* materialInstance) noexcept {
-    upcast(this)->setMaterialInstanceAt(instance, 0, primitiveIndex, upcast(materialInstance));
+    const uint8_t level = upcast(this)->getLevel(instance, primitiveIndex);
+    upcast(this)->setMaterialInstanceAt(instance, level, primitiveIndex, upcast(materialInstance));
 }
 
 MaterialInstance* RenderableManager::getMaterialInstanceAt(
         Instance instance, size_t primitiveIndex) const noexcept {
-    return upcast(this)->getMaterialInstanceAt(instance, 0, primitiveIndex);
+    const uint8_t level = upcast(this)->getLevel(instance, primitiveIndex);
+    return upcast(this)->getMaterialInstanceAt(instance, level, primitiveIndex);
 }
 
 void RenderableManager::setBlendOrderAt(Instance instance, size_t primitiveIndex, uint16_t order) noexcept {
-    upcast(this)->setBlendOrderAt(instance, 0, primitiveIndex, order);
+    const uint8_t level = upcast(this)->getLevel(instance, primitiveIndex);
+    upcast(this)->setBlendOrderAt(instance, level, primitiveIndex, order);
 }
 
 AttributeBitset RenderableManager::getEnabledAttributesAt(Instance instance, size_t primitiveIndex) const noexcept {
-    return upcast(this)->getEnabledAttributesAt(instance, 0, primitiveIndex);
+    const uint8_t level = upcast(this)->getLevel(instance, primitiveIndex);
+    return upcast(this)->getEnabledAttributesAt(instance, level, primitiveIndex);
 }
 
 void RenderableManager::setGeometryAt(Instance instance, size_t primitiveIndex,
         PrimitiveType type, VertexBuffer* vertices, IndexBuffer* indices,
         size_t offset, size_t count) noexcept {
-    upcast(this)->setGeometryAt(instance, 0, primitiveIndex,
+    const uint8_t level = upcast(this)->getLevel(instance, primitiveIndex);
+    upcast(this)->setGeometryAt(instance, level, primitiveIndex,
             type, upcast(vertices), upcast(indices), offset, count);
 }
 
 void RenderableManager::setGeometryAt(RenderableManager::Instance instance, size_t primitiveIndex,
         RenderableManager::PrimitiveType type, size_t offset, size_t count) noexcept {
-    upcast(this)->setGeometryAt(instance, 0, primitiveIndex, type, offset, count);
+    const uint8_t level = upcast(this)->getLevel(instance, primitiveIndex);
+    upcast(this)->setGeometryAt(instance, level, primitiveIndex, type, offset, count);
 }
 
 void RenderableManager::setBones(Instance instance,
@@ -19,7 +19,7 @@
 
 #include "upcast.h"
 
-#include "UniformBuffer.h"
+#include "details/BonePalette.h"
 
 #include "private/backend/DriverApiForward.h"
 
@@ -35,8 +35,12 @@
 #include <utils/Slice.h>
 #include <utils/Range.h>
 
+#include <memory>
+#include <vector>
+
 // for gtest
 class FilamentTest_Bones_Test;
+class FilamentTest_DualQuaternionBones_Test;
 
 namespace filament {
 namespace details {
@@ -54,6 +58,23 @@ public:
         bool receiveShadows : 1;
         bool culling        : 1;
         bool skinning       : 1;
+        bool occluder       : 1;
+        bool staticShadowCaster : 1;
+        bool dualQuaternionBones : 1;   // see BoneFormat, meaningful only with skinning
+    };
+
+    // levels of detail, level i uses the primitives [offsets[i], offsets[i + 1])
+    struct Levels {
+        uint8_t count = 1;
+        uint32_t offsets[MAX_LEVEL_COUNT + 1] = {};
+        // level i is replaced by level i + 1 under this projected size, in pixels
+        float screenSizes[MAX_LEVEL_COUNT] = {};
+    };
+
+    // simplified mesh used for occlusion culling, in the renderable's local space
+    struct Occluder {
+        std::vector<math::float3> vertices;
+        std::vector<uint16_t> indices;
     };
 
     explicit FRenderableManager(FEngine& engine) noexcept;
@@ -78,16 +99,36 @@ public:
 
     void destroy(utils::Entity e) noexcept;
 
-    // - instances is a list of Instance (typically the list from a given scene)
-    // - list is a list of index in 'instances' (typically the visible ones)
-    void prepare(backend::DriverApi& driver,
-            RenderableManager::Instance const* instances,
-            utils::Range<uint32_t> list) const noexcept;
+    // uploads the bones of all the renderables if any changed since the last call
+    void prepare(backend::DriverApi& driver) noexcept;
 
     void gc(utils::EntityManager& em) noexcept {
-        mManager.gc(em);
+        mManager.gc(em, 4, [this](utils::Entity e) {
+            mManager.removeComponent(e);
+            mStructureGeneration = mGeneration;
+        });
     }
 
+    /*
+     * Change tracking, see FTransformManager. Only the state that FScene caches per renderable
+     * (bounding box, layers and visibility) and the primitives, which RenderPass' command cache
+     * depends on, are tracked.
+     */
+
+    // returns the current generation and starts a new one
+    uint32_t advanceGeneration() noexcept { return mGeneration++; }
+
+    // generation of the last change to this instance
+    uint32_t getGeneration(Instance instance) const noexcept {
+        return mManager[instance].generation;
+    }
+
+    // generation of the last change to any instance
+    uint32_t getChangeGeneration() const noexcept { return mChangeGeneration; }
+
+    // generation of the last time instances were created, destroyed or moved
+    uint32_t getStructureGeneration() const noexcept { return mStructureGeneration; }
+
     inline void setAxisAlignedBoundingBox(Instance instance, const Box& aabb) noexcept;
 
     inline void setLayerMask(Instance instance, uint8_t select, uint8_t values) noexcept;
@@ -99,6 +140,7 @@ public:
 
     inline void setLayerMask(Instance instance, uint8_t layerMask) noexcept;
     inline void setReceiveShadows(Instance instance, bool enable) noexcept;
+    inline void setStaticShadowCaster(Instance instance, bool enable) noexcept;
     inline void setCulling(Instance instance, bool enable) noexcept;
     inline void setSkinning(Instance instance, bool enable) noexcept;
     inline void setPrimitives(Instance instance, utils::Slice<FRenderPrimitive> const& primitives) noexcept;
@@ -108,6 +150,7 @@ public:
 
     inline bool isShadowCaster(Instance instance) const noexcept;
     inline bool isShadowReceiver(Instance instance) const noexcept;
+    inline bool isStaticShadowCaster(Instance instance) const noexcept;
     inline bool isCullingEnabled(Instance instance) const noexcept;
 
     inline Box const& getAABB(Instance instance) const noexcept;
@@ -116,11 +159,23 @@ public:
     inline uint8_t getLayerMask(Instance instance) const noexcept;
     inline uint8_t getPriority(Instance instance) const noexcept;
 
-    inline backend::Handle<backend::HwUniformBuffer> getBonesUbh(Instance instance) const noexcept;
-
-
-    inline size_t getLevelCount(Instance instance) const noexcept { return 1; }
-    inline size_t getPrimitiveCount(Instance instance, uint8_t level) const noexcept;
+    // offset of the renderable's bones in the bone palette, see getBonePaletteUbh()
+    inline uint32_t getBonesOffset(Instance instance) const noexcept;
+    backend::Handle<backend::HwUniformBuffer> getBonePaletteUbh() const noexcept {
+        return mBonePalette.getHandle();
+    }
+    inline Occluder const* getOccluder(Instance instance) const noexcept;
+
+
+    inline Levels const& getLevels(Instance instance) const noexcept;
+    inline size_t getLevelCount(Instance instance) const noexcept;
+    // whether any renderable has more than one level of detail
+    bool hasLevels() const noexcept { return mMultiLevelCount != 0; }
+    // converts an index in all the primitives of a renderable (as used by the public API) to
+    // a level and an index in that level
+    inline uint8_t getLevel(Instance instance, size_t& primitiveIndex) const noexcept;
+    inline size_t getPrimitiveCount(Instance instance) const noexcept;
+    size_t getPrimitiveCount(Instance instance, uint8_t level) const noexcept;
     void setMaterialInstanceAt(Instance instance, uint8_t level,
             size_t primitiveIndex, FMaterialInstance const* materialInstance) noexcept;
     MaterialInstance* getMaterialInstanceAt(Instance instance, uint8_t level, size_t primitiveIndex) const noexcept;
@@ -131,30 +186,50 @@ public:
             PrimitiveType type, size_t offset, size_t count) noexcept;
     void setBlendOrderAt(Instance instance, uint8_t level, size_t primitiveIndex, uint16_t blendOrder) noexcept;
     AttributeBitset getEnabledAttributesAt(Instance instance, uint8_t level, size_t primitiveIndex) const noexcept;
-    inline utils::Slice<FRenderPrimitive> const& getRenderPrimitives(Instance instance, uint8_t level) const noexcept;
-    inline utils::Slice<FRenderPrimitive>& getRenderPrimitives(Instance instance, uint8_t level) noexcept;
+    utils::Slice<FRenderPrimitive> getRenderPrimitives(Instance instance, uint8_t level) const noexcept;
 
 private:
+    inline void setChanged(Instance instance) noexcept;
     void destroyComponent(Instance ci) noexcept;
     static void destroyComponentPrimitives(FEngine& engine,
             utils::Slice<FRenderPrimitive>& primitives) noexcept;
 
+    // range of the bone palette used by a renderable, 'count' is 0 if it has no bones
     struct Bones {
-        filament::backend::Handle<backend::HwUniformBuffer> handle;
-        UniformBuffer bones;
-        size_t count;
+        uint32_t offset = 0;
+        uint16_t count = 0;
+        BoneFormat format = BoneFormat::QUATERNION_SCALE;
     };
 
     friend class ::FilamentTest_Bones_Test;
+    friend class ::FilamentTest_DualQuaternionBones_Test;
+
+    static size_t getBoneSize(BoneFormat format) noexcept {
+        return format == BoneFormat::DUAL_QUATERNION ?
+               sizeof(PerRenderableUibDualQuaternionBone) : sizeof(PerRenderableUibBone);
+    }
+
+    // returns the address of the bones [offset, offset + count) in the bone palette
+    void* invalidateBones(Instance instance, size_t& count, size_t offset) noexcept;
 
     static void makeBone(PerRenderableUibBone* out, math::mat4f const& transforms) noexcept;
 
+    // the scales of the transform are dropped
+    static void makeBone(PerRenderableUibDualQuaternionBone* out,
+            math::mat4f const& transforms) noexcept;
+
+    static void makeBone(PerRenderableUibDualQuaternionBone* out,
+            math::quatf const& rotation, math::float3 const& translation) noexcept;
+
     enum {
         AABB,               // user data
         LAYERS,             // user data
         VISIBILITY,         // user data
         PRIMITIVES,         // user data
-        BONES,              // filament data, UBO storing a pointer to the bones information
+        BONES,              // filament data, range of the bone palette
+        GENERATION,         // filament data, generation of the last change
+        OCCLUDER,           // user data, mesh used for occlusion culling
+        LEVELS,             // user data, levels of detail
     };
 
     using Base = utils::SingleInstanceComponentManager<
@@ -162,7 +237,10 @@ private:
             uint8_t,
             Visibility,
             utils::Slice<FRenderPrimitive>,
-            std::unique_ptr<Bones>
+            Bones,
+            uint32_t,
+            std::unique_ptr<Occluder>,
+            Levels
     >;
 
     struct Sim : public Base {
@@ -182,6 +260,9 @@ private:
                 Field<VISIBILITY>   visibility;
                 Field<PRIMITIVES>   primitives;
                 Field<BONES>        bones;
+                Field<GENERATION>   generation;
+                Field<OCCLUDER>     occluder;
+                Field<LEVELS>       levels;
             };
         };
 
@@ -195,12 +276,23 @@ private:
 
     Sim mManager;
     FEngine& mEngine;
+    BonePalette mBonePalette;
+    uint32_t mGeneration = 1;
+    uint32_t mChangeGeneration = 0;
+    uint32_t mMultiLevelCount = 0;
+    uint32_t mStructureGeneration = 0;
 };
 
 FILAMENT_UPCAST(RenderableManager)
 
+void FRenderableManager::setChanged(Instance instance) noexcept {
+    mManager[instance].generation = mGeneration;
+    mChangeGeneration = mGeneration;
+}
+
 void FRenderableManager::setAxisAlignedBoundingBox(Instance instance, const Box& aabb) noexcept {
     if (instance) {
+        setChanged(instance);
         mManager[instance].aabb = aabb;
     }
 }
@@ -208,6 +300,7 @@ void FRenderableManager::setAxisAlignedBoundingBox(Instance instance, const Box&
 void FRenderableManager::setLayerMask(Instance instance,
         uint8_t select, uint8_t values) noexcept {
     if (instance) {
+        setChanged(instance);
         uint8_t& layers = mManager[instance].layers;
         layers = (layers & ~select) | (values & select);
     }
@@ -215,12 +308,14 @@ void FRenderableManager::setLayerMask(Instance instance,
 
 void FRenderableManager::setLayerMask(Instance instance, uint8_t layerMask) noexcept {
     if (instance) {
+        setChanged(instance);
         mManager[instance].layers = layerMask;
     }
 }
 
 void FRenderableManager::setPriority(Instance instance, uint8_t priority) noexcept {
     if (instance) {
+        setChanged(instance);
         Visibility& visibility = mManager[instance].visibility;
         visibility.priority = priority;
     }
@@ -228,6 +323,7 @@ void FRenderableManager::setPriority(Instance instance, uint8_t priority) noexce
 
 void FRenderableManager::setCastShadows(Instance instance, bool enable) noexcept {
     if (instance) {
+        setChanged(instance);
         Visibility& visibility = mManager[instance].visibility;
         visibility.castShadows = enable;
     }
@@ -235,13 +331,23 @@ void FRenderableManager::setCastShadows(Instance instance, bool enable) noexcept
 
 void FRenderableManager::setReceiveShadows(Instance instance, bool enable) noexcept {
     if (instance) {
+        setChanged(instance);
         Visibility& visibility = mManager[instance].visibility;
         visibility.receiveShadows = enable;
     }
 }
 
+void FRenderableManager::setStaticShadowCaster(Instance instance, bool enable) noexcept {
+    if (instance) {
+        setChanged(instance);
+        Visibility& visibility = mManager[instance].visibility;
+        visibility.staticShadowCaster = enable;
+    }
+}
+
 void FRenderableManager::setCulling(Instance instance, bool enable) noexcept {
     if (instance) {
+        setChanged(instance);
         Visibility& visibility = mManager[instance].visibility;
         visibility.culling = enable;
     }
@@ -249,6 +355,7 @@ void FRenderableManager::setCulling(Instance instance, bool enable) noexcept {
 
 void FRenderableManager::setSkinning(Instance instance, bool enable) noexcept {
     if (instance) {
+        setChanged(instance);
         Visibility& visibility = mManager[instance].visibility;
         visibility.skinning = enable;
     }
@@ -274,6 +381,10 @@ bool FRenderableManager::isShadowReceiver(Instance instance) const noexcept {
     return getVisibility(instance).receiveShadows;
 }
 
+bool FRenderableManager::isStaticShadowCaster(Instance instance) const noexcept {
+    return getVisibility(instance).staticShadowCaster;
+}
+
 bool FRenderableManager::isCullingEnabled(Instance instance) const noexcept {
     return getVisibility(instance).culling;
 }
@@ -290,23 +401,42 @@ Box const& FRenderableManager::getAABB(Instance instance) const noexcept {
     return mManager[instance].aabb;
 }
 
-backend::Handle<backend::HwUniformBuffer> FRenderableManager::getBonesUbh(Instance instance) const noexcept {
-    std::unique_ptr<Bones> const& bones = mManager[instance].bones;
-    return bones ? bones->handle : backend::Handle<backend::HwUniformBuffer>{};
+uint32_t FRenderableManager::getBonesOffset(Instance instance) const noexcept {
+    Bones const& bones = mManager[instance].bones;
+    return bones.offset;
 }
 
-utils::Slice<FRenderPrimitive> const& FRenderableManager::getRenderPrimitives(
-        Instance instance, uint8_t level) const noexcept {
-    return mManager[instance].primitives;
+FRenderableManager::Occluder const* FRenderableManager::getOccluder(
+        Instance instance) const noexcept {
+    std::unique_ptr<Occluder> const& occluder = mManager[instance].occluder;
+    return occluder.get();
 }
 
-utils::Slice<FRenderPrimitive>& FRenderableManager::getRenderPrimitives(
-        Instance instance, uint8_t level) noexcept {
-    return mManager[instance].primitives;
+FRenderableManager::Levels const& FRenderableManager::getLevels(
+        Instance instance) const noexcept {
+    Levels const& levels = mManager[instance].levels;
+    return levels;
+}
+
+size_t FRenderableManager::getLevelCount(Instance instance) const noexcept {
+    return getLevels(instance).count;
+}
+
+uint8_t FRenderableManager::getLevel(Instance instance, size_t& primitiveIndex) const noexcept {
+    uint8_t level = 0;
+    if (instance) {
+        Levels const& levels = getLevels(instance);
+        while (level + 1 < levels.count && primitiveIndex >= levels.offsets[level + 1]) {
+            level++;
+        }
+        primitiveIndex -= levels.offsets[level];
+    }
+    return level;
 }
 
-size_t FRenderableManager::getPrimitiveCount(Instance instance, uint8_t level) const noexcept {
-    return getRenderPrimitives(instance, level).size();
+size_t FRenderableManager::getPrimitiveCount(Instance instance) const noexcept {
+    utils::Slice<FRenderPrimitive> const& primitives = mManager[instance].primitives;
+    return primitives.size();
 }
 
 } // namespace details
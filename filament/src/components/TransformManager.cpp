@@ -16,6 +16,11 @@
 
 #include "components/TransformManager.h"
 
+#include <utils/JobSystem.h>
+#include <utils/Systrace.h>
+
+#include <algorithm>
+
 using namespace utils;
 using namespace filament::math;
 
@@ -24,11 +29,34 @@ namespace details {
 
 FTransformManager::FTransformManager() noexcept = default;
 
+FTransformManager::FTransformManager(JobSystem& js) noexcept : mJobSystem(&js) {
+}
+
 FTransformManager::~FTransformManager() noexcept = default;
 
 void FTransformManager::terminate() noexcept {
 }
 
+FTransformManager::TransformType FTransformManager::classify(mat3x4f const& m) noexcept {
+    // the transforms are typically the result of several products, so we allow for some
+    // rounding errors, relative to the scale of the transform.
+    constexpr float EPSILON = 1e-4f;
+    const float l0 = dot(m[0], m[0]);
+    const float l1 = dot(m[1], m[1]);
+    const float l2 = dot(m[2], m[2]);
+    const float d01 = dot(m[0], m[1]);
+    const float d02 = dot(m[0], m[2]);
+    const float d12 = dot(m[1], m[2]);
+    const float tolerance = EPSILON * l0;
+    const bool uniform = std::abs(l1 - l0) <= tolerance && std::abs(l2 - l0) <= tolerance &&
+            std::abs(d01) <= tolerance && std::abs(d02) <= tolerance &&
+            std::abs(d12) <= tolerance && l0 > 0.0f;
+    if (!uniform) {
+        return TransformType::GENERAL;
+    }
+    return std::abs(l0 - 1.0f) <= EPSILON ? TransformType::RIGID : TransformType::UNIFORM_SCALE;
+}
+
 void FTransformManager::create(Entity entity) {
     create(entity, 0, {});
 }
@@ -46,10 +74,16 @@ void FTransformManager::create(Entity entity, Instance parent, const mat4f& loca
     assert(i != parent);
 
     if (i && i != parent) {
+        mStructureGeneration = mGeneration;
+        mOrderDirty = true;
         manager[i].parent = 0;
         manager[i].next = 0;
         manager[i].prev = 0;
         manager[i].firstChild = 0;
+        manager[i].generation = mGeneration;
+        manager[i].dirty = 0;
+        manager[i].localType = TransformType::RIGID;
+        manager[i].worldType = TransformType::RIGID;
         insertNode(i, parent);
         setTransform(i, localTransform);
     }
@@ -64,6 +98,7 @@ void FTransformManager::setParent(Instance i, Instance parent) noexcept {
             // TODO: on debug builds, ensure that the new parent isn't one of our descendant
             removeNode(i);
             insertNode(i, parent);
+            mOrderDirty = true;
             updateNodeTransform(i);
         }
     }
@@ -109,6 +144,8 @@ void FTransformManager::destroy(Entity e) noexcept {
 
         // 2) remove the component
         Instance moved = manager.removeComponent(e);
+        mStructureGeneration = mGeneration;
+        mOrderDirty = true;
 
         // 3) update the references to the entry now with Instance i
         if (moved != i) {
@@ -121,8 +158,9 @@ void FTransformManager::setTransform(Instance ci, const mat4f& model) noexcept {
     validateNode(ci);
     if (ci) {
         auto& manager = mManager;
-        // store our local transform
-        manager[ci].local = model;
+        // store our local transform, its last row is always (0, 0, 0, 1)
+        manager[ci].local = mat3x4f(model);
+        manager[ci].localType = classify(manager[ci].local);
         updateNodeTransform(ci);
     }
 }
@@ -133,30 +171,29 @@ void FTransformManager::updateNodeTransform(Instance i) noexcept {
     assert(i);
 
     if (UTILS_UNLIKELY(mLocalTransformTransactionOpen)) {
-        // don't update the world transform until commitLocalTransformTransaction() is called
-        Instance ci = manager[i].firstChild;
-        while (ci) {
-            Instance child = manager[ci].firstChild;
-            ci = manager[ci].next;
-            if (child) {
-                updateNodeTransform(child);
-            }
-        }
+        // don't update the world transform until commitLocalTransformTransaction() is called,
+        // which also updates the node's descendants
+        manager[i].dirty = 1;
+        mHasDirtyNodes = true;
         return;
     }
 
     // find our parent's world transform, if any
     // note: by using the raw_array() we don't need to check that parent is valid.
     Instance parent = manager[i].parent;
-    mat4f const& pt = manager.raw_array<WORLD>()[parent];
+    mat3x4f const& pt = manager.raw_array<WORLD>()[parent];
 
     // compute our world transform
-    manager[i].world = pt * static_cast<mat4f const&>(manager[i].local);
+    manager[i].world = pt * static_cast<mat3x4f const&>(manager[i].local);
+    manager[i].worldType = std::max(manager.raw_array<WORLD_TYPE>()[parent],
+            static_cast<TransformType>(manager[i].localType));
+    manager[i].generation = mGeneration;
+    mChangeGeneration = mGeneration;
 
     // update our children's world transforms
     Instance child = manager[i].firstChild;
     if (UTILS_UNLIKELY(child)) { // assume we don't have a hierarchy in the common case
-        transformChildren(manager, child);
+        transformChildren(manager, child, mGeneration);
     }
 }
 
@@ -166,24 +203,131 @@ void FTransformManager::openLocalTransformTransaction() noexcept {
 
 void FTransformManager::commitLocalTransformTransaction() noexcept {
     if (mLocalTransformTransactionOpen) {
+        SYSTRACE_CALL();
         mLocalTransformTransactionOpen = false;
-        auto& manager = mManager;
 
-        // swapNode() below needs some temporary storage which we provide here
-        auto& soa = manager.getSoA();
-        soa.ensureCapacity(soa.size() + 1);
+        if (mOrderDirty) {
+            // the nodes only move when the hierarchy changed since the last transaction
+            if (sortNodesByDepth()) {
+                mStructureGeneration = mGeneration;
+            }
+            mOrderDirty = false;
+        }
 
-        mat4f const* const UTILS_RESTRICT world = manager.raw_array<WORLD>();
-        for (Instance i = manager.begin(), e = manager.end(); i != e; ++i) {
-            // Ensure that children are always sorted after their parent.
-            if (UTILS_UNLIKELY(Instance(manager[i].parent) > i)) {
-                swapNode(i, manager[i].parent);
+        if (mHasDirtyNodes) {
+            updateDirtyNodes();
+            mHasDirtyNodes = false;
+            mChangeGeneration = mGeneration;
+        }
+    }
+}
+
+// Sorts the nodes in breadth-first order and computes the levels of the hierarchy. Returns
+// whether any node moved, which invalidates the Instances.
+bool FTransformManager::sortNodesByDepth() noexcept {
+    SYSTRACE_CALL();
+
+    auto& manager = mManager;
+    const uint32_t begin = manager.begin();
+    const uint32_t end = manager.end();
+
+    // the roots first, then the children of each level in the order of their parent
+    std::vector<Instance>& order = mOrder;
+    order.clear();
+    for (Instance i = manager.begin(), e = manager.end(); i != e; ++i) {
+        if (!Instance(manager[i].parent)) {
+            order.push_back(i);
+        }
+    }
+    mLevels.assign(1, begin);
+    for (size_t first = 0; first < order.size();) {
+        const size_t last = order.size();
+        for (size_t k = first; k < last; k++) {
+            for (Instance ci = manager[order[k]].firstChild; ci; ci = manager[ci].next) {
+                order.push_back(ci);
+            }
+        }
+        first = last;
+        mLevels.push_back(uint32_t(begin + last));
+    }
+    // all the nodes are reachable from a root, unless a node was parented to a descendant
+    assert(order.size() == end - begin);
+
+    // swapNode() below needs some temporary storage which we provide here
+    auto& soa = manager.getSoA();
+    soa.ensureCapacity(soa.size() + 1);
+
+    // move each node to its position, keeping track of where the others went
+    std::vector<uint32_t>& positions = mPositions;
+    std::vector<uint32_t>& nodes = mNodes;
+    positions.resize(end);
+    nodes.resize(end);
+    for (uint32_t i = begin; i < end; i++) {
+        positions[i] = i;
+        nodes[i] = i;
+    }
+    bool moved = false;
+    for (uint32_t p = begin; p < end; p++) {
+        const uint32_t node = order[p - begin];
+        const uint32_t src = positions[node];
+        if (src != p) {
+            swapNode(p, src);
+            const uint32_t other = nodes[p];
+            nodes[p] = node;
+            nodes[src] = other;
+            positions[node] = p;
+            positions[other] = src;
+            moved = true;
+        }
+    }
+    return moved;
+}
+
+// Computes the world transform of the nodes whose local transform changed and of their
+// descendants, one level at a time.
+void FTransformManager::updateDirtyNodes() noexcept {
+    SYSTRACE_CALL();
+
+    auto& soa = mManager.getSoA();
+    mat3x4f const* const UTILS_RESTRICT local = soa.data<LOCAL>();
+    mat3x4f* const UTILS_RESTRICT world = soa.data<WORLD>();
+    Instance const* const UTILS_RESTRICT parents = soa.data<PARENT>();
+    uint32_t* const UTILS_RESTRICT generations = soa.data<GENERATION>();
+    uint8_t* const UTILS_RESTRICT dirty = soa.data<DIRTY>();
+    TransformType const* const UTILS_RESTRICT localTypes = soa.data<LOCAL_TYPE>();
+    TransformType* const UTILS_RESTRICT worldTypes = soa.data<WORLD_TYPE>();
+    const uint32_t generation = mGeneration;
+
+    // the roots' parent is the null instance, which is never dirty
+    dirty[0] = 0;
+
+    // a node is dirty if its parent, on the previous level, is
+    auto work = [=](uint32_t first, uint32_t count) {
+        for (uint32_t i = first, e = first + count; i < e; i++) {
+            const uint32_t parent = parents[i];
+            if (dirty[i] | dirty[parent]) {
+                dirty[i] = 1;
+                world[i] = world[parent] * local[i];
+                worldTypes[i] = std::max(worldTypes[parent], localTypes[i]);
+                generations[i] = generation;
             }
-            Instance parent = manager[i].parent;
-            assert(parent < i);
-            manager[i].world = world[parent] * static_cast<mat4f const&>(manager[i].local);
+        }
+    };
+
+    JobSystem* const js = mJobSystem;
+    std::vector<uint32_t> const& levels = mLevels;
+    for (size_t l = 0; l + 1 < levels.size(); l++) {
+        const uint32_t first = levels[l];
+        const uint32_t count = levels[l + 1] - first;
+        if (js && count >= UPDATE_CHUNK_SIZE * 2) {
+            js->runAndWait(jobs::parallel_for(*js, nullptr, first, count,
+                    std::cref(work), jobs::CountSplitter<UPDATE_CHUNK_SIZE, 8>()));
+        } else {
+            work(first, count);
         }
     }
+
+    std::fill_n(dirty, soa.size(), uint8_t(0));
 }
 
 // Inserts a parentless node in the hierarchy
@@ -219,6 +363,10 @@ void FTransformManager::swapNode(Instance i, Instance j) noexcept {
     // swap the content of the nodes directly
     std::swap(manager.elementAt<LOCAL>(i), manager.elementAt<LOCAL>(j));
     std::swap(manager.elementAt<WORLD>(i), manager.elementAt<WORLD>(j));
+    std::swap(manager.elementAt<GENERATION>(i), manager.elementAt<GENERATION>(j));
+    std::swap(manager.elementAt<DIRTY>(i), manager.elementAt<DIRTY>(j));
+    std::swap(manager.elementAt<LOCAL_TYPE>(i), manager.elementAt<LOCAL_TYPE>(j));
+    std::swap(manager.elementAt<WORLD_TYPE>(i), manager.elementAt<WORLD_TYPE>(j));
     manager.swap(i, j); // this swaps the data relative to SingleInstanceComponentManager
 
     // now swap the linked-list references, to do that correctly we must use a temporary
@@ -305,18 +453,22 @@ void FTransformManager::updateNode(Instance i) noexcept {
     validateNode(next);
 }
 
-void FTransformManager::transformChildren(Sim& manager, Instance ci) noexcept {
+void FTransformManager::transformChildren(Sim& manager, Instance ci,
+        uint32_t generation) noexcept {
     while (ci) {
         // update child's world transform
         Instance parent = manager[ci].parent;
-        mat4f const& pt = manager[parent].world;
-        mat4f const& local = manager[ci].local;
+        mat3x4f const& pt = manager[parent].world;
+        mat3x4f const& local = manager[ci].local;
         manager[ci].world = pt * local;
+        manager[ci].worldType = std::max(static_cast<TransformType>(manager[parent].worldType),
+                static_cast<TransformType>(manager[ci].localType));
+        manager[ci].generation = generation;
 
         // assume we don't have a deep hierarchy
         Instance child = manager[ci].firstChild;
         if (UTILS_UNLIKELY(child)) {
-            transformChildren(manager, child);
+            transformChildren(manager, child, generation);
         }
 
         // process our next child
@@ -402,11 +554,11 @@ void TransformManager::setTransform(Instance ci, const mat4f& model) noexcept {
     upcast(this)->setTransform(ci, model);
 }
 
-const mat4f& TransformManager::getTransform(Instance ci) const noexcept {
+mat4f TransformManager::getTransform(Instance ci) const noexcept {
     return upcast(this)->getTransform(ci);
 }
 
-const mat4f& TransformManager::getWorldTransform(Instance ci) const noexcept {
+mat4f TransformManager::getWorldTransform(Instance ci) const noexcept {
     return upcast(this)->getWorldTransform(ci);
 }
 
@@ -26,8 +26,15 @@
 #include <utils/Entity.h>
 #include <utils/Slice.h>
 
+#include <math/mat3x4.h>
 #include <math/mat4.h>
 
+#include <vector>
+
+namespace utils {
+class JobSystem;
+} // namespace utils
+
 namespace filament {
 namespace details {
 
@@ -35,7 +42,20 @@ class UTILS_PRIVATE FTransformManager : public TransformManager {
 public:
     using Instance = TransformManager::Instance;
 
+    // What the linear part of a transform is made of, from the cheapest to handle (e.g. to
+    // compute its normal matrix) to the most expensive. The composition of two transforms is of
+    // the largest of their types.
+    enum class TransformType : uint8_t {
+        RIGID,          // rotations and reflections only
+        UNIFORM_SCALE,  // rigid with the same scale on all axes
+        GENERAL         // anything else, e.g. non-uniform scales or shears
+    };
+
+    static TransformType classify(math::mat3x4f const& m) noexcept;
+
     FTransformManager() noexcept;
+    // the world transforms of a local transform transaction are computed with this JobSystem
+    explicit FTransformManager(utils::JobSystem& js) noexcept;
     ~FTransformManager() noexcept;
 
     // free-up all resources
@@ -74,20 +94,55 @@ public:
 
     void gc(utils::EntityManager& em) noexcept;
 
-    utils::Slice<const math::mat4f> getWorldTransforms() const noexcept {
+    utils::Slice<const math::mat3x4f> getWorldTransforms() const noexcept {
         return mManager.slice<WORLD>();
     }
 
+    // the transforms are affine, only their first 3 rows are stored
     void setTransform(Instance ci, const math::mat4f& model) noexcept;
 
-    const math::mat4f& getTransform(Instance ci) const noexcept {
+    math::mat4f getTransform(Instance ci) const noexcept {
+        return getAffineTransform(ci).toMat4();
+    }
+
+    math::mat4f getWorldTransform(Instance ci) const noexcept {
+        return getAffineWorldTransform(ci).toMat4();
+    }
+
+    const math::mat3x4f& getAffineTransform(Instance ci) const noexcept {
         return mManager[ci].local;
     }
 
-    const math::mat4f& getWorldTransform(Instance ci) const noexcept {
+    const math::mat3x4f& getAffineWorldTransform(Instance ci) const noexcept {
         return mManager[ci].world;
     }
 
+    TransformType getWorldTransformType(Instance ci) const noexcept {
+        return mManager[ci].worldType;
+    }
+
+    /*
+     * Change tracking
+     *
+     * Every change to a world transform is tagged with the current generation, which only
+     * moves forward when advanceGeneration() is called. This lets FScene find out which
+     * transforms changed since it last looked at them.
+     */
+
+    // returns the current generation and starts a new one
+    uint32_t advanceGeneration() noexcept { return mGeneration++; }
+
+    // generation of the last change to this instance's world transform
+    uint32_t getGeneration(Instance ci) const noexcept {
+        return mManager[ci].generation;
+    }
+
+    // generation of the last change to any world transform
+    uint32_t getChangeGeneration() const noexcept { return mChangeGeneration; }
+
+    // generation of the last time instances were created, destroyed or moved
+    uint32_t getStructureGeneration() const noexcept { return mStructureGeneration; }
+
 private:
     struct Sim;
 
@@ -97,7 +152,10 @@ private:
     void updateNodeTransform(Instance i) noexcept;
     void insertNode(Instance i, Instance p) noexcept;
     void swapNode(Instance i, Instance j) noexcept;
-    static void transformChildren(Sim& manager, Instance firstChild) noexcept;
+    bool sortNodesByDepth() noexcept;
+    void updateDirtyNodes() noexcept;
+    static void transformChildren(Sim& manager, Instance firstChild,
+            uint32_t generation) noexcept;
 
 
     enum {
@@ -107,15 +165,23 @@ private:
         FIRST_CHILD,    // instance to our first child
         NEXT,           // instance to our next sibling
         PREV,           // instance to our previous sibling
+        GENERATION,     // generation of the last change to the world transform
+        DIRTY,          // local transform changed during a local transform transaction
+        LOCAL_TYPE,     // type of the local transform
+        WORLD_TYPE,     // type of the world transform
     };
 
     using Base = utils::SingleInstanceComponentManager<
-            math::mat4f,
-            math::mat4f,
+            math::mat3x4f,
+            math::mat3x4f,
+            Instance,
             Instance,
             Instance,
             Instance,
-            Instance
+            uint32_t,
+            uint8_t,
+            TransformType,
+            TransformType
     >;
 
     struct Sim : public Base {
@@ -138,6 +204,10 @@ private:
                 Field<FIRST_CHILD>  firstChild;
                 Field<NEXT>         next;
                 Field<PREV>         prev;
+                Field<GENERATION>   generation;
+                Field<DIRTY>        dirty;
+                Field<LOCAL_TYPE>   localType;
+                Field<WORLD_TYPE>   worldType;
             };
         };
 
@@ -149,8 +219,29 @@ private:
         }
     };
 
+    // number of nodes of a level updated per job in commitLocalTransformTransaction()
+    static constexpr size_t UPDATE_CHUNK_SIZE = 1024;
+
     Sim mManager;
+    utils::JobSystem* const mJobSystem = nullptr;
+
+    /*
+     * commitLocalTransformTransaction() keeps the nodes sorted by depth, in breadth-first order,
+     * so that a node's parent is always on a previous level. The nodes of a level only depend
+     * on the levels before it, and are updated in parallel. mLevels holds the first instance of
+     * each level, and the end of the last one. It's only valid while mOrderDirty is false.
+     */
+    std::vector<uint32_t> mLevels;
+    // scratch storage for sortNodesByDepth()
+    std::vector<Instance> mOrder;       // sorted nodes
+    std::vector<uint32_t> mPositions;   // node -> current position
+    std::vector<uint32_t> mNodes;       // position -> node currently there
+    bool mOrderDirty = true;
+    bool mHasDirtyNodes = false;
     bool mLocalTransformTransactionOpen = false;
+    uint32_t mGeneration = 1;
+    uint32_t mChangeGeneration = 0;
+    uint32_t mStructureGeneration = 0;
 };
 
 FILAMENT_UPCAST(TransformManager)
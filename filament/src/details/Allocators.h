@@ -33,6 +33,14 @@ static constexpr size_t CONFIG_PER_FRAME_COMMANDS_SIZE = 1 * 1024 * 1024;
 static constexpr size_t CONFIG_MIN_COMMAND_BUFFERS_SIZE = 1 * 1024 * 1024;
 static constexpr size_t CONFIG_COMMAND_BUFFERS_SIZE     = 3 * CONFIG_MIN_COMMAND_BUFFERS_SIZE;
 
+// largest size the command-stream buffer can grow to, see FEngine::setCommandBufferGrowthEnabled()
+static constexpr size_t CONFIG_MAX_COMMAND_BUFFERS_SIZE = 8 * CONFIG_COMMAND_BUFFERS_SIZE;
+
+// number and size of the secondary command-stream buffers, which the JobSystem workers record
+// into in parallel (these come from mmap too)
+static constexpr size_t CONFIG_SECONDARY_COMMAND_STREAM_COUNT  = 8;
+static constexpr size_t CONFIG_SECONDARY_COMMAND_BUFFERS_SIZE  = 256 * 1024;
+
 #ifndef NDEBUG
 
 using HeapAllocatorArena = utils::Arena<
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_BONEPALETTE_H
+#define TNT_FILAMENT_DETAILS_BONEPALETTE_H
+
+#include "private/backend/DriverApiForward.h"
+
+#include <private/filament/EngineEnums.h>
+#include <private/filament/UibGenerator.h>
+
+#include <backend/Handle.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * The bones of all the skinned renderables, in a single uniform buffer.
+ *
+ * Each skinned renderable gets a range of the palette, which is bound with
+ * bindUniformBufferRange() when it's drawn. The bones are written to a CPU copy of the palette,
+ * which is uploaded at most once per frame, by commit().
+ *
+ * GLES requires the bound range to be at least as large as the uniform block, so the buffer
+ * always has BINDING_SIZE bytes past the last range.
+ */
+class BonePalette {
+public:
+    // alignment of the ranges, the largest uniform buffer offset alignment we support
+    static constexpr uint32_t ALIGNMENT = 256;
+
+    // size of the BonesUniforms block, i.e. of each binding
+    static constexpr uint32_t BINDING_SIZE = CONFIG_MAX_BONE_COUNT * sizeof(PerRenderableUibBone);
+
+    BonePalette() noexcept;
+    ~BonePalette() noexcept;
+
+    BonePalette(BonePalette const& rhs) = delete;
+    BonePalette& operator=(BonePalette const& rhs) = delete;
+
+    void terminate(backend::DriverApi& driver) noexcept;
+
+    // Returns the offset of a new range of 'size' bytes, the first free range large enough is
+    // reused, otherwise the palette grows.
+    uint32_t allocate(uint32_t size) noexcept;
+
+    // Returns a range obtained with allocate() to the palette.
+    void free(uint32_t offset, uint32_t size) noexcept;
+
+    // Returns the address of 'size' bytes at 'offset' in the CPU copy, which will be uploaded by
+    // the next commit(). Valid until the next call to allocate().
+    void* invalidate(uint32_t offset, uint32_t size) noexcept;
+
+    // Uploads the palette if it changed since the last commit(), (re)creating the uniform buffer
+    // first if it's too small. Call once per frame, before the draws are recorded.
+    void commit(backend::DriverApi& driver) noexcept;
+
+    backend::Handle<backend::HwUniformBuffer> getHandle() const noexcept { return mHandle; }
+
+    // size of the palette in bytes, including the free ranges
+    size_t getSize() const noexcept { return mData.size(); }
+
+    size_t getFreeRangeCount() const noexcept { return mFreeRanges.size(); }
+
+    static constexpr uint32_t align(uint32_t size) noexcept {
+        return (size + ALIGNMENT - 1u) & ~(ALIGNMENT - 1u);
+    }
+
+private:
+    struct Range {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    // sorted by offset, adjacent ranges are merged and the last range of the palette is never
+    // free (the palette shrinks instead)
+    std::vector<Range> mFreeRanges;
+    std::vector<uint8_t> mData;
+    backend::Handle<backend::HwUniformBuffer> mHandle;
+    uint32_t mCapacity = 0;     // size of the uniform buffer, without the BINDING_SIZE tail
+    bool mDirty = false;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_BONEPALETTE_H
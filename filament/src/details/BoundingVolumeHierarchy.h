@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_BOUNDINGVOLUMEHIERARCHY_H
+#define TNT_FILAMENT_DETAILS_BOUNDINGVOLUMEHIERARCHY_H
+
+#include "details/Culler.h"
+
+#include <filament/Frustum.h>
+
+#include <utils/compiler.h>
+
+#include <math/vec3.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * A bounding volume hierarchy of axis aligned boxes, used to reject whole groups of boxes
+ * during frustum culling.
+ *
+ * Nodes are stored in depth-first order, which means that each subtree covers a contiguous
+ * range of boxes and can be skipped by jumping to the node that follows it. This makes the
+ * traversal stack-less. Leaves are culled with Culler::intersects().
+ *
+ * Boxes are identified by their index in the arrays passed to build(), and cull() writes its
+ * results using these indices, unless remap() is used.
+ */
+class BoundingVolumeHierarchy {
+public:
+    // maximum number of boxes per leaf, must be a multiple of Culler::MODULO
+    static constexpr size_t LEAF_SIZE = 32;
+    static_assert(LEAF_SIZE % Culler::MODULO == 0, "LEAF_SIZE must be a multiple of MODULO");
+
+    BoundingVolumeHierarchy() noexcept;
+    ~BoundingVolumeHierarchy() noexcept;
+
+    BoundingVolumeHierarchy(BoundingVolumeHierarchy const& rhs) = delete;
+    BoundingVolumeHierarchy& operator=(BoundingVolumeHierarchy const& rhs) = delete;
+
+    // builds the hierarchy from scratch, this is O(N.log(N))
+    void build(math::float3 const* center, math::float3 const* extent, size_t count);
+
+    // Updates the boxes and the bounds of the nodes that contain them, the topology of the tree
+    // is preserved. 'count' must be the same as in the last call to build().
+    // Returns the number of boxes that changed.
+    size_t refit(math::float3 const* center, math::float3 const* extent, size_t count) noexcept;
+
+    // Sets bit 'bit' of results[i] for each box i that intersects the frustum. Other bits are
+    // left untouched. 'results' must have room for size() entries.
+    void cull(Culler::result_type* results, Frustum const& frustum, size_t bit) const noexcept;
+
+    // Makes cull() write the result of box i to results[map[i]] instead, until the next
+    // call to build(). 'map' must be a permutation of [0, size()).
+    void remap(uint32_t const* map) noexcept;
+
+    // Number of boxes in the hierarchy
+    size_t size() const noexcept { return mIndices.size(); }
+
+    bool empty() const noexcept { return mIndices.empty(); }
+
+    // Returns true when refit() has degraded the tree enough that it's worth rebuilding it.
+    bool needsRebuild() const noexcept {
+        return mCost > REBUILD_COST_RATIO * mBuildCost;
+    }
+
+private:
+    // rebuild when the summed surface area of the nodes has grown by this much since build()
+    static constexpr float REBUILD_COST_RATIO = 2.0f;
+
+    struct Node {                   // 36 bytes
+        math::float3 center;        // 12 node's bounding box center
+        uint32_t first;             //  4 index of the first box of the subtree (in tree order)
+        math::float3 extent;        // 12 node's bounding box half-extent
+        uint32_t count;             //  4 number of boxes in the subtree
+        uint32_t next;              //  4 index of the node following the subtree
+        bool isLeaf(uint32_t index) const noexcept { return next == index + 1; }
+    };
+
+    uint32_t buildRecursive(math::float3 const* center, math::float3 const* extent,
+            uint32_t first, uint32_t count);
+    void computeLeafBounds(Node& node) const noexcept;
+    static float area(math::float3 extent) noexcept;
+
+    std::vector<Node> mNodes;
+
+    // boxes in tree order, with enough padding for Culler::intersects()
+    std::vector<math::float3> mCenters;
+    std::vector<math::float3> mExtents;
+
+    std::vector<uint32_t> mIndices;     // tree order -> box index (or result index)
+    std::vector<uint32_t> mSlots;       // box index -> tree order
+    std::vector<uint32_t> mLeafFirst;   // first box of each leaf, in tree order (sorted)
+    std::vector<uint32_t> mLeafNodes;   // node index of each leaf
+    std::vector<uint8_t> mDirty;        // scratch used by refit(), one per node
+
+    float mBuildCost = 0.0f;
+    float mCost = 0.0f;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_BOUNDINGVOLUMEHIERARCHY_H
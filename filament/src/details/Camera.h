@@ -78,7 +78,7 @@ public:
     void lookAt(const math::float3& eye, const math::float3& center, const math::float3& up = { 0, 1, 0 })  noexcept;
 
     // returns the view matrix
-    math::mat4f const& getModelMatrix() const noexcept;
+    math::mat4f getModelMatrix() const noexcept;
 
     // returns the inverse of the view matrix
     math::mat4f getViewMatrix() const noexcept;
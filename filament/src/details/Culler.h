@@ -22,6 +22,7 @@
 #include <utils/compiler.h>
 #include <utils/Slice.h>
 
+#include <math/mat4.h>
 #include <math/vec4.h>
 #include <math/vec2.h>
 
@@ -48,6 +49,22 @@ public:
 
     using result_type = uint8_t;
 
+    // Instruction sets the array versions of intersects() have a kernel for. The best one
+    // supported by the CPU is selected at runtime.
+    enum class Isa : uint8_t {
+        SCALAR,     // portable C++, relies on the compiler's auto-vectorization
+        SSE2,       // 4 wide, baseline on x86-64
+        AVX2,       // 8 wide
+        AVX512,     // 16 wide (AVX-512F)
+        NEON        // 4 wide, baseline on ARMv8
+    };
+
+    // returns the instruction set used by intersects()
+    static Isa getIsa() noexcept;
+
+    // returns whether the kernels for 'isa' can run on this CPU
+    static bool isSupported(Isa isa) noexcept;
+
     /*
      * returns whether each AABB in an array intersects with the frustum
      */
@@ -57,6 +74,17 @@ public:
             math::float3 const* extent,
             size_t count, size_t bit) noexcept;
 
+    /*
+     * returns whether each AABB in an array intersects with each of the frustums: bit
+     * 'bit + i' of the results is set when the AABB intersects frustums[i]. This reads the
+     * AABBs from memory only once, however many frustums there are.
+     */
+    static void intersects(result_type* results,
+            Frustum const* frustums, size_t frustumCount,
+            math::float3 const* center,
+            math::float3 const* extent,
+            size_t count, size_t bit) noexcept;
+
     /*
      * returns whether each sphere in an array intersects with the frustum
      */
@@ -80,6 +108,14 @@ public:
             Frustum const& frustum,
             math::float4 const& sphere) noexcept;
 
+    /*
+     * returns the frustum expressed in the source space of the rigid transform 'm', given a
+     * frustum expressed in its destination space.
+     */
+    static Frustum transform(
+            Frustum const& frustum,
+            math::mat4f const& m) noexcept;
+
 
     struct UTILS_PUBLIC Test {
         static void intersects(result_type* results,
@@ -92,6 +128,18 @@ public:
                 Frustum const& frustum,
                 math::float4 const* b,
                 size_t count) noexcept;
+
+        // same as above, using the kernels for 'isa', which must be supported
+        static void intersects(result_type* results,
+                Frustum const& frustum,
+                math::float3 const* c,
+                math::float3 const* e,
+                size_t count, Isa isa) noexcept;
+
+        static void intersects(result_type* results,
+                Frustum const& frustum,
+                math::float4 const* b,
+                size_t count, Isa isa) noexcept;
     };
 };
 
@@ -28,12 +28,14 @@
 #include "details/Allocators.h"
 #include "details/Camera.h"
 #include "details/DebugRegistry.h"
+#include "details/HwRenderPrimitiveFactory.h"
 #include "details/RenderTarget.h"
 #include "details/ResourceList.h"
 #include "details/Skybox.h"
 
 #include "private/backend/CommandStream.h"
 #include "private/backend/CommandBufferQueue.h"
+#include "private/backend/CommandProfiler.h"
 #include "private/backend/DriverApi.h"
 
 #include <private/filament/EngineEnums.h>
@@ -56,8 +58,10 @@
 #include <utils/JobSystem.h>
 #include <utils/CountDownLatch.h>
 
+#include <array>
 #include <chrono>
 #include <memory>
+#include <string>
 #include <unordered_map>
 
 namespace filament {
@@ -124,6 +128,13 @@ public:
 
     backend::Driver& getDriver() const noexcept { return *mDriver; }
     DriverApi& getDriverApi() noexcept { return mCommandStream; }
+
+    // Secondary command streams, they're recorded by the JobSystem workers and spliced into
+    // the driver api, see DriverApi::splice()
+    DriverApi& getSecondaryDriverApi(size_t index) noexcept {
+        assert(index < CONFIG_SECONDARY_COMMAND_STREAM_COUNT);
+        return mSecondaryCommandStreams[index];
+    }
     DFG* getDFG() const noexcept { return mDFG.get(); }
 
     // the per-frame Area is used by all Renderer, so they must run in sequence and
@@ -167,6 +178,10 @@ public:
         return mPostProcessManager;
     }
 
+    HwRenderPrimitiveFactory& getRenderPrimitiveFactory() noexcept {
+        return mRenderPrimitiveFactory;
+    }
+
     FRenderableManager& getRenderableManager() noexcept {
         return mRenderableManager;
     }
@@ -197,6 +212,49 @@ public:
 
     void* streamAlloc(size_t size, size_t alignment) noexcept;
 
+    void setAutomaticInstancingEnabled(bool enable) noexcept {
+        mAutomaticInstancingEnabled = enable;
+    }
+
+    bool isAutomaticInstancingEnabled() const noexcept {
+        return mAutomaticInstancingEnabled;
+    }
+
+    void setCommandBufferGrowthEnabled(bool enable) noexcept {
+        mCommandBufferGrowthEnabled = enable;
+        mCommandBufferQueue.setMaxBufferSize(enable ? CONFIG_MAX_COMMAND_BUFFERS_SIZE : 0);
+    }
+
+    bool isCommandBufferGrowthEnabled() const noexcept {
+        return mCommandBufferGrowthEnabled;
+    }
+
+    bool startCommandCapture(const char* path, uint32_t frameCount) noexcept {
+        return mCommandStream.startCapture(path, frameCount);
+    }
+
+    void setCommandProfilingEnabled(bool enable) noexcept {
+        mCommandProfilingEnabled = enable;
+        getDriver().setCommandProfilingEnabled(enable);
+    }
+
+    bool isCommandProfilingEnabled() const noexcept {
+        return mCommandProfilingEnabled;
+    }
+
+    utils::CString getCommandProfileAsJson() const {
+        backend::CommandProfiler::Frame frame = getDriver().getCommandProfiler().getLastFrame();
+        std::string json = backend::CommandProfiler::toJson(frame);
+        return utils::CString(json.c_str(), json.size());
+    }
+
+    CommandBufferStatistics getCommandBufferStatistics() const noexcept {
+        return mCommandBufferStatistics;
+    }
+
+    // called at the end of each frame, after the last flush()
+    void updateCommandBufferStatistics() noexcept;
+
     utils::JobSystem& getJobSystem() noexcept { return mJobSystem; }
 
 
@@ -294,11 +352,19 @@ private:
     bool mOwnPlatform = false;
     void* mSharedGLContext = nullptr;
     bool mTerminated = false;
+    bool mAutomaticInstancingEnabled = false;
+    bool mCommandBufferGrowthEnabled = false;
+    bool mCommandProfilingEnabled = false;
+    CommandBufferStatistics mCommandBufferStatistics;
     backend::Handle<backend::HwRenderPrimitive> mFullScreenTriangleRph;
     FVertexBuffer* mFullScreenTriangleVb = nullptr;
     FIndexBuffer* mFullScreenTriangleIb = nullptr;
 
     PostProcessManager mPostProcessManager;
+    HwRenderPrimitiveFactory mRenderPrimitiveFactory;
+
+    // constructed before the component managers, FTransformManager keeps a reference to it
+    utils::JobSystem mJobSystem;
 
     utils::EntityManager& mEntityManager;
     FRenderableManager mRenderableManager;
@@ -330,12 +396,13 @@ private:
     std::thread mDriverThread;
     backend::CommandBufferQueue mCommandBufferQueue;
     DriverApi mCommandStream;
+    std::array<std::unique_ptr<backend::CircularBuffer>,
+            CONFIG_SECONDARY_COMMAND_STREAM_COUNT> mSecondaryCommandBuffers;
+    std::array<DriverApi, CONFIG_SECONDARY_COMMAND_STREAM_COUNT> mSecondaryCommandStreams;
 
     LinearAllocatorArena mPerRenderPassAllocator;
     HeapAllocatorArena mHeapAllocator;
 
-    utils::JobSystem mJobSystem;
-
     Epoch mEngineEpoch;
 
     mutable FMaterial const* mDefaultMaterial = nullptr;
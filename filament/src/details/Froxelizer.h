@@ -76,6 +76,12 @@ public:
 //  +----+
 // 256 lights max
 //
+// Above 256 lights, the "clustered" mode is used: the lights are stored in a texture (4 texels
+// per light, up to CONFIG_MAX_CLUSTERED_LIGHT_COUNT) instead of the UBO, which is why the
+// record buffer is R_U16. Each froxel gets a variable-length list of lights, built by first
+// binning the lights into screen-space tiles, then testing each light of a tile against the
+// froxels of that tile, slice by slice.
+//
 
 // Max number of froxels limited by:
 // - max texture size [min 2048]
@@ -95,27 +101,45 @@ public:
     void terminate(backend::DriverApi& driverApi) noexcept;
 
     // gpu buffer containing records. valid after construction.
-    GPUBuffer const& getRecordBuffer() const noexcept { return mRecordsBuffer; }
+    // the record buffer used by the last prepare(), it changes with the clustered mode
+    GPUBuffer const& getRecordBuffer() const noexcept {
+        return mClustered ? mClusteredRecordsBuffer : mRecordsBuffer;
+    }
 
     // gpu buffer containing froxels. valid after construction.
     GPUBuffer const& getFroxelBuffer() const noexcept { return mFroxelBuffer; }
 
+    // gpu buffer containing the lights in clustered mode. valid after construction.
+    GPUBuffer const& getLightBuffer() const noexcept { return mLightBuffer; }
+    GPUBuffer& getLightBuffer() noexcept { return mLightBuffer; }
+
+    // whether this many point and spot lights need the clustered mode
+    static bool isClustered(size_t lightCount) noexcept {
+        return lightCount > CONFIG_MAX_LIGHT_COUNT;
+    }
+
     void setOptions(float zLightNear, float zLightFar) noexcept;
 
     /*
-     * Allocate per-frame data structures for froxelization.
+     * Finds the lights which changed since the last froxelization, and allocates per-frame data
+     * structures for froxelization if there are any.
      *
+     * engine            engine owning the lights
      * driverApi         used to allocate memory in the stream
      * arena             use to allocate per-frame memory
      * viewport          viewport used to calculate froxel dimensions
      * projection        camera projection matrix
      * projectionNear    near plane
      * projectionFar     far plane
+     * camera            camera the lights will be froxelized with
+     * lightData         lights that will be froxelized
      *
      * return true if updateUniforms() needs to be called
      */
-    bool prepare(backend::DriverApi& driverApi, ArenaScope& arena, Viewport const& viewport,
-            const math::mat4f& projection, float projectionNear, float projectionFar) noexcept;
+    bool prepare(FEngine& engine, backend::DriverApi& driverApi, ArenaScope& arena,
+            Viewport const& viewport,
+            const math::mat4f& projection, float projectionNear, float projectionFar,
+            CameraInfo const& camera, const FScene::LightSoa& lightData) noexcept;
 
     Froxel getFroxelAt(size_t x, size_t y, size_t z) const noexcept;
     size_t getFroxelCountX() const noexcept { return mFroxelCountX; }
@@ -124,6 +148,9 @@ public:
     size_t getFroxelCount() const noexcept { return mFroxelCount; }
 
     // update Records and Froxels texture with lights data. this is thread-safe.
+    // Up to CONFIG_MAX_LIGHT_COUNT lights, only the lights which prepare() found changed
+    // are froxelized, everything is froxelized again after a viewport or projection change.
+    // Nothing is done if no light changed. The parameters must be the ones given to prepare().
     void froxelizeLights(FEngine& engine, CameraInfo const& camera,
             const FScene::LightSoa& lightData) noexcept;
 
@@ -135,7 +162,7 @@ public:
         u.setUniform(offsetof(PerViewUib, oneOverFroxelDimensionY), mOneOverDimension.y);
     }
 
-    // send froxel data to GPU
+    // send froxel data to GPU, if it changed
     void commit(backend::DriverApi& driverApi);
 
 
@@ -161,9 +188,30 @@ public:
     // This depends on the maximum number of lights (currently 255),and can't be more than 16 bits.
     static_assert(CONFIG_MAX_LIGHT_INDEX <= std::numeric_limits<uint16_t>::max(), "can't have more than 65536 lights");
     using RecordBufferType = std::conditional_t<CONFIG_MAX_LIGHT_INDEX <= std::numeric_limits<uint8_t>::max(), uint8_t, uint16_t>;
+
+    // The clustered mode needs 16 bits per record (currently 4095 lights), this doubles the size
+    // of the record buffer, so it's only used in that mode.
+    static_assert(CONFIG_MAX_CLUSTERED_LIGHT_INDEX <= std::numeric_limits<uint16_t>::max(), "can't have more than 65536 lights");
+    using ClusteredRecordBufferType = uint16_t;
+
     const utils::Slice<FroxelEntry>& getFroxelBufferUser() const { return mFroxelBufferUser; }
+
     const utils::Slice<RecordBufferType>& getRecordBufferUser() const { return mRecordBufferUser; }
 
+    const utils::Slice<ClusteredRecordBufferType>& getClusteredRecordBufferUser() const {
+        return mClusteredRecordBufferUser;
+    }
+
+    // froxelizePointAndSpotLight() uses SSE2 or NEON when available, unless disabled here.
+    // This causes all lights to be froxelized again.
+    void setSimdEnabled(bool enabled) noexcept {
+        mSimdEnabled = enabled;
+        invalidate();
+    }
+
+    // the next froxelizeLights() froxelizes all lights, not just the ones which changed
+    void invalidate() noexcept { mCacheValid = false; }
+
     // this is chosen so froxelizePointAndSpotLight() vectorizes 4 froxel tests / spotlight
     // with 256 lights this implies 8 jobs (256 / 32) for froxelization.
     using LightGroupType = uint32_t;
@@ -182,6 +230,19 @@ private:
         float invSin = std::numeric_limits<float>::infinity();
         // radius is not used in the hot loop, so leave it at the end
         float radius;
+
+        bool operator!=(LightParams const& rhs) const noexcept {
+            return position != rhs.position || cosSqr != rhs.cosSqr ||
+                   axis != rhs.axis || invSin != rhs.invSin || radius != rhs.radius;
+        }
+    };
+
+    // bounding-box of a light in froxel space. x1 points past the last value, y1 and z1 point
+    // to the last value. x0 == x1 if the light doesn't light anything.
+    struct LightBounds {
+        uint16_t x0, x1;
+        uint16_t y0, y1;
+        uint16_t z0, z1;
     };
 
     struct LightTreeNode {
@@ -203,14 +264,23 @@ private:
     void setProjection(const math::mat4f& projection, float near, float far) noexcept;
     bool update() noexcept;
 
-    void froxelizeLoop(FEngine& engine,
+    // returns false if no light changed since the last froxelization
+    bool findChangedLights(FEngine& engine,
             const CameraInfo& camera, const FScene::LightSoa& lightData) noexcept;
 
+    void froxelizeLoop(FEngine& engine, const FScene::LightSoa& lightData) noexcept;
+
     void froxelizeAssignRecordsCompress() noexcept;
 
+    void froxelizeClustered(FEngine& engine,
+            const CameraInfo& camera, const FScene::LightSoa& lightData) noexcept;
+
     void froxelizePointAndSpotLight(FroxelThreadData& froxelThread, size_t bit,
             math::mat4f const& projection, const LightParams& light) const noexcept;
 
+    LightBounds computeLightBounds(
+            math::mat4f const& projection, const LightParams& light) const noexcept;
+
     static void computeLightTree(LightTreeNode* lightTree,
             utils::Slice<RecordBufferType> const& lightList,
             const FScene::LightSoa& lightData, size_t lightRecordsOffset) noexcept;
@@ -234,14 +304,26 @@ private:
     math::float4* mPlanesX = nullptr;
     math::float4* mPlanesY = nullptr;
     math::float4* mBoundingSpheres = nullptr;
+    float* mPlanesXx = nullptr;     // x components of mPlanesX, for the SIMD kernels
+    float* mPlanesXz = nullptr;     // z components of mPlanesX, for the SIMD kernels
 
+    // kept between frames, along with the lights they were computed with
     utils::Slice<FroxelThreadData> mFroxelShardedData;  // 256 KiB w/  256 lights
+    LightParams* mCachedLights = nullptr;               //   9 KiB w/  256 lights
+    LightGroupType* mChangedLights = nullptr;           // one bit per light, by group
     utils::Slice<FroxelEntry> mFroxelBufferUser;        //  32 KiB w/ 8192 froxels
 
     // max 32 KiB  (actual: resolution dependant)
     utils::Slice<RecordBufferType> mRecordBufferUser;   //  64 KiB
+    utils::Slice<ClusteredRecordBufferType> mClusteredRecordBufferUser; // 128 KiB, clustered mode
     utils::Slice<LightRecord> mLightRecords;            // 256 KiB w/ 256 lights
 
+    // clustered mode only, these replace mFroxelShardedData and mLightRecords
+    utils::Slice<LightParams> mClusteredLights;         // 144 KiB w/ 4096 lights
+    utils::Slice<LightBounds> mClusteredBounds;         //  48 KiB w/ 4096 lights
+    utils::Slice<uint32_t> mTileOffsets;                //   2 KiB w/ 512 tiles
+    utils::Slice<ClusteredRecordBufferType> mTileRecords; // 256 KiB
+
     uint16_t mFroxelCountX = 0;
     uint16_t mFroxelCountY = 0;
     uint16_t mFroxelCountZ = 0;
@@ -255,7 +337,9 @@ private:
     float mClipToFroxelY = 0.0f;
     math::float2 mOneOverDimension = {};
     GPUBuffer mRecordsBuffer;
+    GPUBuffer mClusteredRecordsBuffer;                  // created on first use
     GPUBuffer mFroxelBuffer;
+    GPUBuffer mLightBuffer;
 
     // needed for update()
     Viewport mViewport;
@@ -265,6 +349,18 @@ private:
     float mZLightFar = FEngine::CONFIG_Z_LIGHT_FAR;
     float mZLightNear = FEngine::CONFIG_Z_LIGHT_NEAR;  // light near (first slice)
 
+    bool mSimdEnabled = true;
+
+    // mFroxelShardedData and the GPU buffers match mCachedLights
+    bool mCacheValid = false;
+    // the froxels or records changed and need to be sent to the GPU
+    bool mCommitNeeded = false;
+    // all the lights need to be froxelized again
+    bool mRebuildNeeded = false;
+    // the last prepare() was in clustered mode, and uses the 16-bits records
+    bool mClustered = false;
+    uint16_t mCachedLightCount = 0;
+
     // track if we need to update our internal state before froxelizing
     uint8_t mDirtyFlags = 0;
     enum {
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_HWRENDERPRIMITIVEFACTORY_H
+#define TNT_FILAMENT_DETAILS_HWRENDERPRIMITIVEFACTORY_H
+
+#include "private/backend/DriverApiForward.h"
+
+#include <backend/DriverEnums.h>
+#include <backend/Handle.h>
+
+#include <utils/Hash.h>
+
+#include <tsl/robin_map.h>
+
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * Shares the backend's render primitives between the renderables which draw the same geometry,
+ * so that RenderPass can recognize them by their handle and draw them as instances.
+ * Render primitives are reference counted, the factory owns them.
+ */
+class HwRenderPrimitiveFactory {
+public:
+    // everything a HwRenderPrimitive is made of. Must not have padding, it's hashed as is.
+    struct Key {
+        backend::VertexBufferHandle vbh;
+        backend::IndexBufferHandle ibh;
+        uint32_t enabledAttributes = 0;
+        uint32_t type = uint32_t(backend::PrimitiveType::NONE);
+        uint32_t offset = 0;
+        uint32_t minIndex = 0;
+        uint32_t maxIndex = 0;
+        uint32_t count = 0;
+
+        bool operator==(Key const& rhs) const noexcept {
+            return vbh == rhs.vbh && ibh == rhs.ibh &&
+                   enabledAttributes == rhs.enabledAttributes && type == rhs.type &&
+                   offset == rhs.offset && minIndex == rhs.minIndex &&
+                   maxIndex == rhs.maxIndex && count == rhs.count;
+        }
+    };
+
+    HwRenderPrimitiveFactory() noexcept;
+    ~HwRenderPrimitiveFactory() noexcept;
+
+    HwRenderPrimitiveFactory(HwRenderPrimitiveFactory const& rhs) = delete;
+    HwRenderPrimitiveFactory& operator=(HwRenderPrimitiveFactory const& rhs) = delete;
+
+    // destroys all the render primitives that haven't been released
+    void terminate(backend::DriverApi& driver) noexcept;
+
+    // Returns the render primitive for this key, it's created the first time a key is seen.
+    // Each call must be balanced by a call to release().
+    backend::RenderPrimitiveHandle acquire(backend::DriverApi& driver, Key const& key) noexcept;
+
+    // Releases a reference to the render primitive of this key, the last one destroys it.
+    void release(backend::DriverApi& driver, Key const& key) noexcept;
+
+    // number of distinct render primitives
+    size_t getSize() const noexcept { return mEntries.size(); }
+
+private:
+    struct Entry {
+        backend::RenderPrimitiveHandle handle;
+        uint32_t refs;
+    };
+    tsl::robin_map<Key, Entry, utils::hash::MurmurHashFn<Key>> mEntries;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_HWRENDERPRIMITIVEFACTORY_H
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_OCCLUSIONCULLER_H
+#define TNT_FILAMENT_DETAILS_OCCLUSIONCULLER_H
+
+#include "details/Culler.h"
+
+#include <utils/compiler.h>
+
+#include <math/mat3x4.h>
+#include <math/mat4.h>
+#include <math/vec3.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace utils {
+class JobSystem;
+}
+
+namespace filament {
+namespace details {
+
+/*
+ * A software occlusion culler.
+ *
+ * Occluders (simplified meshes provided by the application) are rasterized on the CPU into a
+ * low resolution depth buffer, which is then reduced into a hierarchical depth buffer holding
+ * the farthest occluder depth of each tile. A box is occluded when its nearest point is behind
+ * the farthest occluder of all the tiles its screen-space bounds touch.
+ *
+ * Depth is the NDC z (i.e. smaller is closer). Triangles crossing the near plane are skipped
+ * and boxes crossing it are always visible, which keeps the result conservative.
+ */
+class OcclusionCuller {
+public:
+    // resolution of the depth buffer, in pixels
+    static constexpr size_t WIDTH = 256;
+    static constexpr size_t HEIGHT = 128;
+
+    // size of the tiles of the hierarchical depth buffer, in pixels. Each rasterization job
+    // processes one row of tiles.
+    static constexpr size_t TILE_SIZE = 8;
+    static constexpr size_t TILE_COUNT_X = WIDTH / TILE_SIZE;
+    static constexpr size_t TILE_COUNT_Y = HEIGHT / TILE_SIZE;
+
+    OcclusionCuller() noexcept;
+    ~OcclusionCuller() noexcept;
+
+    OcclusionCuller(OcclusionCuller const& rhs) = delete;
+    OcclusionCuller& operator=(OcclusionCuller const& rhs) = delete;
+
+    // Starts a new frame, forgetting all occluders. 'viewProjection' transforms world-space
+    // to clip-space.
+    void begin(math::mat4f const& viewProjection) noexcept;
+
+    // Adds an indexed triangle list, 'world' transforms its vertices to world-space.
+    void addOccluder(math::mat3x4f const& world,
+            math::float3 const* vertices, size_t vertexCount,
+            uint16_t const* indices, size_t indexCount);
+
+    // Rasterizes the occluders added since begin() and builds the hierarchical depth buffer.
+    void rasterize(utils::JobSystem& js) noexcept;
+
+    // Clears bit 'bit' of results[i] for each box i which has it set and is occluded.
+    void cull(utils::JobSystem& js, Culler::result_type* results,
+            math::float3 const* center, math::float3 const* extent,
+            size_t count, size_t bit) const noexcept;
+
+    // Returns whether a box is hidden by the occluders, rasterize() must have been called.
+    bool isOccluded(math::float3 const& center, math::float3 const& extent) const noexcept;
+
+    // number of occluder triangles that will be rasterized
+    size_t getTriangleCount() const noexcept { return mTriangles.size(); }
+
+private:
+    struct Triangle {
+        // edge functions, for each edge: a * x + b * y + c >= 0 inside the triangle
+        math::float3 edges[3];
+        // depth plane: z = a * x + b * y + c
+        math::float3 depth;
+        // bounds in pixels, inclusive
+        int32_t xmin, ymin, xmax, ymax;
+    };
+
+    void rasterizeTileRow(uint32_t row) noexcept;
+
+    math::mat4f mViewProjection;
+    std::vector<math::float4> mClipVertices;
+    std::vector<Triangle> mTriangles;
+    std::vector<float> mDepth;  // WIDTH * HEIGHT, depth of the nearest occluder
+    std::vector<float> mHiZ;    // TILE_COUNT_X * TILE_COUNT_Y, depth of the farthest occluder
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_OCCLUSIONCULLER_H
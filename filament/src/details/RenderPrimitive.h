@@ -19,6 +19,7 @@
 
 #include "components/RenderableManager.h"
 
+#include "details/HwRenderPrimitiveFactory.h"
 #include "details/MaterialInstance.h"
 
 #include <backend/Handle.h>
@@ -37,7 +38,7 @@ class FRenderPrimitive {
 public:
     FRenderPrimitive() noexcept = default;
 
-    void init(backend::DriverApi& driver, const RenderableManager::Builder::Entry& entry) noexcept;
+    void init(FEngine& engine, const RenderableManager::Builder::Entry& entry) noexcept;
 
     void set(FEngine& engine, RenderableManager::PrimitiveType type,
             FVertexBuffer* vertices, FIndexBuffer* indices, size_t offset,
@@ -49,6 +50,8 @@ public:
     // frees driver resources, object becomes invalid
     void terminate(FEngine& engine);
 
+    // Primitives drawing the same geometry share their handle, see HwRenderPrimitiveFactory.
+
     const FMaterialInstance* getMaterialInstance() const noexcept { return mMaterialInstance; }
     backend::Handle<backend::HwRenderPrimitive> getHwHandle() const noexcept { return mHandle; }
     backend::PrimitiveType getPrimitiveType() const noexcept { return mPrimitiveType; }
@@ -61,8 +64,11 @@ public:
     }
 
 private:
+    void setKey(FEngine& engine, HwRenderPrimitiveFactory::Key const& key) noexcept;
+
     FMaterialInstance const* mMaterialInstance = nullptr;
     backend::Handle<backend::HwRenderPrimitive> mHandle;
+    HwRenderPrimitiveFactory::Key mKey;
     backend::PrimitiveType mPrimitiveType = backend::PrimitiveType::NONE;
     AttributeBitset mEnabledAttributes;
     uint16_t mBlendOrder = 0;
@@ -22,6 +22,7 @@
 #include "components/RenderableManager.h"
 #include "components/TransformManager.h"
 
+#include "details/BoundingVolumeHierarchy.h"
 #include "details/Culler.h"
 
 #include "Allocators.h"
@@ -34,11 +35,19 @@
 #include <utils/Slice.h>
 #include <utils/StructureOfArrays.h>
 #include <utils/Range.h>
+#include <utils/JobSystem.h>
+#include <utils/Mutex.h>
 
 #include <cstddef>
+#include <utility>
+#include <vector>
+
 #include <tsl/robin_set.h>
 
 namespace filament {
+
+class GPUBuffer;
+
 namespace details {
 
 struct CameraInfo;
@@ -69,6 +78,9 @@ public:
     size_t getLightCount() const noexcept;
     bool hasEntity(utils::Entity entity) const noexcept;
 
+    void setHierarchicalCullingEnabled(bool enabled) noexcept;
+    bool isHierarchicalCullingEnabled() const noexcept { return mHierarchicalCulling; }
+
 public:
     /*
      * Filaments-scope Public API
@@ -82,8 +94,9 @@ public:
     ~FScene() noexcept;
     void terminate(FEngine& engine);
 
-    void prepare(const math::mat4f& worldOriginTransform);
-    void prepareDynamicLights(const CameraInfo& camera, ArenaScope& arena, backend::Handle<backend::HwUniformBuffer> lightUbh) noexcept;
+    void prepare(utils::JobSystem& js, const math::mat4f& worldOriginTransform);
+    void prepareDynamicLights(const CameraInfo& camera, ArenaScope& arena,
+            backend::Handle<backend::HwUniformBuffer> lightUbh, GPUBuffer& lightBuffer) noexcept;
 
 
     filament::backend::Handle<backend::HwUniformBuffer> getRenderableUBO() const noexcept {
@@ -96,15 +109,18 @@ public:
 
     enum {
         RENDERABLE_INSTANCE,    //  4 instance of the Renderable component
-        WORLD_TRANSFORM,        // 16 instance of the Transform component
+        WORLD_TRANSFORM,        // 48 affine world transform of the renderable
+        WORLD_NORMAL,           // 36 normal matrix of the world transform, see computeNormals()
         VISIBILITY_STATE,       //  1 visibility data of the component
-        BONES_UBH,              //  4 bones uniform buffer handle
+        BONES_OFFSET,           //  4 offset of the bones in the bone palette
         WORLD_AABB_CENTER,      // 12 world-space bounding box center of the renderable
         VISIBLE_MASK,           //  1 each bit represents a visibility in a pass
 
         // These are not needed anymore after culling
         LAYERS,                 //  1 layers
         WORLD_AABB_EXTENT,      // 12 world-space bounding box half-extent of the renderable
+        TRANSFORM_INSTANCE,     //  4 instance of the Transform component
+        LEVEL_OF_DETAIL,        //  1 level of detail selected during culling
 
         // These are temporaries and should be stored out of line
         PRIMITIVES,             //  8 level-of-detail'ed primitives
@@ -113,13 +129,16 @@ public:
 
     using RenderableSoa = utils::StructureOfArrays<
             utils::EntityInstance<RenderableManager>,
-            math::mat4f,
+            math::mat3x4f,
+            math::mat3f,
             FRenderableManager::Visibility,
-            backend::Handle<backend::HwUniformBuffer>,
+            uint32_t,
             math::float3,
             Culler::result_type,
             uint8_t,
             math::float3,
+            FTransformManager::Instance,
+            uint8_t,
             utils::Slice<FRenderPrimitive>,
             uint32_t
     >;
@@ -148,7 +167,8 @@ public:
         DIRECTION,
         LIGHT_INSTANCE,
         VISIBILITY,
-        SCREEN_SPACE_Z_RANGE
+        SCREEN_SPACE_Z_RANGE,
+        SHADOW_INFO             // shadow atlas tile (or -1), normal bias, see LightsUib
     };
 
     using LightSoa = utils::StructureOfArrays<
@@ -156,6 +176,7 @@ public:
             math::float3,
             FLightManager::Instance,
             Culler::result_type,
+            math::float2,
             math::float2
     >;
 
@@ -164,7 +185,67 @@ public:
 
     void updateUBOs(utils::Range<uint32_t> visibleRenderables, backend::Handle<backend::HwUniformBuffer> renderableUbh) noexcept;
 
+    // Writes the PerRenderableUib of the given renderables to 'buffer', which must be at least
+    // getPerRenderableUboSize(visibleRenderables.size()) bytes.
+    void writeUBOs(void* buffer, utils::Range<uint32_t> visibleRenderables) const noexcept;
+
+    // Every draw binds the whole ObjectUniforms block, i.e. CONFIG_MAX_INSTANCES entries starting
+    // at its first instance, so buffers of PerRenderableUib need that many minus one extra entries.
+    static size_t getPerRenderableUboSize(size_t count) noexcept;
+
+    // Writes the PerRenderableUib of a renderable with the given world transform and its normal
+    // matrix at 'offset'.
+    static void setPerRenderableUniforms(void* buffer, size_t offset,
+            math::mat3x4f const& model, math::mat3f const& normal) noexcept;
+
+    // Returns the normal matrix of a transform of type RIGID or UNIFORM_SCALE, i.e. its rotation.
+    static math::mat3f getNormalMatrix(math::mat3x4f const& model,
+            FTransformManager::TransformType type) noexcept;
+
+    // Computes the normal matrix of transforms of any type, i.e. the inverse-transpose of their
+    // linear part, pre-scaled by the inverse of its largest scale factor.
+    static void computeNormals(math::mat3f* UTILS_RESTRICT normals,
+            math::mat3x4f const* UTILS_RESTRICT models, size_t count) noexcept;
+
+    // The culling hierarchy references renderables by their index in RenderableSoa, it's only
+    // valid between prepare() and the moment the SoA is re-ordered. The hierarchy is expressed
+    // in world space, i.e. without the world origin transform applied.
+    // Returns nullptr if hierarchical culling is disabled.
+    BoundingVolumeHierarchy const* getCullingHierarchy() const noexcept {
+        return mHierarchicalCulling ? &mCullingHierarchy : nullptr;
+    }
+
+    // the world origin transform used by the last call to prepare()
+    math::mat4f const& getWorldOrigin() const noexcept { return mWorldOrigin; }
+
+    // number of RenderableSoa rows written by the last call to prepare()
+    size_t getRowsTouched() const noexcept { return mRowsTouched; }
+
+    // Bounds of the renderables changed by the last call to prepare(), both before and after the
+    // change, in world space with the world origin applied. This is only valid when
+    // hasChangedAll() is false, otherwise (e.g. the scene was rebuilt or the world origin moved)
+    // all renderables must be considered changed.
+    bool hasChangedAll() const noexcept { return mChangedAll; }
+    std::vector<Aabb> const& getChangedBounds() const noexcept { return mChangedBounds; }
+
+    // Whether a static shadow caster (see RenderableManager::Builder::staticShadowCaster()) was
+    // changed by the last call to prepare(), this includes hasChangedAll().
+    bool hasChangedStaticCasters() const noexcept { return mChangedStaticCasters; }
+
+    // Number of calls to prepare(). The changes above are only complete for a caller that saw
+    // every call, e.g. a scene shared by several views is prepared once per view.
+    uint32_t getPrepareCount() const noexcept { return mPrepareCount; }
+
 private:
+    // number of entities processed per job in prepare()
+    static constexpr size_t PREPARE_CHUNK_SIZE = 256;
+
+    size_t gatherEntities(utils::JobSystem& js, const math::mat4f& worldOriginTransform);
+    size_t updateRenderables(utils::JobSystem& js,
+            const math::mat4f& worldOriginTransform) noexcept;
+    void prepareLights(const math::mat4f& worldOriginTransform) noexcept;
+    void updateCullingHierarchy(bool rebuilt) noexcept;
+
     static inline void computeLightRanges(math::float2* zrange,
             CameraInfo const& camera, const math::float4* spheres, size_t count) noexcept;
 
@@ -192,6 +273,47 @@ private:
     RenderableSoa mRenderableData;
     LightSoa mLightData;
     backend::Handle<backend::HwUniformBuffer> mRenderableViewUbh; // This is actually owned by the view.
+    math::mat4f mWorldOrigin;
+
+    /*
+     * prepare() only updates the rows of mRenderableData that changed since the last call,
+     * i.e. since the generations below. mLights caches the scene's lights and their transform.
+     */
+    using LightInstances = std::pair<FLightManager::Instance, FTransformManager::Instance>;
+    std::vector<LightInstances> mLights;
+    uint32_t mRenderableGeneration = 0;
+    uint32_t mTransformGeneration = 0;
+    uint32_t mLightGeneration = 0;
+    bool mEntitiesChanged = true;
+    size_t mRowsTouched = 0;
+    bool mChangedAll = true;
+    bool mChangedStaticCasters = true;
+    uint32_t mPrepareCount = 0;
+    std::vector<Aabb> mChangedBounds;   // one entry per job of updateRenderables()
+    utils::Mutex mChangedBoundsLock;
+
+    // scratch storage for gatherEntities()
+    struct Chunk {
+        uint32_t renderables;
+        uint32_t lights;
+    };
+    std::vector<utils::Entity> mEntityList;
+    std::vector<LightInstances> mLightScratch;
+    std::vector<Chunk> mChunks;
+
+    /*
+     * Hierarchical culling data. The world-space (i.e. without the world origin) AABBs are
+     * kept separately from RenderableSoa, so that the hierarchy doesn't need to be refit when
+     * only the world origin changes (e.g. when the camera moves).
+     */
+    bool mHierarchicalCulling = false;
+    BoundingVolumeHierarchy mCullingHierarchy;
+    std::vector<math::float3> mCullingAABBCenter;
+    std::vector<math::float3> mCullingAABBExtent;
+    std::vector<utils::EntityInstance<RenderableManager>> mCullingHierarchyInstances;
+    std::vector<uint32_t> mCullingBoxes;        // renderable instance -> box
+    std::vector<uint32_t> mCullingRows;         // box -> row in mRenderableData
+    std::vector<uint8_t> mCullingDirtyRows;     // rows whose box changed in prepare()
 };
 
 FILAMENT_UPCAST(Scene)
@@ -33,39 +33,56 @@
 namespace filament {
 namespace details {
 
-class FView;
-class RenderPass;
-
+/*
+ * The shadow map of a light, or of one of the cascades of a directional light. The shadow map
+ * texture and its render targets are owned by ShadowMapManager.
+ */
 class ShadowMap {
 public:
     explicit ShadowMap(FEngine& engine) noexcept;
     ~ShadowMap();
 
-    void terminate(backend::DriverApi& driverApi) noexcept;
-
     // Call once per frame if the light, scene (or visible layers) or camera changes.
-    // This computes the light's camera.
+    // This computes the light's camera. The shadow map covers the part of the camera's
+    // frustum between the distances zn and zf.
     void update(const FScene::LightSoa& lightData, size_t index, FScene const* scene,
-            details::CameraInfo const& camera, uint8_t visibleLayers) noexcept;
-
-    void render(backend::DriverApi& driver, RenderPass& pass, FView& view) noexcept;
+            details::CameraInfo const& camera, uint8_t visibleLayers,
+            float zn, float zf) noexcept;
+
+    // Computes the light's camera of a spot light, or of one face of the cube map of a point
+    // light: a perspective frustum from 'position' towards 'direction', with a half field of
+    // view of 'halfAngle', ending at the light's radius. The shadow map is the tile of the given
+    // dimension at 'tileOrigin' in the shadow atlas, its viewport is set-up as well (there is no
+    // need to call prepare()).
+    void updatePunctual(FLightManager::ShadowParams const& params,
+            math::float3 const& position, math::float3 const& direction, math::float3 const& up,
+            float halfAngle, float radius, uint32_t dimension,
+            math::uint2 tileOrigin, uint32_t atlasDimension) noexcept;
 
     // Do we have visible shadows. Valid after calling update().
     bool hasVisibleShadows() const noexcept { return mHasVisibleShadows; }
 
-    // Allocates shadow texture based on user parameters (e.g. dimensions)
-    void prepare(backend::DriverApi& driver, backend::SamplerGroup& buffer) noexcept;
+    // Computes the viewport and resolution of the shadow map for a texture of the given format.
+    // Call after update().
+    void prepare(backend::TextureFormat format) noexcept;
+
+    // Returns the shadow map's dimension, in texels. Valid after calling update().
+    uint32_t getDimension() const noexcept { return mShadowMapDimension; }
 
     // Returns the shadow map's viewport. Valid after prepare().
     Viewport const& getViewport() const noexcept { return mViewport; }
 
-    backend::Handle<backend::HwRenderTarget> getRenderTarget() const { return mShadowMapRenderTarget; }
+    backend::PolygonOffset const& getPolygonOffset() const noexcept { return mPolygonOffset; }
+
+    // Returns the camera to render the shadow casters with. Valid after calling update().
+    details::CameraInfo getCameraInfo() const noexcept;
 
     // Computes the transform to use in the shader to access the shadow map.
     // Valid after calling update().
     math::mat4f const& getLightSpaceMatrix() const noexcept { return mLightSpace; }
 
-    // return the size of a texel in world space (pre-warping)
+    // return the size of a texel in world space (pre-warping). For the punctual lights, this is
+    // the size of a texel at a distance of 1 from the light.
     float getTexelSizeWorldSpace() const noexcept { return mTexelSizeWs; }
 
     // Returns the light's projection. Valid after calling update().
@@ -172,8 +189,6 @@ private:
     float texelSizeWorldSpace(const math::mat3f& worldToShadowTexture) const noexcept;
     float texelSizeWorldSpace(const math::mat4f& W, const math::mat4f& MbMtF) const noexcept;
 
-    void fillWithDebugPattern(backend::DriverApi& driverApi) const noexcept;
-
     static constexpr const Segment sBoxSegments[12] = {
             { 0, 1 }, { 1, 3 }, { 3, 2 }, { 2, 0 },
             { 4, 5 }, { 5, 7 }, { 7, 6 }, { 6, 4 },
@@ -195,8 +210,6 @@ private:
 
     // set-up in prepare()
     Viewport mViewport;
-    backend::Handle<backend::HwTexture> mShadowMapHandle;
-    backend::Handle<backend::HwRenderTarget> mShadowMapRenderTarget;
 
     // set-up in update()
     uint32_t mShadowMapDimension = 0;
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_SHADOWMAPMANAGER_H
+#define TNT_FILAMENT_DETAILS_SHADOWMAPMANAGER_H
+
+#include "details/Allocators.h"
+#include "details/Camera.h"
+#include "details/Scene.h"
+#include "details/ShadowMap.h"
+
+#include "private/backend/DriverApiForward.h"
+#include "private/backend/SamplerGroup.h"
+
+#include <private/filament/EngineEnums.h>
+
+#include <filament/Frustum.h>
+
+#include <backend/DriverEnums.h>
+#include <backend/Handle.h>
+
+#include <math/vec4.h>
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+class FView;
+class RenderPass;
+
+/*
+ * Cascaded shadow maps of the directional light, and shadow atlas of the point and spot lights.
+ *
+ * The view frustum is split along its z axis in up to CONFIG_MAX_SHADOW_CASCADES cascades, each
+ * with its own ShadowMap. All the cascades are rendered in the layers of a single texture array.
+ * A single cascade behaves like a regular shadow map.
+ *
+ * Optionally (see ShadowOptions::cacheStaticCasters), the static shadow casters of each cascade
+ * are rendered in a persistent texture array, which is copied in the cascade before the other
+ * shadow casters are rendered. They're only rendered again when the cascade's projection or one
+ * of them changed.
+ *
+ * The point and spot lights that cast shadows share a single texture, the shadow atlas, in which
+ * each one gets a square tile (six for a point light, one per face of its cube map) sized after
+ * the light's size on screen. The atlas persists across frames: a tile is only rendered again
+ * when its light or the casters around the light changed.
+ */
+class ShadowMapManager {
+public:
+    explicit ShadowMapManager(FEngine& engine) noexcept;
+    ~ShadowMapManager();
+
+    void terminate(backend::DriverApi& driver) noexcept;
+
+    // Call once per frame. Computes the split distances of the cascades of the given light and
+    // the light's camera of each cascade.
+    void update(const FScene::LightSoa& lightData, size_t index, FScene const* scene,
+            details::CameraInfo const& camera, uint8_t visibleLayers) noexcept;
+
+    // Call once per frame, before the lights are culled. Selects the point and spot lights that
+    // cast shadows, by decreasing size on screen, allocates their tiles in the shadow atlas and
+    // computes the light's camera of each tile. The SHADOW_INFO of the selected lights is set.
+    // Returns whether any light has shadows.
+    bool updatePunctual(FScene::LightSoa& lightData, details::CameraInfo const& camera,
+            Frustum const& frustum, uint32_t viewportHeight) noexcept;
+
+    // Allocates the shadow map texture array, one layer per cascade, the shadow atlas and their
+    // render targets. Both textures are sampled by the shadow receivers, so the unused one is
+    // kept as a 1x1 placeholder. Call after update() and updatePunctual().
+    void prepare(backend::DriverApi& driver, backend::SamplerGroup& sb,
+            bool hasCascades, bool hasPunctualShadows) noexcept;
+
+    // Renders the shadow casters of each cascade in its layer. The commands of the cascades are
+    // generated in parallel, in batches of as many as fit in the pass' commands buffer. Then
+    // renders the tiles of the shadow atlas that changed.
+    void render(ArenaScope& arena, backend::DriverApi& driver, RenderPass& pass,
+            FView& view) noexcept;
+
+    // Number of tiles in the shadow atlas. Valid after calling updatePunctual().
+    size_t getTileCount() const noexcept { return mTileCount; }
+
+    ShadowMap const& getTile(size_t i) const noexcept { return *mTiles[i]; }
+
+    // Number of point and spot lights with shadows. Valid after calling updatePunctual().
+    size_t getPunctualShadowCount() const noexcept { return mPunctualShadows.size(); }
+
+    // The frustum containing the shadow casters of the i-th light with shadows.
+    Frustum const& getPunctualShadowFrustum(size_t i) const noexcept {
+        return mPunctualShadows[i].frustum;
+    }
+
+    // Packs square tiles in an atlas of dimension 'atlasDimension'. The tiles of a light must be
+    // consecutive and the lights sorted by decreasing priority. While the tiles don't fit, the
+    // dimension of the lights with the largest tiles is halved, starting with the lowest
+    // priority, down to 'minDimension'. Past that, the lowest priority lights are dropped.
+    // All dimensions must be powers of two. 'dimensions' is updated and the origin of each tile
+    // is written to 'origins'. Returns the number of lights that fit.
+    static size_t packAtlas(uint32_t* dimensions, uint8_t const* tileCounts, size_t count,
+            uint32_t atlasDimension, uint32_t minDimension, math::uint2* origins) noexcept;
+
+    // Do we have visible shadows in any cascade. Valid after calling update().
+    bool hasVisibleShadows() const noexcept { return mHasVisibleShadows; }
+
+    // Number of cascades. Valid after calling update().
+    size_t getCascadeCount() const noexcept { return mCascadeCount; }
+
+    ShadowMap const& getCascade(size_t i) const noexcept { return *mCascades[i]; }
+
+    // View-space z of the far plane of each cascade, the unused cascades are set to the lowest
+    // float. Valid after calling update().
+    math::float4 const& getCascadeSplits() const noexcept { return mCascadeSplits; }
+
+    // use only for debugging
+    FCamera const& getDebugCamera() const noexcept { return mCascades[0]->getDebugCamera(); }
+
+    // dimension of the shadow atlas and of its smallest tiles
+    static constexpr uint32_t ATLAS_DIMENSION = 2048;
+    static constexpr uint32_t MIN_TILE_DIMENSION = 64;
+
+private:
+    // a point or spot light with shadows
+    struct PunctualShadow {
+        FLightManager::Instance li;
+        math::float4 sphere;        // position and radius of the light
+        math::float3 direction;
+        float halfAngle;            // half angle of the spot light's cone, or 0 for a cube map
+        float priority;             // projected size of the light, in pixels
+        uint32_t dimension;         // dimension of the light's tiles
+        uint8_t tileCount;          // 1 for a spot light, 6 for a cube map
+        uint8_t firstTile;
+        uint32_t index;             // in the light data, valid in updatePunctual() only
+        Frustum frustum;            // contains the shadow casters
+    };
+
+    // what the content of a tile, or of the static casters of a cascade, depends on, beside the
+    // shadow casters
+    struct TileState {
+        FLightManager::Instance li;
+        filament::Viewport viewport;
+        math::mat4f lightSpace;
+        backend::PolygonOffset polygonOffset;
+        uint8_t visibleLayers;
+    };
+
+    void fillWithDebugPattern(backend::DriverApi& driver) const noexcept;
+
+    void createTexture(backend::DriverApi& driver, uint32_t dim, uint32_t layers) noexcept;
+
+    void createAtlas(backend::DriverApi& driver, uint32_t dim) noexcept;
+
+    void createStaticTexture(backend::DriverApi& driver, uint32_t dim, uint32_t layers) noexcept;
+
+    void destroyStaticTexture(backend::DriverApi& driver) noexcept;
+
+    // Renders the static casters of the cascades that changed in the static texture. Returns the
+    // cascades that start from a copy of their static casters, which are removed from them.
+    uint8_t renderStaticCasters(backend::DriverApi& driver, RenderPass& pass,
+            FView& view) noexcept;
+
+    void renderCascades(ArenaScope& arena, backend::DriverApi& driver, RenderPass& pass,
+            FView& view) noexcept;
+
+    void renderAtlas(backend::DriverApi& driver, RenderPass& pass, FView& view) noexcept;
+
+    FEngine& mEngine;
+
+    // whether the backend can render into a layer of a texture array
+    const bool mHasLayeredRenderTargets;
+
+    // whether the backend limits the clears to the viewport, which is needed to render some
+    // tiles of the atlas only
+    const bool mHasScissoredClears;
+
+    // whether the backend can copy depth buffers, which is needed to cache the static casters
+    const bool mHasDepthBlits;
+
+    // set-up in update()
+    std::array<std::unique_ptr<ShadowMap>, CONFIG_MAX_SHADOW_CASCADES> mCascades;
+    size_t mCascadeCount = 0;
+    math::float4 mCascadeSplits{};
+    bool mHasVisibleShadows = false;
+    FLightManager::Instance mCascadeLight;
+    bool mCacheStaticCasters = false;
+
+    // set-up in prepare()
+    backend::Handle<backend::HwTexture> mTexture;
+    std::array<backend::Handle<backend::HwRenderTarget>, CONFIG_MAX_SHADOW_CASCADES> mRenderTargets;
+    uint32_t mTextureDimension = 0;
+    uint32_t mTextureLayers = 0;
+
+    // set-up in updatePunctual()
+    std::vector<PunctualShadow> mPunctualShadows;
+    std::array<std::unique_ptr<ShadowMap>, CONFIG_MAX_SHADOW_ATLAS_TILES> mTiles;
+    std::array<uint8_t, CONFIG_MAX_SHADOW_ATLAS_TILES> mTileLights{};   // index of the light
+    size_t mTileCount = 0;
+
+    // set-up in prepare()
+    backend::Handle<backend::HwTexture> mAtlasTexture;
+    backend::Handle<backend::HwRenderTarget> mAtlasRenderTarget;
+    uint32_t mAtlasDimension = 0;
+
+    // state of the tiles when they were last rendered, invalid after the atlas is created
+    std::array<TileState, CONFIG_MAX_SHADOW_ATLAS_TILES> mTileStates{};
+    size_t mRenderedTileCount = 0;
+    FScene const* mRenderedScene = nullptr;
+    uint32_t mRenderedScenePrepareCount = 0;
+    bool mAtlasValid = false;
+
+    // set-up in prepare(), when the static casters are cached
+    backend::Handle<backend::HwTexture> mStaticTexture;
+    std::array<backend::Handle<backend::HwRenderTarget>, CONFIG_MAX_SHADOW_CASCADES>
+            mStaticRenderTargets;
+
+    // state of the static casters of each cascade when they were last rendered
+    std::array<TileState, CONFIG_MAX_SHADOW_CASCADES> mStaticStates{};
+    std::array<bool, CONFIG_MAX_SHADOW_CASCADES> mStaticValid{};
+    FScene const* mStaticScene = nullptr;
+    uint32_t mStaticScenePrepareCount = 0;
+    std::vector<uint8_t> mStaticLevels;     // level of detail of the static casters, by instance
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_SHADOWMAPMANAGER_H
@@ -21,14 +21,16 @@
 
 #include "upcast.h"
 
+#include "RenderPass.h"
 #include "UniformBuffer.h"
 
 #include "details/Allocators.h"
 #include "details/Camera.h"
 #include "details/Froxelizer.h"
+#include "details/OcclusionCuller.h"
 #include "details/RenderTarget.h"
-#include "details/ShadowMap.h"
 #include "details/Scene.h"
+#include "details/ShadowMapManager.h"
 
 #include "private/backend/DriverApi.h"
 
@@ -103,6 +105,14 @@ public:
     void setFrustumCullingEnabled(bool culling) noexcept { mCulling = culling; }
     bool isFrustumCullingEnabled() const noexcept { return mCulling; }
 
+    void setOcclusionCullingEnabled(bool enabled) noexcept { mOcclusionCulling = enabled; }
+    bool isOcclusionCullingEnabled() const noexcept { return mOcclusionCulling; }
+
+    void setScreenSizeCullingThreshold(float pixels) noexcept {
+        mScreenSizeCullingThreshold = std::max(0.0f, pixels);
+    }
+    float getScreenSizeCullingThreshold() const noexcept { return mScreenSizeCullingThreshold; }
+
     void setFrontFaceWindingInverted(bool inverted) noexcept { mFrontFaceWindingInverted = inverted; }
     bool isFrontFaceWindingInverted() const noexcept { return mFrontFaceWindingInverted; }
 
@@ -123,7 +133,7 @@ public:
 
     void prepareCamera(const CameraInfo& camera, const Viewport& viewport) const noexcept;
     void prepareShadowing(FEngine& engine, backend::DriverApi& driver,
-            FScene::RenderableSoa& renderableData, FScene::LightSoa const& lightData) noexcept;
+            FScene::LightSoa const& lightData) noexcept;
     void prepareLighting(FEngine& engine, FEngine::DriverApi& driver,
             ArenaScope& arena, Viewport const& viewport) noexcept;
     void prepareSSAO(backend::Handle<backend::HwTexture> ssao) const noexcept;
@@ -134,7 +144,18 @@ public:
 
     bool hasDirectionalLight() const noexcept { return mHasDirectionalLight; }
     bool hasDynamicLighting() const noexcept { return mHasDynamicLighting; }
-    bool hasShadowing() const noexcept { return mHasShadowing & mDirectionalShadowMap.hasVisibleShadows(); }
+    bool hasShadowing() const noexcept { return mHasShadowing & mShadowMapManager.hasVisibleShadows(); }
+    bool hasPunctualShadowing() const noexcept { return mHasPunctualShadowing; }
+
+    // After culling, the shadow casters of cascade 'i' have the bit
+    // 'VISIBLE_SHADOW_CASCADE_BIT + i' set in the scene's VISIBLE_MASK.
+    static constexpr size_t VISIBLE_SHADOW_CASCADE_BIT = 2u;
+
+    // After culling, the shadow casters of the point and spot lights have the bit
+    // VISIBLE_PUNCTUAL_SHADOW_CASTER_BIT set. VISIBLE_SHADOW_TILE_BIT is free, it's used to
+    // cull the shadow casters of each tile of the shadow atlas.
+    static constexpr size_t VISIBLE_PUNCTUAL_SHADOW_CASTER_BIT = 6u;
+    static constexpr size_t VISIBLE_SHADOW_TILE_BIT = 7u;
 
     void updatePrimitivesLod(
             FEngine& engine, const CameraInfo& camera,
@@ -142,11 +163,11 @@ public:
 
     void setShadowsEnabled(bool enabled) noexcept { mShadowingEnabled = enabled; }
 
-    ShadowMap const& getShadowMap() const { return mDirectionalShadowMap; }
-    ShadowMap& getShadowMap() { return mDirectionalShadowMap; }
+    ShadowMapManager const& getShadowMapManager() const { return mShadowMapManager; }
+    ShadowMapManager& getShadowMapManager() { return mShadowMapManager; }
 
     FCamera const* getDirectionalLightCamera() const noexcept {
-        return &mDirectionalShadowMap.getDebugCamera();
+        return &mShadowMapManager.getDebugCamera();
     }
 
     void setRenderTarget(FRenderTarget* renderTarget, TargetBufferFlags discard) noexcept {
@@ -234,6 +255,21 @@ public:
         return mDepthPrepass;
     }
 
+    void setCommandCachingEnabled(bool enabled) noexcept {
+        mCommandCaching = enabled;
+        if (!enabled) {
+            mCommandCache.clear();
+        }
+    }
+
+    bool isCommandCachingEnabled() const noexcept {
+        return mCommandCaching;
+    }
+
+    RenderPass::CommandCache* getCommandCache() noexcept {
+        return mCommandCaching ? &mCommandCache : nullptr;
+    }
+
     void setAmbientOcclusion(AmbientOcclusion ambientOcclusion) noexcept {
         mAmbientOcclusion = ambientOcclusion;
     }
@@ -279,18 +315,41 @@ public:
 private:
     static constexpr size_t MAX_FRAMETIME_HISTORY = 32u;
 
-    void prepareVisibleRenderables(utils::JobSystem& js,
-            Frustum const& frustum, FScene::RenderableSoa& renderableData) const noexcept;
+    // parameters of the screen-size culling and of the level of detail selection
+    struct ScreenSizeParams {
+        FRenderableManager const* rcm;
+        math::float3 position;  // position of the camera
+        float scale;            // the projected diameter, in pixels, is radius * scale / distance
+        float threshold;        // renderables smaller than this, in pixels, are culled
+        bool perspective;       // with an orthographic projection the distance is 1
+    };
 
-    static void prepareVisibleShadowCasters(utils::JobSystem& js,
-            Frustum const& lightFrustum, FScene::RenderableSoa& renderableData) noexcept;
+    void prepareVisibleRenderables(utils::JobSystem& js, Frustum const& frustum,
+            ScreenSizeParams const* screenSize, FScene& scene) const noexcept;
+
+    void prepareOcclusionCulling(FEngine& engine, utils::JobSystem& js,
+            math::mat4f const& viewProjection, FScene& scene) noexcept;
 
     static void prepareVisibleLights(
             FLightManager const& lcm, utils::JobSystem& js, Frustum const& frustum,
             FScene::LightSoa& lightData) noexcept;
 
-    static void cullRenderables(utils::JobSystem& js,
-            FScene::RenderableSoa& renderableData, Frustum const& frustum, size_t bit) noexcept;
+    // culls the scene's renderables against all the frustums at once, frustums[i] sets
+    // bit 'bit + i' of the scene's VISIBLE_MASK. The screen-size culling and level of detail
+    // selection are done in the same pass, if 'screenSize' is set.
+    static void cullRenderables(utils::JobSystem& js, FScene& scene,
+            Frustum const* frustums, size_t frustumCount, size_t bit,
+            ScreenSizeParams const* screenSize = nullptr) noexcept;
+
+    // culls the scene's renderables against the frustums of the point and spot lights with
+    // shadows, all of them set the same 'bit' of the scene's VISIBLE_MASK
+    static void cullPunctualShadowCasters(utils::JobSystem& js, FScene& scene,
+            ShadowMapManager const& shadowMapManager, size_t bit) noexcept;
+
+    // culls the renderables [first, first + count) that are too small on screen and selects
+    // their level of detail
+    static void applyScreenSize(ScreenSizeParams const& params,
+            FScene::RenderableSoa& renderableData, uint32_t first, uint32_t count) noexcept;
 
     void computeVisibilityMasks(
             uint8_t visibleLayers, uint8_t const* layers,
@@ -327,9 +386,13 @@ private:
 
     mutable Froxelizer mFroxelizer;
 
+    OcclusionCuller mOcclusionCuller;
+
     Viewport mViewport;
     LinearColorA mClearColor;
     bool mCulling = true;
+    bool mOcclusionCulling = false;
+    float mScreenSizeCullingThreshold = 0.0f;
     bool mFrontFaceWindingInverted = false;
     bool mClearTargetColor = true;
     bool mClearTargetDepth = true;
@@ -346,6 +409,8 @@ private:
     bool mShadowingEnabled = true;
     bool mHasPostProcessPass = true;
     DepthPrepass mDepthPrepass = DepthPrepass::DEFAULT;
+    bool mCommandCaching = false;
+    RenderPass::CommandCache mCommandCache;
     AmbientOcclusion mAmbientOcclusion = AmbientOcclusion::NONE;
     AmbientOcclusionOptions mAmbientOcclusionOptions{};
 
@@ -372,7 +437,8 @@ private:
     mutable bool mHasDirectionalLight = false;
     mutable bool mHasDynamicLighting = false;
     mutable bool mHasShadowing = false;
-    mutable ShadowMap mDirectionalShadowMap;
+    mutable bool mHasPunctualShadowing = false;
+    mutable ShadowMapManager mShadowMapManager;
 };
 
 FILAMENT_UPCAST(View)
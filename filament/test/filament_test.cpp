@@ -16,11 +16,13 @@
 
 #include <iostream>
 #include <random>
+#include <thread>
 
 #include <gtest/gtest.h>
 
 #include <math/vec3.h>
 #include <math/vec4.h>
+#include <math/mat3x4.h>
 #include <math/mat4.h>
 
 #include <filament/Camera.h>
@@ -29,16 +31,32 @@
 #include <filament/Material.h>
 #include <filament/Engine.h>
 
+#include <private/filament/EngineEnums.h>
 #include <private/filament/UniformInterfaceBlock.h>
 #include <private/filament/UibGenerator.h>
 
+#include <backend/Platform.h>
+
+#include "private/backend/CommandProfiler.h"
+#include "private/backend/CommandReplay.h"
+
 #include "details/Allocators.h"
+#include "details/BonePalette.h"
+#include "details/BoundingVolumeHierarchy.h"
+#include "details/Culler.h"
 #include "details/Material.h"
 #include "details/Camera.h"
 #include "details/Froxelizer.h"
+#include "details/OcclusionCuller.h"
+#include "details/RenderPrimitive.h"
+#include "details/Scene.h"
+#include "details/ShadowMapManager.h"
 #include "details/Engine.h"
+#include "details/IndexBuffer.h"
+#include "details/VertexBuffer.h"
 #include "components/RenderableManager.h"
 #include "components/TransformManager.h"
+#include "RenderPass.h"
 #include "UniformBuffer.h"
 
 using namespace filament;
@@ -61,6 +79,61 @@ static bool vec3eq(float3 a, float3 b) {
             almostEqualUlps(a.z, b.z, 1);
 }
 
+// The tests that need an engine share its setup and teardown. The renderables created with
+// createRenderable() are destroyed with the scene and the engine.
+class FilamentEngineTest : public testing::Test {
+protected:
+    void SetUp() override {
+        engine = filament::details::FEngine::create();
+        scene = engine->createScene();
+    }
+
+    void TearDown() override {
+        filament::details::FRenderableManager& rcm = engine->getRenderableManager();
+        filament::details::FTransformManager& tcm = engine->getTransformManager();
+        for (Entity e : renderables) {
+            rcm.destroy(e);
+            tcm.destroy(e);
+        }
+        engine->getEntityManager().destroy(renderables.size(), renderables.data());
+        if (vb) {
+            engine->destroy(filament::details::upcast(vb));
+            engine->destroy(filament::details::upcast(ib));
+        }
+        engine->destroy(scene);
+        engine->shutdown();
+        delete engine;
+    }
+
+    // a single triangle, for the renderables that need some geometry
+    void createTriangle() {
+        vb = VertexBuffer::Builder()
+                .vertexCount(3)
+                .bufferCount(1)
+                .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::FLOAT3)
+                .build(*engine);
+        ib = IndexBuffer::Builder()
+                .indexCount(3)
+                .build(*engine);
+    }
+
+    // builds a renderable with a transform, and adds it to the scene
+    Entity createRenderable(RenderableManager::Builder& builder, mat4f const& transform = {}) {
+        Entity e = engine->getEntityManager().create();
+        builder.build(*engine, e);
+        engine->getTransformManager().create(e, {}, transform);
+        scene->addEntity(e);
+        renderables.push_back(e);
+        return e;
+    }
+
+    filament::details::FEngine* engine = nullptr;
+    filament::details::FScene* scene = nullptr;
+    VertexBuffer* vb = nullptr;
+    IndexBuffer* ib = nullptr;
+    std::vector<Entity> renderables;
+};
+
 TEST(FilamentTest, TransformManager) {
     filament::details::FTransformManager tcm;
     EntityManager& em = EntityManager::get();
@@ -86,30 +159,30 @@ TEST(FilamentTest, TransformManager) {
     EXPECT_EQ(tcm.getWorldTransform(child), mat4f{ float4{ 1 }});
 
     // test setting a transform
-    tcm.setTransform(parent, mat4f{ float4{ 2 }});
+    tcm.setTransform(parent, mat4f::scaling(2.0f));
 
     // test local and world transform propagation
-    EXPECT_EQ(tcm.getTransform(parent), mat4f{ float4{ 2 }});
-    EXPECT_EQ(tcm.getWorldTransform(parent), mat4f{ float4{ 2 }});
+    EXPECT_EQ(tcm.getTransform(parent), mat4f::scaling(2.0f));
+    EXPECT_EQ(tcm.getWorldTransform(parent), mat4f::scaling(2.0f));
     EXPECT_EQ(tcm.getTransform(child), mat4f{ float4{ 1 }});
-    EXPECT_EQ(tcm.getWorldTransform(child), mat4f{ float4{ 2 }});
+    EXPECT_EQ(tcm.getWorldTransform(child), mat4f::scaling(2.0f));
 
     // test local transaction
     tcm.openLocalTransformTransaction();
-    tcm.setTransform(parent, mat4f{ float4{ 4 }});
+    tcm.setTransform(parent, mat4f::scaling(4.0f));
 
     // check the transforms ARE NOT propagated
-    EXPECT_EQ(tcm.getTransform(parent), mat4f{ float4{ 4 }});
-    EXPECT_EQ(tcm.getWorldTransform(parent), mat4f{ float4{ 2 }});
+    EXPECT_EQ(tcm.getTransform(parent), mat4f::scaling(4.0f));
+    EXPECT_EQ(tcm.getWorldTransform(parent), mat4f::scaling(2.0f));
     EXPECT_EQ(tcm.getTransform(child), mat4f{ float4{ 1 }});
-    EXPECT_EQ(tcm.getWorldTransform(child), mat4f{ float4{ 2 }});
+    EXPECT_EQ(tcm.getWorldTransform(child), mat4f::scaling(2.0f));
 
     tcm.commitLocalTransformTransaction();
     // test propagation after closing the transaction
-    EXPECT_EQ(tcm.getTransform(parent), mat4f{ float4{ 4 }});
-    EXPECT_EQ(tcm.getWorldTransform(parent), mat4f{ float4{ 4 }});
+    EXPECT_EQ(tcm.getTransform(parent), mat4f::scaling(4.0f));
+    EXPECT_EQ(tcm.getWorldTransform(parent), mat4f::scaling(4.0f));
     EXPECT_EQ(tcm.getTransform(child), mat4f{ float4{ 1 }});
-    EXPECT_EQ(tcm.getWorldTransform(child), mat4f{ float4{ 4 }});
+    EXPECT_EQ(tcm.getWorldTransform(child), mat4f::scaling(4.0f));
 
     //
     // test out-of-order parent/child
@@ -128,7 +201,7 @@ TEST(FilamentTest, TransformManager) {
 
     // local transaction reorders parent/child
     tcm.openLocalTransformTransaction();
-    tcm.setTransform(newParent, mat4f{ float4{ 8 }});
+    tcm.setTransform(newParent, mat4f::scaling(8.0f));
     tcm.commitLocalTransformTransaction();
 
     // local transaction invalidates Instances
@@ -140,10 +213,136 @@ TEST(FilamentTest, TransformManager) {
     EXPECT_GT(child, newParent);
 
     // check transform propagation
-    EXPECT_EQ(tcm.getTransform(newParent), mat4f{ float4{ 8 }});
-    EXPECT_EQ(tcm.getWorldTransform(newParent), mat4f{ float4{ 8 }});
+    EXPECT_EQ(tcm.getTransform(newParent), mat4f::scaling(8.0f));
+    EXPECT_EQ(tcm.getWorldTransform(newParent), mat4f::scaling(8.0f));
     EXPECT_EQ(tcm.getTransform(child), mat4f{ float4{ 1 }});
-    EXPECT_EQ(tcm.getWorldTransform(child), mat4f{ float4{ 8 }});
+    EXPECT_EQ(tcm.getWorldTransform(child), mat4f::scaling(8.0f));
+}
+
+TEST_F(FilamentEngineTest, TransformManagerTransaction) {
+    using namespace filament::details;
+
+    FTransformManager& tcm = engine->getTransformManager();
+    EntityManager& em = engine->getEntityManager();
+
+    // a few roots with many children, each with a child: the last two levels are large enough
+    // to be updated in parallel
+    constexpr size_t ROOT_COUNT = 4;
+    constexpr size_t CHILD_COUNT = 1024;
+    std::vector<Entity> roots(ROOT_COUNT);
+    std::vector<Entity> children(ROOT_COUNT * CHILD_COUNT);
+    std::vector<Entity> grandChildren(ROOT_COUNT * CHILD_COUNT);
+    em.create(roots.size(), roots.data());
+    em.create(children.size(), children.data());
+    em.create(grandChildren.size(), grandChildren.data());
+
+    // the descendants are created first, so the nodes must be sorted
+    for (Entity e : grandChildren) tcm.create(e);
+    for (Entity e : children) tcm.create(e);
+    for (Entity e : roots) tcm.create(e);
+    for (size_t i = 0; i < children.size(); i++) {
+        tcm.setParent(tcm.getInstance(children[i]), tcm.getInstance(roots[i / CHILD_COUNT]));
+        tcm.setParent(tcm.getInstance(grandChildren[i]), tcm.getInstance(children[i]));
+    }
+
+    tcm.openLocalTransformTransaction();
+    for (size_t r = 0; r < roots.size(); r++) {
+        tcm.setTransform(tcm.getInstance(roots[r]), mat4f::translation(float3{ r, 0, 0 }));
+    }
+    for (size_t i = 0; i < children.size(); i++) {
+        tcm.setTransform(tcm.getInstance(children[i]), mat4f::translation(float3{ 0, i, 0 }));
+        tcm.setTransform(tcm.getInstance(grandChildren[i]), mat4f::translation(float3{ 0, 0, 1 }));
+    }
+    tcm.commitLocalTransformTransaction();
+
+    for (size_t i = 0; i < children.size(); i++) {
+        auto const ci = tcm.getInstance(children[i]);
+        auto const gi = tcm.getInstance(grandChildren[i]);
+        EXPECT_LT(tcm.getInstance(roots[i / CHILD_COUNT]), ci);
+        EXPECT_LT(ci, gi);
+        EXPECT_EQ(float3(i / CHILD_COUNT, i, 1), tcm.getWorldTransform(gi)[3].xyz);
+    }
+
+    // only the subtree that changed is updated
+    const uint32_t generation = tcm.advanceGeneration();
+    tcm.openLocalTransformTransaction();
+    tcm.setTransform(tcm.getInstance(roots[1]), mat4f::translation(float3{ 10, 0, 0 }));
+    tcm.commitLocalTransformTransaction();
+    for (size_t i = 0; i < children.size(); i++) {
+        auto const gi = tcm.getInstance(grandChildren[i]);
+        const bool moved = i / CHILD_COUNT == 1;
+        EXPECT_EQ(moved, tcm.getGeneration(gi) > generation);
+        EXPECT_EQ(float3(moved ? 10 : i / CHILD_COUNT, i, 1), tcm.getWorldTransform(gi)[3].xyz);
+    }
+
+    for (Entity e : grandChildren) tcm.destroy(e);
+    for (Entity e : children) tcm.destroy(e);
+    for (Entity e : roots) tcm.destroy(e);
+    em.destroy(grandChildren.size(), grandChildren.data());
+    em.destroy(children.size(), children.data());
+    em.destroy(roots.size(), roots.data());
+}
+
+TEST_F(FilamentEngineTest, TransformTypes) {
+    using namespace filament::details;
+    using Type = FTransformManager::TransformType;
+
+    const mat4f rotation = mat4f::rotation(0.5f, float3{ 1, 2, 3 });
+    const mat4f translation = mat4f::translation(float3{ 1, 2, 3 });
+    EXPECT_EQ(Type::RIGID, FTransformManager::classify(mat3x4f{}));
+    EXPECT_EQ(Type::RIGID, FTransformManager::classify(mat3x4f(translation * rotation)));
+    EXPECT_EQ(Type::RIGID, FTransformManager::classify(
+            mat3x4f(mat4f::scaling(float3{ -1, 1, 1 }))));
+    EXPECT_EQ(Type::UNIFORM_SCALE, FTransformManager::classify(
+            mat3x4f(rotation * mat4f::scaling(3.0f))));
+    EXPECT_EQ(Type::GENERAL, FTransformManager::classify(
+            mat3x4f(rotation * mat4f::scaling(float3{ 1, 2, 1 }))));
+
+    // the type of a world transform is the largest of its ancestors'
+    FTransformManager& tcm = engine->getTransformManager();
+    EntityManager& em = engine->getEntityManager();
+    Entity entities[3];
+    em.create(3, entities);
+    tcm.create(entities[0], {}, mat4f::scaling(2.0f));
+    tcm.create(entities[1], tcm.getInstance(entities[0]), rotation);
+    tcm.create(entities[2], tcm.getInstance(entities[1]), translation);
+    EXPECT_EQ(Type::UNIFORM_SCALE, tcm.getWorldTransformType(tcm.getInstance(entities[2])));
+    tcm.setTransform(tcm.getInstance(entities[0]), translation);
+    EXPECT_EQ(Type::RIGID, tcm.getWorldTransformType(tcm.getInstance(entities[2])));
+    tcm.openLocalTransformTransaction();
+    tcm.setTransform(tcm.getInstance(entities[1]), mat4f::scaling(float3{ 1, 1, 2 }));
+    tcm.commitLocalTransformTransaction();
+    EXPECT_EQ(Type::GENERAL, tcm.getWorldTransformType(tcm.getInstance(entities[2])));
+    for (Entity e : entities) tcm.destroy(e);
+    em.destroy(3, entities);
+
+    // all the ways of computing the normal matrix match the inverse-transpose
+    auto reference = [](mat3x4f const& model) {
+        mat3f m = transpose(inverse(model.upperLeft()));
+        return m * (1.0f / std::sqrt(max(float3{ length2(m[0]), length2(m[1]), length2(m[2]) })));
+    };
+    auto expectNear = [](mat3f const& a, mat3f const& b) {
+        for (size_t c = 0; c < 3; c++) {
+            for (size_t r = 0; r < 3; r++) {
+                EXPECT_NEAR(a[c][r], b[c][r], 1e-5f);
+            }
+        }
+    };
+    const mat3x4f models[] = {
+            mat3x4f(translation * rotation),
+            mat3x4f(rotation * mat4f::scaling(0.25f)),
+            mat3x4f(rotation * mat4f::scaling(float3{ 1, 2, -3 })),
+            mat3x4f(mat4f::scaling(float3{ -1, 1, 1 })),
+    };
+    mat3f normals[4];
+    FScene::computeNormals(normals, models, 4);
+    for (size_t i = 0; i < 4; i++) {
+        expectNear(reference(models[i]), normals[i]);
+        const Type type = FTransformManager::classify(models[i]);
+        if (type != Type::GENERAL) {
+            expectNear(reference(models[i]), FScene::getNormalMatrix(models[i], type));
+        }
+    }
 }
 
 TEST(FilamentTest, UniformInterfaceBlock) {
@@ -410,6 +609,196 @@ TEST(FilamentTest, SphereCulling) {
     EXPECT_TRUE(frustum.intersects({ 0, 200 }));
 }
 
+TEST(FilamentTest, CullingKernels) {
+    using filament::details::Culler;
+
+    const Frustum frustum(mat4f::perspective(60.0f, 1.5f, 0.1f, 100.0f));
+
+    // not a multiple of 16, so the wide kernels also go through their remainder path
+    const size_t count = 1000;
+    std::default_random_engine gen; // NOLINT
+    std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+    std::uniform_real_distribution<float> size(0.1f, 3.0f);
+    std::vector<float3> centers(count);
+    std::vector<float3> extents(count);
+    std::vector<float4> spheres(count);
+    for (size_t i = 0; i < count; i++) {
+        centers[i] = { position(gen), position(gen), position(gen) };
+        extents[i] = { size(gen), size(gen), size(gen) };
+        spheres[i] = { centers[i], size(gen) };
+    }
+
+    std::vector<Culler::result_type> expectedBoxes(count, 0);
+    std::vector<Culler::result_type> expectedSpheres(count, 0);
+    Culler::Test::intersects(expectedBoxes.data(), frustum,
+            centers.data(), extents.data(), count, Culler::Isa::SCALAR);
+    Culler::Test::intersects(expectedSpheres.data(), frustum,
+            spheres.data(), count, Culler::Isa::SCALAR);
+
+    EXPECT_TRUE(Culler::isSupported(Culler::getIsa()));
+
+    for (auto isa : { Culler::Isa::SSE2, Culler::Isa::AVX2, Culler::Isa::AVX512,
+                      Culler::Isa::NEON }) {
+        if (!Culler::isSupported(isa)) {
+            continue;
+        }
+        // box results are OR'ed with existing bits, sphere results overwrite them
+        std::vector<Culler::result_type> boxes(count, 0x10);
+        std::vector<Culler::result_type> sphereResults(count, 0x10);
+        Culler::Test::intersects(boxes.data(), frustum,
+                centers.data(), extents.data(), count, isa);
+        Culler::Test::intersects(sphereResults.data(), frustum,
+                spheres.data(), count, isa);
+        for (size_t i = 0; i < count; i++) {
+            EXPECT_EQ(expectedBoxes[i] | 0x10, boxes[i]) << "isa " << int(isa);
+            EXPECT_EQ(expectedSpheres[i], sphereResults[i]) << "isa " << int(isa);
+        }
+    }
+}
+
+TEST(FilamentTest, MultiFrustumCulling) {
+    using filament::details::Culler;
+
+    const Frustum frustums[] = {
+            Frustum{ mat4f::perspective(60.0f, 1.5f, 0.1f, 100.0f) },
+            Frustum{ mat4f::ortho(-20.0f, 20.0f, -20.0f, 20.0f, 0.0f, 50.0f) },
+            Frustum{ mat4f::perspective(90.0f, 1.0f, 1.0f, 30.0f) *
+                     mat4f::rotation(float(M_PI_2), float3{ 0, 1, 0 }) }};
+
+    // spans several of the blocks Culler processes at once
+    const size_t count = 1000;
+    std::default_random_engine gen; // NOLINT
+    std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+    std::uniform_real_distribution<float> size(0.1f, 3.0f);
+    std::vector<float3> centers(count);
+    std::vector<float3> extents(count);
+    for (size_t i = 0; i < count; i++) {
+        centers[i] = { position(gen), position(gen), position(gen) };
+        extents[i] = { size(gen), size(gen), size(gen) };
+    }
+
+    std::vector<Culler::result_type> expected(Culler::round(count), 0);
+    for (size_t i = 0; i < 3; i++) {
+        Culler::intersects(expected.data(), frustums[i],
+                centers.data(), extents.data(), count, i + 1);
+    }
+
+    std::vector<Culler::result_type> actual(Culler::round(count), 0);
+    Culler::intersects(actual.data(), frustums, 3, centers.data(), extents.data(), count, 1);
+    EXPECT_EQ(expected, actual);
+}
+
+TEST(FilamentTest, HierarchicalCulling) {
+    using filament::details::BoundingVolumeHierarchy;
+    using filament::details::Culler;
+
+    std::default_random_engine gen; // NOLINT
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> size(0.1f, 5.0f);
+
+    const size_t count = 10000;
+    std::vector<float3> centers(Culler::round(count));
+    std::vector<float3> extents(Culler::round(count));
+    for (size_t i = 0; i < count; i++) {
+        centers[i] = { position(gen), position(gen) * 0.05f, position(gen) };
+        extents[i] = { size(gen), size(gen), size(gen) };
+    }
+
+    BoundingVolumeHierarchy bvh;
+    bvh.build(centers.data(), extents.data(), count);
+    EXPECT_EQ(count, bvh.size());
+
+    const mat4f projection = mat4f::perspective(45.0f, 1.0f, 0.1f, 200.0f);
+    auto camera = [&position](std::default_random_engine& gen) {
+        return mat4f::lookAt(
+                float3{ position(gen), 0, position(gen) },
+                float3{ position(gen), 0, position(gen) }, float3{ 0, 1, 0 });
+    };
+
+    auto check = [&]() {
+        for (size_t n = 0; n < 16; n++) {
+            const Frustum frustum(projection * inverse(camera(gen)));
+
+            std::vector<Culler::result_type> expected(Culler::round(count), 0);
+            std::vector<Culler::result_type> actual(Culler::round(count), 0);
+            Culler::Test::intersects(expected.data(), frustum,
+                    centers.data(), extents.data(), count);
+            bvh.cull(actual.data(), frustum, 0);
+            for (size_t i = 0; i < count; i++) {
+                EXPECT_EQ(expected[i], actual[i]);
+            }
+        }
+    };
+
+    check();
+
+    // move some of the boxes around, the hierarchy must still give the same results
+    for (size_t i = 0; i < count; i += 3) {
+        centers[i].x += 50.0f;
+    }
+    EXPECT_EQ((count + 2) / 3, bvh.refit(centers.data(), extents.data(), count));
+    check();
+
+    // nothing changed
+    EXPECT_EQ(0, bvh.refit(centers.data(), extents.data(), count));
+
+    // a frustum expressed in a rigid transform's destination space must classify points the
+    // same way once transformed back to its source space
+    const mat4f origin = mat4f::translation(float3{ 10, 2, -3 }) *
+            mat4f::rotation(0.5f, float3{ 0, 1, 0 });
+    const Frustum frustum(projection * inverse(camera(gen)));
+    const Frustum source(Culler::transform(frustum, origin));
+    for (size_t i = 0; i < count; i++) {
+        const float4 p{ centers[i], 1 };
+        const float4 q{ (origin * p).xyz, 1 };
+        for (size_t j = 0; j < 6; j++) {
+            EXPECT_NEAR(dot(frustum.getNormalizedPlanes()[j], q),
+                        dot(source.getNormalizedPlanes()[j], p), 1e-2f);
+        }
+    }
+}
+
+TEST(FilamentTest, OcclusionCulling) {
+    using filament::details::Culler;
+    using filament::details::OcclusionCuller;
+
+    // camera at the origin, looking down -z, with square pixels
+    const mat4f viewProjection = mat4f::perspective(90.0f,
+            float(OcclusionCuller::WIDTH) / OcclusionCuller::HEIGHT, 0.1f, 100.0f);
+
+    // a 10 x 10 wall, 10 units in front of the camera
+    const float3 vertices[] = {{ -5, -5, 0 }, { 5, -5, 0 }, { 5, 5, 0 }, { -5, 5, 0 }};
+    const uint16_t indices[] = { 0, 1, 2, 0, 2, 3 };
+
+    JobSystem js;
+    js.adopt();
+
+    OcclusionCuller culler;
+    culler.begin(viewProjection);
+    culler.addOccluder(mat3x4f(mat4f::translation(float3{ 0, 0, -10 })),
+            vertices, 4, indices, 6);
+    EXPECT_EQ(2u, culler.getTriangleCount());
+    culler.rasterize(js);
+
+    EXPECT_TRUE(culler.isOccluded({ 0, 0, -20 }, { 1, 1, 1 }));     // behind the wall
+    EXPECT_FALSE(culler.isOccluded({ 0, 0, -5 }, { 1, 1, 1 }));     // in front of the wall
+    EXPECT_FALSE(culler.isOccluded({ 0, 0, -10 }, { 1, 1, 1 }));    // intersects the wall
+    EXPECT_FALSE(culler.isOccluded({ 30, 0, -20 }, { 1, 1, 1 }));   // next to the wall
+    EXPECT_FALSE(culler.isOccluded({ 0, 0, 0 }, { 1, 1, 1 }));      // crosses the near plane
+
+    // only boxes with the bit set are tested
+    Culler::result_type results[] = { 0x2, 0x2, 0x0, 0x3 };
+    const float3 centers[] = {{ 0, 0, -20 }, { 0, 0, -5 }, { 0, 0, -20 }, { 0, 0, -30 }};
+    const float3 extents[] = {{ 1, 1, 1 }, { 1, 1, 1 }, { 1, 1, 1 }, { 1, 1, 1 }};
+    culler.cull(js, results, centers, extents, 4, 1);
+    EXPECT_EQ(0x0, results[0]);
+    EXPECT_EQ(0x2, results[1]);
+    EXPECT_EQ(0x0, results[2]);
+    EXPECT_EQ(0x1, results[3]);
+
+    js.emancipate();
+}
+
 TEST(FilamentTest, ColorConversion) {
     // Linear to Gamma
     // 0.0 stays 0.0
@@ -469,9 +858,12 @@ TEST(FilamentTest, FroxelData) {
     Viewport vp(0, 0, 1280, 640);
     mat4f p = mat4f::perspective(90, 1.0f, 0.1, 100, mat4f::Fov::HORIZONTAL);
 
+    FScene::LightSoa lights;
+    lights.push_back({}, {}, {}, {}, {}, {});   // first one is always skipped
+
     Froxelizer froxelData(*engine);
     froxelData.setOptions(5, 100);
-    froxelData.prepare(engine->getDriverApi(), scope, vp, p, 0.1, 100);
+    froxelData.prepare(*engine, engine->getDriverApi(), scope, vp, p, 0.1, 100, {}, lights);
 
     Froxel f = froxelData.getFroxelAt(0,0,0);
 
@@ -517,11 +909,10 @@ TEST(FilamentTest, FroxelData) {
     LightManager::Builder(LightManager::Type::POINT).build(*engine, e);
     LightManager::Instance instance = engine->getLightManager().getInstance(e);
 
-    FScene::LightSoa lights;
-    lights.push_back({}, {}, {}, {}, {});   // first one is always skipped
-    lights.push_back(float4{ 0, 0, -5, 1 }, {}, instance, 1, {});
+    lights.push_back(float4{ 0, 0, -5, 1 }, {}, instance, 1, {}, {});
 
     {
+        froxelData.prepare(*engine, engine->getDriverApi(), scope, vp, p, 0.1, 100, {}, lights);
         froxelData.froxelizeLights(*engine, {}, lights);
         auto const& froxelBuffer = froxelData.getFroxelBufferUser();
         auto const& recordBuffer = froxelData.getRecordBufferUser();
@@ -542,6 +933,7 @@ TEST(FilamentTest, FroxelData) {
         auto pos = lights.elementAt<FScene::POSITION_RADIUS>(1);
         EXPECT_TRUE(pos == float4( 0, 0, -3, 1 ));
 
+        froxelData.prepare(*engine, engine->getDriverApi(), scope, vp, p, 0.1, 100, {}, lights);
         froxelData.froxelizeLights(*engine, {}, lights);
         auto const& froxelBuffer = froxelData.getFroxelBufferUser();
         auto const& recordBuffer = froxelData.getRecordBufferUser();
@@ -559,6 +951,595 @@ TEST(FilamentTest, FroxelData) {
     delete engine;
 }
 
+TEST_F(FilamentEngineTest, ClusteredFroxelData) {
+    using namespace filament;
+    using namespace filament::details;
+
+    LinearAllocatorArena arena("FRenderer: per-frame allocator", FEngine::CONFIG_PER_RENDER_PASS_ARENA_SIZE);
+    utils::ArenaScope<LinearAllocatorArena> scope(arena);
+
+    // more lights than the UBO can hold, in two groups
+    constexpr size_t LIGHT_COUNT = 300;
+    constexpr size_t NEAR_LIGHT_COUNT = 200;
+    EXPECT_TRUE(Froxelizer::isClustered(LIGHT_COUNT));
+
+    Viewport vp(0, 0, 1280, 640);
+    mat4f p = mat4f::perspective(90, 1.0f, 0.1, 100, mat4f::Fov::HORIZONTAL);
+
+    Entity e = engine->getEntityManager().create();
+    LightManager::Builder(LightManager::Type::POINT).build(*engine, e);
+    LightManager::Instance instance = engine->getLightManager().getInstance(e);
+
+    FScene::LightSoa lights;
+    lights.push_back({}, {}, {}, {}, {}, {});   // first one is always skipped
+    for (size_t i = 0; i < LIGHT_COUNT; i++) {
+        const float z = i < NEAR_LIGHT_COUNT ? -3.0f : -20.0f;
+        lights.push_back(float4{ 0, 0, z, 1 }, {}, instance, 1, {}, {});
+    }
+
+    Froxelizer froxelData(*engine);
+    froxelData.setOptions(5, 100);
+    froxelData.prepare(*engine, engine->getDriverApi(), scope, vp, p, 0.1, 100, {}, lights);
+    froxelData.froxelizeLights(*engine, {}, lights);
+    auto const& froxelBuffer = froxelData.getFroxelBufferUser();
+    auto const& recordBuffer = froxelData.getClusteredRecordBufferUser();
+    // the clustered mode needs 16-bits records, the 8-bits ones aren't allocated
+    EXPECT_TRUE(froxelData.getRecordBufferUser().empty());
+
+    size_t maxPointCount = 0;
+    size_t maxLightIndex = 0;
+    for (size_t i = 0, c = froxelData.getFroxelCount(); i < c; i++) {
+        auto const& entry = froxelBuffer[i];
+        EXPECT_EQ(entry.spotLightCount, 0);
+        maxPointCount = std::max(maxPointCount, size_t(entry.pointLightCount));
+
+        // every light of a froxel is a distinct light
+        for (size_t j = 0; j < entry.pointLightCount; j++) {
+            EXPECT_LT(recordBuffer[entry.offset + j], LIGHT_COUNT);
+            maxLightIndex = std::max(maxLightIndex, size_t(recordBuffer[entry.offset + j]));
+            if (j) {
+                EXPECT_LT(recordBuffer[entry.offset + j - 1], recordBuffer[entry.offset + j]);
+            }
+        }
+    }
+
+    // the froxels around the near lights get all of them...
+    EXPECT_GE(maxPointCount, NEAR_LIGHT_COUNT);
+    EXPECT_LE(maxPointCount, 255);
+
+    // ...and lights with an index above CONFIG_MAX_LIGHT_INDEX are not dropped
+    EXPECT_EQ(maxLightIndex, LIGHT_COUNT - 1);
+
+    froxelData.terminate(engine->getDriverApi());
+}
+
+TEST_F(FilamentEngineTest, FroxelDataSimd) {
+    using namespace filament;
+    using namespace filament::details;
+
+    LinearAllocatorArena arena("FRenderer: per-frame allocator", FEngine::CONFIG_PER_RENDER_PASS_ARENA_SIZE);
+    utils::ArenaScope<LinearAllocatorArena> scope(arena);
+
+    constexpr size_t LIGHT_COUNT = 200;
+    EXPECT_FALSE(Froxelizer::isClustered(LIGHT_COUNT));
+
+    Viewport vp(0, 0, 1280, 640);
+    mat4f p = mat4f::perspective(90, 2.0f, 0.1, 100, mat4f::Fov::HORIZONTAL);
+
+    Froxelizer froxelData(*engine);
+    froxelData.setOptions(5, 100);
+
+    Entity pointLight = engine->getEntityManager().create();
+    Entity spotLight = engine->getEntityManager().create();
+    LightManager::Builder(LightManager::Type::POINT).build(*engine, pointLight);
+    LightManager::Builder(LightManager::Type::SPOT)
+            .spotLightCone(0.5f, 0.7f)
+            .build(*engine, spotLight);
+    FLightManager& lcm = engine->getLightManager();
+
+    // half point lights, half spot lights, of all sizes
+    std::default_random_engine gen; // NOLINT
+    std::uniform_real_distribution<float> xy(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> z(-50.0f, -0.5f);
+    std::uniform_real_distribution<float> radius(0.5f, 10.0f);
+    FScene::LightSoa lights;
+    lights.push_back({}, {}, {}, {}, {}, {});   // first one is always skipped
+    for (size_t i = 0; i < LIGHT_COUNT; i++) {
+        const float d = z(gen);
+        const float3 direction = normalize(float3{ xy(gen), xy(gen), xy(gen) });
+        lights.push_back(float4{ xy(gen) * d, xy(gen) * d * 0.5f, d, radius(gen) }, direction,
+                lcm.getInstance((i & 1) ? spotLight : pointLight), 1, {}, {});
+    }
+
+    froxelData.setSimdEnabled(false);
+    froxelData.prepare(*engine, engine->getDriverApi(), scope, vp, p, 0.1, 100, {}, lights);
+    froxelData.froxelizeLights(*engine, {}, lights);
+    std::vector<uint32_t> froxels;
+    for (auto const& entry : froxelData.getFroxelBufferUser()) {
+        froxels.push_back(entry.u32);
+    }
+    auto const& recordBuffer = froxelData.getRecordBufferUser();
+    std::vector<Froxelizer::RecordBufferType> records(recordBuffer.begin(), recordBuffer.end());
+
+    // the SIMD kernels must find exactly the same froxels
+    froxelData.setSimdEnabled(true);
+    froxelData.prepare(*engine, engine->getDriverApi(), scope, vp, p, 0.1, 100, {}, lights);
+    froxelData.froxelizeLights(*engine, {}, lights);
+    size_t lightCount = 0;
+    auto const& froxelBuffer = froxelData.getFroxelBufferUser();
+    for (size_t i = 0; i < froxelBuffer.size(); i++) {
+        EXPECT_EQ(froxels[i], froxelBuffer[i].u32);
+        lightCount += froxelBuffer[i].pointLightCount + froxelBuffer[i].spotLightCount;
+    }
+    EXPECT_GT(lightCount, 0);
+    EXPECT_TRUE(std::equal(records.begin(), records.end(), recordBuffer.begin()));
+
+    lcm.destroy(pointLight);
+    lcm.destroy(spotLight);
+    froxelData.terminate(engine->getDriverApi());
+}
+
+TEST_F(FilamentEngineTest, IncrementalFroxelData) {
+    using namespace filament;
+    using namespace filament::details;
+
+    LinearAllocatorArena arena("FRenderer: per-frame allocator", FEngine::CONFIG_PER_RENDER_PASS_ARENA_SIZE);
+
+    constexpr size_t LIGHT_COUNT = 100;
+
+    Viewport vp(0, 0, 1280, 640);
+    mat4f p = mat4f::perspective(90, 2.0f, 0.1, 100, mat4f::Fov::HORIZONTAL);
+
+    // 'incremental' only froxelizes the lights that changed, 'full' froxelizes all of them
+    Froxelizer incremental(*engine);
+    Froxelizer full(*engine);
+    for (Froxelizer* froxelizer : { &incremental, &full }) {
+        froxelizer->setOptions(5, 100);
+    }
+
+    Entity pointLight = engine->getEntityManager().create();
+    Entity spotLight = engine->getEntityManager().create();
+    LightManager::Builder(LightManager::Type::POINT).build(*engine, pointLight);
+    LightManager::Builder(LightManager::Type::SPOT)
+            .spotLightCone(0.5f, 0.7f)
+            .build(*engine, spotLight);
+    FLightManager& lcm = engine->getLightManager();
+
+    std::default_random_engine gen; // NOLINT
+    std::uniform_real_distribution<float> xy(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> z(-50.0f, -0.5f);
+    std::uniform_real_distribution<float> radius(0.5f, 10.0f);
+    FScene::LightSoa lights;
+    lights.push_back({}, {}, {}, {}, {}, {});   // first one is always skipped
+    for (size_t i = 0; i < LIGHT_COUNT; i++) {
+        const float d = z(gen);
+        lights.push_back(float4{ xy(gen) * d, xy(gen) * d * 0.5f, d, radius(gen) },
+                float3{ 0, -1, 0 }, lcm.getInstance((i & 1) ? spotLight : pointLight), 1, {}, {});
+    }
+
+    auto froxelize = [&](Froxelizer& froxelizer) {
+        utils::ArenaScope<LinearAllocatorArena> frame(arena);   // per-frame allocations
+        froxelizer.prepare(*engine, engine->getDriverApi(), frame, vp, p, 0.1, 100, {}, lights);
+        froxelizer.froxelizeLights(*engine, {}, lights);
+    };
+
+    auto check = [&]() {
+        froxelize(incremental);
+        full.invalidate();
+        froxelize(full);
+        auto const& froxels = incremental.getFroxelBufferUser();
+        auto const& expectedFroxels = full.getFroxelBufferUser();
+        for (size_t i = 0, c = full.getFroxelCount(); i < c; i++) {
+            EXPECT_EQ(expectedFroxels[i].u32, froxels[i].u32);
+        }
+        auto const& records = incremental.getRecordBufferUser();
+        auto const& expectedRecords = full.getRecordBufferUser();
+        EXPECT_TRUE(std::equal(expectedRecords.begin(), expectedRecords.end(), records.begin()));
+    };
+
+    check();
+
+    // nothing changed, there is nothing to send to the GPU
+    froxelize(incremental);
+    EXPECT_TRUE(incremental.getFroxelBufferUser().empty());
+    EXPECT_TRUE(incremental.getRecordBufferUser().empty());
+
+    // move a few lights, and make a point light a spot light
+    for (size_t i = 0; i < LIGHT_COUNT; i += 7) {
+        lights.elementAt<FScene::POSITION_RADIUS>(i + 1).x += 2.0f;
+    }
+    lights.elementAt<FScene::LIGHT_INSTANCE>(1) = lcm.getInstance(spotLight);
+    check();
+
+    // remove some lights
+    while (lights.size() > LIGHT_COUNT / 2) {
+        lights.pop_back();
+    }
+    check();
+
+    lcm.destroy(pointLight);
+    lcm.destroy(spotLight);
+    incremental.terminate(engine->getDriverApi());
+    full.terminate(engine->getDriverApi());
+}
+
+TEST_F(FilamentEngineTest, IncrementalScenePrepare) {
+    using namespace filament::details;
+
+    FRenderableManager& rcm = engine->getRenderableManager();
+    FTransformManager& tcm = engine->getTransformManager();
+
+    std::array<Entity, 3> entities;
+    for (Entity& e : entities) {
+        e = createRenderable(RenderableManager::Builder(0)
+                .boundingBox({{ 0, 0, 0 }, { 1, 1, 1 }}));
+    }
+
+    auto findRow = [this](RenderableManager::Instance ri) {
+        auto const& soa = scene->getRenderableData();
+        for (size_t i = 0; i < soa.size(); i++) {
+            if (soa.elementAt<FScene::RENDERABLE_INSTANCE>(i) == ri) {
+                return i;
+            }
+        }
+        return soa.size();
+    };
+
+    // first prepare gathers everything
+    scene->prepare(engine->getJobSystem(), mat4f{});
+    EXPECT_EQ(3, scene->getRenderableData().size());
+    EXPECT_EQ(3, scene->getRowsTouched());
+
+    // nothing changed
+    scene->prepare(engine->getJobSystem(), mat4f{});
+    EXPECT_EQ(0, scene->getRowsTouched());
+
+    // only the renderable that moved is updated, even if the rows were re-ordered
+    auto& soa = scene->getRenderableData();
+    std::reverse(soa.begin(), soa.end());
+    tcm.setTransform(tcm.getInstance(entities[1]), mat4f::translation(float3{ 10, 0, 0 }));
+    scene->prepare(engine->getJobSystem(), mat4f{});
+    EXPECT_EQ(1, scene->getRowsTouched());
+    const size_t row = findRow(rcm.getInstance(entities[1]));
+    EXPECT_EQ(float3(10, 0, 0), soa.elementAt<FScene::WORLD_AABB_CENTER>(row));
+
+    // changes to the renderable's state are picked up
+    rcm.setLayerMask(rcm.getInstance(entities[2]), 0x2);
+    scene->prepare(engine->getJobSystem(), mat4f{});
+    EXPECT_EQ(1, scene->getRowsTouched());
+    EXPECT_EQ(0x2, soa.elementAt<FScene::LAYERS>(findRow(rcm.getInstance(entities[2]))));
+
+    // moving the world origin updates all rows
+    scene->prepare(engine->getJobSystem(), mat4f::translation(float3{ 0, 1, 0 }));
+    EXPECT_EQ(3, scene->getRowsTouched());
+    EXPECT_EQ(float3(10, 1, 0),
+            soa.elementAt<FScene::WORLD_AABB_CENTER>(findRow(rcm.getInstance(entities[1]))));
+
+    // removing an entity gathers everything again
+    scene->remove(entities[0]);
+    scene->prepare(engine->getJobSystem(), mat4f::translation(float3{ 0, 1, 0 }));
+    EXPECT_EQ(2, scene->getRenderableData().size());
+    EXPECT_EQ(2, scene->getRowsTouched());
+}
+
+TEST_F(FilamentEngineTest, StaticShadowCasterChanges) {
+    using namespace filament::details;
+
+    FRenderableManager& rcm = engine->getRenderableManager();
+    FTransformManager& tcm = engine->getTransformManager();
+
+    // entities[0] is a static shadow caster
+    std::array<Entity, 2> entities;
+    for (size_t i = 0; i < entities.size(); i++) {
+        entities[i] = createRenderable(RenderableManager::Builder(0)
+                .boundingBox({{ 0, 0, 0 }, { 1, 1, 1 }})
+                .castShadows(true)
+                .staticShadowCaster(i == 0));
+    }
+    EXPECT_TRUE(rcm.isStaticShadowCaster(rcm.getInstance(entities[0])));
+    EXPECT_FALSE(rcm.isStaticShadowCaster(rcm.getInstance(entities[1])));
+
+    // the first prepare changes everything
+    scene->prepare(engine->getJobSystem(), mat4f{});
+    EXPECT_TRUE(scene->hasChangedStaticCasters());
+
+    scene->prepare(engine->getJobSystem(), mat4f{});
+    EXPECT_FALSE(scene->hasChangedStaticCasters());
+
+    // moving a dynamic caster keeps the static casters
+    tcm.setTransform(tcm.getInstance(entities[1]), mat4f::translation(float3{ 10, 0, 0 }));
+    scene->prepare(engine->getJobSystem(), mat4f{});
+    EXPECT_FALSE(scene->hasChangedAll());
+    EXPECT_FALSE(scene->hasChangedStaticCasters());
+
+    // moving a static caster doesn't
+    tcm.setTransform(tcm.getInstance(entities[0]), mat4f::translation(float3{ 0, 10, 0 }));
+    scene->prepare(engine->getJobSystem(), mat4f{});
+    EXPECT_TRUE(scene->hasChangedStaticCasters());
+
+    // neither does a renderable becoming static
+    rcm.setStaticShadowCaster(rcm.getInstance(entities[1]), true);
+    scene->prepare(engine->getJobSystem(), mat4f{});
+    EXPECT_TRUE(scene->hasChangedStaticCasters());
+
+    // nor the world origin moving
+    scene->prepare(engine->getJobSystem(), mat4f::translation(float3{ 0, 1, 0 }));
+    EXPECT_TRUE(scene->hasChangedStaticCasters());
+}
+
+TEST(FilamentTest, RadixSortCommands) {
+    using filament::details::RenderPass;
+    using Command = RenderPass::Command;
+
+    // keys shaped like RenderPass' with constant and zero bytes in the middle and many duplicates
+    std::default_random_engine gen; // NOLINT
+    std::uniform_int_distribution<uint32_t> pass(0, 2);
+    std::uniform_int_distribution<uint32_t> low(0, 1023);
+    std::vector<Command> commands(50000);
+    for (size_t i = 0; i < commands.size(); i++) {
+        commands[i].key = (uint64_t(pass(gen)) << 56u) | (uint64_t(0x04) << 48u) | low(gen);
+        commands[i].primitive.index = uint16_t(i);
+    }
+
+    std::vector<Command> expected(commands);
+    std::stable_sort(expected.begin(), expected.end());
+
+    JobSystem js(4);
+    js.adopt();
+    std::vector<Command> scratch(commands.size());
+    RenderPass::sortCommands(js,
+            commands.data(), commands.data() + commands.size(), scratch.data());
+    js.emancipate();
+
+    // the radix sort is stable, so the commands must come out in exactly the same order
+    for (size_t i = 0; i < commands.size(); i++) {
+        EXPECT_EQ(expected[i].key, commands[i].key);
+        EXPECT_EQ(expected[i].primitive.index, commands[i].primitive.index);
+    }
+}
+
+TEST_F(FilamentEngineTest, CommandCache) {
+    using namespace filament::details;
+    using Command = RenderPass::Command;
+
+    FRenderableManager& rcm = engine->getRenderableManager();
+    FMaterialInstance const* mi = engine->getDefaultMaterial()->getDefaultInstance();
+
+    createTriangle();
+
+    std::array<Entity, 16> entities;
+    for (size_t i = 0; i < entities.size(); i++) {
+        entities[i] = createRenderable(RenderableManager::Builder(1)
+                .boundingBox({{ 0, 0, 0 }, { 1, 1, 1 }})
+                .geometry(0, RenderableManager::PrimitiveType::TRIANGLES, vb, ib)
+                .material(0, mi), mat4f::translation(float3{ 0, 0, -float(i) }));
+    }
+
+    // the renderables are all visible, as if the view had culled them
+    auto prepare = [&]() {
+        scene->prepare(engine->getJobSystem(), mat4f{});
+        FScene::RenderableSoa& soa = scene->getRenderableData();
+        std::fill(soa.begin<FScene::VISIBLE_MASK>(), soa.end<FScene::VISIBLE_MASK>(), 0xFF);
+    };
+    prepare();
+    const Range<uint32_t> vr{ 0, uint32_t(scene->getRenderableData().size()) };
+
+    CameraInfo camera{};
+    camera.model = mat4f::translation(float3{ 0, 0, 10 });
+
+    // commands with the same key can come in any order, so we compare them sorted by index too
+    std::vector<Command> storage(1024);
+    uint8_t visibilityMask = 0xFF;
+    auto generate = [&](RenderPass::CommandCache* cache) {
+        GrowingSlice<Command> commands(storage.data(), storage.size());
+        RenderPass pass(*engine, commands);
+        pass.setCommandCache(cache);
+        pass.setVisibilityMask(visibilityMask);
+        pass.setCamera(camera);
+        pass.setGeometry(*scene, vr);
+        pass.appendSortedCommands(RenderPass::COLOR);
+        std::vector<std::pair<uint64_t, uint16_t>> result;
+        for (Command const& command : commands) {
+            result.emplace_back(command.key, command.primitive.index);
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    };
+
+    RenderPass::CommandCache cache;
+    auto expected = generate(nullptr);
+    EXPECT_EQ(entities.size(), expected.size());
+
+    // first use fills the cache
+    EXPECT_EQ(expected, generate(&cache));
+    EXPECT_EQ(1u, cache.getStats().misses);
+
+    // nothing changed
+    EXPECT_EQ(expected, generate(&cache));
+    EXPECT_EQ(1u, cache.getStats().hits);
+
+    // a single renderable changed, only its commands are regenerated
+    rcm.setPriority(rcm.getInstance(entities[3]), 7);
+    prepare();
+    expected = generate(nullptr);
+    EXPECT_EQ(expected, generate(&cache));
+    EXPECT_EQ(1u, cache.getStats().patches);
+
+    // the camera moved, all distances changed
+    camera.model = mat4f::translation(float3{ 0, 0, 20 });
+    expected = generate(nullptr);
+    EXPECT_EQ(expected, generate(&cache));
+    EXPECT_EQ(2u, cache.getStats().misses);
+
+    // a shadow cascade only draws the renderables with its bit in VISIBLE_MASK
+    uint8_t* const visibleMask = scene->getRenderableData().data<FScene::VISIBLE_MASK>();
+    visibilityMask = 0x04;
+    visibleMask[5] = 0x01;
+    expected = generate(nullptr);
+    EXPECT_EQ(entities.size() - 1, expected.size());
+    EXPECT_EQ(expected, generate(&cache));
+    EXPECT_EQ(3u, cache.getStats().misses);
+
+    // a renderable entering or leaving the cascade keeps its row, but not its commands
+    visibleMask[5] = 0x05;
+    expected = generate(nullptr);
+    EXPECT_EQ(entities.size(), expected.size());
+    EXPECT_EQ(expected, generate(&cache));
+    EXPECT_EQ(2u, cache.getStats().patches);
+
+    visibleMask[5] = 0x01;
+    expected = generate(nullptr);
+    EXPECT_EQ(expected, generate(&cache));
+    EXPECT_EQ(3u, cache.getStats().patches);
+    EXPECT_EQ(1u, cache.getStats().hits);
+}
+
+TEST_F(FilamentEngineTest, Instancing) {
+    using namespace filament::details;
+    using Command = RenderPass::Command;
+
+    FRenderableManager& rcm = engine->getRenderableManager();
+    FMaterialInstance const* mi = engine->getDefaultMaterial()->getDefaultInstance();
+
+    createTriangle();
+
+    std::array<Entity, 16> entities;
+    for (size_t i = 0; i < entities.size(); i++) {
+        entities[i] = createRenderable(RenderableManager::Builder(1)
+                .boundingBox({{ 0, 0, 0 }, { 1, 1, 1 }})
+                .geometry(0, RenderableManager::PrimitiveType::TRIANGLES, vb, ib)
+                .material(0, mi), mat4f::translation(float3{ 0, float(i), -1 }));
+    }
+
+    // identical geometries share their render primitive
+    auto handleOf = [&](Entity e) {
+        return rcm.getRenderPrimitives(rcm.getInstance(e), 0)[0].getHwHandle();
+    };
+    for (Entity e : entities) {
+        EXPECT_EQ(handleOf(entities[0]), handleOf(e));
+    }
+
+    // ...until one of them changes
+    rcm.setGeometryAt(rcm.getInstance(entities[15]), 0, 0,
+            RenderableManager::PrimitiveType::TRIANGLES, upcast(vb), upcast(ib), 0, 2);
+    EXPECT_NE(handleOf(entities[0]), handleOf(entities[15]));
+    EXPECT_EQ(handleOf(entities[0]), handleOf(entities[14]));
+
+    // draw it last, so that the others are sorted together
+    rcm.setPriority(rcm.getInstance(entities[15]), 7);
+
+    scene->prepare(engine->getJobSystem(), mat4f{});
+    FScene::RenderableSoa& soa = scene->getRenderableData();
+    const Range<uint32_t> vr{ 0, uint32_t(soa.size()) };
+
+    // the renderables are all visible, as if the view had culled them
+    std::fill(soa.begin<FScene::VISIBLE_MASK>(), soa.end<FScene::VISIBLE_MASK>(), 0xFF);
+
+    CameraInfo camera{};
+    std::vector<Command> storage(1024);
+    auto generate = [&](RenderPass::RenderFlags flags) {
+        GrowingSlice<Command> commands(storage.data(), storage.size());
+        RenderPass pass(*engine, commands);
+        pass.setRenderFlags(flags);
+        pass.setCamera(camera);
+        pass.setGeometry(*scene, vr);
+        pass.appendSortedCommands(RenderPass::COLOR);
+        return std::vector<Command>(commands.begin(), commands.end());
+    };
+
+    std::vector<Command> commands = generate(0);
+    EXPECT_EQ(entities.size(), commands.size());
+    EXPECT_EQ(15u, RenderPass::getInstanceCount(
+            commands.data(), commands.data() + commands.size()));
+
+    // 15 renderables are merged into a single draw, the one which changed is drawn by itself
+    std::vector<Command> instanced = generate(RenderPass::HAS_INSTANCING);
+    ASSERT_EQ(2u, instanced.size());
+    EXPECT_EQ(15u, instanced[0].primitive.instanceCount);
+    EXPECT_EQ(1u, instanced[1].primitive.instanceCount);
+
+    // the instances get the transforms of the renderables they replace, the buffer is laid out
+    // like the ObjectUniforms block: 4 mat4 per instance
+    std::vector<mat4f> instances((CONFIG_MAX_INSTANCES + 15) * 4);
+    Command* last = RenderPass::instanceCommands(commands.data(),
+            commands.data() + commands.size(), soa, instances.data());
+    ASSERT_EQ(2u, size_t(last - commands.data()));
+    EXPECT_EQ(15u, commands[0].primitive.instanceCount);
+    std::vector<float> positions;
+    for (size_t i = 0; i < 15; i++) {
+        positions.push_back(instances[(commands[0].primitive.index + i) * 4][3].y);
+    }
+    std::sort(positions.begin(), positions.end());
+    for (size_t i = 0; i < positions.size(); i++) {
+        EXPECT_EQ(float(i), positions[i]);
+    }
+}
+
+TEST_F(FilamentEngineTest, LevelsOfDetail) {
+    using namespace filament::details;
+
+    FRenderableManager& rcm = engine->getRenderableManager();
+    FMaterialInstance const* mi = engine->getDefaultMaterial()->getDefaultInstance();
+    FMaterialInstance* other = engine->getDefaultMaterial()->createInstance();
+
+    createTriangle();
+
+    // level 0 has one primitive, level 1 has two
+    Entity entity = engine->getEntityManager().create();
+    RenderableManager::Builder(3)
+            .boundingBox({{ 0, 0, 0 }, { 1, 1, 1 }})
+            .geometry(0, RenderableManager::PrimitiveType::TRIANGLES, vb, ib)
+            .geometry(1, RenderableManager::PrimitiveType::TRIANGLES, vb, ib)
+            .geometry(2, RenderableManager::PrimitiveType::TRIANGLES, vb, ib)
+            .material(0, mi)
+            .material(1, mi)
+            .material(2, mi)
+            .level(1, 1)
+            .level(2, 1)
+            .levelScreenSize(0, 100.0f)
+            .build(*engine, entity);
+    auto ri = rcm.getInstance(entity);
+
+    EXPECT_TRUE(rcm.hasLevels());
+    EXPECT_EQ(2u, rcm.getLevelCount(ri));
+    EXPECT_EQ(100.0f, rcm.getLevels(ri).screenSizes[0]);
+    EXPECT_EQ(3u, rcm.getPrimitiveCount(ri));
+    EXPECT_EQ(1u, rcm.getPrimitiveCount(ri, 0));
+    EXPECT_EQ(2u, rcm.getPrimitiveCount(ri, 1));
+
+    // the public API indexes primitives across all levels
+    size_t index = 2;
+    EXPECT_EQ(1u, rcm.getLevel(ri, index));
+    EXPECT_EQ(1u, index);
+    RenderableManager& api = rcm;
+    api.setMaterialInstanceAt(ri, 2, other);
+    EXPECT_EQ(other, rcm.getMaterialInstanceAt(ri, 1, 1));
+    EXPECT_EQ(mi, rcm.getMaterialInstanceAt(ri, 1, 0));
+    EXPECT_EQ(mi, rcm.getMaterialInstanceAt(ri, 0, 0));
+
+    // the first primitive must be at level 0
+    Entity invalid = engine->getEntityManager().create();
+    RenderableManager::Builder builder(2);
+    builder.boundingBox({{ 0, 0, 0 }, { 1, 1, 1 }})
+            .geometry(0, RenderableManager::PrimitiveType::TRIANGLES, vb, ib)
+            .geometry(1, RenderableManager::PrimitiveType::TRIANGLES, vb, ib)
+            .level(0, 1)
+            .level(1, 1);
+#if defined(UTILS_EXCEPTIONS)
+    EXPECT_THROW(builder.build(*engine, invalid), utils::PreconditionPanic);
+#elif defined(NDEBUG)
+    EXPECT_EQ(RenderableManager::Builder::Error, builder.build(*engine, invalid));
+#endif
+    EXPECT_FALSE(rcm.hasComponent(invalid));
+    engine->getEntityManager().destroy(invalid);
+
+    rcm.destroy(entity);
+    EXPECT_FALSE(rcm.hasLevels());
+
+    engine->getEntityManager().destroy(entity);
+    engine->destroy(other);
+}
+
 TEST(FilamentTest, Bones) {
     using namespace ::filament::details;
 
@@ -693,6 +1674,433 @@ TEST(FilamentTest, Bones) {
     }
 }
 
+TEST(FilamentTest, DualQuaternionBones) {
+    using namespace ::filament::details;
+
+    // same as skinPosition() and skinNormal() in getters.vs, with dual quaternion bones
+    struct Shader {
+        static void blend(quatf& real, quatf& dual, PerRenderableUibDualQuaternionBone const* bones,
+                float4 const& weights) noexcept {
+            real = quatf{};
+            dual = quatf{};
+            for (size_t i = 0; i < 4; i++) {
+                const float w = dot(bones[0].real, bones[i].real) < 0 ? -weights[i] : weights[i];
+                real += bones[i].real * w;
+                dual += bones[i].dual * w;
+            }
+            const float invLength = 1.0f / length(real);
+            real *= invLength;
+            dual *= invLength;
+        }
+        static float3 vertice(float3 v, quatf const& real, quatf const& dual) noexcept {
+            v += 2.0f * cross(real.xyz, cross(real.xyz, v) + real.w * v);
+            v += 2.0f * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+            return v;
+        }
+        static float3 normal(float3 n, quatf const& real) noexcept {
+            return n + 2.0f * cross(real.xyz, cross(real.xyz, n) + real.w * n);
+        }
+    };
+
+    auto expect_eq = [](float3 e, float3 a) {
+        for (size_t i = 0; i < 3; i++) {
+            EXPECT_NEAR(e[i], a[i], 1e-4f * std::max({ 1.0f, std::abs(e[i]), std::abs(a[i]) }));
+        }
+    };
+
+    // a single bone is the rigid transform
+    auto check = [&](mat4f const& m, float3 const& v) {
+        PerRenderableUibDualQuaternionBone bones[4];
+        FRenderableManager::makeBone(&bones[0], m);
+        quatf real, dual;
+        Shader::blend(real, dual, bones, { 1, 0, 0, 0 });
+        expect_eq((m * v).xyz, Shader::vertice(v, real, dual));
+        expect_eq(m.upperLeft() * normalize(v), Shader::normal(normalize(v), real));
+    };
+
+    const float3 v{ 1, -2, 3 };
+    check(mat4f{}, v);
+    check(mat4f::translation(float3{ 1, 2, 3 }), v);
+    check(mat4f::rotation(M_PI_2, float3{ 0, 0, 1 }), v);
+    check(mat4f::rotation(-M_PI_2, float3{ 1, 1, 0 }), v);
+    check(mat4f::rotation(3.0, float3{ 1, 2, 3 }), v);
+    check(mat4f::translation(float3{ -4, 5, 6 }) * mat4f::rotation(1.0, float3{ 0, 1, 1 }), v);
+
+    // the scales are dropped
+    {
+        const mat4f rigid = mat4f::translation(float3{ 1, 2, 3 }) *
+                mat4f::rotation(M_PI_2, float3{ 1, 0, 0 });
+        PerRenderableUibDualQuaternionBone bone;
+        FRenderableManager::makeBone(&bone, rigid * mat4f::scaling(float3{ 2, 3, 4 }));
+        quatf real, dual;
+        PerRenderableUibDualQuaternionBone bones[4] = { bone };
+        Shader::blend(real, dual, bones, { 1, 0, 0, 0 });
+        expect_eq((rigid * v).xyz, Shader::vertice(v, real, dual));
+    }
+
+    // q and -q are the same rotation, they blend into it instead of canceling out
+    {
+        const mat4f m = mat4f::translation(float3{ 1, 2, 3 }) *
+                mat4f::rotation(2.0, float3{ 0, 1, 0 });
+        PerRenderableUibDualQuaternionBone bones[4];
+        FRenderableManager::makeBone(&bones[0], m);
+        bones[1].real = -bones[0].real;
+        bones[1].dual = -bones[0].dual;
+        quatf real, dual;
+        Shader::blend(real, dual, bones, { 0.5f, 0.5f, 0, 0 });
+        expect_eq((m * v).xyz, Shader::vertice(v, real, dual));
+    }
+
+    // blending two bones preserves the distance to the joint, unlike blending the vertices
+    {
+        PerRenderableUibDualQuaternionBone bones[4];
+        FRenderableManager::makeBone(&bones[0], mat4f{});
+        FRenderableManager::makeBone(&bones[1], mat4f::rotation(M_PI_2, float3{ 0, 0, 1 }));
+        quatf real, dual;
+        Shader::blend(real, dual, bones, { 0.5f, 0.5f, 0, 0 });
+        EXPECT_NEAR(1.0f, length(Shader::vertice({ 1, 0, 0 }, real, dual)), 1e-5f);
+    }
+}
+
+TEST(FilamentTest, BonePalette) {
+    using namespace ::filament::details;
+    constexpr uint32_t A = BonePalette::ALIGNMENT;
+
+    BonePalette palette;
+    EXPECT_EQ(0, palette.getSize());
+
+    // the ranges are aligned, and allocated one after the other
+    const uint32_t a = palette.allocate(3 * sizeof(PerRenderableUibBone));
+    const uint32_t b = palette.allocate(A);
+    const uint32_t c = palette.allocate(A + 1);
+    const uint32_t d = palette.allocate(10 * sizeof(PerRenderableUibDualQuaternionBone));
+    EXPECT_EQ(0, a);
+    EXPECT_EQ(A, b);
+    EXPECT_EQ(2 * A, c);
+    EXPECT_EQ(4 * A, d);
+    EXPECT_EQ(6 * A, palette.getSize());
+
+    // the bones are written to the CPU copy of the palette
+    auto* bones = (PerRenderableUibBone*)palette.invalidate(b, A);
+    bones[1].t = { 1, 2, 3, 0 };
+    EXPECT_EQ(float4(1, 2, 3, 0),
+            ((PerRenderableUibBone*)palette.invalidate(b, A))[1].t);
+
+    // free ranges are reused, first fit
+    palette.free(b, A);
+    palette.free(a, A);
+    EXPECT_EQ(1, palette.getFreeRangeCount());  // merged
+    EXPECT_EQ(0, palette.allocate(A));
+    EXPECT_EQ(A, palette.allocate(A));
+    EXPECT_EQ(0, palette.getFreeRangeCount());
+    EXPECT_EQ(6 * A, palette.allocate(3 * A));
+    EXPECT_EQ(9 * A, palette.getSize());
+
+    // a free range at the end shrinks the palette, along with the free ranges before it
+    palette.free(c, A + 1);
+    EXPECT_EQ(1, palette.getFreeRangeCount());
+    palette.free(6 * A, 3 * A);
+    EXPECT_EQ(6 * A, palette.getSize());
+    palette.free(d, 10 * sizeof(PerRenderableUibDualQuaternionBone));
+    EXPECT_EQ(2 * A, palette.getSize());
+    EXPECT_EQ(0, palette.getFreeRangeCount());
+    palette.free(0, A);
+    palette.free(A, A);
+    EXPECT_EQ(0, palette.getSize());
+    EXPECT_EQ(0, palette.getFreeRangeCount());
+}
+
+TEST_F(FilamentEngineTest, CommandStreamSplice) {
+    using namespace ::filament::backend;
+    using namespace ::filament::details;
+
+    Driver& driver = engine->getDriver();
+
+    CircularBuffer buffer(16 * CircularBuffer::BLOCK_SIZE);
+    CircularBuffer buffer0(4 * CircularBuffer::BLOCK_SIZE);
+    CircularBuffer buffer1(4 * CircularBuffer::BLOCK_SIZE);
+    CommandStream stream(driver, buffer);
+    CommandStream secondary0(driver, buffer0);
+    CommandStream secondary1(driver, buffer1);
+
+    auto bytes = [](CircularBuffer const& buffer) {
+        return size_t(uintptr_t(buffer.getHead()) - uintptr_t(buffer.getTail()));
+    };
+
+    // the secondary streams are recorded on other threads
+    auto record = [](CommandStream& stream, uint32_t count) {
+        stream.debugThreading();
+        for (uint32_t i = 0; i < count; i++) {
+            stream.bindUniformBufferRange(0, {}, i * 256, 256);
+            stream.draw({}, {}, i + 1);
+        }
+    };
+    std::thread thread0(record, std::ref(secondary0), 3);
+    std::thread thread1(record, std::ref(secondary1), 5);
+    stream.bindUniformBuffer(0, {});
+    thread0.join();
+    thread1.join();
+
+    const size_t size = bytes(buffer);
+    const size_t size0 = bytes(buffer0);
+    const size_t size1 = bytes(buffer1);
+    EXPECT_LT(size0, size1);
+    std::vector<uint8_t> commands0((uint8_t*)buffer0.getTail(), (uint8_t*)buffer0.getHead());
+    std::vector<uint8_t> commands1((uint8_t*)buffer1.getTail(), (uint8_t*)buffer1.getHead());
+
+    // the commands are moved in order, after the ones already in the stream
+    stream.splice(secondary0);
+    stream.splice(secondary1);
+    EXPECT_EQ(size + size0 + size1, bytes(buffer));
+    EXPECT_EQ(0, bytes(buffer0));
+    EXPECT_EQ(0, bytes(buffer1));
+    uint8_t const* const spliced = (uint8_t const*)buffer.getTail() + size;
+    EXPECT_TRUE(std::equal(commands0.begin(), commands0.end(), spliced));
+    EXPECT_TRUE(std::equal(commands1.begin(), commands1.end(), spliced + size0));
+
+    // splicing an empty stream does nothing, and the secondary streams can be reused
+    stream.splice(secondary0);
+    EXPECT_EQ(size + size0 + size1, bytes(buffer));
+    record(secondary0, 3);
+    EXPECT_EQ(size0, bytes(buffer0));
+}
+
+TEST(FilamentTest, CommandBufferQueueGrowth) {
+    using namespace ::filament::backend;
+    constexpr size_t BLOCK_SIZE = CircularBuffer::BLOCK_SIZE;
+    constexpr size_t SIZE = BLOCK_SIZE - 64;
+
+    CommandBufferQueue queue(BLOCK_SIZE, 4 * BLOCK_SIZE);
+    queue.setMaxBufferSize(16 * BLOCK_SIZE);
+    CircularBuffer& buffer = queue.getCircularBuffer();
+
+    // nothing releases the command buffers, the 4th flush() would block if the buffer didn't grow
+    for (uint8_t i = 0; i < 6; i++) {
+        memset(buffer.allocate(SIZE), i, SIZE);
+        queue.flush();
+    }
+    EXPECT_EQ(8 * BLOCK_SIZE, queue.getBufferSize());
+
+    CommandBufferQueue::Statistics statistics = queue.resetStatistics();
+    EXPECT_EQ(0, statistics.stallCount);
+    EXPECT_EQ(0, statistics.stallTime);
+    EXPECT_LT(6 * SIZE, statistics.flushedSize);
+    EXPECT_GE(statistics.highWatermark, 4 * SIZE);
+    EXPECT_EQ(0, queue.resetStatistics().flushedSize);
+
+    // the command buffers flushed before the buffer grew are still valid
+    EXPECT_EQ(6, queue.waitForCommands());
+    for (uint8_t i = 0; i < 6; i++) {
+        CommandBufferQueue::Slice const& slice = queue.front();
+        EXPECT_EQ(i, *(uint8_t const*)slice.begin);
+        EXPECT_EQ(i, *((uint8_t const*)slice.begin + SIZE - 1));
+        queue.releaseBuffer(slice);
+    }
+
+    // the previous memory is released by the next flush()
+    memset(buffer.allocate(SIZE), 6, SIZE);
+    queue.flush();
+    EXPECT_EQ(1, queue.waitForCommands());
+    EXPECT_EQ(6, *(uint8_t const*)queue.front().begin);
+    queue.releaseBuffer(queue.front());
+}
+
+TEST(FilamentTest, CommandCaptureReplay) {
+    using namespace ::filament::backend;
+
+    Backend backend = Backend::NOOP;
+    DefaultPlatform* platform = DefaultPlatform::create(&backend);
+    Driver* driver = platform->createDriver(nullptr);
+    const char* path = "filament_test_capture.fcap";
+
+    CircularBuffer buffer(4 * CircularBuffer::BLOCK_SIZE);
+    CommandStream stream(*driver, buffer);
+    Handle<HwUniformBuffer> notCaptured = stream.createUniformBuffer(16, BufferUsage::STATIC);
+
+    ASSERT_TRUE(stream.startCapture(path, 2));
+    stream.beginFrame(0, 1);
+    Handle<HwUniformBuffer> ubh = stream.createUniformBuffer(64, BufferUsage::DYNAMIC);
+    static uint8_t data[64] = { 1, 2, 3 };
+    stream.loadUniformBuffer(ubh, { data, sizeof(data) });
+    stream.bindUniformBuffer(0, ubh);
+    stream.bindUniformBuffer(1, Handle<HwUniformBuffer>(ubh.getId() + 1));
+    stream.pushGroupMarker("marker");
+    stream.popGroupMarker();
+    stream.endFrame(1);
+    stream.beginFrame(0, 2);
+    stream.endFrame(2);
+    EXPECT_FALSE(stream.isCapturing());
+    stream.destroyUniformBuffer(notCaptured);
+
+    new(buffer.allocate(sizeof(NoopCommand))) NoopCommand(nullptr);
+    void* const commands = buffer.getTail();
+    buffer.circularize();
+    stream.execute(commands);
+
+    // the commands are replayed in order, but the binding of a handle created before the capture
+    // started is skipped
+    const CommandId expected[] = {
+            CommandId::beginFrame, CommandId::createUniformBuffer, CommandId::loadUniformBuffer,
+            CommandId::bindUniformBuffer, CommandId::bindUniformBuffer,
+            CommandId::pushGroupMarker, CommandId::popGroupMarker, CommandId::endFrame,
+            CommandId::beginFrame, CommandId::endFrame };
+    {
+        CommandReplay replay(path, *driver);
+        ASSERT_TRUE(replay.isValid());
+        CommandId id;
+        bool skipped;
+        for (size_t i = 0; i < sizeof(expected) / sizeof(*expected); i++) {
+            ASSERT_TRUE(replay.next(&id, &skipped));
+            EXPECT_STREQ(getCommandName(expected[i]), getCommandName(id));
+            EXPECT_EQ(i == 4, skipped);
+        }
+        EXPECT_FALSE(replay.next());
+        EXPECT_EQ(1, replay.getSkippedCount());
+    }
+
+    remove(path);
+    driver->terminate();
+    delete driver;
+    DefaultPlatform::destroy(&platform);
+}
+
+TEST(FilamentTest, CommandProfiler) {
+    using namespace ::filament::backend;
+
+    Backend backend = Backend::NOOP;
+    DefaultPlatform* platform = DefaultPlatform::create(&backend);
+    Driver* driver = platform->createDriver(nullptr);
+
+    CircularBuffer buffer(4 * CircularBuffer::BLOCK_SIZE);
+    CommandStream stream(*driver, buffer);
+    auto execute = [&]() {
+        new(buffer.allocate(sizeof(NoopCommand))) NoopCommand(nullptr);
+        void* const commands = buffer.getTail();
+        buffer.circularize();
+        stream.execute(commands);
+    };
+
+    // the commands recorded before profiling is enabled aren't profiled
+    Handle<HwUniformBuffer> ubh = stream.createUniformBuffer(64, BufferUsage::DYNAMIC);
+    driver->setCommandProfilingEnabled(true);
+    static uint8_t data[64] = {};
+    stream.beginFrame(0, 1);
+    stream.loadUniformBuffer(ubh, { data, sizeof(data) });
+    stream.bindUniformBuffer(0, ubh);
+    stream.bindUniformBuffer(1, ubh);
+    stream.endFrame(1);
+    driver->setCommandProfilingEnabled(false);
+    stream.beginFrame(0, 2);
+    stream.endFrame(2);
+    execute();
+
+    CommandProfiler::Frame frame = driver->getCommandProfiler().getLastFrame();
+    auto const& commands = frame.commands;
+    EXPECT_EQ(0, frame.frame);
+    EXPECT_EQ(0, commands[size_t(CommandId::createUniformBuffer)].count);
+    EXPECT_EQ(1, commands[size_t(CommandId::beginFrame)].count);
+    EXPECT_EQ(1, commands[size_t(CommandId::loadUniformBuffer)].count);
+    EXPECT_EQ(2, commands[size_t(CommandId::bindUniformBuffer)].count);
+    EXPECT_EQ(1, commands[size_t(CommandId::endFrame)].count);
+    EXPECT_LE(commands[size_t(CommandId::bindUniformBuffer)].maxTime,
+            commands[size_t(CommandId::bindUniformBuffer)].totalTime);
+    EXPECT_GT(commands[size_t(CommandId::loadUniformBuffer)].payloadSize, sizeof(data));
+
+    std::string json = CommandProfiler::toJson(frame);
+    EXPECT_NE(std::string::npos, json.find("\"bindUniformBuffer\": { \"count\": 2,"));
+    EXPECT_EQ(std::string::npos, json.find("createUniformBuffer"));
+
+    driver->terminate();
+    delete driver;
+    DefaultPlatform::destroy(&platform);
+}
+
+TEST(FilamentTest, ShadowCascadeSplits) {
+    float splits[3];
+
+    LightManager::ShadowCascades::computeUniformSplits(splits, 4);
+    EXPECT_FLOAT_EQ(0.25f, splits[0]);
+    EXPECT_FLOAT_EQ(0.50f, splits[1]);
+    EXPECT_FLOAT_EQ(0.75f, splits[2]);
+
+    // logarithmic splits are at 1, 10 and 100 between 0.1 and 1000
+    LightManager::ShadowCascades::computeLogSplits(splits, 4, 0.1f, 1000.0f);
+    EXPECT_NEAR((1.0f - 0.1f) / 999.9f, splits[0], 1e-5f);
+    EXPECT_NEAR((10.0f - 0.1f) / 999.9f, splits[1], 1e-5f);
+    EXPECT_NEAR((100.0f - 0.1f) / 999.9f, splits[2], 1e-5f);
+
+    // lambda blends the two schemes
+    float uniform[3];
+    float log[3];
+    LightManager::ShadowCascades::computeUniformSplits(uniform, 4);
+    LightManager::ShadowCascades::computeLogSplits(log, 4, 0.1f, 1000.0f);
+    LightManager::ShadowCascades::computePracticalSplits(splits, 4, 0.1f, 1000.0f, 0.5f);
+    for (size_t i = 0; i < 3; i++) {
+        EXPECT_FLOAT_EQ((uniform[i] + log[i]) * 0.5f, splits[i]);
+    }
+
+    // a single cascade has no split position
+    splits[0] = -1.0f;
+    LightManager::ShadowCascades::computePracticalSplits(splits, 1, 0.1f, 1000.0f, 0.5f);
+    EXPECT_EQ(-1.0f, splits[0]);
+
+    // the uniform buffer holds a light-space matrix per cascade
+    EXPECT_EQ(CONFIG_MAX_SHADOW_CASCADES,
+            sizeof(PerViewUib::lightFromWorldMatrix) / sizeof(mat4f));
+}
+
+TEST(FilamentTest, ShadowAtlasPacking) {
+    using filament::details::ShadowMapManager;
+
+    // a point light (6 tiles) and two spot lights, by decreasing priority
+    uint32_t dimensions[3] = { 256, 512, 64 };
+    const uint8_t tileCounts[3] = { 6, 1, 1 };
+    uint2 origins[8];
+
+    // everything fits, the tiles are placed by decreasing dimension without overlapping
+    size_t count = ShadowMapManager::packAtlas(dimensions, tileCounts, 3, 1024, 64, origins);
+    EXPECT_EQ(3, count);
+    EXPECT_EQ(256, dimensions[0]);
+    EXPECT_EQ(512, dimensions[1]);
+    EXPECT_EQ(64, dimensions[2]);
+    EXPECT_EQ(uint2(0, 0), origins[6]);
+    const uint32_t dims[8] = { 256, 256, 256, 256, 256, 256, 512, 64 };
+    for (size_t i = 0; i < 8; i++) {
+        EXPECT_EQ(0, origins[i].x % dims[i]);
+        EXPECT_EQ(0, origins[i].y % dims[i]);
+        EXPECT_LE(origins[i].x + dims[i], 1024);
+        EXPECT_LE(origins[i].y + dims[i], 1024);
+        for (size_t j = 0; j < i; j++) {
+            bool disjoint = origins[i].x + dims[i] <= origins[j].x ||
+                            origins[j].x + dims[j] <= origins[i].x ||
+                            origins[i].y + dims[i] <= origins[j].y ||
+                            origins[j].y + dims[j] <= origins[i].y;
+            EXPECT_TRUE(disjoint);
+        }
+    }
+
+    // in a smaller atlas, the largest tiles are halved first, lowest priority first
+    dimensions[0] = 256; dimensions[1] = 512; dimensions[2] = 64;
+    count = ShadowMapManager::packAtlas(dimensions, tileCounts, 3, 512, 64, origins);
+    EXPECT_EQ(3, count);
+    EXPECT_EQ(128, dimensions[0]);
+    EXPECT_EQ(128, dimensions[1]);
+    EXPECT_EQ(64, dimensions[2]);
+
+    // past the minimum dimension, the lowest priority lights are dropped
+    uint32_t spotDimensions[5] = { 128, 128, 128, 128, 128 };
+    const uint8_t spotTileCounts[5] = { 1, 1, 1, 1, 1 };
+    count = ShadowMapManager::packAtlas(spotDimensions, spotTileCounts, 5, 128, 64, origins);
+    EXPECT_EQ(4, count);
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(64, spotDimensions[i]);
+    }
+
+    // the uniform buffer holds a light-space matrix per tile
+    EXPECT_EQ(CONFIG_MAX_SHADOW_ATLAS_TILES,
+            sizeof(PerViewUib::shadowAtlasFromWorldMatrix) / sizeof(mat4f));
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
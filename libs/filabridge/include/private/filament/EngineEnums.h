@@ -51,10 +51,28 @@ static_assert(BindingPoints::PER_MATERIAL_INSTANCE == BindingPoints::COUNT - 1,
 constexpr size_t CONFIG_MAX_LIGHT_COUNT = 256;
 constexpr size_t CONFIG_MAX_LIGHT_INDEX = CONFIG_MAX_LIGHT_COUNT - 1;
 
+// Beyond CONFIG_MAX_LIGHT_COUNT, lights are stored in a texture and assigned to froxels with
+// variable-length lists. This value is limited by the size of that texture (4 texels per light).
+constexpr size_t CONFIG_MAX_CLUSTERED_LIGHT_COUNT = 4096;
+constexpr size_t CONFIG_MAX_CLUSTERED_LIGHT_INDEX = CONFIG_MAX_CLUSTERED_LIGHT_COUNT - 1;
+
 // This value is also limited by UBO size, ES3.0 only guarantees 16 KiB.
 // We store 64 bytes per bone.
 constexpr size_t CONFIG_MAX_BONE_COUNT = 256;
 
+// This value is also limited by UBO size, ES3.0 only guarantees 16 KiB.
+// We store 256 bytes per instance (i.e. sizeof(PerRenderableUib)).
+constexpr size_t CONFIG_MAX_INSTANCES = 64;
+
+// Cascades of the directional light's shadow map, each is a layer of the shadow map texture.
+// Must match LightManager::ShadowOptions::cascadeSplitPositions and fit in a float4 uniform.
+constexpr size_t CONFIG_MAX_SHADOW_CASCADES = 4;
+
+// Shadow maps of the point and spot lights, each is a tile of the shadow atlas. A spot light uses
+// one tile, a point light uses six (one per face of a cube map).
+// This value is also limited by UBO size, we store 64 bytes per tile.
+constexpr size_t CONFIG_MAX_SHADOW_ATLAS_TILES = 32;
+
 // TODO This should be injected by the engine as a define of the shader.
 static constexpr bool   CONFIG_IBL_RGBM  = true;
 static constexpr size_t CONFIG_IBL_SIZE  = 256;
@@ -42,8 +42,10 @@ struct PerViewSib {
     static constexpr size_t IBL_DFG_LUT    = 3;
     static constexpr size_t IBL_SPECULAR   = 4;
     static constexpr size_t SSAO           = 5;
+    static constexpr size_t LIGHTS         = 6;
+    static constexpr size_t SHADOW_ATLAS   = 7;
 
-    static constexpr size_t SAMPLER_COUNT = 6;
+    static constexpr size_t SAMPLER_COUNT = 8;
 };
 
 struct PostProcessSib {
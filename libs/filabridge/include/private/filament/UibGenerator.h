@@ -17,10 +17,14 @@
 #ifndef TNT_FILABRIDGE_UIBGENERATOR_H
 #define TNT_FILABRIDGE_UIBGENERATOR_H
 
+#include <private/filament/EngineEnums.h>
 
 #include <math/mat4.h>
+#include <math/quat.h>
 #include <math/vec4.h>
 
+#include <stddef.h>
+
 namespace filament {
 
 class UniformInterfaceBlock;
@@ -50,7 +54,7 @@ struct PerViewUib { // NOLINT(cppcoreguidelines-pro-type-member-init)
     filament::math::mat4f viewFromClipMatrix;
     filament::math::mat4f clipFromWorldMatrix;
     filament::math::mat4f worldFromClipMatrix;
-    filament::math::mat4f lightFromWorldMatrix;
+    filament::math::mat4f lightFromWorldMatrix[CONFIG_MAX_SHADOW_CASCADES];
 
     filament::math::float4 resolution; // viewport width, height, 1/width, 1/height
 
@@ -80,15 +84,34 @@ struct PerViewUib { // NOLINT(cppcoreguidelines-pro-type-member-init)
     alignas(16) filament::math::float4 iblSH[9]; // actually float3 entries (std140 requires float4 alignment)
 
     filament::math::float4 userTime;  // time(s), (double)time - (float)time, 0, 0
+
+    uint32_t clusteredLights; // 1 if punctual lights are in the light_punctualLights texture
+    uint32_t cascades;        // number of shadow cascades of the directional light
+
+    alignas(16) filament::math::float4 cascadeSplits; // view-space z of the far plane of each cascade
+    filament::math::float4 cascadeNormalBias;         // normal bias of each cascade, world units
+
+    // transforms from world space to the shadow atlas texture, one per tile
+    filament::math::mat4f shadowAtlasFromWorldMatrix[CONFIG_MAX_SHADOW_ATLAS_TILES];
 };
 
 
 // PerRenderableUib must have an alignment of 256 to be compatible with all versions of GLES.
+// The ObjectUniforms block is an array of CONFIG_MAX_INSTANCES of these, one per instance.
 struct alignas(256) PerRenderableUib {
-    filament::math::mat4f worldFromModelMatrix;
+    // rows of the affine world transform, the last row is always (0, 0, 0, 1)
+    filament::math::float4 worldFromModelMatrix[3];
     filament::math::mat3f worldFromModelNormalMatrix;
+    // in the uniform block, each column of the normal matrix is padded to a vec4
+    filament::math::float3 reserved;
+    // 1 if the bones are PerRenderableUibDualQuaternionBone, 0 if they're PerRenderableUibBone
+    float boneFormat;
 };
 
+static_assert(offsetof(PerRenderableUib, boneFormat) == 6 * sizeof(filament::math::float4),
+        "boneFormat must be the 7th vec4 of PerRenderableUib");
+
+// Also used for the lights texture, each light is stored as 4 consecutive RGBA32F texels.
 struct LightsUib {
     static const UniformInterfaceBlock& getUib() noexcept {
         return UibGenerator::getLightsUib();
@@ -96,7 +119,7 @@ struct LightsUib {
     filament::math::float4 positionFalloff;   // { float3(pos), 1/falloff^2 }
     filament::math::float4 colorIntensity;    // { float3(col), intensity }
     filament::math::float4 directionIES;      // { float3(dir), IES index }
-    filament::math::float4 spotScaleOffset;   // { scale, offset, unused, unused }
+    filament::math::float4 spotScaleOffset;   // { scale, offset, shadow tile or -1, shadow normal bias }
 };
 
 struct PostProcessingUib {
@@ -117,6 +140,12 @@ struct PerRenderableUibBone {
     filament::math::float4 ns = { 1, 1, 1, 0 };
 };
 
+// Compact alternative to PerRenderableUibBone for rigid bones, a unit dual quaternion.
+struct PerRenderableUibDualQuaternionBone {
+    filament::math::quatf real = { 1, 0, 0, 0 };    // rotation
+    filament::math::quatf dual = { 0, 0, 0, 0 };    // translation * real / 2
+};
+
 } // namespace filament
 
 #endif // TNT_FILABRIDGE_UIBGENERATOR_H
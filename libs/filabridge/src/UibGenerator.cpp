@@ -31,6 +31,17 @@ static_assert(sizeof(PerRenderableUib) % 256 == 0,
 static_assert(CONFIG_MAX_BONE_COUNT * sizeof(PerRenderableUibBone) <= 16384,
         "Bones exceed max UBO size");
 
+// the shaders read the bones as 4 or 2 vec4
+static_assert(sizeof(PerRenderableUibBone) == 4 * sizeof(math::float4) &&
+        sizeof(PerRenderableUibDualQuaternionBone) == 2 * sizeof(math::float4),
+        "Unexpected size of the bones");
+
+static_assert(sizeof(PerRenderableUib) == 16 * sizeof(math::float4),
+        "PerRenderableUib must be the size of 16 vec4, see getPerRenderableUib()");
+
+static_assert(CONFIG_MAX_INSTANCES * sizeof(PerRenderableUib) <= 16384,
+        "Instances exceed max UBO size");
+
 
 UniformInterfaceBlock const& UibGenerator::getPerViewUib() noexcept  {
     // IMPORTANT NOTE: Respect std140 layout, don't update without updating Engine::PerViewUib
@@ -43,7 +54,8 @@ UniformInterfaceBlock const& UibGenerator::getPerViewUib() noexcept  {
             .add("viewFromClipMatrix",      1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             .add("clipFromWorldMatrix",     1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             .add("worldFromClipMatrix",     1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
-            .add("lightFromWorldMatrix",    1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
+            .add("lightFromWorldMatrix",    CONFIG_MAX_SHADOW_CASCADES,
+                    UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             // view
             .add("resolution",              1, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
             // camera
@@ -73,6 +85,15 @@ UniformInterfaceBlock const& UibGenerator::getPerViewUib() noexcept  {
             .add("iblSH",                   9, UniformInterfaceBlock::Type::FLOAT3)
             // user time
             .add("userTime",                1, UniformInterfaceBlock::Type::FLOAT4)
+            // punctual lights
+            .add("clusteredLights",         1, UniformInterfaceBlock::Type::UINT)
+            // shadow cascades
+            .add("cascades",                1, UniformInterfaceBlock::Type::UINT)
+            .add("cascadeSplits",           1, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
+            .add("cascadeNormalBias",       1, UniformInterfaceBlock::Type::FLOAT4)
+            // point and spot lights shadows
+            .add("shadowAtlasFromWorldMatrix", CONFIG_MAX_SHADOW_ATLAS_TILES,
+                    UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             .build();
     return uib;
 }
@@ -80,8 +101,9 @@ UniformInterfaceBlock const& UibGenerator::getPerViewUib() noexcept  {
 UniformInterfaceBlock const& UibGenerator::getPerRenderableUib() noexcept {
     static UniformInterfaceBlock uib =  UniformInterfaceBlock::Builder()
             .name("ObjectUniforms")
-            .add("worldFromModelMatrix",       1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
-            .add("worldFromModelNormalMatrix", 1, UniformInterfaceBlock::Type::MAT3, Precision::HIGH)
+            // PerRenderableUib of each instance, as 16 vec4 (see getters.vs)
+            .add("data", CONFIG_MAX_INSTANCES * 16,
+                    UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
             .build();
     return uib;
 }
@@ -568,6 +568,14 @@ char const* CodeGenerator::getSamplerTypeName(SamplerType type, SamplerFormat fo
                     case SamplerFormat::SHADOW: return "sampler2DShadow";   // should not happen
                 }
             }
+        case SamplerType::SAMPLER_2D_ARRAY:
+            assert(!multisample);
+            switch (format) {
+                case SamplerFormat::INT:    return "isampler2DArray";
+                case SamplerFormat::UINT:   return "usampler2DArray";
+                case SamplerFormat::FLOAT:  return "sampler2DArray";
+                case SamplerFormat::SHADOW: return "sampler2DArrayShadow";
+            }
         case SamplerType::SAMPLER_CUBEMAP:
             assert(!multisample);
             switch (format) {
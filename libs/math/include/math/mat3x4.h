@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MATH_MAT3X4_H_
+#define MATH_MAT3X4_H_
+
+#include <math/mat3.h>
+#include <math/mat4.h>
+#include <math/vec3.h>
+#include <math/vec4.h>
+#include <math/compiler.h>
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace filament {
+namespace math {
+// -------------------------------------------------------------------------------------
+namespace details {
+
+/**
+ * A 3x4 column-major affine matrix class.
+ *
+ * A 3x4 matrix is a 4x4 matrix whose last row is implicitly (0, 0, 0, 1), i.e. a linear
+ * transform followed by a translation. It is an array of 4 column vec3:
+ *
+ * mat3x4 m =
+ *      \f$
+ *      \left(
+ *      \begin{array}{cccc}
+ *      m[0][0] & m[1][0] & m[2][0] & m[3][0] \\
+ *      m[0][1] & m[1][1] & m[2][1] & m[3][1] \\
+ *      m[0][2] & m[1][2] & m[2][2] & m[3][2] \\
+ *      0       & 0       & 0       & 1       \\
+ *      \end{array}
+ *      \right)
+ *      \f$
+ *
+ * m[n] is the \f$ n^{th} \f$ column of the matrix and is a vec3, m[3] is the translation.
+ *
+ * It takes 3/4 of the storage of a 4x4 matrix, and the product of two of them takes 36
+ * multiplies instead of 64.
+ */
+template <typename T>
+class MATH_EMPTY_BASES TMat34 {
+public:
+    enum no_init { NO_INIT };
+    typedef T value_type;
+    typedef T& reference;
+    typedef T const& const_reference;
+    typedef size_t size_type;
+    typedef TVec3<T> col_type;
+    typedef TVec4<T> row_type;
+
+    static constexpr size_t COL_SIZE = col_type::SIZE;  // size of a column (i.e.: number of rows)
+    static constexpr size_t ROW_SIZE = row_type::SIZE;  // size of a row (i.e.: number of columns)
+    static constexpr size_t NUM_ROWS = COL_SIZE;
+    static constexpr size_t NUM_COLS = ROW_SIZE;
+
+private:
+    col_type m_value[NUM_COLS];
+
+public:
+    // array access
+    inline constexpr col_type const& operator[](size_t column) const {
+        assert(column < NUM_COLS);
+        return m_value[column];
+    }
+
+    inline constexpr col_type& operator[](size_t column) {
+        assert(column < NUM_COLS);
+        return m_value[column];
+    }
+
+    // returns the i-th row, including the translation
+    inline constexpr row_type row(size_t i) const {
+        assert(i < NUM_ROWS);
+        return row_type(m_value[0][i], m_value[1][i], m_value[2][i], m_value[3][i]);
+    }
+
+    /*
+     *  constructors
+     */
+
+    // leaves object uninitialized. use with caution.
+    explicit constexpr TMat34(no_init) noexcept {}
+
+    // initialize to identity
+    constexpr TMat34() noexcept
+            : m_value{ col_type(1, 0, 0), col_type(0, 1, 0), col_type(0, 0, 1),
+                       col_type(0, 0, 0) } {
+    }
+
+    /**
+     * construct from a 3x3 matrix and a 3d translation
+     */
+    template <typename U, typename V = T>
+    constexpr explicit TMat34(const TMat33<U>& matrix, const TVec3<V>& translation = {}) noexcept
+            : m_value{ col_type(matrix[0]), col_type(matrix[1]), col_type(matrix[2]),
+                       col_type(translation) } {
+    }
+
+    /**
+     * construct from the 3 first rows of a 4x4 matrix, whose last row must be (0, 0, 0, 1)
+     */
+    template <typename U>
+    constexpr explicit TMat34(const TMat44<U>& matrix) noexcept
+            : m_value{ col_type(matrix[0].xyz), col_type(matrix[1].xyz), col_type(matrix[2].xyz),
+                       col_type(matrix[3].xyz) } {
+    }
+
+    /**
+     * Constructs a 3x3 matrix from the linear part of this matrix
+     */
+    inline constexpr TMat33<T> upperLeft() const {
+        return TMat33<T>(m_value[0], m_value[1], m_value[2]);
+    }
+
+    /**
+     * Returns the translation of this matrix
+     */
+    inline constexpr col_type const& translation() const {
+        return m_value[3];
+    }
+
+    /**
+     * Constructs the 4x4 matrix this matrix is a compact form of
+     */
+    inline constexpr TMat44<T> toMat4() const {
+        return TMat44<T>(upperLeft(), m_value[3]);
+    }
+};
+
+// ----------------------------------------------------------------------------------------
+// Arithmetic operators outside of class
+// ----------------------------------------------------------------------------------------
+
+// affine * affine, same as the product of the 4x4 matrices but without their last row
+template <typename T, typename U>
+constexpr TMat34<T> MATH_PURE operator *(const TMat34<T>& lhs, const TMat34<U>& rhs) {
+    TMat34<T> result(TMat34<T>::NO_INIT);
+    for (size_t col = 0; col < 3; ++col) {
+        result[col] = lhs[0] * T(rhs[col][0]) + lhs[1] * T(rhs[col][1]) + lhs[2] * T(rhs[col][2]);
+    }
+    result[3] = lhs[0] * T(rhs[3][0]) + lhs[1] * T(rhs[3][1]) + lhs[2] * T(rhs[3][2]) + lhs[3];
+    return result;
+}
+
+// mat34 * vec4, result is the xyz of mat44 * vec4
+template <typename T, typename U>
+constexpr TVec3<U> MATH_PURE operator *(const TMat34<T>& lhs, const TVec4<U>& rhs) {
+    return TVec3<U>(lhs[0] * T(rhs[0]) + lhs[1] * T(rhs[1]) + lhs[2] * T(rhs[2]) +
+            lhs[3] * T(rhs[3]));
+}
+
+// mat34 * vec3, transforms a point, result is mat34 * {vec3, 1}
+template <typename T, typename U>
+constexpr TVec3<U> MATH_PURE operator *(const TMat34<T>& lhs, const TVec3<U>& rhs) {
+    return TVec3<U>(lhs[0] * T(rhs[0]) + lhs[1] * T(rhs[1]) + lhs[2] * T(rhs[2]) + lhs[3]);
+}
+
+template <typename T, typename U>
+constexpr bool MATH_PURE operator ==(const TMat34<T>& lhs, const TMat34<U>& rhs) {
+    return lhs[0] == rhs[0] && lhs[1] == rhs[1] && lhs[2] == rhs[2] && lhs[3] == rhs[3];
+}
+
+template <typename T, typename U>
+constexpr bool MATH_PURE operator !=(const TMat34<T>& lhs, const TMat34<U>& rhs) {
+    return !operator==(lhs, rhs);
+}
+
+// the inverse of an affine matrix is affine, its linear part must be invertible
+template <typename T>
+constexpr TMat34<T> MATH_PURE inverse(const TMat34<T>& m) {
+    const TMat33<T> linear = inverse(m.upperLeft());
+    return TMat34<T>(linear, -(linear * m[3]));
+}
+
+} // namespace details
+
+// ----------------------------------------------------------------------------------------
+
+typedef details::TMat34<double> mat3x4;
+typedef details::TMat34<float> mat3x4f;
+
+// ----------------------------------------------------------------------------------------
+}  // namespace math
+}  // namespace filament
+
+#endif  // MATH_MAT3X4_H_
@@ -23,6 +23,7 @@
 #include <math/mat2.h>
 #include <math/mat4.h>
 #include <math/mat3.h>
+#include <math/mat3x4.h>
 #include <math/quat.h>
 
 using namespace filament::math;
@@ -716,3 +717,74 @@ TYPED_TEST(MatTestT, ToQuaternionPointTransformation44) {
 }
 
 #undef TEST_MATRIX_INVERSE
+
+//------------------------------------------------------------------------------
+// MAT 3x4
+//------------------------------------------------------------------------------
+
+class Mat3x4Test : public testing::Test {
+protected:
+};
+
+TEST_F(Mat3x4Test, Basics) {
+    EXPECT_EQ(sizeof(mat3x4f), sizeof(float)*12);
+    EXPECT_EQ(sizeof(mat3x4), sizeof(double)*12);
+}
+
+TEST_F(Mat3x4Test, Constructors) {
+    mat3x4 m0;
+    EXPECT_EQ(m0.toMat4(), mat4());
+    EXPECT_EQ(m0.upperLeft(), mat3());
+    EXPECT_EQ(m0.translation(), double3(0));
+
+    mat4 m1 = mat4::translation(double3{ 1, 2, 3 }) * mat4::rotation(0.5, double3{ 0, 1, 0 });
+    mat3x4 m2(m1);
+    EXPECT_EQ(m2.toMat4(), m1);
+    EXPECT_EQ(m2.upperLeft(), m1.upperLeft());
+    EXPECT_EQ(m2.translation(), double3(1, 2, 3));
+    EXPECT_EQ(m2.row(0), double4(m1[0][0], m1[1][0], m1[2][0], m1[3][0]));
+
+    mat3x4 m3(m1.upperLeft(), double3{ 1, 2, 3 });
+    EXPECT_EQ(m3, m2);
+    EXPECT_NE(m3, m0);
+}
+
+TEST_F(Mat3x4Test, ArithmeticOps) {
+    std::default_random_engine generator(171717);
+    std::uniform_real_distribution<double> distribution(-10.0, 10.0);
+    auto rand_gen = std::bind(distribution, generator);
+
+    for (size_t i = 0; i < 100; ++i) {
+        const double3 t0(rand_gen(), rand_gen(), rand_gen());
+        const double3 t1(rand_gen(), rand_gen(), rand_gen());
+        const double3 s(rand_gen(), rand_gen(), rand_gen());
+        const mat4 a = mat4::translation(t0) * mat4::eulerZYX(rand_gen(), rand_gen(), rand_gen());
+        const mat4 b = mat4::translation(t1) * mat4::scaling(s);
+        const double4 p(rand_gen(), rand_gen(), rand_gen(), rand_gen());
+
+        const mat4 ab = a * b;
+        const mat4 r = (mat3x4(a) * mat3x4(b)).toMat4();
+        for (size_t c = 0; c < 4; c++) {
+            for (size_t l = 0; l < 4; l++) {
+                ASSERT_NEAR(ab[c][l], r[c][l], 1e-10);
+            }
+        }
+
+        const double3 ap = (a * p).xyz;
+        const double3 rp = mat3x4(a) * p;
+        const double3 rq = mat3x4(a) * p.xyz;
+        const double3 aq = (a * double4(p.xyz, 1)).xyz;
+        for (size_t l = 0; l < 3; l++) {
+            ASSERT_NEAR(ap[l], rp[l], 1e-10);
+            ASSERT_NEAR(aq[l], rq[l], 1e-10);
+        }
+
+        const mat4 ia = inverse(a);
+        const mat4 ir = inverse(mat3x4(a)).toMat4();
+        for (size_t c = 0; c < 4; c++) {
+            for (size_t l = 0; l < 4; l++) {
+                ASSERT_NEAR(ia[c][l], ir[c][l], 1e-10);
+            }
+        }
+    }
+}
@@ -62,8 +62,29 @@ float getNdotV() {
 }
 
 #if defined(HAS_SHADOWING) && defined(HAS_DIRECTIONAL_LIGHTING)
-highp vec3 getLightSpacePosition() {
-    return vertex_lightSpacePosition.xyz * (1.0 / vertex_lightSpacePosition.w);
+/**
+ * Returns the shadow cascade covering this fragment, based on its view-space depth.
+ * cascadeSplits holds the (negative) view-space z of the far plane of each cascade.
+ */
+uint getShadowCascade() {
+    highp float z = (frameUniforms.viewFromWorldMatrix * vec4(vertex_worldPosition, 1.0)).z;
+    uvec4 beyond = uvec4(lessThan(vec4(z), frameUniforms.cascadeSplits));
+    uint cascade = beyond.x + beyond.y + beyond.z + beyond.w;
+    return min(cascade, frameUniforms.cascades - 1u);
+}
+
+highp vec3 getLightSpacePosition(const uint cascade) {
+    if (cascade == 0u) {
+        return vertex_lightSpacePosition.xyz * (1.0 / vertex_lightSpacePosition.w);
+    }
+    // the other cascades are computed per fragment, see getLightSpacePosition() in shadowing.vs
+    highp vec3 n = normalize(vertex_worldNormal);
+    float NoL = saturate(dot(n, frameUniforms.lightDirection));
+    float sinTheta = sqrt(1.0 - NoL * NoL);
+    highp vec3 p = vertex_worldPosition +
+            n * (sinTheta * frameUniforms.cascadeNormalBias[cascade]);
+    highp vec4 position = frameUniforms.lightFromWorldMatrix[cascade] * vec4(p, 1.0);
+    return position.xyz * (1.0 / position.w);
 }
 #endif
 
@@ -3,17 +3,35 @@
 //------------------------------------------------------------------------------
 
 mat4 getLightFromWorldMatrix() {
-    return frameUniforms.lightFromWorldMatrix;
+    // the light-space position is only interpolated for the first shadow cascade
+    return frameUniforms.lightFromWorldMatrix[0];
 }
 
+/** @public-api */
+int getInstanceIndex() {
+#if defined(TARGET_VULKAN_ENVIRONMENT)
+    return gl_InstanceIndex;
+#else
+    return gl_InstanceID;
+#endif
+}
+
+// objectUniforms.data holds a PerRenderableUib per instance, each made of 16 vec4: the 3 rows
+// of the affine worldFromModelMatrix, the 3 columns of worldFromModelNormalMatrix, the format of
+// the bones and padding.
+
 /** @public-api */
 mat4 getWorldFromModelMatrix() {
-    return objectUniforms.worldFromModelMatrix;
+    int i = getInstanceIndex() * 16;
+    return transpose(mat4(objectUniforms.data[i], objectUniforms.data[i + 1],
+            objectUniforms.data[i + 2], vec4(0.0, 0.0, 0.0, 1.0)));
 }
 
 /** @public-api */
 mat3 getWorldFromModelNormalMatrix() {
-    return objectUniforms.worldFromModelNormalMatrix;
+    int i = getInstanceIndex() * 16 + 3;
+    return mat3(objectUniforms.data[i].xyz, objectUniforms.data[i + 1].xyz,
+            objectUniforms.data[i + 2].xyz);
 }
 
 //------------------------------------------------------------------------------
@@ -48,7 +66,45 @@ vec3 mulBoneVertice(vec3 v, uint i) {
     return v;
 }
 
+// The bones are either a quaternion, a translation and scales (4 vec4 per bone), or a unit dual
+// quaternion (2 vec4 per bone), see PerRenderableUib::boneFormat.
+bool hasDualQuaternionBones() {
+    return objectUniforms.data[getInstanceIndex() * 16 + 6].x > 0.5;
+}
+
+// Blends the dual quaternions of 4 bones and normalizes the result, see "Skinning with Dual
+// Quaternions", Kavan et al. 2007.
+void blendDualQuaternions(out vec4 real, out vec4 dual, const uvec4 ids, const vec4 weights) {
+    vec4 r0 = bonesUniforms.bones[ids.x * 2u];
+    vec4 r1 = bonesUniforms.bones[ids.y * 2u];
+    vec4 r2 = bonesUniforms.bones[ids.z * 2u];
+    vec4 r3 = bonesUniforms.bones[ids.w * 2u];
+
+    // q and -q are the same rotation, blend along the shortest path
+    vec4 w = weights;
+    w.y = dot(r0, r1) < 0.0 ? -w.y : w.y;
+    w.z = dot(r0, r2) < 0.0 ? -w.z : w.z;
+    w.w = dot(r0, r3) < 0.0 ? -w.w : w.w;
+
+    real = r0 * w.x + r1 * w.y + r2 * w.z + r3 * w.w;
+    dual =   bonesUniforms.bones[ids.x * 2u + 1u] * w.x
+           + bonesUniforms.bones[ids.y * 2u + 1u] * w.y
+           + bonesUniforms.bones[ids.z * 2u + 1u] * w.z
+           + bonesUniforms.bones[ids.w * 2u + 1u] * w.w;
+
+    float invLength = inversesqrt(dot(real, real));
+    real *= invLength;
+    dual *= invLength;
+}
+
 void skinNormal(inout vec3 n, const uvec4 ids, const vec4 weights) {
+    if (hasDualQuaternionBones()) {
+        vec4 real;
+        vec4 dual;
+        blendDualQuaternions(real, dual, ids, weights);
+        n += 2.0 * cross(real.xyz, cross(real.xyz, n) + real.w * n);
+        return;
+    }
     n =   mulBoneNormal(n, ids.x * 4u) * weights.x
         + mulBoneNormal(n, ids.y * 4u) * weights.y
         + mulBoneNormal(n, ids.z * 4u) * weights.z
@@ -56,6 +112,15 @@ void skinNormal(inout vec3 n, const uvec4 ids, const vec4 weights) {
 }
 
 void skinPosition(inout vec3 p, const uvec4 ids, const vec4 weights) {
+    if (hasDualQuaternionBones()) {
+        vec4 real;
+        vec4 dual;
+        blendDualQuaternions(real, dual, ids, weights);
+        // rotation, then the translation 2 * dual * conjugate(real)
+        p += 2.0 * cross(real.xyz, cross(real.xyz, p) + real.w * p);
+        p += 2.0 * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+        return;
+    }
     p =   mulBoneVertice(p, ids.x * 4u) * weights.x
         + mulBoneVertice(p, ids.y * 4u) * weights.y
         + mulBoneVertice(p, ids.z * 4u) * weights.z
@@ -38,10 +38,14 @@ void evaluateDirectionalLight(const MaterialInputs material,
     float visibility = 1.0;
 #if defined(HAS_SHADOWING)
     if (light.NoL > 0.0) {
-        visibility = shadow(light_shadowMap, getLightSpacePosition());
-        #if defined(MATERIAL_HAS_AMBIENT_OCCLUSION)
-        visibility *= computeMicroShadowing(light.NoL, material.ambientOcclusion);
-        #endif
+        // there are no cascades when only the point and spot lights cast shadows
+        if (frameUniforms.cascades > 0u) {
+            uint cascade = getShadowCascade();
+            visibility = shadow(light_shadowMap, cascade, getLightSpacePosition(cascade));
+            #if defined(MATERIAL_HAS_AMBIENT_OCCLUSION)
+            visibility *= computeMicroShadowing(light.NoL, material.ambientOcclusion);
+            #endif
+        }
     } else {
 #if defined(MATERIAL_CAN_SKIP_LIGHTING)
         return;
@@ -11,6 +11,10 @@
 #define RECORD_BUFFER_WIDTH         (1u << RECORD_BUFFER_WIDTH_SHIFT)
 #define RECORD_BUFFER_WIDTH_MASK    (RECORD_BUFFER_WIDTH - 1u)
 
+#define LIGHT_BUFFER_WIDTH_SHIFT    6u
+#define LIGHT_BUFFER_WIDTH          (1u << LIGHT_BUFFER_WIDTH_SHIFT)
+#define LIGHT_BUFFER_WIDTH_MASK     (LIGHT_BUFFER_WIDTH - 1u)
+
 struct FroxelParams {
     uint recordOffset; // offset at which the list of lights for this froxel starts
     uint pointCount;   // number of point lights in this froxel
@@ -78,6 +82,27 @@ ivec2 getRecordTexCoord(uint index) {
     return ivec2(index & RECORD_BUFFER_WIDTH_MASK, index >> RECORD_BUFFER_WIDTH_SHIFT);
 }
 
+/**
+ * Returns the coordinates of the n-th texel of a light in the light_punctualLights
+ * texture, each light is stored as 4 consecutive texels.
+ */
+ivec2 getLightTexCoord(uint lightIndex, uint n) {
+    uint texel = (lightIndex << 2u) + n;
+    return ivec2(texel & LIGHT_BUFFER_WIDTH_MASK, texel >> LIGHT_BUFFER_WIDTH_SHIFT);
+}
+
+/**
+ * Returns the n-th vec4 of the parameters of the specified light. When there are more
+ * lights than the lightsUniforms uniform buffer can hold, they're stored in the
+ * light_punctualLights texture instead.
+ */
+highp vec4 getLightData(uint lightIndex, uint n) {
+    if (frameUniforms.clusteredLights != 0u) {
+        return texelFetch(light_punctualLights, getLightTexCoord(lightIndex, n), 0);
+    }
+    return lightsUniforms.lights[lightIndex][n];
+}
+
 float getSquareFalloffAttenuation(float distanceSquare, float falloff) {
     float factor = distanceSquare * falloff;
     float smoothFactor = saturate(1.0 - factor * factor);
@@ -113,30 +138,74 @@ void setupPunctualLight(inout Light light, const highp vec4 positionFalloff) {
     light.NoL = saturate(dot(shading_normal, light.l));
 }
 
+#if defined(HAS_SHADOWING)
+/**
+ * Returns the visibility of a point or spot light whose shadow map is in the shadow atlas.
+ * shadowInfo holds the index of the light's first tile in the atlas, or -1 if the light doesn't
+ * cast shadows, and the normal bias per unit of distance to the light. Lights shadowed with a
+ * cube map (all point lights and the wide spot lights) have six consecutive tiles, one per face
+ * (+x, -x, +y, -y, +z, -z), and their first tile is offset by SHADOW_ATLAS_TILE_COUNT.
+ */
+float getPunctualShadowVisibility(const highp vec3 posToLight, const vec2 shadowInfo) {
+    int tile = int(shadowInfo.x);
+    if (tile < 0) {
+        return 1.0;
+    }
+
+    if (tile >= SHADOW_ATLAS_TILE_COUNT) {
+        tile -= SHADOW_ATLAS_TILE_COUNT;
+        highp vec3 d = abs(posToLight);
+        if (d.x >= d.y && d.x >= d.z) {
+            tile += posToLight.x > 0.0 ? 1 : 0;
+        } else if (d.y >= d.z) {
+            tile += posToLight.y > 0.0 ? 3 : 2;
+        } else {
+            tile += posToLight.z > 0.0 ? 5 : 4;
+        }
+    }
+
+    // the size of a texel grows linearly with the distance to the light
+    highp vec3 n = getWorldGeometricNormalVector();
+    float NoL = saturate(dot(n, normalize(posToLight)));
+    float sinTheta = sqrt(1.0 - NoL * NoL);
+    highp vec3 p = vertex_worldPosition + n * (sinTheta * shadowInfo.y * length(posToLight));
+
+    highp vec4 position = frameUniforms.shadowAtlasFromWorldMatrix[tile] * vec4(p, 1.0);
+    return shadow(light_shadowAtlas, 0u, position.xyz * (1.0 / position.w));
+}
+#endif
+
 /**
  * Returns a Light structure (see common_lighting.fs) describing a spot light.
  * The colorIntensity field will store the *pre-exposed* intensity of the light
  * in the w component.
  *
  * The light parameters used to compute the Light structure are fetched from the
- * lightsUniforms uniform buffer.
+ * lightsUniforms uniform buffer or the light_punctualLights texture.
  */
 Light getSpotLight(uint index) {
     Light light;
     ivec2 texCoord = getRecordTexCoord(index);
     uint lightIndex = texelFetch(light_records, texCoord, 0).r;
 
-    highp vec4 positionFalloff = lightsUniforms.lights[lightIndex][0];
-    highp vec4 colorIntensity  = lightsUniforms.lights[lightIndex][1];
-          vec4 directionIES    = lightsUniforms.lights[lightIndex][2];
-          vec2 scaleOffset     = lightsUniforms.lights[lightIndex][3].xy;
+    highp vec4 positionFalloff = getLightData(lightIndex, 0u);
+    highp vec4 colorIntensity  = getLightData(lightIndex, 1u);
+          vec4 directionIES    = getLightData(lightIndex, 2u);
+          vec4 scaleOffset     = getLightData(lightIndex, 3u);
 
     light.colorIntensity.rgb = colorIntensity.rgb;
     light.colorIntensity.w = computePreExposedIntensity(colorIntensity.w, frameUniforms.exposure);
 
     setupPunctualLight(light, positionFalloff);
 
-    light.attenuation *= getAngleAttenuation(-directionIES.xyz, light.l, scaleOffset);
+    light.attenuation *= getAngleAttenuation(-directionIES.xyz, light.l, scaleOffset.xy);
+
+#if defined(HAS_SHADOWING)
+    if (light.NoL > 0.0 && light.attenuation > 0.0) {
+        light.attenuation *= getPunctualShadowVisibility(
+                positionFalloff.xyz - vertex_worldPosition, scaleOffset.zw);
+    }
+#endif
 
     return light;
 }
@@ -147,21 +216,28 @@ Light getSpotLight(uint index) {
  * in the w component.
  *
  * The light parameters used to compute the Light structure are fetched from the
- * lightsUniforms uniform buffer.
+ * lightsUniforms uniform buffer or the light_punctualLights texture.
  */
 Light getPointLight(uint index) {
     Light light;
     ivec2 texCoord = getRecordTexCoord(index);
     uint lightIndex = texelFetch(light_records, texCoord, 0).r;
 
-    highp vec4 positionFalloff = lightsUniforms.lights[lightIndex][0];
-    highp vec4 colorIntensity  = lightsUniforms.lights[lightIndex][1];
+    highp vec4 positionFalloff = getLightData(lightIndex, 0u);
+    highp vec4 colorIntensity  = getLightData(lightIndex, 1u);
 
     light.colorIntensity.rgb = colorIntensity.rgb;
     light.colorIntensity.w = computePreExposedIntensity(colorIntensity.w, frameUniforms.exposure);
 
     setupPunctualLight(light, positionFalloff);
 
+#if defined(HAS_SHADOWING)
+    if (light.NoL > 0.0 && light.attenuation > 0.0) {
+        light.attenuation *= getPunctualShadowVisibility(
+                positionFalloff.xyz - vertex_worldPosition, getLightData(lightIndex, 3u).zw);
+    }
+#endif
+
     return light;
 }
 
@@ -179,7 +255,7 @@ void evaluatePunctualLights(const PixelParams pixel, inout vec3 color) {
     // the current fragment. A froxel also contains a record offset that
     // tells us where the indices of those lights are in the records
     // texture. The records texture contains the indices of the actual
-    // light data in the lightsUniforms uniform buffer
+    // light data in the lightsUniforms uniform buffer (see getLightData())
 
     uint index = froxel.recordOffset;
     uint end = index + froxel.pointCount;
@@ -27,7 +27,10 @@ vec4 evaluateMaterial(const MaterialInputs material) {
 
 #if defined(HAS_DIRECTIONAL_LIGHTING)
 #if defined(HAS_SHADOWING)
-    color *= 1.0 - shadow(light_shadowMap, getLightSpacePosition());
+    if (frameUniforms.cascades > 0u) {
+        uint cascade = getShadowCascade();
+        color *= 1.0 - shadow(light_shadowMap, cascade, getLightSpacePosition(cascade));
+    }
 #else
     color = vec4(0.0);
 #endif
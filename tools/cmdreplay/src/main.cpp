@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <getopt/getopt.h>
+
+#include <backend/Platform.h>
+
+#include "private/backend/CommandReplay.h"
+#include "private/backend/Driver.h"
+
+#include <utils/Path.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+
+using namespace filament;
+using namespace backend;
+using namespace utils;
+
+using Clock = std::chrono::steady_clock;
+
+struct Config {
+    Backend backend = Backend::NOOP;
+    bool perCommand = false;
+    bool verbose = false;
+};
+
+struct CommandStats {
+    uint32_t count = 0;
+    uint32_t skipped = 0;
+    Clock::duration time{};     // only measured with --per-command
+};
+
+static void printUsage(const char* name) {
+    std::string execName(Path(name).getName());
+    std::string usage(
+            "CMDREPLAY replays a capture of the backend commands written by "
+                    "Engine::startCommandCapture()\n"
+                    "Usage:\n"
+                    "    CMDREPLAY [options] <capture file>\n"
+                    "\n"
+                    "Options:\n"
+                    "   --help, -h\n"
+                    "       Print this message\n\n"
+                    "   --api, -a\n"
+                    "       Backend to replay the commands on: noop (default), opengl or vulkan\n\n"
+                    "   --per-command, -c\n"
+                    "       Execute and time the commands one at a time, instead of once per frame\n\n"
+                    "   --verbose, -v\n"
+                    "       Print the statistics of every frame\n\n"
+                    "   --license\n"
+                    "       Print copyright and license information\n\n"
+    );
+
+    const std::string from("CMDREPLAY");
+    for (size_t pos = usage.find(from); pos != std::string::npos; pos = usage.find(from, pos)) {
+        usage.replace(pos, from.length(), execName);
+    }
+    printf("%s", usage.c_str());
+}
+
+static void license() {
+    std::cout <<
+    #include "licenses/licenses.inc"
+    ;
+}
+
+static int handleArguments(int argc, char* argv[], Config* config) {
+    static constexpr const char* OPTSTR = "hla:cv";
+    static const struct option OPTIONS[] = {
+            { "help",         no_argument,       nullptr, 'h' },
+            { "license",      no_argument,       nullptr, 'l' },
+            { "api",          required_argument, nullptr, 'a' },
+            { "per-command",  no_argument,       nullptr, 'c' },
+            { "verbose",      no_argument,       nullptr, 'v' },
+            { nullptr, 0, nullptr, 0 }  // termination of the option list
+    };
+
+    int opt;
+    int optionIndex = 0;
+
+    while ((opt = getopt_long(argc, argv, OPTSTR, OPTIONS, &optionIndex)) >= 0) {
+        std::string arg(optarg ? optarg : "");
+        switch (opt) {
+            default:
+            case 'h':
+                printUsage(argv[0]);
+                exit(0);
+            case 'l':
+                license();
+                exit(0);
+            case 'a':
+                if (arg == "noop") {
+                    config->backend = Backend::NOOP;
+                } else if (arg == "opengl") {
+                    config->backend = Backend::OPENGL;
+                } else if (arg == "vulkan") {
+                    config->backend = Backend::VULKAN;
+                } else {
+                    std::cerr << "Unrecognized backend. Must be 'noop', 'opengl' or 'vulkan'."
+                              << std::endl;
+                    exit(1);
+                }
+                break;
+            case 'c':
+                config->perCommand = true;
+                break;
+            case 'v':
+                config->verbose = true;
+                break;
+        }
+    }
+
+    return optind;
+}
+
+static double toMilliseconds(Clock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+static void replay(Config const& config, CommandReplay& replay) {
+    std::array<CommandStats, size_t(CommandId::COUNT)> stats{};
+    std::vector<Clock::duration> frames;
+    Clock::duration frameTime{};
+    uint32_t frameCommandCount = 0;
+
+    CommandId id;
+    bool skipped;
+    while (replay.next(&id, &skipped)) {
+        CommandStats& s = stats[size_t(id)];
+        s.count++;
+        s.skipped += skipped ? 1 : 0;
+        frameCommandCount++;
+
+        if (config.perCommand) {
+            const Clock::time_point start = Clock::now();
+            replay.execute();
+            const Clock::duration time = Clock::now() - start;
+            s.time += time;
+            frameTime += time;
+        }
+
+        if (id == CommandId::endFrame) {
+            if (!config.perCommand) {
+                const Clock::time_point start = Clock::now();
+                replay.execute();
+                frameTime = Clock::now() - start;
+            }
+            if (config.verbose) {
+                printf("frame %4zu: %6u commands, %9.3f ms\n",
+                        frames.size(), frameCommandCount, toMilliseconds(frameTime));
+            }
+            frames.push_back(frameTime);
+            frameTime = {};
+            frameCommandCount = 0;
+        }
+    }
+    replay.execute();
+
+    uint32_t commandCount = 0;
+    for (CommandStats const& s : stats) {
+        commandCount += s.count;
+    }
+
+    printf("%zu frames, %u commands, %zu skipped\n",
+            frames.size(), commandCount, replay.getSkippedCount());
+    if (!frames.empty()) {
+        std::vector<Clock::duration> sorted(frames);
+        std::sort(sorted.begin(), sorted.end());
+        Clock::duration total{};
+        for (Clock::duration frame : frames) {
+            total += frame;
+        }
+        printf("frame execution: average %.3f ms, median %.3f ms, max %.3f ms\n",
+                toMilliseconds(total) / frames.size(),
+                toMilliseconds(sorted[sorted.size() / 2]),
+                toMilliseconds(sorted.back()));
+    }
+
+    // histogram of the commands, the most frequent first
+    std::vector<size_t> order;
+    for (size_t i = 0; i < stats.size(); i++) {
+        if (stats[i].count) {
+            order.push_back(i);
+        }
+    }
+    std::sort(order.begin(), order.end(), [&stats](size_t lhs, size_t rhs) {
+        return stats[lhs].count > stats[rhs].count;
+    });
+
+    printf("\n%-32s %10s %10s", "command", "count", "skipped");
+    if (config.perCommand) {
+        printf(" %12s %12s", "total (ms)", "avg (us)");
+    }
+    printf("\n");
+    for (size_t i : order) {
+        CommandStats const& s = stats[i];
+        printf("%-32s %10u %10u", getCommandName(CommandId(i)), s.count, s.skipped);
+        if (config.perCommand) {
+            printf(" %12.3f %12.3f", toMilliseconds(s.time),
+                    toMilliseconds(s.time) * 1000.0 / s.count);
+        }
+        printf("\n");
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Config config;
+    int optionIndex = handleArguments(argc, argv, &config);
+
+    int numArgs = argc - optionIndex;
+    if (numArgs < 1) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    Backend backend = config.backend;
+    DefaultPlatform* platform = DefaultPlatform::create(&backend);
+    if (backend != config.backend) {
+        std::cerr << "The requested backend isn't available." << std::endl;
+        DefaultPlatform::destroy(&platform);
+        return 1;
+    }
+
+    Driver* driver = platform ? platform->createDriver(nullptr) : nullptr;
+    if (!driver) {
+        std::cerr << "Could not create the driver." << std::endl;
+        DefaultPlatform::destroy(&platform);
+        return 1;
+    }
+
+    int result = 0;
+    {
+        CommandReplay commandReplay(argv[optionIndex], *driver);
+        if (commandReplay.isValid()) {
+            replay(config, commandReplay);
+        } else {
+            result = 1;
+        }
+    }
+
+    driver->terminate();
+    delete driver;
+    DefaultPlatform::destroy(&platform);
+    return result;
+}
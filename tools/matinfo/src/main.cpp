@@ -365,6 +365,7 @@ const char* toString(SamplerType type) {
         case SamplerType::SAMPLER_2D: return "sampler2D";
         case SamplerType::SAMPLER_CUBEMAP: return "samplerCubemap";
         case SamplerType::SAMPLER_EXTERNAL: return "samplerExternal";
+        case SamplerType::SAMPLER_2D_ARRAY: return "sampler2DArray";
     }
 }
 